@@ -34,8 +34,8 @@ import numpy as np
 from optparse import OptionParser
 from jpegtran import JPEGImage
 
-from imu.msg import MagneticFieldBatch , ImuBatch
-from sensor_msgs.msg import MagneticField, Imu
+from imu.msg import MagneticFieldBatch , ImuBatch, FluidPressureBatch, TemperatureBatch
+from sensor_msgs.msg import MagneticField, Imu, FluidPressure, Temperature
 
 import rospy
 import rosbag
@@ -72,6 +72,26 @@ def unbatchMagneticField(msg):
         m.magnetic_field.z = msg.magnetic_fields[i].z
         yield m
 
+def unbatchFluidPressure(msg):
+    nbFrames = len(msg.stamps)
+    for i in range(nbFrames):
+        m = FluidPressure()
+        m.header.seq = nbFrames * msg.header.seq + i
+        m.header.frame_id = msg.header.frame_id
+        m.header.stamp = msg.stamps[i]
+        m.fluid_pressure = msg.fluid_pressures[i]
+        yield m
+
+def unbatchTemperature(msg):
+    nbFrames = len(msg.stamps)
+    for i in range(nbFrames):
+        m = Temperature()
+        m.header.seq = nbFrames * msg.header.seq + i
+        m.header.frame_id = msg.header.frame_id
+        m.header.stamp = msg.stamps[i]
+        m.temperature = msg.temperatures[i]
+        yield m
+
 def main(args=None):
 
     parser = OptionParser()
@@ -132,6 +152,18 @@ def main(args=None):
                         outbag.write(topic, m, m.header.stamp)
                         nbTotalMessageProcessed += 1
                         
+                elif msg.__class__.__name__.endswith('FluidPressureBatch'):
+                    # Unbatch messages of type FluidPressureBatch into individual FluidPressure messages.
+                    for m in unbatchFluidPressure(msg):
+                        outbag.write(topic, m, m.header.stamp)
+                        nbTotalMessageProcessed += 1
+                        
+                elif msg.__class__.__name__.endswith('TemperatureBatch'):
+                    # Unbatch messages of type TemperatureBatch into individual Temperature messages.
+                    for m in unbatchTemperature(msg):
+                        outbag.write(topic, m, m.header.stamp)
+                        nbTotalMessageProcessed += 1
+                        
                 else:
                     outbag.write(topic, msg, timestamp)
                     nbTotalMessageProcessed += 1
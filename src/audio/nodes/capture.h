@@ -0,0 +1,368 @@
+/******************************************************************************
+ * 
+ * Copyright (c) 2016, Simon Brodeur
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ * 
+ *  - Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ *  - Neither the name of the NECOTIS research group nor the names of its contributors 
+ *    may be used to endorse or promote products derived from this software 
+ *    without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND 
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED 
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. 
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, 
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT 
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, 
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef AUDIO_CAPTURE_H
+#define AUDIO_CAPTURE_H
+
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <alsa/asoundlib.h>
+#include <ros/ros.h>
+#include <ros/console.h>
+#include <boost/make_shared.hpp>
+#include <audio/AudioData.h>
+
+#include "std_msgs/MultiArrayLayout.h"
+#include "std_msgs/MultiArrayDimension.h"
+
+namespace audio {
+
+class CaptureNode {
+
+    public:
+        ros::NodeHandle node_;
+        ros::Publisher pub_;
+
+        std::string deviceName_;
+        int rate_;
+        int channels_;
+        std::string micName_;
+        int bufferSize_;
+        std::string outputName_;
+
+        // "rw" reads with snd_pcm_readi, "mmap" copies the periods out of the ALSA ring after a poll wakeup
+        std::string access_;
+        bool mmap_;
+        int periodSize_;
+        int periods_;
+        snd_pcm_uframes_t hwBufferSize_;
+        std::vector<struct pollfd> pollFds_;
+
+        // Overruns recovered since the start, the frames of the message being filled are dropped with them
+        unsigned long xruns_;
+
+        int poolSize_;
+
+        snd_pcm_t *capture_handle_;
+        snd_pcm_hw_params_t *hw_params_;
+
+        // Messages are allocated once with their layout filled, and ALSA reads directly
+        // into the data of a message no subscriber references anymore.
+        audio::AudioData prototype_;
+        std::vector<audio::AudioDataPtr> pool_;
+        size_t poolIndex_;
+
+        CaptureNode(const ros::NodeHandle& node = ros::NodeHandle("~")) : node_(node), hwBufferSize_(0), xruns_(0),
+        		capture_handle_(NULL), hw_params_(NULL), poolIndex_(0){
+
+			node_.param("device", deviceName_, std::string("default"));
+			node_.param("mic_name", micName_, std::string("default"));
+			node_.param("rate", rate_, 16000);
+			node_.param("channels", channels_, 1);
+			node_.param("buffer_size", bufferSize_, 2048);
+			node_.param("output", outputName_, "/audio/" + micName_ + "/raw");
+			node_.param("pool_size", poolSize_, 4);
+			node_.param("access", access_, std::string("rw"));
+			// Period of the wakeups and number of periods in the hardware buffer (frames)
+			node_.param("period_size", periodSize_, bufferSize_);
+			node_.param("periods", periods_, 4);
+
+			if (access_ != "rw" && access_ != "mmap") {
+				throw std::runtime_error("unknown access mode " + access_ + " (rw or mmap)");
+			}
+			mmap_ = (access_ == "mmap");
+
+			pub_ = node_.advertise<audio::AudioData>(outputName_, 10);
+
+			int err;
+			if ((err = snd_pcm_open (&capture_handle_, deviceName_.c_str(), SND_PCM_STREAM_CAPTURE, 0)) < 0) {
+				capture_handle_ = NULL;
+				fail ("cannot open audio device " + deviceName_, err);
+			}
+
+			if ((err = snd_pcm_hw_params_malloc (&hw_params_)) < 0) {
+				fail ("cannot allocate hardware parameter structure", err);
+			}
+
+			if ((err = snd_pcm_hw_params_any (capture_handle_, hw_params_)) < 0) {
+				fail ("cannot initialize hardware parameter structure", err);
+			}
+
+			if ((err = snd_pcm_hw_params_set_access (capture_handle_, hw_params_, mmap_ ? SND_PCM_ACCESS_MMAP_INTERLEAVED : SND_PCM_ACCESS_RW_INTERLEAVED)) < 0) {
+				fail ("cannot set access type", err);
+			}
+
+			if ((err = snd_pcm_hw_params_set_format (capture_handle_, hw_params_, SND_PCM_FORMAT_S16_LE)) < 0) {
+				fail ("cannot set sample format", err);
+			}
+
+			if ((err = snd_pcm_hw_params_set_rate_near (capture_handle_, hw_params_, (unsigned int*) &rate_, 0)) < 0) {
+				fail ("cannot set sample rate", err);
+			}
+
+			if ((err = snd_pcm_hw_params_set_channels (capture_handle_, hw_params_, (unsigned int) channels_)) < 0) {
+				fail ("cannot set channel count", err);
+			}
+
+			snd_pcm_uframes_t periodSize = periodSize_;
+			if ((err = snd_pcm_hw_params_set_period_size_near (capture_handle_, hw_params_, &periodSize, 0)) < 0) {
+				fail ("cannot set period size", err);
+			}
+
+			hwBufferSize_ = periodSize * std::max(periods_, 2);
+			if ((err = snd_pcm_hw_params_set_buffer_size_near (capture_handle_, hw_params_, &hwBufferSize_)) < 0) {
+				fail ("cannot set buffer size", err);
+			}
+
+			if ((err = snd_pcm_hw_params (capture_handle_, hw_params_)) < 0) {
+				fail ("cannot set parameters", err);
+			}
+
+			// The device may have rounded the sizes
+			snd_pcm_hw_params_get_period_size (hw_params_, &periodSize, 0);
+			snd_pcm_hw_params_get_buffer_size (hw_params_, &hwBufferSize_);
+			periodSize_ = periodSize;
+			ROS_INFO("Audio capture on %s (%s access): period of %d frames, buffer of %d frames",
+					deviceName_.c_str(), access_.c_str(), periodSize_, (int) hwBufferSize_);
+
+			snd_pcm_hw_params_free (hw_params_);
+			hw_params_ = NULL;
+
+			// Wake up once a full period is available
+			snd_pcm_sw_params_t *sw_params;
+			if ((err = snd_pcm_sw_params_malloc (&sw_params)) < 0) {
+				fail ("cannot allocate software parameter structure", err);
+			}
+
+			if ((err = snd_pcm_sw_params_current (capture_handle_, sw_params)) < 0 ||
+				(err = snd_pcm_sw_params_set_avail_min (capture_handle_, sw_params, periodSize)) < 0 ||
+				(err = snd_pcm_sw_params (capture_handle_, sw_params)) < 0) {
+				snd_pcm_sw_params_free (sw_params);
+				fail ("cannot set software parameters", err);
+			}
+
+			snd_pcm_sw_params_free (sw_params);
+
+			if ((err = snd_pcm_prepare (capture_handle_)) < 0) {
+				fail ("cannot prepare audio interface for use", err);
+			}
+
+			if (mmap_) {
+				pollFds_.resize(snd_pcm_poll_descriptors_count (capture_handle_));
+				if (pollFds_.empty() ||
+					(err = snd_pcm_poll_descriptors (capture_handle_, &pollFds_[0], pollFds_.size())) < 0) {
+					fail ("cannot get poll descriptors", err);
+				}
+			}
+
+			// Fill the constant part of the messages once (the rate is only known after negotiation)
+			prototype_.header.frame_id = "camera_link";
+			prototype_.fs = rate_;
+			prototype_.layout.dim.resize(2);
+			prototype_.layout.dim[0].size = bufferSize_;
+			prototype_.layout.dim[0].stride = channels_*bufferSize_;
+			prototype_.layout.dim[0].label = "frames";
+			prototype_.layout.dim[1].size = channels_;
+			prototype_.layout.dim[1].stride = channels_;
+			prototype_.layout.dim[1].label = "channels";
+			prototype_.data.resize(bufferSize_ * channels_);
+
+			pool_.resize(std::max(poolSize_, 1));
+			for (size_t i = 0; i < pool_.size(); i++){
+				pool_[i] = boost::make_shared<audio::AudioData>(prototype_);
+			}
+        }
+
+        virtual ~CaptureNode() {
+			if (xruns_ > 0) {
+				ROS_WARN("Audio capture on %s recovered from %lu overruns", deviceName_.c_str(), xruns_);
+			}
+			snd_pcm_close (capture_handle_);
+        }
+
+        // Releases the device and reports an ALSA error, the destructor is not called when the constructor throws
+        void fail(const std::string& what, int err) {
+			if (hw_params_ != NULL) {
+				snd_pcm_hw_params_free (hw_params_);
+				hw_params_ = NULL;
+			}
+			if (capture_handle_ != NULL) {
+				snd_pcm_close (capture_handle_);
+				capture_handle_ = NULL;
+			}
+			throw std::runtime_error(what + " (" + snd_strerror (err) + ")");
+        }
+
+        // Restarts the stream after an overrun or a suspend, returns false on other errors
+        bool recover(int err) {
+			if (err == -EPIPE || err == -ESTRPIPE) {
+				xruns_++;
+				ROS_WARN_THROTTLE(1.0, "Audio overrun on %s (%lu since the start)", deviceName_.c_str(), xruns_);
+			}
+			if ((err = snd_pcm_recover (capture_handle_, err, 1)) < 0) {
+				ROS_ERROR("cannot recover audio interface (%s)", snd_strerror (err));
+				return false;
+			}
+			return true;
+        }
+
+        // Fills a message with blocking reads
+        bool captureRw(int16_t* data) {
+			snd_pcm_uframes_t filled = 0;
+			while (filled < (snd_pcm_uframes_t) bufferSize_) {
+				if (!node_.ok()) {
+					return false;
+				}
+				snd_pcm_sframes_t frames = snd_pcm_readi (capture_handle_, data + filled * channels_, bufferSize_ - filled);
+				if (frames < 0) {
+					if (!recover(frames)) {
+						return false;
+					}
+					filled = 0;
+					continue;
+				}
+				filled += frames;
+			}
+			return true;
+        }
+
+        // Fills a message from the mmap ring, sleeping in poll() until a period is available
+        bool captureMmap(int16_t* data) {
+			snd_pcm_uframes_t filled = 0;
+			while (filled < (snd_pcm_uframes_t) bufferSize_) {
+				if (!node_.ok()) {
+					return false;
+				}
+
+				int err;
+				// Capture in mmap mode starts explicitly, also after a recovery
+				if (snd_pcm_state (capture_handle_) == SND_PCM_STATE_PREPARED &&
+					(err = snd_pcm_start (capture_handle_)) < 0) {
+					if (!recover(err)) {
+						return false;
+					}
+					filled = 0;
+					continue;
+				}
+
+				snd_pcm_sframes_t avail = snd_pcm_avail_update (capture_handle_);
+				if (avail < 0) {
+					if (!recover(avail)) {
+						return false;
+					}
+					filled = 0;
+					continue;
+				}
+
+				snd_pcm_uframes_t frames = bufferSize_ - filled;
+				if ((snd_pcm_uframes_t) avail < std::min(frames, (snd_pcm_uframes_t) periodSize_)) {
+					// Timeout so that a shutdown is noticed if the device stalls, errors show up in avail
+					if (poll (&pollFds_[0], pollFds_.size(), 1000) > 0) {
+						unsigned short revents;
+						snd_pcm_poll_descriptors_revents (capture_handle_, &pollFds_[0], pollFds_.size(), &revents);
+					}
+					continue;
+				}
+
+				frames = std::min(frames, (snd_pcm_uframes_t) avail);
+				const snd_pcm_channel_area_t *areas;
+				snd_pcm_uframes_t offset;
+				if ((err = snd_pcm_mmap_begin (capture_handle_, &areas, &offset, &frames)) < 0) {
+					if (!recover(err)) {
+						return false;
+					}
+					filled = 0;
+					continue;
+				}
+
+				// Interleaved S16_LE: the frames are contiguous from the first channel area
+				const uint8_t* src = (const uint8_t*) areas[0].addr + (areas[0].first + offset * areas[0].step) / 8;
+				memcpy (data + filled * channels_, src, frames * channels_ * sizeof(int16_t));
+
+				snd_pcm_sframes_t committed = snd_pcm_mmap_commit (capture_handle_, offset, frames);
+				if (committed < 0 || (snd_pcm_uframes_t) committed != frames) {
+					if (!recover(committed < 0 ? committed : -EPIPE)) {
+						return false;
+					}
+					filled = 0;
+					continue;
+				}
+				filled += frames;
+			}
+			return true;
+        }
+
+        audio::AudioDataPtr nextMessage() {
+			for (size_t n = 0; n < pool_.size(); n++){
+				audio::AudioDataPtr& msg = pool_[poolIndex_];
+				poolIndex_ = (poolIndex_ + 1) % pool_.size();
+				if (msg.unique()){
+					return msg;
+				}
+			}
+
+			// All messages are still referenced: release the oldest one to its subscribers
+			audio::AudioDataPtr& msg = pool_[poolIndex_];
+			poolIndex_ = (poolIndex_ + 1) % pool_.size();
+			msg = boost::make_shared<audio::AudioData>(prototype_);
+			return msg;
+        }
+
+        bool spin() {
+            while (node_.ok()) {
+                
+                // AudioData message, read in place (interleaved S16_LE matches the int16 data layout)
+                audio::AudioDataPtr msg = nextMessage();
+
+                bool captured = mmap_ ? captureMmap(&(msg->data[0])) : captureRw(&(msg->data[0]));
+                if (!captured) {
+                    // Either the node is shutting down, or the device could not be recovered
+                    return !node_.ok();
+                }
+
+                msg->header.stamp = ros::Time::now();
+                pub_.publish(msg);
+                
+            }
+            return true;
+        }
+};
+
+} // namespace audio
+
+#endif // AUDIO_CAPTURE_H
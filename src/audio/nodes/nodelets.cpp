@@ -0,0 +1,72 @@
+/******************************************************************************
+ * 
+ * Copyright (c) 2016, Simon Brodeur
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ * 
+ *  - Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ *  - Neither the name of the NECOTIS research group nor the names of its contributors 
+ *    may be used to endorse or promote products derived from this software 
+ *    without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND 
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED 
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. 
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, 
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT 
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, 
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread.hpp>
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+
+#include "capture.h"
+
+namespace audio {
+
+/* Runs the blocking ALSA capture loop in its own thread, so that it can be loaded
+ * into a nodelet manager and share messages by pointer with the other nodelets.
+ */
+class CaptureNodelet : public nodelet::Nodelet {
+
+    public:
+        virtual ~CaptureNodelet() {
+        	if (node_){
+        		// Makes node_.ok() false, so the capture loop exits after the current period
+        		node_->node_.shutdown();
+        		thread_.join();
+        	}
+        }
+
+    private:
+        boost::scoped_ptr<CaptureNode> node_;
+        boost::thread thread_;
+
+        virtual void onInit() {
+        	// Errors are reported without exiting, which would stop all the nodelets of the manager
+        	try {
+        		node_.reset(new CaptureNode(getPrivateNodeHandle()));
+        	} catch (std::runtime_error& ex) {
+        		NODELET_FATAL_STREAM(ex.what());
+        		return;
+        	}
+        	thread_ = boost::thread(boost::bind(&CaptureNode::spin, node_.get()));
+        }
+};
+
+} // namespace audio
+
+PLUGINLIB_EXPORT_CLASS(audio::CaptureNodelet, nodelet::Nodelet)
@@ -94,15 +94,21 @@ class VideoCapture {
 	int _focus;
 	int _gain;
 	bool _decodeEnabled;
+	bool _lazyInit;
 
 	// Codec
 	VideoDecoder* _decoder;
 
   public:
-	VideoCapture(string devname, int width, int height, int framerate=15, int exposure=255, int focus=30, int gain=255, bool decodeEnabled=true);
+	// In lazy mode, the device capabilities are not printed, the format negotiated with the camera is reused if
+	// it is the requested one, and the decoder is only built for the first frame to decode.
+	VideoCapture(string devname, int width, int height, int framerate=15, int exposure=255, int focus=30, int gain=255, bool decodeEnabled=true, bool lazyInit=false);
 	~VideoCapture();
 	int printInfo();
 	int setParameters();
+	int setControls(uint32_t ctrlClass, struct v4l2_ext_control* controls, int count);
+	// Manual exposure, focus and gain, also while capturing. Returns the number of controls not set
+	int setCameraControls(int exposure, int focus, int gain);
 	int initMmap();
 	std::vector<uint8_t> grabFrame();
 };
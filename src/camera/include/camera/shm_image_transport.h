@@ -0,0 +1,87 @@
+/******************************************************************************
+ *
+ * Copyright (c) 2014, Simon Brodeur
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  - Neither the name of the NECOTIS research group nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SHM_IMAGE_TRANSPORT_H_
+#define SHM_IMAGE_TRANSPORT_H_
+
+#include <boost/thread/mutex.hpp>
+#include <image_transport/simple_publisher_plugin.h>
+#include <image_transport/simple_subscriber_plugin.h>
+#include <camera/ShmImage.h>
+#include <camera/shm_ring.h>
+
+namespace camera {
+
+/* image_transport plugin "shm" for subscribers on the same host.
+ * The publisher serializes each image once into a slot of a shared memory ring, and only sends the
+ * slot index over the topic. The ring is recreated with larger slots when an image does not fit.
+ */
+class ShmPublisher : public image_transport::SimplePublisherPlugin<camera::ShmImage>
+{
+public:
+  ShmPublisher();
+  virtual ~ShmPublisher() {}
+
+  virtual std::string getTransportName() const
+  {
+    return "shm";
+  }
+
+protected:
+  virtual void publish(const sensor_msgs::Image& message, const PublishFn& publish_fn) const;
+
+  // publish() is const in the plugin interface and may be called from several threads
+  mutable boost::mutex mutex_;
+  mutable ShmRing ring_;
+  mutable uint32_t next_slot_;
+  mutable int generation_;
+};
+
+/* Maps the segment named in the messages, and deserializes the image from its slot.
+ * Images overwritten by the publisher before they could be read are dropped.
+ */
+class ShmSubscriber : public image_transport::SimpleSubscriberPlugin<camera::ShmImage>
+{
+public:
+  virtual ~ShmSubscriber() {}
+
+  virtual std::string getTransportName() const
+  {
+    return "shm";
+  }
+
+protected:
+  virtual void internalCallback(const camera::ShmImage::ConstPtr& message, const Callback& user_cb);
+
+  ShmRing ring_;
+};
+
+}
+
+#endif /* SHM_IMAGE_TRANSPORT_H_ */
@@ -0,0 +1,82 @@
+/******************************************************************************
+ *
+ * Copyright (c) 2014, Simon Brodeur
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  - Neither the name of the NECOTIS research group nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SHM_RING_H_
+#define SHM_RING_H_
+
+#include <stdint.h>
+#include <string>
+
+/* Ring of fixed-size slots in a POSIX shared memory segment, written by a single process and read by
+ * processes of the same host.
+ * Each slot is protected by a sequence lock: its sequence number is odd while the writer fills it and
+ * even once it is complete. A reader remembers the sequence given by the writer, and the data it read
+ * is only valid if the slot still has the same sequence afterwards (the writer did not wrap around).
+ */
+class ShmRing {
+
+	std::string _name;
+	uint8_t* _memory;
+	size_t _length;
+	bool _owner;
+	uint32_t _slots;
+	uint64_t _slotSize;
+
+	struct SlotHeader* slot(uint32_t index) const;
+
+  public:
+	ShmRing();
+	~ShmRing();
+
+	// Writer side: creates (or replaces) the segment, which is removed when the ring is closed
+	bool create(const std::string& name, uint32_t slots, uint64_t slotSize);
+	// Reader side: maps an existing segment read-only
+	bool open(const std::string& name);
+	void close();
+
+	bool isOpen() const;
+	const std::string& getName() const;
+	uint32_t getSlots() const;
+	uint64_t getSlotSize() const;
+
+	// Returns the memory of the slot, that the writer can fill with up to getSlotSize() bytes
+	uint8_t* beginWrite(uint32_t index);
+	// Publishes the first size bytes of the slot, and returns the sequence to give to the readers
+	uint64_t endWrite(uint32_t index, uint64_t size);
+
+	// Returns the data of the slot if it still holds the given sequence, or NULL
+	const uint8_t* beginRead(uint32_t index, uint64_t sequence, uint64_t* size) const;
+	// Returns false if the slot was overwritten while it was read
+	bool endRead(uint32_t index, uint64_t sequence) const;
+
+	// Segment name derived from a topic name, unique to the calling process
+	static std::string segmentName(const std::string& topic, int generation);
+};
+
+#endif /* SHM_RING_H_ */
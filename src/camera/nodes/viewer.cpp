@@ -30,37 +30,101 @@
 #include <ros/ros.h>
 #include <ros/console.h>
 #include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
 #include <opencv2/highgui/highgui.hpp>
 #include <image_transport/image_transport.h>
 #include <sensor_msgs/image_encodings.h>
+#include <sensor_msgs/CompressedImage.h>
 #include <cv_bridge/cv_bridge.h>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
 
 using namespace std;
 using namespace cv;
 
 static std::string input;
+static std::string transport;
 
 class ImageViewer
 {
   ros::NodeHandle nh_;
   image_transport::ImageTransport it_;
   image_transport::Subscriber image_sub_;
+  ros::Subscriber compressed_sub_;
+
+  // Threaded mode: the callbacks only keep the latest frame, that the display thread decodes and shows.
+  // Frames received while the display thread is busy replace the pending one and are counted as dropped.
+  bool threaded_;
+  int scale_;
+  bool overlay_;
+  boost::thread display_thread_;
+  boost::mutex mutex_;
+  boost::condition_variable frame_ready_;
+  sensor_msgs::CompressedImageConstPtr pending_compressed_;
+  sensor_msgs::ImageConstPtr pending_image_;
+  bool stopped_;
+  int dropped_;
+
+  // Display rate, measured over windows of one second
+  ros::WallTime fps_start_;
+  int fps_frames_;
+  double fps_;
   
 public:
   ImageViewer()
-    : nh_("~"), it_(nh_)
+    : nh_("~"), it_(nh_), stopped_(false), dropped_(0), fps_frames_(0), fps_(0.0)
   {
 	nh_.param("input", input, std::string("/video/default"));
+	// "shm" avoids the copy over TCPROS when the viewer runs on the camera host
+	nh_.param("transport", transport, std::string("compressed"));
+	nh_.param("threaded", threaded_, false);
+	// Reduced-size JPEG decode (1, 2, 4 or 8), done by the decoder on the DCT coefficients
+	nh_.param("scale", scale_, 1);
+	nh_.param("overlay", overlay_, true);
+	if (scale_ != 1 && scale_ != 2 && scale_ != 4 && scale_ != 8)
+	{
+	  ROS_WARN("Unsupported scale %d, the frames are shown at full size", scale_);
+	  scale_ = 1;
+	}
 
 	cvNamedWindow(input.c_str());
 	cvStartWindowThread();
 
+    if (threaded_)
+    {
+      display_thread_ = boost::thread(boost::bind(&ImageViewer::display, this));
+      if (transport == "compressed")
+      {
+        // Subscribed directly, so that the JPEG is only decoded for the frames that are shown
+        compressed_sub_ = nh_.subscribe(input + "/compressed", 1, &ImageViewer::compressedCallback, this);
+      }
+      else
+      {
+        image_transport::TransportHints hints(transport, ros::TransportHints());
+        image_sub_ = it_.subscribe(input, 1, &ImageViewer::queueCallback, this, hints);
+      }
+      return;
+    }
     
     // Subscribe to input video feed and publish output video feed
-	image_transport::TransportHints hints("compressed", ros::TransportHints());
+	image_transport::TransportHints hints(transport, ros::TransportHints());
     image_sub_ = it_.subscribe(input, 1, &ImageViewer::imageCallback, this, hints);
   }
 
+  ~ImageViewer()
+  {
+    if (threaded_)
+    {
+      {
+        boost::mutex::scoped_lock lock(mutex_);
+        stopped_ = true;
+      }
+      frame_ready_.notify_one();
+      display_thread_.join();
+    }
+  }
+
 void imageCallback(const sensor_msgs::ImageConstPtr& msg)
 {
   cv_bridge::CvImagePtr cv_ptr;
@@ -84,6 +148,111 @@ void imageCallback(const sensor_msgs::ImageConstPtr& msg)
   }
 }
 
+void compressedCallback(const sensor_msgs::CompressedImageConstPtr& msg)
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  if (pending_compressed_)
+  {
+    dropped_++;
+  }
+  pending_compressed_ = msg;
+  frame_ready_.notify_one();
+}
+
+void queueCallback(const sensor_msgs::ImageConstPtr& msg)
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  if (pending_image_)
+  {
+    dropped_++;
+  }
+  pending_image_ = msg;
+  frame_ready_.notify_one();
+}
+
+void display()
+{
+  fps_start_ = ros::WallTime::now();
+  while (true)
+  {
+    sensor_msgs::CompressedImageConstPtr compressed;
+    sensor_msgs::ImageConstPtr image;
+    int dropped;
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      while (!stopped_ && !pending_compressed_ && !pending_image_)
+      {
+        frame_ready_.wait(lock);
+      }
+      if (stopped_)
+      {
+        return;
+      }
+      compressed.swap(pending_compressed_);
+      image.swap(pending_image_);
+      dropped = dropped_;
+    }
+
+    Mat frame;
+    ros::Time stamp;
+    if (compressed)
+    {
+      stamp = compressed->header.stamp;
+      const int flags = scale_ == 8 ? IMREAD_REDUCED_COLOR_8 :
+                        scale_ == 4 ? IMREAD_REDUCED_COLOR_4 :
+                        scale_ == 2 ? IMREAD_REDUCED_COLOR_2 : IMREAD_COLOR;
+      frame = imdecode(compressed->data, flags);
+    }
+    else
+    {
+      stamp = image->header.stamp;
+      try
+      {
+        cv_bridge::CvImageConstPtr cv_ptr = cv_bridge::toCvShare(image, sensor_msgs::image_encodings::BGR8);
+        if (scale_ > 1)
+        {
+          resize(cv_ptr->image, frame, Size(), 1.0 / scale_, 1.0 / scale_, INTER_AREA);
+        }
+        else
+        {
+          frame = cv_ptr->image.clone();
+        }
+      }
+      catch (cv_bridge::Exception& e)
+      {
+        ROS_ERROR("Could not convert from '%s' to 'bgr8'.", image->encoding.c_str());
+      }
+    }
+    if (frame.empty())
+    {
+      ROS_ERROR_THROTTLE(1.0, "Could not decode the frame");
+      continue;
+    }
+
+    fps_frames_++;
+    const double elapsed = (ros::WallTime::now() - fps_start_).toSec();
+    if (elapsed >= 1.0)
+    {
+      fps_ = fps_frames_ / elapsed;
+      fps_frames_ = 0;
+      fps_start_ = ros::WallTime::now();
+    }
+
+    if (overlay_)
+    {
+      // From the capture timestamp to the display, the clocks of both hosts must be synchronized
+      const double latency = (ros::Time::now() - stamp).toSec() * 1000.0;
+      char text[128];
+      snprintf(text, sizeof(text), "latency %.1f ms  %.1f fps  dropped %d", latency, fps_, dropped);
+      putText(frame, text, Point(10, 20), FONT_HERSHEY_SIMPLEX, 0.5, Scalar(0, 0, 0), 3);
+      putText(frame, text, Point(10, 20), FONT_HERSHEY_SIMPLEX, 0.5, Scalar(255, 255, 255), 1);
+    }
+
+    imshow(input, frame);
+    waitKey(1);
+  }
+}
+
 };
 
 
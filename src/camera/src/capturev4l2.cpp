@@ -38,7 +38,7 @@ static int xioctl(int fd, int request, void *arg){
         return r;
 }
 
-VideoCapture::VideoCapture (string devname, int width, int height, int framerate, int exposure, int focus, int gain, bool decodeEnabled) {
+VideoCapture::VideoCapture (string devname, int width, int height, int framerate, int exposure, int focus, int gain, bool decodeEnabled, bool lazyInit) {
   _devname = devname;
   _width = width;
   _height = height;
@@ -46,20 +46,23 @@ VideoCapture::VideoCapture (string devname, int width, int height, int framerate
   _focus = focus;
   _gain = gain;
   _decodeEnabled = decodeEnabled;
+  _lazyInit = lazyInit;
   _framerate = framerate;
 
   _fd = open(_devname.c_str(), O_RDWR);
   if (_fd == -1){
 	  perror("Opening video device");
   }
-  printInfo();
+  if (!_lazyInit){
+	  printInfo();
+  }
   setParameters();
   initMmap();
 
+  // The decoder initializes itself when it is built
   _decoder = NULL;
-  if (_decodeEnabled){
+  if (_decodeEnabled && !_lazyInit){
 	  _decoder = new VideoDecoder(_width, _height);
-	  _decoder->initDecoder();
   }
 }
 
@@ -128,17 +131,37 @@ int VideoCapture::printInfo()
                 fmtdesc.index++;
         }
 
+        return 0;
+}
+
+int VideoCapture::setParameters()
+{
         struct v4l2_format fmt;
+        memset(&fmt, 0, sizeof(fmt));
         fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        fmt.fmt.pix.width = _width;
-        fmt.fmt.pix.height = _height;
-        fmt.fmt.pix.pixelformat = V4L2_PIX_FMT_MJPEG;
-        fmt.fmt.pix.field = V4L2_FIELD_NONE;
 
-        if (-1 == xioctl(_fd, VIDIOC_S_FMT, &fmt))
+        // The driver keeps the negotiated format while the camera stays connected: in lazy mode, it is only
+        // negotiated again if it differs from the requested one
+        bool negotiate = true;
+        if (_lazyInit && 0 == xioctl(_fd, VIDIOC_G_FMT, &fmt))
         {
-            perror("Couldn't set pixel format");
-            //return 1;
+        	negotiate = fmt.fmt.pix.width != (uint32_t) _width || fmt.fmt.pix.height != (uint32_t) _height ||
+        			fmt.fmt.pix.pixelformat != V4L2_PIX_FMT_MJPEG;
+        }
+
+        if (negotiate)
+        {
+        	fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        	fmt.fmt.pix.width = _width;
+        	fmt.fmt.pix.height = _height;
+        	fmt.fmt.pix.pixelformat = V4L2_PIX_FMT_MJPEG;
+        	fmt.fmt.pix.field = V4L2_FIELD_NONE;
+
+        	if (-1 == xioctl(_fd, VIDIOC_S_FMT, &fmt))
+        	{
+        		perror("Couldn't set pixel format");
+        		//return 1;
+        	}
         }
 
         struct v4l2_streamparm stream_params;
@@ -149,15 +172,20 @@ int VideoCapture::printInfo()
         	perror("Couldn't get camera framerate");
         	//return 1;
         }
-        stream_params.parm.capture.timeperframe.numerator = 1;
         //TODO : It seems we must multiply by a factor of 2 to get the right framerate!
-        stream_params.parm.capture.timeperframe.denominator = 2 * _framerate;
-        if (xioctl(_fd, VIDIOC_S_PARM, &stream_params) < 0)
+        if (negotiate || stream_params.parm.capture.timeperframe.numerator != 1 ||
+        		stream_params.parm.capture.timeperframe.denominator != (uint32_t) (2 * _framerate))
         {
-        	perror("Couldn't set camera framerate");
-        	//return 1;
+        	stream_params.parm.capture.timeperframe.numerator = 1;
+        	stream_params.parm.capture.timeperframe.denominator = 2 * _framerate;
+        	if (xioctl(_fd, VIDIOC_S_PARM, &stream_params) < 0)
+        	{
+        		perror("Couldn't set camera framerate");
+        		//return 1;
+        	}
         }
 
+        char fourcc[5] = {0};
         strncpy(fourcc, (char *)&fmt.fmt.pix.pixelformat, 4);
         printf( "Selected Camera Mode:\n"
                 "  Width: %d\n"
@@ -169,104 +197,65 @@ int VideoCapture::printInfo()
                 fourcc,
                 fmt.fmt.pix.field);
 
+        setCameraControls(_exposure, _focus, _gain);
+
         return 0;
 }
 
-int VideoCapture::setParameters()
+int VideoCapture::setCameraControls(int exposure, int focus, int gain)
 {
-        struct v4l2_format fmt;
-        fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        fmt.fmt.pix.width = _width;
-        fmt.fmt.pix.height = _height;
-        fmt.fmt.pix.pixelformat = V4L2_PIX_FMT_MJPEG;
-        fmt.fmt.pix.field = V4L2_FIELD_NONE;
+        _exposure = exposure;
+        _focus = focus;
+        _gain = gain;
 
-        if (-1 == xioctl(_fd, VIDIOC_S_FMT, &fmt))
-        {
-            perror("Couldn't set pixel format");
-            //return 1;
-        }
-
-        struct v4l2_streamparm stream_params;
-        memset(&stream_params, 0, sizeof(stream_params));
-        stream_params.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        if (xioctl(_fd, VIDIOC_G_PARM, &stream_params) < 0)
-        {
-        	perror("Couldn't get camera framerate");
-        	//return 1;
-        }
-        stream_params.parm.capture.timeperframe.numerator = 1;
-        //TODO : It seems we must multiply by a factor of 2 to get the right framerate!
-        stream_params.parm.capture.timeperframe.denominator = 2 * _framerate;
-        if (xioctl(_fd, VIDIOC_S_PARM, &stream_params) < 0)
-        {
-        	perror("Couldn't set camera framerate");
-        	//return 1;
-        }
-
-        // Manual exposure control
+        // Manual exposure and focus, then manual gain: each class of controls is written with one ioctl
         // See: https://linuxtv.org/downloads/v4l-dvb-apis/extended-controls.html
-        struct v4l2_control stream_control_exposure;
-        stream_control_exposure.id = V4L2_CID_EXPOSURE_AUTO;
-        stream_control_exposure.value = V4L2_EXPOSURE_MANUAL;
-        if(xioctl(_fd, VIDIOC_S_CTRL, &stream_control_exposure) != 0)
+        struct v4l2_ext_control camera_controls[4];
+        memset(camera_controls, 0, sizeof(camera_controls));
+        camera_controls[0].id = V4L2_CID_EXPOSURE_AUTO;
+        camera_controls[0].value = V4L2_EXPOSURE_MANUAL;
+        camera_controls[1].id = V4L2_CID_EXPOSURE_ABSOLUTE;
+        camera_controls[1].value = _exposure;
+        camera_controls[2].id = V4L2_CID_FOCUS_AUTO;
+        camera_controls[2].value = false;
+        camera_controls[3].id = V4L2_CID_FOCUS_ABSOLUTE;
+        camera_controls[3].value = _focus;
+
+        struct v4l2_ext_control user_controls[2];
+        memset(user_controls, 0, sizeof(user_controls));
+        user_controls[0].id = V4L2_CID_AUTOGAIN;
+        user_controls[0].value = false;
+        user_controls[1].id = V4L2_CID_GAIN;
+        user_controls[1].value = _gain;
+        return setControls(V4L2_CTRL_CLASS_CAMERA, camera_controls, 4) + setControls(V4L2_CTRL_CLASS_USER, user_controls, 2);
+}
+
+int VideoCapture::setControls(uint32_t ctrlClass, struct v4l2_ext_control* controls, int count)
+{
+        struct v4l2_ext_controls ctrls;
+        memset(&ctrls, 0, sizeof(ctrls));
+        ctrls.ctrl_class = ctrlClass;
+        ctrls.count = count;
+        ctrls.controls = controls;
+        if (0 == xioctl(_fd, VIDIOC_S_EXT_CTRLS, &ctrls))
         {
-        	perror("Couldn't set camera exposure to manual");
-        	//return 1;
+        	return 0;
         }
 
-        // Manual exposure absolute value
-        struct v4l2_control stream_control_exposure_value;
-        stream_control_exposure_value.id = V4L2_CID_EXPOSURE_ABSOLUTE;
-        stream_control_exposure_value.value = _exposure;
-        if(xioctl(_fd, VIDIOC_S_CTRL, &stream_control_exposure_value) != 0)
+        // Rejected as a whole (e.g. a control the camera lacks): set the others one by one
+        int failed = 0;
+        for (int i = 0; i < count; i++)
         {
-        	perror("Couldn't set camera exposure absolute value");
-        	//return 1;
+        	struct v4l2_control control;
+        	control.id = controls[i].id;
+        	control.value = controls[i].value;
+        	if (xioctl(_fd, VIDIOC_S_CTRL, &control) != 0)
+        	{
+        		fprintf(stderr, "Couldn't set camera control 0x%08x to %d: %s\n", control.id, control.value, strerror(errno));
+        		failed++;
+        	}
         }
-
-        // Manual gain control
-		struct v4l2_control stream_control_gain;
-		stream_control_gain.id = V4L2_CID_AUTOGAIN;
-		stream_control_gain.value = false;
-		if(xioctl(_fd, VIDIOC_S_CTRL, &stream_control_gain) != 0)
-		{
-			perror("Couldn't set camera gain to manual");
-			//return 1;
-		}
-
-		// Manual gain absolute value
-		struct v4l2_control stream_control_gain_value;
-		stream_control_gain_value.id = V4L2_CID_GAIN;
-		stream_control_gain_value.value = _gain;
-		if(xioctl(_fd, VIDIOC_S_CTRL, &stream_control_gain_value) != 0)
-		{
-			perror("Couldn't set camera gain value");
-			//return 1;
-		}
-
-
-        // Manual focus
-		struct v4l2_control stream_control_focus;
-        stream_control_focus.id = V4L2_CID_FOCUS_AUTO;
-        stream_control_focus.value = false;
-		if(xioctl(_fd, VIDIOC_S_CTRL, &stream_control_focus) != 0)
-		{
-			perror("Couldn't set autofocus to manual");
-			//return 1;
-		}
-
-        // Manual focus absolute value
-		struct v4l2_control stream_control_focus_value;
-		stream_control_focus_value.id = V4L2_CID_FOCUS_ABSOLUTE;
-		stream_control_focus_value.value = _focus;
-		if(xioctl(_fd, VIDIOC_S_CTRL, &stream_control_focus_value) != 0)
-		{
-			perror("Couldn't set camera focus absolute value");
-			//return 1;
-		}
-
-        return 0;
+        return failed;
 }
 
 int VideoCapture::initMmap()
@@ -340,6 +329,9 @@ std::vector<uint8_t> VideoCapture::grabFrame()
     if (buf.bytesused > 0){
     	if (_decodeEnabled){
     		//printf("Decoding...\n");
+    		if (!_decoder){
+    			_decoder = new VideoDecoder(_width, _height);
+    		}
     		frame = _decoder->decodeBuffer(_buffer, buf.bytesused);
     	}else{
     		//printf("Pass-through...\n");
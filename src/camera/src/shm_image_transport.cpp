@@ -0,0 +1,183 @@
+/******************************************************************************
+ *
+ * Copyright (c) 2014, Simon Brodeur
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  - Neither the name of the NECOTIS research group nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <camera/shm_image_transport.h>
+
+#include <algorithm>
+#include <cstring>
+#include <ros/ros.h>
+#include <pluginlib/class_list_macros.h>
+
+namespace camera {
+
+// Room left in the slots when the ring is resized, so that small variations of the image size (e.g.
+// the frame_id) do not recreate it every time
+static const double SHM_SLOT_MARGIN = 1.25;
+
+ShmPublisher::ShmPublisher() : next_slot_(0), generation_(0)
+{
+}
+
+void ShmPublisher::publish(const sensor_msgs::Image& message, const PublishFn& publish_fn) const
+{
+  boost::mutex::scoped_lock lock(mutex_);
+
+  const uint32_t length = ros::serialization::serializationLength(message);
+  if (!ring_.isOpen() || length > ring_.getSlotSize())
+  {
+    int slots;
+    nh().param("shm_slots", slots, 4);
+    const std::string name = ShmRing::segmentName(getTopic(), generation_++);
+    if (!ring_.create(name, std::max(slots, 2), (uint64_t) (length * SHM_SLOT_MARGIN)))
+    {
+      ROS_ERROR_THROTTLE(1.0, "Could not create shared memory segment %s for topic %s", name.c_str(), getTopic().c_str());
+      return;
+    }
+    next_slot_ = 0;
+    ROS_DEBUG("Shared memory segment %s: %d slots of %d bytes", name.c_str(), ring_.getSlots(), (int) ring_.getSlotSize());
+  }
+
+  const uint32_t slot = next_slot_;
+  next_slot_ = (next_slot_ + 1) % ring_.getSlots();
+
+  ros::serialization::OStream stream(ring_.beginWrite(slot), length);
+  ros::serialization::serialize(stream, message);
+
+  camera::ShmImage shm;
+  shm.header = message.header;
+  shm.segment = ring_.getName();
+  shm.slot = slot;
+  shm.sequence = ring_.endWrite(slot, length);
+  publish_fn(shm);
+}
+
+// Read a length prefix only if it fits in the bytes left in the slot, so that a torn slot
+// cannot make the message allocate more than the slot holds
+static bool readLength(ros::serialization::IStream& stream, uint32_t& length)
+{
+  if (stream.getLength() < sizeof(length))
+  {
+    return false;
+  }
+  stream.next(length);
+  return length <= stream.getLength();
+}
+
+static bool readString(ros::serialization::IStream& stream, std::string& value)
+{
+  uint32_t length;
+  if (!readLength(stream, length))
+  {
+    return false;
+  }
+  value.assign(reinterpret_cast<const char*>(stream.advance(length)), length);
+  return true;
+}
+
+// Same layout as ros::serialization::deserialize(), with every length checked before it is used
+// and each value read only once from the slot
+static bool deserializeImage(ros::serialization::IStream& stream, sensor_msgs::Image& image)
+{
+  stream.next(image.header.seq);
+  stream.next(image.header.stamp);
+  if (!readString(stream, image.header.frame_id))
+  {
+    return false;
+  }
+  stream.next(image.height);
+  stream.next(image.width);
+  if (!readString(stream, image.encoding))
+  {
+    return false;
+  }
+  stream.next(image.is_bigendian);
+  stream.next(image.step);
+
+  uint32_t size;
+  if (!readLength(stream, size))
+  {
+    return false;
+  }
+  image.data.resize(size);
+  if (size > 0)
+  {
+    memcpy(&image.data[0], stream.advance(size), size);
+  }
+  return true;
+}
+
+void ShmSubscriber::internalCallback(const camera::ShmImage::ConstPtr& message, const Callback& user_cb)
+{
+  // The publisher moves to a new segment when it resizes its ring
+  if (ring_.getName() != message->segment && !ring_.open(message->segment))
+  {
+    ROS_ERROR_THROTTLE(1.0, "Could not map shared memory segment %s, the shm transport only works on the publisher host",
+                       message->segment.c_str());
+    return;
+  }
+
+  uint64_t length;
+  const uint8_t* data = ring_.beginRead(message->slot, message->sequence, &length);
+  if (data == NULL)
+  {
+    ROS_WARN_THROTTLE(1.0, "Dropped image from %s, overwritten before it was received", message->segment.c_str());
+    return;
+  }
+
+  // Deserialized straight out of the slot, the only copy for this subscriber
+  // A slot overwritten while it is read may hold inconsistent values, checked after the sequence
+  sensor_msgs::ImagePtr image(new sensor_msgs::Image);
+  bool valid;
+  try
+  {
+    ros::serialization::IStream stream(const_cast<uint8_t*>(data), length);
+    valid = deserializeImage(stream, *image);
+  }
+  catch (std::exception& e)
+  {
+    valid = false;
+  }
+  if (!ring_.endRead(message->slot, message->sequence))
+  {
+    ROS_WARN_THROTTLE(1.0, "Dropped image from %s, overwritten while it was received", message->segment.c_str());
+    return;
+  }
+  if (!valid)
+  {
+    ROS_ERROR_THROTTLE(1.0, "Invalid image in shared memory segment %s", message->segment.c_str());
+    return;
+  }
+
+  user_cb(image);
+}
+
+}
+
+PLUGINLIB_EXPORT_CLASS(camera::ShmPublisher, image_transport::PublisherPlugin)
+PLUGINLIB_EXPORT_CLASS(camera::ShmSubscriber, image_transport::SubscriberPlugin)
@@ -0,0 +1,226 @@
+/******************************************************************************
+ *
+ * Copyright (c) 2014, Simon Brodeur
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  - Neither the name of the NECOTIS research group nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <camera/shm_ring.h>
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <sstream>
+
+static const uint32_t SHM_RING_MAGIC = 0x53484d52; // "SHMR"
+static const size_t SHM_RING_ALIGN = 64;            // slots start on their own cache line
+
+struct RingHeader {
+	uint32_t magic;
+	uint32_t slots;
+	uint64_t slotSize;
+};
+
+struct SlotHeader {
+	volatile uint64_t sequence;
+	volatile uint64_t size;
+};
+
+static size_t align(size_t size){
+	return (size + SHM_RING_ALIGN - 1) & ~(SHM_RING_ALIGN - 1);
+}
+
+static size_t slotStride(uint64_t slotSize){
+	return align(sizeof(SlotHeader)) + align(slotSize);
+}
+
+ShmRing::ShmRing() : _memory(NULL), _length(0), _owner(false), _slots(0), _slotSize(0) {
+}
+
+ShmRing::~ShmRing(){
+	close();
+}
+
+SlotHeader* ShmRing::slot(uint32_t index) const {
+	return (SlotHeader*) (_memory + align(sizeof(RingHeader)) + index * slotStride(_slotSize));
+}
+
+bool ShmRing::create(const std::string& name, uint32_t slots, uint64_t slotSize){
+	close();
+
+	const size_t length = align(sizeof(RingHeader)) + slots * slotStride(slotSize);
+	int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+	if (fd == -1){
+		perror("Creating shared memory segment");
+		return false;
+	}
+	if (ftruncate(fd, length) == -1){
+		perror("Sizing shared memory segment");
+		::close(fd);
+		shm_unlink(name.c_str());
+		return false;
+	}
+	void* memory = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (memory == MAP_FAILED){
+		perror("Mapping shared memory segment");
+		shm_unlink(name.c_str());
+		return false;
+	}
+
+	// The segment is zero-filled, so every slot starts empty with an even sequence
+	_memory = (uint8_t*) memory;
+	_length = length;
+	_name = name;
+	_owner = true;
+	_slots = slots;
+	_slotSize = slotSize;
+
+	RingHeader* header = (RingHeader*) _memory;
+	header->slots = slots;
+	header->slotSize = slotSize;
+	__sync_synchronize();
+	header->magic = SHM_RING_MAGIC;
+	return true;
+}
+
+bool ShmRing::open(const std::string& name){
+	close();
+
+	int fd = shm_open(name.c_str(), O_RDONLY, 0);
+	if (fd == -1){
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st) == -1 || (size_t) st.st_size < align(sizeof(RingHeader))){
+		::close(fd);
+		return false;
+	}
+	void* memory = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (memory == MAP_FAILED){
+		return false;
+	}
+
+	const RingHeader* header = (const RingHeader*) memory;
+	if (header->magic != SHM_RING_MAGIC || header->slots == 0 ||
+		align(sizeof(RingHeader)) + header->slots * slotStride(header->slotSize) > (size_t) st.st_size){
+		munmap(memory, st.st_size);
+		return false;
+	}
+
+	_memory = (uint8_t*) memory;
+	_length = st.st_size;
+	_name = name;
+	_owner = false;
+	_slots = header->slots;
+	_slotSize = header->slotSize;
+	return true;
+}
+
+void ShmRing::close(){
+	if (_memory){
+		munmap(_memory, _length);
+		// Readers keep their mapping until they switch to the next segment
+		if (_owner){
+			shm_unlink(_name.c_str());
+		}
+	}
+	_memory = NULL;
+	_length = 0;
+	_name.clear();
+	_owner = false;
+	_slots = 0;
+	_slotSize = 0;
+}
+
+bool ShmRing::isOpen() const {
+	return _memory != NULL;
+}
+
+const std::string& ShmRing::getName() const {
+	return _name;
+}
+
+uint32_t ShmRing::getSlots() const {
+	return _slots;
+}
+
+uint64_t ShmRing::getSlotSize() const {
+	return _slotSize;
+}
+
+uint8_t* ShmRing::beginWrite(uint32_t index){
+	SlotHeader* header = slot(index);
+	header->sequence++;
+	__sync_synchronize();
+	return (uint8_t*) header + align(sizeof(SlotHeader));
+}
+
+uint64_t ShmRing::endWrite(uint32_t index, uint64_t size){
+	SlotHeader* header = slot(index);
+	header->size = size;
+	__sync_synchronize();
+	header->sequence++;
+	return header->sequence;
+}
+
+const uint8_t* ShmRing::beginRead(uint32_t index, uint64_t sequence, uint64_t* size) const {
+	if (index >= _slots){
+		return NULL;
+	}
+	const SlotHeader* header = slot(index);
+	if (header->sequence != sequence){
+		return NULL;
+	}
+	__sync_synchronize();
+	*size = header->size;
+	if (*size > _slotSize){
+		return NULL;
+	}
+	return (const uint8_t*) header + align(sizeof(SlotHeader));
+}
+
+bool ShmRing::endRead(uint32_t index, uint64_t sequence) const {
+	__sync_synchronize();
+	return slot(index)->sequence == sequence;
+}
+
+std::string ShmRing::segmentName(const std::string& topic, int generation){
+	// Segment names are a single path component
+	std::ostringstream name;
+	name << "/camera_shm";
+	for (size_t i = 0; i < topic.size(); i++){
+		const char c = topic[i];
+		name << (isalnum(c) ? c : '_');
+	}
+	name << "_" << getpid() << "_" << generation;
+	return name.str();
+}
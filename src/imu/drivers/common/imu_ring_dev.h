@@ -0,0 +1,359 @@
+/******************************************************************************
+ *
+ * Copyright (c) 2016, Simon Brodeur
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  - Neither the name of the NECOTIS research group nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef IMU_RING_DEV_H
+#define IMU_RING_DEV_H
+
+#include <linux/fs.h>
+#include <linux/kref.h>
+#include <linux/log2.h>
+#include <linux/miscdevice.h>
+#include <linux/mm.h>
+#include <linux/mutex.h>
+#include <linux/poll.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/uaccess.h>
+#include <linux/vmalloc.h>
+#include <linux/wait.h>
+
+#include "imu/imu_ring.h"
+
+/* Character device exporting the samples of a sensor in a mmap-able ring
+ * (see imu/imu_ring.h for the layout), shared by the IMU drivers.
+ * Each record is a single store in the ring, instead of four input events
+ * copied to every reader. The sensor is enabled while the device is open.
+ * Records must be pushed from one context at a time (driver lock or the
+ * polling work).
+ *
+ * The memory of the ring is refcounted: each open file holds a reference,
+ * so that a file still open or mapped when the driver is removed keeps a
+ * valid buffer and wait queue. On removal, the driver calls
+ * imu_ring_unregister() first (no more opens, the callbacks are detached
+ * from the driver), stops everything that pushes records, then calls
+ * imu_ring_destroy(). */
+
+#define IMU_RING_DEFAULT_CAPACITY	4096
+
+struct imu_ring_buffer {
+	struct kref ref;
+	struct imu_ring_header *header;
+	wait_queue_head_t wait;
+	atomic_t users;
+	bool dead;
+
+	/* serializes the callbacks against imu_ring_unregister() */
+	struct mutex lock;
+	int (*enable)(void *data);
+	void (*disable)(void *data);
+	void *data;
+};
+
+struct imu_ring {
+	struct miscdevice misc;
+	char name[32];
+	struct imu_ring_buffer *buf;
+	struct imu_ring_header *header;
+	struct imu_ring_record *records;
+	size_t size;
+	u32 mask;
+	u32 flags;
+	bool registered;
+};
+
+struct imu_ring_client {
+	struct imu_ring_buffer *buf;
+	u32 seen;
+};
+
+static inline u32 imu_ring_buffer_head(struct imu_ring_buffer *buf)
+{
+	return READ_ONCE(buf->header->head);
+}
+
+static inline bool imu_ring_active(struct imu_ring *ring)
+{
+	return ring->buf && atomic_read(&ring->buf->users) > 0;
+}
+
+static inline void imu_ring_push(struct imu_ring *ring, ktime_t ts,
+						int x, int y, int z)
+{
+	u32 head = ring->header->head;
+	struct imu_ring_record *rec = &ring->records[head & ring->mask];
+
+	rec->timestamp = ktime_to_ns(ts);
+	rec->x = x;
+	rec->y = y;
+	rec->z = z;
+	rec->flags = ring->flags;
+	ring->flags = 0;
+
+	/* the record must be visible before the new head */
+	smp_wmb();
+	WRITE_ONCE(ring->header->head, head + 1);
+}
+
+/* Flag the next record: samples were lost before it */
+static inline void imu_ring_mark_overrun(struct imu_ring *ring)
+{
+	ring->flags |= IMU_RING_FLAG_OVERRUN;
+}
+
+/* Wake up the readers, once per sample or once per fifo burst */
+static inline void imu_ring_wake(struct imu_ring *ring)
+{
+	if (imu_ring_active(ring))
+		wake_up_interruptible(&ring->buf->wait);
+}
+
+static void imu_ring_buffer_free(struct kref *ref)
+{
+	struct imu_ring_buffer *buf = container_of(ref,
+					struct imu_ring_buffer, ref);
+
+	vfree(buf->header);
+	kfree(buf);
+}
+
+static int imu_ring_open(struct inode *inode, struct file *file)
+{
+	/* misc_open() holds the misc lock, so the ring is still registered */
+	struct imu_ring *ring = container_of(file->private_data,
+						struct imu_ring, misc);
+	struct imu_ring_buffer *buf = ring->buf;
+	struct imu_ring_client *client;
+	int err = 0;
+
+	client = kzalloc(sizeof(*client), GFP_KERNEL);
+	if (!client)
+		return -ENOMEM;
+	client->buf = buf;
+	client->seen = imu_ring_buffer_head(buf);
+
+	mutex_lock(&buf->lock);
+	if (atomic_inc_return(&buf->users) == 1 && buf->enable) {
+		err = buf->enable(buf->data);
+		if (err < 0)
+			atomic_dec(&buf->users);
+	}
+	mutex_unlock(&buf->lock);
+	if (err < 0) {
+		kfree(client);
+		return err;
+	}
+
+	kref_get(&buf->ref);
+	file->private_data = client;
+	return nonseekable_open(inode, file);
+}
+
+static int imu_ring_release(struct inode *inode, struct file *file)
+{
+	struct imu_ring_client *client = file->private_data;
+	struct imu_ring_buffer *buf = client->buf;
+
+	mutex_lock(&buf->lock);
+	if (atomic_dec_and_test(&buf->users) && buf->disable)
+		buf->disable(buf->data);
+	mutex_unlock(&buf->lock);
+
+	kref_put(&buf->ref, imu_ring_buffer_free);
+	kfree(client);
+	return 0;
+}
+
+static ssize_t imu_ring_read(struct file *file, char __user *buf,
+					size_t count, loff_t *ppos)
+{
+	struct imu_ring_client *client = file->private_data;
+	struct imu_ring_buffer *buf = client->buf;
+	u32 head;
+
+	if (count < sizeof(head))
+		return -EINVAL;
+
+	if (imu_ring_buffer_head(buf) == client->seen) {
+		if (READ_ONCE(buf->dead))
+			return -ENODEV;
+		if (file->f_flags & O_NONBLOCK)
+			return -EAGAIN;
+		if (wait_event_interruptible(buf->wait,
+				imu_ring_buffer_head(buf) != client->seen ||
+				READ_ONCE(buf->dead)))
+			return -ERESTARTSYS;
+		if (imu_ring_buffer_head(buf) == client->seen)
+			return -ENODEV;
+	}
+
+	head = imu_ring_buffer_head(buf);
+	client->seen = head;
+	if (copy_to_user(buf, &head, sizeof(head)))
+		return -EFAULT;
+	return sizeof(head);
+}
+
+static unsigned int imu_ring_poll(struct file *file, poll_table *wait)
+{
+	struct imu_ring_client *client = file->private_data;
+	struct imu_ring_buffer *buf = client->buf;
+
+	poll_wait(file, &buf->wait, wait);
+	if (imu_ring_buffer_head(buf) != client->seen)
+		return POLLIN | POLLRDNORM;
+	if (READ_ONCE(buf->dead))
+		return POLLHUP | POLLERR;
+	return 0;
+}
+
+static int imu_ring_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct imu_ring_client *client = file->private_data;
+	struct imu_ring_buffer *buf = client->buf;
+
+	/* readers must not corrupt the ring of the other readers,
+	 * also not through a later mprotect() */
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+	vma->vm_flags &= ~VM_MAYWRITE;
+
+	return remap_vmalloc_range(vma, buf->header, vma->vm_pgoff);
+}
+
+static const struct file_operations imu_ring_fops = {
+	.owner = THIS_MODULE,
+	.open = imu_ring_open,
+	.release = imu_ring_release,
+	.read = imu_ring_read,
+	.poll = imu_ring_poll,
+	.mmap = imu_ring_mmap,
+};
+
+static int imu_ring_init(struct imu_ring *ring, const char *name,
+			u32 capacity, int (*enable)(void *data),
+			void (*disable)(void *data), void *data)
+{
+	size_t data_offset = PAGE_ALIGN(sizeof(struct imu_ring_header));
+	struct imu_ring_buffer *buf;
+	int err;
+
+	ring->buf = NULL;
+	ring->header = NULL;
+	ring->registered = false;
+	if (!is_power_of_2(capacity))
+		return -EINVAL;
+
+	buf = kzalloc(sizeof(*buf), GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+	ring->size = PAGE_ALIGN(data_offset +
+			capacity * sizeof(struct imu_ring_record));
+	ring->header = vmalloc_user(ring->size);
+	if (!ring->header) {
+		kfree(buf);
+		return -ENOMEM;
+	}
+	ring->records = (struct imu_ring_record *)
+				((u8 *) ring->header + data_offset);
+	ring->mask = capacity - 1;
+	ring->flags = 0;
+
+	ring->header->magic = IMU_RING_MAGIC;
+	ring->header->version = IMU_RING_VERSION;
+	ring->header->record_size = sizeof(struct imu_ring_record);
+	ring->header->capacity = capacity;
+	ring->header->data_offset = data_offset;
+	ring->header->head = 0;
+
+	/* the driver holds the first reference, dropped by imu_ring_destroy() */
+	kref_init(&buf->ref);
+	buf->header = ring->header;
+	init_waitqueue_head(&buf->wait);
+	atomic_set(&buf->users, 0);
+	mutex_init(&buf->lock);
+	buf->enable = enable;
+	buf->disable = disable;
+	buf->data = data;
+	ring->buf = buf;
+
+	snprintf(ring->name, sizeof(ring->name), "%s", name);
+	ring->misc.minor = MISC_DYNAMIC_MINOR;
+	ring->misc.name = ring->name;
+	ring->misc.fops = &imu_ring_fops;
+	ring->misc.mode = 0444;
+
+	err = misc_register(&ring->misc);
+	if (err < 0) {
+		kref_put(&buf->ref, imu_ring_buffer_free);
+		ring->buf = NULL;
+		ring->header = NULL;
+		return err;
+	}
+	ring->registered = true;
+	return 0;
+}
+
+/* No more opens, and the files still open no longer call the driver.
+ * The records already pushed stay readable. */
+static void imu_ring_unregister(struct imu_ring *ring)
+{
+	struct imu_ring_buffer *buf = ring->buf;
+
+	if (!ring->registered)
+		return;
+	misc_deregister(&ring->misc);
+	ring->registered = false;
+
+	mutex_lock(&buf->lock);
+	buf->enable = NULL;
+	buf->disable = NULL;
+	buf->data = NULL;
+	mutex_unlock(&buf->lock);
+}
+
+/* Called once nothing pushes records anymore: the readers are woken up
+ * with an error, and the memory goes away with the last open file. */
+static void imu_ring_destroy(struct imu_ring *ring)
+{
+	struct imu_ring_buffer *buf = ring->buf;
+
+	if (!buf)
+		return;
+	imu_ring_unregister(ring);
+
+	ring->buf = NULL;
+	ring->header = NULL;
+	ring->records = NULL;
+
+	WRITE_ONCE(buf->dead, true);
+	wake_up_interruptible(&buf->wait);
+	kref_put(&buf->ref, imu_ring_buffer_free);
+}
+
+#endif /* IMU_RING_DEV_H */
@@ -61,10 +61,13 @@
 #include <linux/moduleparam.h>
 #include <linux/kernel.h>
 #include <linux/stat.h>
+#include <linux/ktime.h>
+#include <linux/version.h>
 
 
 /*#include <linux/input/l3gd20.h>*/
 #include "l3gd20.h"
+#include "imu_ring_dev.h"
 
 /* Maximum polled-device-reported rot speed value value in dps */
 #define FS_MAX		32768
@@ -130,6 +133,18 @@
 #define	FIFO_WATERMARK_MASK	(0x1F)
 
 #define FIFO_STORED_DATA_MASK	(0x1F)
+#define FIFO_SRC_WTM		(0x80)
+#define FIFO_SRC_OVRN		(0x40)
+#define FIFO_SRC_EMPTY		(0x20)
+#define FIFO_DEPTH		32
+#define FIFO_SAMPLE_SIZE	6
+
+/* SMBus block transfers are limited to 32 bytes: 5 samples per transfer */
+#define SMBUS_BURST_SAMPLES	5
+
+#ifndef MSC_TIMESTAMP
+#define MSC_TIMESTAMP		0x05
+#endif
 
 #define I2C_AUTO_INCREMENT	(0x80)
 
@@ -168,14 +183,15 @@ struct l3gd20_gyr_triple {
 struct output_rate {
 	int poll_rate_ms;
 	u8 mask;
+	u32 period_ns;
 };
 
 static const struct output_rate odr_table[] = {
 
-	{	2,	ODR760|BW10},
-	{	3,	ODR380|BW01},
-	{	6,	ODR190|BW00},
-	{	11,	ODR095|BW00},
+	{	2,	ODR760|BW10,	1315789},
+	{	3,	ODR380|BW01,	2631579},
+	{	6,	ODR190|BW00,	5263158},
+	{	11,	ODR095|BW00,	10526316},
 };
 
 static struct l3gd20_gyr_platform_data default_l3gd20_gyr_pdata = {
@@ -223,6 +239,14 @@ struct l3gd20_gyr_status {
 	/* fifo related */
 	u8 watermark;
 	u8 fifomode;
+	u32 odr_period_ns;
+	ktime_t fifo_last_ts;
+	bool fifo_ts_valid;
+	u32 fifo_overruns;
+	u8 fifo_buf[FIFO_DEPTH * FIFO_SAMPLE_SIZE];
+
+	/* mmap-able sample ring, alternative to the input device */
+	struct imu_ring ring;
 
 	struct hrtimer hr_timer;
 	ktime_t ktime;
@@ -380,6 +404,18 @@ static int l3gd20_gyr_register_update(struct l3gd20_gyr_status *stat,
 }
 
 
+/* In stream mode the timer only needs to fire once per watermark level,
+ * instead of once per sample */
+static void l3gd20_gyr_update_poll_ktime(struct l3gd20_gyr_status *stat)
+{
+	if (stat->fifomode == FIFO_MODE_STREAM && stat->odr_period_ns)
+		stat->ktime = ktime_set(0, (stat->watermark + 1) *
+						stat->odr_period_ns);
+	else
+		stat->ktime = ktime_set(0,
+				MS_TO_NS(stat->pdata->poll_interval));
+}
+
 static int l3gd20_gyr_update_watermark(struct l3gd20_gyr_status *stat,
 								u8 watermark)
 {
@@ -403,6 +439,7 @@ static int l3gd20_gyr_update_watermark(struct l3gd20_gyr_status *stat,
 		(~FIFO_WATERMARK_MASK &
 				stat->resume_state[RES_FIFO_CTRL_REG]));
 	stat->watermark = new_value;
+	l3gd20_gyr_update_poll_ktime(stat);
 	mutex_unlock(&stat->lock);
 	return res;
 }
@@ -430,6 +467,8 @@ static int l3gd20_gyr_update_fifomode(struct l3gd20_gyr_status *stat,
 		(~FIFO_MODE_MASK &
 				stat->resume_state[RES_FIFO_CTRL_REG]));
 	stat->fifomode = new_value;
+	stat->fifo_ts_valid = false;
+	l3gd20_gyr_update_poll_ktime(stat);
 
 	return res;
 }
@@ -516,6 +555,30 @@ static int l3gd20_gyr_manage_int2settings(struct l3gd20_gyr_status *stat,
 		/* enable_fifo_hw = true; */
 		break;
 
+	case FIFO_MODE_STREAM:
+		recognized_mode = true;
+
+		/* The fifo keeps collecting samples in both cases, it is
+		 * drained either on watermark interrupt or on timer */
+		if (stat->polling_enabled)
+			int2bits = I2_NONE;
+		else
+			int2bits = (I2_WTM | I2_OVRUN);
+		enable_fifo_hw = true;
+
+		res = l3gd20_gyr_register_update(stat, buf, CTRL_REG3,
+					I2_MASK, int2bits);
+		if (res < 0) {
+			dev_err(&stat->client->dev, "%s : failed to update "
+							"CTRL_REG3:0x%02x\n",
+							__func__, fifomode);
+			goto err_mutex_unlock;
+		}
+		stat->resume_state[RES_CTRL_REG3] =
+			((I2_MASK & int2bits) |
+			(~(I2_MASK) & stat->resume_state[RES_CTRL_REG3]));
+		break;
+
 	case FIFO_MODE_BYPASS:
 		recognized_mode = true;
 
@@ -638,28 +701,24 @@ static int l3gd20_gyr_update_odr(struct l3gd20_gyr_status *stat,
 		if (err < 0)
 			return err;
 		stat->resume_state[RES_CTRL_REG1] = config[1];
+		stat->odr_period_ns = odr_table[i].period_ns;
 		stat->ktime = ktime_set(0, MS_TO_NS(poll_interval_ms));
+		if (stat->fifomode == FIFO_MODE_STREAM)
+			stat->ktime = ktime_set(0, (stat->watermark + 1) *
+							stat->odr_period_ns);
 	}
 
 	return err;
 }
 
-/* gyroscope data readout */
-static int l3gd20_gyr_get_data(struct l3gd20_gyr_status *stat,
-			     struct l3gd20_gyr_triple *data)
+/* conversion of one raw sample, with axis mapping */
+static void l3gd20_gyr_convert_data(struct l3gd20_gyr_status *stat,
+			const unsigned char *gyro_out,
+			struct l3gd20_gyr_triple *data)
 {
-	int err;
-	unsigned char gyro_out[6];
 	/* y,p,r hardware data */
 	s32 hw_d[3] = { 0 };
 
-	gyro_out[0] = (AXISDATA_REG);
-
-	err = l3gd20_gyr_i2c_read(stat, gyro_out, 6);
-
-	if (err < 0)
-		return err;
-
 	hw_d[0] = (s32) ((s16)((gyro_out[1]) << 8) | gyro_out[0]);
 	hw_d[1] = (s32) ((s16)((gyro_out[3]) << 8) | gyro_out[2]);
 	hw_d[2] = (s32) ((s16)((gyro_out[5]) << 8) | gyro_out[4]);
@@ -676,6 +735,23 @@ static int l3gd20_gyr_get_data(struct l3gd20_gyr_status *stat,
 		   : (hw_d[stat->pdata->axis_map_y]));
 	data->z = ((stat->pdata->negate_z) ? (-hw_d[stat->pdata->axis_map_z])
 		   : (hw_d[stat->pdata->axis_map_z]));
+}
+
+/* gyroscope data readout */
+static int l3gd20_gyr_get_data(struct l3gd20_gyr_status *stat,
+			     struct l3gd20_gyr_triple *data)
+{
+	int err;
+	unsigned char gyro_out[6];
+
+	gyro_out[0] = (AXISDATA_REG);
+
+	err = l3gd20_gyr_i2c_read(stat, gyro_out, 6);
+
+	if (err < 0)
+		return err;
+
+	l3gd20_gyr_convert_data(stat, gyro_out, data);
 
 #ifdef DEBUG
 	/* dev_info(&stat->client->dev, "gyro_out: x = %d, y = %d, z = %d\n",
@@ -685,9 +761,49 @@ static int l3gd20_gyr_get_data(struct l3gd20_gyr_status *stat,
 	return err;
 }
 
+/* burst readout of several fifo samples.
+ * With the fifo enabled, the auto-incremented read address rolls back from
+ * OUT_Z_H to OUT_X_L, so consecutive samples are read in a single transfer */
+static int l3gd20_gyr_get_fifo_data(struct l3gd20_gyr_status *stat,
+					u8 *buf, int samples)
+{
+	int err;
+	int len;
+	int offset = 0;
+	int total = samples * FIFO_SAMPLE_SIZE;
+
+	while (offset < total) {
+		len = total - offset;
+		if (stat->use_smbus &&
+			len > SMBUS_BURST_SAMPLES * FIFO_SAMPLE_SIZE)
+			len = SMBUS_BURST_SAMPLES * FIFO_SAMPLE_SIZE;
+
+		buf[offset] = (AXISDATA_REG);
+		err = l3gd20_gyr_i2c_read(stat, buf + offset, len);
+		if (err != len)
+			return (err < 0) ? err : -EIO;
+		offset += len;
+	}
+	return samples;
+}
+
+/* Each sample carries its acquisition time as MSC_TIMESTAMP (low 32 bits of
+ * the monotonic clock, in us), since samples read in a burst are all
+ * delivered at the same time */
 static void l3gd20_gyr_report_values(struct l3gd20_gyr_status *stat,
-					struct l3gd20_gyr_triple *data)
+					struct l3gd20_gyr_triple *data,
+					ktime_t ts)
 {
+	if (imu_ring_active(&stat->ring))
+		imu_ring_push(&stat->ring, ts, data->x, data->y, data->z);
+	if (!stat->input_dev->users)
+		return;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 4, 0)
+	input_set_timestamp(stat->input_dev, ts);
+#endif
+	input_event(stat->input_dev, EV_MSC, MSC_TIMESTAMP,
+					(u32) ktime_to_us(ts));
 	input_report_abs(stat->input_dev, ABS_X, data->x);
 	input_report_abs(stat->input_dev, ABS_Y, data->y);
 	input_report_abs(stat->input_dev, ABS_Z, data->z);
@@ -1048,6 +1164,17 @@ static ssize_t attr_fifomode_show(struct device *dev,
 	return sprintf(buf, "0x%02x\n", val);
 }
 
+static ssize_t attr_fifo_overruns_show(struct device *dev,
+			       struct device_attribute *attr, char *buf)
+{
+	struct l3gd20_gyr_status *stat = dev_get_drvdata(dev);
+	u32 val;
+	mutex_lock(&stat->lock);
+	val = stat->fifo_overruns;
+	mutex_unlock(&stat->lock);
+	return sprintf(buf, "%u\n", val);
+}
+
 #ifdef DEBUG
 static ssize_t attr_reg_set(struct device *dev, struct device_attribute *attr,
 				const char *buf, size_t size)
@@ -1111,6 +1238,7 @@ static struct device_attribute attributes[] = {
 						attr_polling_mode_store),
 	__ATTR(fifo_samples, 0664, attr_watermark_show, attr_watermark_store),
 	__ATTR(fifo_mode, 0664, attr_fifomode_show, attr_fifomode_store),
+	__ATTR(fifo_overruns, 0444, attr_fifo_overruns_show, NULL),
 #ifdef DEBUG
 	__ATTR(reg_value, 0600, attr_reg_get, attr_reg_set),
 	__ATTR(reg_addr, 0200, NULL, attr_addr_set),
@@ -1148,8 +1276,75 @@ static void l3gd20_gyr_report_triple(struct l3gd20_gyr_status *stat)
 	err = l3gd20_gyr_get_data(stat, &data_out);
 	if (err < 0)
 		dev_err(&stat->client->dev, "get_gyroscope_data failed\n");
-	else
-		l3gd20_gyr_report_values(stat, &data_out);
+	else {
+		l3gd20_gyr_report_values(stat, &data_out, ktime_get());
+		imu_ring_wake(&stat->ring);
+	}
+}
+
+/* Drain all samples stored in the fifo (stream mode) with one burst read.
+ * Sample times are interpolated between the previous drain and this one,
+ * which follows the actual output data rate of the device. */
+static void l3gd20_gyr_fifo_drain(struct l3gd20_gyr_status *stat)
+{
+	int err;
+	int i;
+	int stored;
+	u8 buf[2];
+	u8 int_source;
+	ktime_t now;
+	s64 step;
+	struct l3gd20_gyr_triple data_out;
+
+	err = l3gd20_gyr_register_read(stat, buf, FIFO_SRC_REG);
+	now = ktime_get();
+	if (err < 0) {
+		dev_err(&stat->client->dev, "error reading fifo source reg\n");
+		return;
+	}
+	int_source = buf[0];
+	if (int_source & FIFO_SRC_EMPTY)
+		return;
+
+	stored = int_source & FIFO_STORED_DATA_MASK;
+	if (int_source & FIFO_SRC_OVRN) {
+		/* Oldest samples were overwritten: the interval since the
+		 * previous drain does not match the stored samples anymore */
+		stored = FIFO_DEPTH;
+		stat->fifo_overruns++;
+		stat->fifo_ts_valid = false;
+		imu_ring_mark_overrun(&stat->ring);
+	}
+	if (stored == 0)
+		return;
+
+	err = l3gd20_gyr_get_fifo_data(stat, stat->fifo_buf, stored);
+	if (err < 0) {
+		dev_err(&stat->client->dev, "fifo burst read failed\n");
+		stat->fifo_ts_valid = false;
+		return;
+	}
+
+	step = stat->odr_period_ns;
+	if (stat->fifo_ts_valid) {
+		step = div_s64(ktime_to_ns(ktime_sub(now, stat->fifo_last_ts)),
+								stored);
+		/* Fall back to the nominal period after a late drain */
+		if (step < stat->odr_period_ns / 2 ||
+					step > 2 * (s64) stat->odr_period_ns)
+			step = stat->odr_period_ns;
+	}
+
+	for (i = 0; i < stored; i++) {
+		l3gd20_gyr_convert_data(stat,
+				stat->fifo_buf + i * FIFO_SAMPLE_SIZE, &data_out);
+		l3gd20_gyr_report_values(stat, &data_out,
+			ktime_sub_ns(now, (u64) (stored - 1 - i) * step));
+	}
+
+	stat->fifo_last_ts = now;
+	stat->fifo_ts_valid = true;
+	imu_ring_wake(&stat->ring);
 }
 
 
@@ -1217,6 +1412,9 @@ static void l3gd20_gyr_irq2_fifo(struct l3gd20_gyr_status *stat)
 		}
 		l3gd20_gyr_fifo_reset(stat);
 		break;
+	case FIFO_MODE_STREAM:
+		l3gd20_gyr_fifo_drain(stat);
+		break;
 	}
 #ifdef DEBUG
 	input_report_abs(stat->input_dev, ABS_MISC, 3);
@@ -1266,7 +1464,24 @@ void l3gd20_gyr_input_close(struct input_dev *dev)
 {
 	struct l3gd20_gyr_status *stat = input_get_drvdata(dev);
 	dev_dbg(&stat->client->dev, "%s\n", __func__);
-	l3gd20_gyr_disable(stat);
+	if (!imu_ring_active(&stat->ring))
+		l3gd20_gyr_disable(stat);
+}
+
+/* The sensor stays enabled while either the input device or the ring is open */
+static int l3gd20_gyr_ring_enable(void *data)
+{
+	struct l3gd20_gyr_status *stat = data;
+
+	return l3gd20_gyr_enable(stat);
+}
+
+static void l3gd20_gyr_ring_disable(void *data)
+{
+	struct l3gd20_gyr_status *stat = data;
+
+	if (!stat->input_dev->users)
+		l3gd20_gyr_disable(stat);
 }
 
 static int l3gd20_gyr_validate_pdata(struct l3gd20_gyr_status *stat)
@@ -1335,6 +1550,8 @@ static int l3gd20_gyr_input_init(struct l3gd20_gyr_status *stat)
 	input_set_drvdata(stat->input_dev, stat);
 
 	set_bit(EV_ABS, stat->input_dev->evbit);
+	set_bit(EV_MSC, stat->input_dev->evbit);
+	set_bit(MSC_TIMESTAMP, stat->input_dev->mscbit);
 
 #ifdef DEBUG
 	set_bit(EV_KEY, stat->input_dev->keybit);
@@ -1378,13 +1595,24 @@ static void poll_function_work(struct work_struct *polling_task)
 	stat = container_of((struct work_struct *)polling_task,
 					struct l3gd20_gyr_status, polling_task);
 
-	err = l3gd20_gyr_get_data(stat, &data_out);
-	if (err < 0)
-		dev_err(&stat->client->dev, "get_rotation_data failed.\n");
-	else
-		l3gd20_gyr_report_values(stat, &data_out);
+	if (stat->fifomode == FIFO_MODE_STREAM) {
+		mutex_lock(&stat->lock);
+		l3gd20_gyr_fifo_drain(stat);
+		mutex_unlock(&stat->lock);
+	} else {
+		err = l3gd20_gyr_get_data(stat, &data_out);
+		if (err < 0)
+			dev_err(&stat->client->dev,
+					"get_rotation_data failed.\n");
+		else {
+			l3gd20_gyr_report_values(stat, &data_out, ktime_get());
+			imu_ring_wake(&stat->ring);
+		}
+	}
 
-	hrtimer_start(&stat->hr_timer, stat->ktime, HRTIMER_MODE_REL);
+	/* disable and remove stop the polling with the timer */
+	if (atomic_read(&stat->enabled))
+		hrtimer_start(&stat->hr_timer, stat->ktime, HRTIMER_MODE_REL);
 }
 
 enum hrtimer_restart poll_function_read(struct hrtimer *timer)
@@ -1559,6 +1787,15 @@ static int l3gd20_gyr_probe(struct i2c_client *client,
 	mutex_unlock(&stat->lock);
 
 	INIT_WORK(&stat->polling_task, poll_function_work);
+
+	/* The ring is optional: the input device remains available */
+	err = imu_ring_init(&stat->ring, "l3gd20_gyr_ring",
+				IMU_RING_DEFAULT_CAPACITY,
+				l3gd20_gyr_ring_enable,
+				l3gd20_gyr_ring_disable, stat);
+	if (err < 0)
+		dev_warn(&client->dev, "ring register failed: %d\n", err);
+
 	dev_info(&client->dev, "%s probed: device created successfully\n",
 							L3GD20_GYR_DEV_NAME);
 
@@ -1598,6 +1835,11 @@ static int l3gd20_gyr_remove(struct i2c_client *client)
 
 	dev_info(&stat->client->dev, "driver removing\n");
 
+	/* No new ring users, and everything that pushes records is stopped
+	 * before the ring memory is released */
+	imu_ring_unregister(&stat->ring);
+	l3gd20_gyr_disable(stat);
+	hrtimer_cancel(&stat->hr_timer);
 	cancel_work_sync(&stat->polling_task);
 	if(!l3gd20_gyr_workqueue) {
 		flush_workqueue(l3gd20_gyr_workqueue);
@@ -1617,7 +1859,7 @@ static int l3gd20_gyr_remove(struct i2c_client *client)
 		destroy_workqueue(stat->irq2_work_queue);
 	}
 
-	l3gd20_gyr_disable(stat);
+	imu_ring_destroy(&stat->ring);
 	l3gd20_gyr_input_cleanup(stat);
 
 	remove_sysfs_interfaces(&client->dev);
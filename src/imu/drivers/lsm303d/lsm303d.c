@@ -56,9 +56,11 @@ Revision 1-0-5 2013/10/23
 #include <linux/irq.h>
 #include <linux/hrtimer.h>
 #include <linux/ktime.h>
+#include <linux/version.h>
 
 /* #include <linux/input/lsm303d.h> */
 #include "lsm303d.h"
+#include "imu_ring_dev.h"
 
 
 #define	I2C_AUTO_INCREMENT	(0x80)
@@ -99,6 +101,8 @@ Revision 1-0-5 2013/10/23
 #define INT_GEN2_SRC_ADDR	(0x35)	/** INT_GEN2_SRC address register */
 #define REG_GEN2_THR_ADDR	(0x36)	/** INT_GEN2_THS address register */
 #define REG_GEN2_DUR_ADDR	(0x37)	/** INT_GEN2_DUR address register */
+#define REG_FIFO_CTRL_ADDR	(0x2E)	/** FIFO_CTRL address register */
+#define REG_FIFO_SRC_ADDR	(0x2F)	/** FIFO_SRC address register */
 
 /* Sensitivity */
 #define SENSITIVITY_ACC_2G	60	/**	ug/LSB	*/
@@ -158,6 +162,7 @@ Revision 1-0-5 2013/10/23
 #define REG_DEF_IIG2_THRESHOLD	(0x00)	/** INT_GEN2_THS default value */
 #define REG_DEF_MIG_THRESHOLD_L	(0x00)	/** INT_THS_L_M default value */
 #define REG_DEF_MIG_THRESHOLD_H	(0x00)	/** INT_THS_H_M default value */
+#define REG_DEF_FIFO_CTRL	(0x00)	/** FIFO_CTRL default value */
 
 #define REG_DEF_ALL_ZEROS	(0x00)
 
@@ -202,6 +207,28 @@ Revision 1-0-5 2013/10/23
 #define INT_PIN_CONF_MASK	(0x10)
 #define INT_POLARITY_MASK	(0x80)
 
+/* Accelerometer FIFO */
+#define FIFO_EN_MASK		(0x40)	/* CNTRL0 fifo enable */
+#define FIFO_FTH_EN_MASK	(0x20)	/* CNTRL0 fifo watermark enable */
+#define FIFO_INT2_MASK		(0x03)	/* CNTRL4 watermark and overrun on INT2 */
+#define FIFO_MODE_MASK		(0xE0)
+#define FIFO_MODE_BYPASS	(0x00)
+#define FIFO_MODE_STREAM	(0x40)
+#define FIFO_WATERMARK_MASK	(0x1F)
+#define FIFO_STORED_DATA_MASK	(0x1F)
+#define FIFO_SRC_WTM		(0x80)
+#define FIFO_SRC_OVRN		(0x40)
+#define FIFO_SRC_EMPTY		(0x20)
+#define FIFO_DEPTH		32
+#define FIFO_SAMPLE_SIZE	6
+
+/* SMBus block transfers are limited to 32 bytes: 5 samples per transfer */
+#define SMBUS_BURST_SAMPLES	5
+
+#ifndef MSC_TIMESTAMP
+#define MSC_TIMESTAMP		0x05
+#endif
+
 #define to_dev(obj) container_of(obj, struct device, kobj)
 #define to_dev_attr(_attr) container_of(_attr, struct device_attribute, attr)
 
@@ -210,19 +237,23 @@ static struct kobject *mag_kobj;
 
 struct workqueue_struct *lsm303d_workqueue = 0;
 
+/* 1600Hz can only be selected through odr_hz, since the poll interval is
+ * limited to 1ms */
 struct {
 	unsigned int cutoff_us;
 	u8 value;
+	u32 period_ns;
 } lsm303d_acc_odr_table[] = {
-		{   1, LSM303D_ACC_ODR800  },
-		{   2, LSM303D_ACC_ODR400  },
-		{   5, LSM303D_ACC_ODR200  },
-		{  10, LSM303D_ACC_ODR100  },
-		{  20, LSM303D_ACC_ODR50   },
-		{  40, LSM303D_ACC_ODR25   },
-		{  80, LSM303D_ACC_ODR12_5 },
-		{ 160, LSM303D_ACC_ODR6_25 },
-		{ 320, LSM303D_ACC_ODR3_125},
+		{   0, LSM303D_ACC_ODR1600,	625000 },
+		{   1, LSM303D_ACC_ODR800,	1250000 },
+		{   2, LSM303D_ACC_ODR400,	2500000 },
+		{   5, LSM303D_ACC_ODR200,	5000000 },
+		{  10, LSM303D_ACC_ODR100,	10000000 },
+		{  20, LSM303D_ACC_ODR50,	20000000 },
+		{  40, LSM303D_ACC_ODR25,	40000000 },
+		{  80, LSM303D_ACC_ODR12_5,	80000000 },
+		{ 160, LSM303D_ACC_ODR6_25,	160000000 },
+		{ 320, LSM303D_ACC_ODR3_125,	320000000 },
 };
 
 struct {
@@ -307,6 +338,19 @@ struct lsm303d_status {
 	u16 sensitivity_acc;
 	u16 sensitivity_mag;
 
+	/* accelerometer fifo */
+	u8 fifo_mode;
+	u8 fifo_watermark;
+	u32 odr_period_acc_ns;
+	ktime_t fifo_last_ts;
+	bool fifo_ts_valid;
+	u32 fifo_overruns;
+	u8 fifo_buf[FIFO_DEPTH * FIFO_SAMPLE_SIZE];
+
+	/* mmap-able sample rings, alternative to the input devices */
+	struct imu_ring ring_acc;
+	struct imu_ring ring_mag;
+
 	int irq1;
 	struct work_struct irq1_work;
 	struct workqueue_struct *irq1_work_queue;
@@ -370,6 +414,7 @@ static struct status_registers {
 	struct reg_rw int_gen2_duration;
 	struct reg_rw int_gen1_threshold;
 	struct reg_rw int_gen2_threshold;
+	struct reg_rw fifo_ctrl;
 	struct reg_r int_src_reg_m;
 	struct reg_r int_gen1_src;
 	struct reg_r int_gen2_src;
@@ -402,6 +447,8 @@ static struct status_registers {
 		.int_gen1_threshold.default_value=REG_DEF_IIG1_THRESHOLD,
 	.int_gen2_threshold.address=REG_GEN2_THR_ADDR,
 		.int_gen2_threshold.default_value=REG_DEF_IIG2_THRESHOLD,
+	.fifo_ctrl.address=REG_FIFO_CTRL_ADDR,
+		.fifo_ctrl.default_value=REG_DEF_FIFO_CTRL,
 	.int_src_reg_m.address = INT_SRC_REG_M_ADDR,
 				.int_src_reg_m.value = REG_DEF_ALL_ZEROS,
 	.int_gen1_src.address = INT_GEN1_SRC_ADDR,
@@ -573,6 +620,8 @@ static int lsm303d_hw_init(struct lsm303d_status *stat)
 			status_registers.int_gen1_threshold.default_value;
 	status_registers.int_gen2_threshold.resume_value = 
 			status_registers.int_gen2_threshold.default_value;
+	status_registers.fifo_ctrl.resume_value = 
+			status_registers.fifo_ctrl.default_value;
 
 
 	stat->temp_value_dec = NDTEMP;
@@ -747,6 +796,8 @@ static void lsm303d_irq1_work_func(struct work_struct *work)
 	enable_irq(stat->irq1);
 }
 
+static void lsm303d_acc_fifo_drain(struct lsm303d_status *stat);
+
 static void lsm303d_irq2_work_func(struct work_struct *work)
 {
 
@@ -754,6 +805,16 @@ static void lsm303d_irq2_work_func(struct work_struct *work)
 	container_of(work, struct lsm303d_status, irq2_work);
 	/* TODO  add interrupt service procedure.
 		 ie:lsm303d_get_int2_source(stat); */
+
+	/* fifo watermark (or overrun) routed on INT2 */
+	if (stat->fifo_mode == FIFO_MODE_STREAM &&
+				atomic_read(&stat->enabled_acc)) {
+		mutex_lock(&stat->lock);
+		lsm303d_acc_fifo_drain(stat);
+		mutex_unlock(&stat->lock);
+		enable_irq(stat->irq2);
+		return;
+	}
 	
 	lsm303d_interrupt_catch(stat,2);
 	pr_info("%s: IRQ2 triggered\n", LSM303D_DEV_NAME);
@@ -861,6 +922,12 @@ static int lsm303d_acc_device_power_on(struct lsm303d_status *stat)
 	if (err < 0)
 		goto err_resume_state;
 
+	buf[0] = status_registers.fifo_ctrl.address;
+	buf[1] = status_registers.fifo_ctrl.resume_value;
+	err = lsm303d_i2c_write(stat, buf, 1);
+	if (err < 0)
+		goto err_resume_state;
+
 	atomic_set(&stat->enabled_acc, 1);
 
 	return 0;
@@ -1085,11 +1152,57 @@ error:
 	return err;
 }
 
+/* In stream mode the timer only needs to fire once per watermark level,
+ * instead of once per sample. When the watermark interrupt is wired, the
+ * timer is only a fallback that drains the fifo before it overruns. */
+static void lsm303d_acc_update_poll_ktime(struct lsm303d_status *stat)
+{
+	unsigned int samples;
+
+	if (stat->fifo_mode == FIFO_MODE_STREAM && stat->odr_period_acc_ns) {
+		samples = stat->fifo_watermark + 1;
+		if (stat->pdata_acc->gpio_int2 >= 0)
+			samples = FIFO_DEPTH;
+		stat->ktime_acc = ktime_set(0, samples *
+						stat->odr_period_acc_ns);
+	} else
+		stat->ktime_acc = ktime_set(0,
+				MS_TO_NS(stat->pdata_acc->poll_interval));
+}
+
+/* The output data rate is kept in the resume state while the accelerometer
+ * is disabled, and applied on the next power on */
+static int lsm303d_acc_write_odr(struct lsm303d_status *stat, int i)
+{
+	int err = 0;
+	u8 config[2];
+
+	config[1] = ((ODR_ACC_MASK & lsm303d_acc_odr_table[i].value) | 
+		((~ODR_ACC_MASK) & status_registers.cntrl1.resume_value));
+
+	if (atomic_read(&stat->enabled_acc)) {
+		config[0] = status_registers.cntrl1.address;
+		err = lsm303d_i2c_write(stat, config, 1);
+		if (err < 0)
+			goto error;
+	}
+	status_registers.cntrl1.resume_value = config[1];
+	stat->odr_period_acc_ns = lsm303d_acc_odr_table[i].period_ns;
+	stat->fifo_ts_valid = false;
+	lsm303d_acc_update_poll_ktime(stat);
+
+	return err;
+
+error:
+	dev_err(&stat->client->dev, "update accelerometer odr failed "
+			"0x%02x,0x%02x: %d\n", config[0], config[1], err);
+
+	return err;
+}
+
 static int lsm303d_acc_update_odr(struct lsm303d_status *stat,
 						unsigned int poll_interval_ms)
 {
-	int err = -1;
-	u8 config[2];
 	int i;
 
 	for (i = ARRAY_SIZE(lsm303d_acc_odr_table) - 1; i >= 0; i--) {
@@ -1098,24 +1211,98 @@ static int lsm303d_acc_update_odr(struct lsm303d_status *stat,
 			break;
 	}
 
-	config[1] = ((ODR_ACC_MASK & lsm303d_acc_odr_table[i].value) | 
-		((~ODR_ACC_MASK) & status_registers.cntrl1.resume_value));
+	return lsm303d_acc_write_odr(stat, i);
+}
+
+/* Select the slowest output data rate at or above the requested frequency,
+ * independently of the poll interval (used with the fifo) */
+static int lsm303d_acc_update_odr_hz(struct lsm303d_status *stat,
+						unsigned int odr_hz)
+{
+	int i;
+
+	for (i = ARRAY_SIZE(lsm303d_acc_odr_table) - 1; i > 0; i--) {
+		if ((u64) odr_hz * lsm303d_acc_odr_table[i].period_ns
+							<= NSEC_PER_SEC)
+			break;
+	}
+
+	return lsm303d_acc_write_odr(stat, i);
+}
+
+/* Configure the accelerometer fifo: bypass mode reads one sample per timer
+ * tick, stream mode keeps filling the fifo which is drained in bursts on
+ * watermark (interrupt on INT2 if wired, timer otherwise) */
+static int lsm303d_acc_update_fifo(struct lsm303d_status *stat,
+						u8 mode, u8 watermark)
+{
+	int err = 0;
+	u8 buf[2];
+	u8 cntrl0;
+	u8 cntrl4;
+	u8 fifo_ctrl;
+
+	if (mode != FIFO_MODE_BYPASS && mode != FIFO_MODE_STREAM) {
+		dev_err(&stat->client->dev, "invalid accelerometer fifo "
+						"mode requested: 0x%02x\n", mode);
+		return -EINVAL;
+	}
+	if (watermark > FIFO_WATERMARK_MASK) {
+		dev_err(&stat->client->dev, "invalid accelerometer fifo "
+					"watermark requested: %u\n", watermark);
+		return -EINVAL;
+	}
+
+	cntrl0 = (~(FIFO_EN_MASK | FIFO_FTH_EN_MASK)) &
+				status_registers.cntrl0.resume_value;
+	cntrl4 = (~FIFO_INT2_MASK) & status_registers.cntrl4.resume_value;
+	if (mode == FIFO_MODE_STREAM) {
+		cntrl0 |= (FIFO_EN_MASK | FIFO_FTH_EN_MASK);
+		if (stat->pdata_acc->gpio_int2 >= 0)
+			cntrl4 |= FIFO_INT2_MASK;
+	}
+	fifo_ctrl = (FIFO_MODE_MASK & mode) | (FIFO_WATERMARK_MASK & watermark);
 
 	if (atomic_read(&stat->enabled_acc)) {
-		config[0] = status_registers.cntrl1.address;
-		err = lsm303d_i2c_write(stat, config, 1);
+		/* Go through bypass mode to flush the fifo */
+		buf[0] = status_registers.fifo_ctrl.address;
+		buf[1] = FIFO_MODE_BYPASS;
+		err = lsm303d_i2c_write(stat, buf, 1);
+		if (err < 0)
+			goto error;
+
+		buf[0] = status_registers.cntrl0.address;
+		buf[1] = cntrl0;
+		err = lsm303d_i2c_write(stat, buf, 1);
+		if (err < 0)
+			goto error;
+
+		buf[0] = status_registers.cntrl4.address;
+		buf[1] = cntrl4;
+		err = lsm303d_i2c_write(stat, buf, 1);
+		if (err < 0)
+			goto error;
+
+		buf[0] = status_registers.fifo_ctrl.address;
+		buf[1] = fifo_ctrl;
+		err = lsm303d_i2c_write(stat, buf, 1);
 		if (err < 0)
 			goto error;
-		status_registers.cntrl1.resume_value = config[1];
-		stat->ktime_acc = ktime_set(0, MS_TO_NS(poll_interval_ms));
 	}
 
+	status_registers.cntrl0.resume_value = cntrl0;
+	status_registers.cntrl4.resume_value = cntrl4;
+	status_registers.fifo_ctrl.resume_value = fifo_ctrl;
+	stat->fifo_mode = mode;
+	stat->fifo_watermark = watermark;
+	stat->fifo_ts_valid = false;
+	lsm303d_acc_update_poll_ktime(stat);
+
 	return err;
 
 error:
-	dev_err(&stat->client->dev, "update accelerometer odr failed "
-			"0x%02x,0x%02x: %d\n", config[0], config[1], err);
-
+	dev_err(&stat->client->dev, "update accelerometer fifo failed "
+			"0x%02x,0x%02x: %d\n", buf[0], buf[1], err);
 	return err;
 }
 
@@ -1213,6 +1400,7 @@ static int lsm303d_acc_enable(struct lsm303d_status *stat)
 			atomic_set(&stat->enabled_acc, 0);
 			return err;
 		}
+		stat->fifo_ts_valid = false;
 		hrtimer_start(&stat->hr_timer_acc, stat->ktime_acc, HRTIMER_MODE_REL);
 		if(!atomic_read(&stat->enabled_mag)) {
 			if(stat->pdata_acc->gpio_int1 >= 0)
@@ -1753,8 +1941,133 @@ static ssize_t attr_get_temp(struct device *dev,
 	return sprintf(buf, "%d.%u\n", dec, flo);
 }
 
+static ssize_t attr_get_odr_hz_acc(struct kobject *kobj,
+					struct kobj_attribute *attr,
+					char *buf)
+{
+	struct device *dev = to_dev(kobj->parent);
+	struct lsm303d_status *stat = dev_get_drvdata(dev);
+	u32 period_ns;
+	mutex_lock(&stat->lock);
+	period_ns = stat->odr_period_acc_ns;
+	mutex_unlock(&stat->lock);
+	if (!period_ns)
+		return sprintf(buf, "0\n");
+	return sprintf(buf, "%u\n", (u32) (NSEC_PER_SEC / period_ns));
+}
+
+static ssize_t attr_set_odr_hz_acc(struct kobject *kobj,
+					struct kobj_attribute *attr,
+					const char *buf, size_t size)
+{
+	struct device *dev = to_dev(kobj->parent);
+	struct lsm303d_status *stat = dev_get_drvdata(dev);
+	unsigned long odr_hz;
+	int err;
+
+	if (kstrtoul(buf, 10, &odr_hz))
+		return -EINVAL;
+	if (!odr_hz)
+		return -EINVAL;
+	mutex_lock(&stat->lock);
+	err = lsm303d_acc_update_odr_hz(stat, (unsigned int)odr_hz);
+	mutex_unlock(&stat->lock);
+	if (err < 0)
+		return err;
+	return size;
+}
+
+static ssize_t attr_get_fifo_mode(struct kobject *kobj,
+					struct kobj_attribute *attr,
+					char *buf)
+{
+	struct device *dev = to_dev(kobj->parent);
+	struct lsm303d_status *stat = dev_get_drvdata(dev);
+	u8 val;
+	mutex_lock(&stat->lock);
+	val = stat->fifo_mode;
+	mutex_unlock(&stat->lock);
+	return sprintf(buf, "0x%02x\n", val);
+}
+
+static ssize_t attr_set_fifo_mode(struct kobject *kobj,
+					struct kobj_attribute *attr,
+					const char *buf, size_t size)
+{
+	struct device *dev = to_dev(kobj->parent);
+	struct lsm303d_status *stat = dev_get_drvdata(dev);
+	unsigned long val;
+	int err;
+
+	if (kstrtoul(buf, 16, &val))
+		return -EINVAL;
+	if (val > 0xFF)
+		return -EINVAL;
+	mutex_lock(&stat->lock);
+	err = lsm303d_acc_update_fifo(stat, (u8)val, stat->fifo_watermark);
+	mutex_unlock(&stat->lock);
+	if (err < 0)
+		return err;
+	return size;
+}
+
+static ssize_t attr_get_fifo_samples(struct kobject *kobj,
+					struct kobj_attribute *attr,
+					char *buf)
+{
+	struct device *dev = to_dev(kobj->parent);
+	struct lsm303d_status *stat = dev_get_drvdata(dev);
+	u8 val;
+	mutex_lock(&stat->lock);
+	val = stat->fifo_watermark;
+	mutex_unlock(&stat->lock);
+	return sprintf(buf, "0x%02x\n", val);
+}
+
+static ssize_t attr_set_fifo_samples(struct kobject *kobj,
+					struct kobj_attribute *attr,
+					const char *buf, size_t size)
+{
+	struct device *dev = to_dev(kobj->parent);
+	struct lsm303d_status *stat = dev_get_drvdata(dev);
+	unsigned long val;
+	int err;
+
+	if (kstrtoul(buf, 16, &val))
+		return -EINVAL;
+	if (val > FIFO_WATERMARK_MASK)
+		return -EINVAL;
+	mutex_lock(&stat->lock);
+	err = lsm303d_acc_update_fifo(stat, stat->fifo_mode, (u8)val);
+	mutex_unlock(&stat->lock);
+	if (err < 0)
+		return err;
+	return size;
+}
+
+static ssize_t attr_get_fifo_overruns(struct kobject *kobj,
+					struct kobj_attribute *attr,
+					char *buf)
+{
+	struct device *dev = to_dev(kobj->parent);
+	struct lsm303d_status *stat = dev_get_drvdata(dev);
+	u32 val;
+	mutex_lock(&stat->lock);
+	val = stat->fifo_overruns;
+	mutex_unlock(&stat->lock);
+	return sprintf(buf, "%u\n", val);
+}
+
 static struct kobj_attribute poll_attr_acc =
 __ATTR(pollrate_ms, 0664, attr_get_polling_rate_acc, attr_set_polling_rate_acc);
+static struct kobj_attribute odr_attr_acc =
+__ATTR(odr_hz, 0664, attr_get_odr_hz_acc, attr_set_odr_hz_acc);
+static struct kobj_attribute fifo_mode_attr_acc =
+__ATTR(fifo_mode, 0664, attr_get_fifo_mode, attr_set_fifo_mode);
+static struct kobj_attribute fifo_samples_attr_acc =
+__ATTR(fifo_samples, 0664, attr_get_fifo_samples, attr_set_fifo_samples);
+static struct kobj_attribute fifo_overruns_attr_acc =
+__ATTR(fifo_overruns, 0444, attr_get_fifo_overruns, NULL);
 static struct kobj_attribute enable_attr_acc =
 __ATTR(enable_device, 0664, attr_get_enable_acc, attr_set_enable_acc);
 static struct kobj_attribute fs_attr_acc = 
@@ -2565,6 +2878,10 @@ static struct attribute *attributes_acc[] = {
 	&enable_attr_acc.attr,
 	&fs_attr_acc.attr,
 	&aa_filter_attr.attr,
+	&odr_attr_acc.attr,
+	&fifo_mode_attr_acc.attr,
+	&fifo_samples_attr_acc.attr,
+	&fifo_overruns_attr_acc.attr,
 	NULL,
 };
 
@@ -2698,7 +3015,8 @@ void lsm303d_acc_input_close(struct input_dev *dev)
 {
 	struct lsm303d_status *stat = input_get_drvdata(dev);
 
-	lsm303d_acc_disable(stat);
+	if (!imu_ring_active(&stat->ring_acc))
+		lsm303d_acc_disable(stat);
 }
 
 int lsm303d_mag_input_open(struct input_dev *input)
@@ -2712,19 +3030,47 @@ void lsm303d_mag_input_close(struct input_dev *dev)
 {
 	struct lsm303d_status *stat = input_get_drvdata(dev);
 
-	lsm303d_mag_disable(stat);
+	if (!imu_ring_active(&stat->ring_mag))
+		lsm303d_mag_disable(stat);
 }
 
-static int lsm303d_acc_get_data(struct lsm303d_status *stat, int *xyz)
+/* The sensors stay enabled while either the input device or the ring is open */
+static int lsm303d_acc_ring_enable(void *data)
 {
-	int i, err = -1;
-	u8 acc_data[6];
-	s32 hw_d[3] = { 0 };
+	struct lsm303d_status *stat = data;
 
-	acc_data[0] = (REG_ACC_DATA_ADDR);
-	err = lsm303d_i2c_read(stat, acc_data, 6);
-	if (err < 0)
-		return err;
+	return lsm303d_acc_enable(stat);
+}
+
+static void lsm303d_acc_ring_disable(void *data)
+{
+	struct lsm303d_status *stat = data;
+
+	if (!stat->input_dev_acc->users)
+		lsm303d_acc_disable(stat);
+}
+
+static int lsm303d_mag_ring_enable(void *data)
+{
+	struct lsm303d_status *stat = data;
+
+	return lsm303d_mag_enable(stat);
+}
+
+static void lsm303d_mag_ring_disable(void *data)
+{
+	struct lsm303d_status *stat = data;
+
+	if (!stat->input_dev_mag->users)
+		lsm303d_mag_disable(stat);
+}
+
+/* conversion of one raw sample to ug, with axis rotation */
+static void lsm303d_acc_convert_data(struct lsm303d_status *stat,
+						const u8 *acc_data, int *xyz)
+{
+	int i;
+	s32 hw_d[3] = { 0 };
 
 	hw_d[0] = ((s32)( (s16)((acc_data[1] << 8) | (acc_data[0]))));
 	hw_d[1] = ((s32)( (s16)((acc_data[3] << 8) | (acc_data[2]))));
@@ -2748,10 +3094,50 @@ static int lsm303d_acc_get_data(struct lsm303d_status *stat, int *xyz)
 				stat->pdata_acc->rot_matrix[1][i] * hw_d[1] +
 				stat->pdata_acc->rot_matrix[2][i] * hw_d[2];
 	}
+}
+
+static int lsm303d_acc_get_data(struct lsm303d_status *stat, int *xyz)
+{
+	int err = -1;
+	u8 acc_data[6];
+
+	acc_data[0] = (REG_ACC_DATA_ADDR);
+	err = lsm303d_i2c_read(stat, acc_data, 6);
+	if (err < 0)
+		return err;
+
+	lsm303d_acc_convert_data(stat, acc_data, xyz);
 
 	return err;
 }
 
+/* burst readout of several fifo samples.
+ * With the fifo enabled, the auto-incremented read address rolls back from
+ * OUT_Z_H_A to OUT_X_L_A, so consecutive samples are read in a single
+ * transfer */
+static int lsm303d_acc_get_fifo_data(struct lsm303d_status *stat,
+						u8 *buf, int samples)
+{
+	int err;
+	int len;
+	int offset = 0;
+	int total = samples * FIFO_SAMPLE_SIZE;
+
+	while (offset < total) {
+		len = total - offset;
+		if (stat->use_smbus &&
+			len > SMBUS_BURST_SAMPLES * FIFO_SAMPLE_SIZE)
+			len = SMBUS_BURST_SAMPLES * FIFO_SAMPLE_SIZE;
+
+		buf[offset] = (REG_ACC_DATA_ADDR);
+		err = lsm303d_i2c_read(stat, buf + offset, len);
+		if (err != len)
+			return (err < 0) ? err : -EIO;
+		offset += len;
+	}
+	return samples;
+}
+
 static int lsm303d_mag_get_data(struct lsm303d_status *stat, int *xyz)
 {
 	int i, err = -1;
@@ -2815,8 +3201,22 @@ static int lsm303d_temp_get_data(struct lsm303d_status *stat,
 	return err;
 }
 
-static void lsm303d_acc_report_values(struct lsm303d_status *stat, int *xyz)
+/* Each sample carries its acquisition time as MSC_TIMESTAMP (low 32 bits of
+ * the monotonic clock, in us), since samples read in a burst are all
+ * delivered at the same time */
+static void lsm303d_acc_report_values(struct lsm303d_status *stat, int *xyz,
+								ktime_t ts)
 {
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 4, 0)
+	input_set_timestamp(stat->input_dev_acc, ts);
+#endif
+	if (imu_ring_active(&stat->ring_acc))
+		imu_ring_push(&stat->ring_acc, ts, xyz[0], xyz[1], xyz[2]);
+	if (!stat->input_dev_acc->users)
+		return;
+
+	input_event(stat->input_dev_acc, EV_MSC, MSC_TIMESTAMP,
+					(u32) ktime_to_us(ts));
 	input_report_abs(stat->input_dev_acc, ABS_X, xyz[0]);
 	input_report_abs(stat->input_dev_acc, ABS_Y, xyz[1]);
 	input_report_abs(stat->input_dev_acc, ABS_Z, xyz[2]);
@@ -2825,12 +3225,84 @@ static void lsm303d_acc_report_values(struct lsm303d_status *stat, int *xyz)
 
 static void lsm303d_mag_report_values(struct lsm303d_status *stat, int *xyz)
 {
+	if (imu_ring_active(&stat->ring_mag))
+		imu_ring_push(&stat->ring_mag, ktime_get(),
+						xyz[0], xyz[1], xyz[2]);
+	if (!stat->input_dev_mag->users)
+		return;
+
 	input_report_abs(stat->input_dev_mag, ABS_X, xyz[0]);
 	input_report_abs(stat->input_dev_mag, ABS_Y, xyz[1]);
 	input_report_abs(stat->input_dev_mag, ABS_Z, xyz[2]);
 	input_sync(stat->input_dev_mag);
 }
 
+/* Drain all samples stored in the accelerometer fifo (stream mode) with one
+ * burst read. Sample times are interpolated between the previous drain and
+ * this one, which follows the actual output data rate of the device. */
+static void lsm303d_acc_fifo_drain(struct lsm303d_status *stat)
+{
+	int err;
+	int i;
+	int stored;
+	u8 buf[1];
+	u8 fifo_src;
+	ktime_t now;
+	s64 step;
+	int xyz[3] = { 0 };
+
+	buf[0] = REG_FIFO_SRC_ADDR;
+	err = lsm303d_i2c_read(stat, buf, 1);
+	now = ktime_get();
+	if (err <= 0) {
+		dev_err(&stat->client->dev, "error reading fifo source reg\n");
+		return;
+	}
+	fifo_src = buf[0];
+	if (fifo_src & FIFO_SRC_EMPTY)
+		return;
+
+	stored = fifo_src & FIFO_STORED_DATA_MASK;
+	if (fifo_src & FIFO_SRC_OVRN) {
+		/* Oldest samples were overwritten: the interval since the
+		 * previous drain does not match the stored samples anymore */
+		stored = FIFO_DEPTH;
+		stat->fifo_overruns++;
+		stat->fifo_ts_valid = false;
+		imu_ring_mark_overrun(&stat->ring_acc);
+	}
+	if (stored == 0)
+		return;
+
+	err = lsm303d_acc_get_fifo_data(stat, stat->fifo_buf, stored);
+	if (err < 0) {
+		dev_err(&stat->client->dev, "fifo burst read failed\n");
+		stat->fifo_ts_valid = false;
+		return;
+	}
+
+	step = stat->odr_period_acc_ns;
+	if (stat->fifo_ts_valid) {
+		step = div_s64(ktime_to_ns(ktime_sub(now, stat->fifo_last_ts)),
+								stored);
+		/* Fall back to the nominal period after a late drain */
+		if (step < stat->odr_period_acc_ns / 2 ||
+				step > 2 * (s64) stat->odr_period_acc_ns)
+			step = stat->odr_period_acc_ns;
+	}
+
+	for (i = 0; i < stored; i++) {
+		lsm303d_acc_convert_data(stat,
+				stat->fifo_buf + i * FIFO_SAMPLE_SIZE, xyz);
+		lsm303d_acc_report_values(stat, xyz,
+			ktime_sub_ns(now, (u64) (stored - 1 - i) * step));
+	}
+
+	stat->fifo_last_ts = now;
+	stat->fifo_ts_valid = true;
+	imu_ring_wake(&stat->ring_acc);
+}
+
 static int lsm303d_acc_input_init(struct lsm303d_status *stat)
 {
 	int err;
@@ -2852,6 +3324,8 @@ static int lsm303d_acc_input_init(struct lsm303d_status *stat)
 	input_set_drvdata(stat->input_dev_acc, stat);
 
 	set_bit(EV_ABS, stat->input_dev_acc->evbit);
+	set_bit(EV_MSC, stat->input_dev_acc->evbit);
+	set_bit(MSC_TIMESTAMP, stat->input_dev_acc->mscbit);
 
 	input_set_abs_params(stat->input_dev_acc, ABS_X, 
 				-ACC_G_MAX_NEG, ACC_G_MAX_POS, FUZZ, FLAT);
@@ -2940,14 +3414,23 @@ static void poll_function_work_acc(struct work_struct *input_work_acc)
 			struct lsm303d_status, input_work_acc);
 
 	mutex_lock(&stat->lock);
-	err = lsm303d_acc_get_data(stat, xyz);
-	if (err < 0)
-		dev_err(&stat->client->dev, "get_accelerometer_data failed\n");
-	else
-		lsm303d_acc_report_values(stat, xyz);
+	if (stat->fifo_mode == FIFO_MODE_STREAM)
+		lsm303d_acc_fifo_drain(stat);
+	else {
+		err = lsm303d_acc_get_data(stat, xyz);
+		if (err < 0)
+			dev_err(&stat->client->dev,
+					"get_accelerometer_data failed\n");
+		else {
+			lsm303d_acc_report_values(stat, xyz, ktime_get());
+			imu_ring_wake(&stat->ring_acc);
+		}
+	}
 
 	mutex_unlock(&stat->lock);
-	hrtimer_start(&stat->hr_timer_acc, stat->ktime_acc, HRTIMER_MODE_REL);
+	/* disable and remove stop the polling with the timer */
+	if (atomic_read(&stat->enabled_acc))
+		hrtimer_start(&stat->hr_timer_acc, stat->ktime_acc, HRTIMER_MODE_REL);
 }
 
 static void poll_function_work_mag(struct work_struct *input_work_mag)
@@ -2979,12 +3462,15 @@ static void poll_function_work_mag(struct work_struct *input_work_mag)
 		if (err < 0)
 			dev_err(&stat->client->dev, "get_magnetometer_data"
 								" failed\n");
-		else
+		else {
 			lsm303d_mag_report_values(stat, xyz);
+			imu_ring_wake(&stat->ring_mag);
+		}
 	}
 
 	mutex_unlock(&stat->lock);
-	hrtimer_start(&stat->hr_timer_mag, stat->ktime_mag, HRTIMER_MODE_REL);
+	if (atomic_read(&stat->enabled_mag) || atomic_read(&stat->enabled_temp))
+		hrtimer_start(&stat->hr_timer_mag, stat->ktime_mag, HRTIMER_MODE_REL);
 }
 
 enum hrtimer_restart poll_function_read_acc(struct hrtimer *timer)
@@ -3307,6 +3793,22 @@ static int lsm303d_probe(struct i2c_client *client,
 	INIT_WORK(&stat->input_work_acc, poll_function_work_acc);
 	INIT_WORK(&stat->input_work_mag, poll_function_work_mag);
 
+	/* The rings are optional: the input devices remain available */
+	err = imu_ring_init(&stat->ring_acc, "lsm303d_acc_ring",
+				IMU_RING_DEFAULT_CAPACITY,
+				lsm303d_acc_ring_enable,
+				lsm303d_acc_ring_disable, stat);
+	if (err < 0)
+		dev_warn(&client->dev, "accelerometer ring register "
+							"failed: %d\n", err);
+	err = imu_ring_init(&stat->ring_mag, "lsm303d_mag_ring",
+				IMU_RING_DEFAULT_CAPACITY,
+				lsm303d_mag_ring_enable,
+				lsm303d_mag_ring_disable, stat);
+	if (err < 0)
+		dev_warn(&client->dev, "magnetometer ring register "
+							"failed: %d\n", err);
+
 	mutex_unlock(&stat->lock);
 	dev_info(&client->dev, "%s: probed\n", LSM303D_DEV_NAME);
 	return 0;
@@ -3360,9 +3862,18 @@ static int lsm303d_remove(struct i2c_client *client)
 {
 	struct lsm303d_status *stat = i2c_get_clientdata(client);
 
+	/* No new ring users, and everything that pushes records is stopped
+	 * before the ring memory is released */
+	imu_ring_unregister(&stat->ring_acc);
+	imu_ring_unregister(&stat->ring_mag);
+
 	lsm303d_acc_disable(stat);
 	lsm303d_mag_disable(stat);
 	lsm303d_temperature_disable(stat);
+	hrtimer_cancel(&stat->hr_timer_acc);
+	cancel_work_sync(&stat->input_work_acc);
+	hrtimer_cancel(&stat->hr_timer_mag);
+	cancel_work_sync(&stat->input_work_mag);
 
 	if(stat->pdata_acc->gpio_int1 >= 0) {
 		free_irq(stat->irq1, stat);
@@ -3376,6 +3887,9 @@ static int lsm303d_remove(struct i2c_client *client)
 		destroy_workqueue(stat->irq2_work_queue);
 	}
 
+	imu_ring_destroy(&stat->ring_acc);
+	imu_ring_destroy(&stat->ring_mag);
+
 	lsm303d_acc_input_cleanup(stat);
 	lsm303d_mag_input_cleanup(stat);
 
@@ -0,0 +1,71 @@
+/******************************************************************************
+ *
+ * Copyright (c) 2016, Simon Brodeur
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  - Neither the name of the NECOTIS research group nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef IMU_IMU_RING_H
+#define IMU_IMU_RING_H
+
+#include <linux/types.h>
+
+/* Sample ring exported by the IMU drivers through a character device (e.g. /dev/lsm303d_acc_ring),
+ * as an alternative to the input devices. Shared between the kernel drivers and the capture nodes.
+ *
+ * The device is mapped read-only: the header at offset 0, followed by the records at data_offset.
+ * The driver writes a record, then increments head (with a write barrier in between), so a reader
+ * consumes the records from its own tail up to head. Records older than head - capacity have been
+ * overwritten, and a record copied while head - tail >= capacity may be torn.
+ *
+ * A read() of 4 bytes blocks until new records are available and returns head. poll() reports
+ * POLLIN when head changed since the last read() on the same file.
+ */
+
+#define IMU_RING_MAGIC		0x474e5249	/* "IRNG" */
+#define IMU_RING_VERSION	1
+
+/* Records were lost in the device (e.g. fifo overrun) before this one */
+#define IMU_RING_FLAG_OVERRUN	0x01
+
+struct imu_ring_header {
+	__u32 magic;
+	__u32 version;
+	__u32 record_size;
+	__u32 capacity;		/* number of records, power of two */
+	__u32 data_offset;	/* offset of the first record in the mapping */
+	__u32 reserved[2];
+	__u32 head;		/* number of records written, wraps around */
+};
+
+struct imu_ring_record {
+	__u64 timestamp;	/* acquisition time, in ns of the monotonic clock */
+	__s32 x;		/* same units as the input device */
+	__s32 y;
+	__s32 z;
+	__u32 flags;		/* IMU_RING_FLAG_* */
+};
+
+#endif /* IMU_IMU_RING_H */
@@ -0,0 +1,128 @@
+/******************************************************************************
+ *
+ * Copyright (c) 2016, Simon Brodeur
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  - Neither the name of the NECOTIS research group nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef IMU_MAG_CALIBRATOR_H
+#define IMU_MAG_CALIBRATOR_H
+
+#include <string>
+
+namespace imu {
+
+  enum MagCalibrationModel {
+    MAG_CALIBRATION_ELLIPSOID = 0, // Full 3D hard-iron offset and symmetric soft-iron matrix
+    MAG_CALIBRATION_PLANAR = 1     // Horizontal plane only, for robots that only rotate around z
+  };
+
+  /* Online hard/soft-iron magnetometer calibration.
+   * Samples are fitted to the quadric x'Mx + 2w'x = 1 by least squares. Only the normal
+   * equations are accumulated (with exponential forgetting), so memory does not depend on
+   * the number of samples and the fit follows slow changes of the payload.
+   * The calibrated field is W (x - h), where h is the center of the ellipsoid and W maps it
+   * onto a sphere whose radius is the geometric mean of its semi-axes.
+   */
+  class MagCalibrator {
+    public:
+      MagCalibrator(const MagCalibrationModel& model = MAG_CALIBRATION_ELLIPSOID);
+
+      void setModel(const MagCalibrationModel& model);
+
+      /* Weight of past samples, applied at each accepted sample (1.0 never forgets).
+       */
+      void setForgetting(const double& lambda);
+
+      /* Minimum distance to the last accepted sample, relative to the field strength.
+       * This keeps a stationary robot from flooding the fit with identical samples.
+       */
+      void setMinSpacing(const double& spacing);
+
+      /* Minimum effective number of samples before a fit is accepted.
+       */
+      void setMinSamples(const double& count);
+
+      /* Maximum ratio between the longest and shortest semi-axes of an accepted fit.
+       */
+      void setMaxAxisRatio(const double& ratio);
+
+      /* Clear the accumulated samples. The current calibration is kept.
+       */
+      void reset();
+
+      /* Accumulate a raw sample. Returns false if it was rejected as too close to the previous one.
+       */
+      bool addSample(const double& x, const double& y, const double& z);
+
+      /* Solve the accumulated normal equations. The calibration is only replaced
+       * if the fitted quadric is a valid ellipsoid.
+       */
+      bool fit();
+
+      /* Apply the current calibration in place.
+       */
+      void apply(double& x, double& y, double& z) const;
+
+      void setCalibration(const double hardIron[3], const double softIron[9]);
+
+      /* Persist or restore the calibration as YAML (also loadable with rosparam).
+       */
+      bool save(const std::string& path) const;
+      bool load(const std::string& path);
+
+      inline const double* getHardIron() const { return hardIron; };
+      inline const double* getSoftIron() const { return softIron; };
+      inline double getSampleCount() const { return count; };
+      inline bool isFitted() const { return fitted; };
+
+    private:
+      static const int MAX_PARAMS = 9;
+
+      MagCalibrationModel model;
+      int nbParams;
+      double forgetting;
+      double minSpacing;
+      double minSamples;
+      double maxAxisRatio;
+
+      // Normal equations of the quadric fit (upper triangle is used), in normalized units
+      double AtA[MAX_PARAMS][MAX_PARAMS];
+      double Atb[MAX_PARAMS];
+      double count;
+      double scale;
+      double last[3];
+      bool hasLast;
+      bool fitted;
+
+      double hardIron[3];
+      double softIron[9];
+
+      int designRow(const double u[3], double d[MAX_PARAMS]) const;
+  };
+
+}  // namespace imu
+
+#endif  // IMU_MAG_CALIBRATOR_H
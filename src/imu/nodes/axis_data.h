@@ -0,0 +1,50 @@
+#ifndef IMU_AXIS_DATA_H
+#define IMU_AXIS_DATA_H
+
+#include <time.h>
+#include <stdint.h>
+#include <linux/input.h>
+#include <ros/time.h>
+
+#ifndef MSC_TIMESTAMP
+#define MSC_TIMESTAMP 0x05
+#endif
+
+namespace imu {
+
+struct AxisData{
+	int x;
+	int y;
+	int z;
+
+	// Acquisition time reported by the driver (EV_MSC/MSC_TIMESTAMP), in us of the monotonic clock
+	uint32_t timestamp;
+	bool hasTimestamp;
+
+	AxisData() : x(0), y(0), z(0), timestamp(0), hasTimestamp(false) {}
+};
+
+/* Stamp of a sample in ROS time.
+ * Samples read from the device FIFO in a burst are all delivered at once, so the acquisition
+ * time reported by the driver is used when available (only its low 32 bits are reported, which
+ * is enough to recover the age of the sample).
+ */
+inline ros::Time sampleStamp(const AxisData& data){
+	const ros::Time now = ros::Time::now();
+	if (!data.hasTimestamp){
+		return now;
+	}
+	struct timespec mono;
+	clock_gettime(CLOCK_MONOTONIC, &mono);
+	const uint32_t nowUs = (uint32_t) ((uint64_t) mono.tv_sec * 1000000 + mono.tv_nsec / 1000);
+	const uint32_t ageUs = nowUs - data.timestamp;
+	if (ageUs > 1000000){
+		// Not a recent sample, the clocks do not match
+		return now;
+	}
+	return now - ros::Duration(ageUs * 1e-6);
+}
+
+} // namespace imu
+
+#endif // IMU_AXIS_DATA_H
@@ -0,0 +1,503 @@
+/******************************************************************************
+ * 
+ * Copyright (c) 2014, Simon Brodeur
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ * 
+ *  - Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ *  - Neither the name of the NECOTIS research group nor the names of its contributors 
+ *    may be used to endorse or promote products derived from this software 
+ *    without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND 
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED 
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. 
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, 
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT 
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, 
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef IMU_CAPTURE_ACC_GYRO_H
+#define IMU_CAPTURE_ACC_GYRO_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <linux/input.h>
+#include <sys/ioctl.h>
+#include <ros/ros.h>
+#include <ros/console.h>
+#include <boost/make_shared.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <sensor_msgs/Imu.h>
+#include <geometry_msgs/Quaternion.h>
+#include <geometry_msgs/Vector3.h>
+#include <imu/ImuBatch.h>
+
+#include "axis_data.h"
+#include "ring_reader.h"
+#include "sensor_conversion.h"
+
+namespace imu {
+
+class AccGyroCaptureNode {
+
+    public:
+        ros::NodeHandle node_;
+        ros::Publisher pubPos_;
+        ros::Publisher pubAcc_;
+        std::string outputPos_;
+        std::string outputAcc_;
+        std::string deviceAccel_;
+        std::string deviceGyro_;
+        bool useRing_;
+        std::string ringAccel_;
+        std::string ringGyro_;
+        double rate_;
+        bool publishAcc_;
+        int frameSize_;
+        int gyroRange_;
+        std::string axesAccel_;
+        std::string axesGyro_;
+
+        // Latest complete samples, a gyroscope sample is published with the latest accelerometer sample
+        AxisData dataAccel_;
+        AxisData dataGyro_;
+        bool accelReceived_;
+        ros::Time nextPos_;
+        std::vector<AxisData> samplesAccel_;
+        std::vector<AxisData> samplesGyro_;
+
+        // Frames read since the previous wakeup, every accelerometer sample is also published on its own
+        std::vector<AxisData> framesAccel_;
+        std::vector<AxisData> framesGyro_;
+        sensor_msgs::ImuPtr msgAcc_;
+        imu::ImuBatchPtr msgAccBatch_;
+        std::vector<AxisData> samplesAccelOnly_;
+        int nbSamplesAcc_;
+
+        // Input events of the frames being received, and SYN_DROPPED handling
+        AxisData eventsAccel_;
+        AxisData eventsGyro_;
+        bool syncDroppedAccel_;
+        bool syncDroppedGyro_;
+        unsigned long eventDrops_;
+        boost::scoped_ptr<VectorConverter> convertAccel_;
+        boost::scoped_ptr<VectorConverter> convertGyro_;
+
+        sensor_msgs::ImuPtr msgPos_;
+        imu::ImuBatchPtr msgPosBatch_;
+        int nbSamplesBatch_;
+
+        int fdAccel_;
+        int fdGyro_;
+        RingReader readerAccel_;
+        RingReader readerGyro_;
+        uint64_t ringLossesAccel_;
+        uint64_t ringLossesGyro_;
+
+        AccGyroCaptureNode(const ros::NodeHandle& node = ros::NodeHandle("~")) : node_(node),
+        		accelReceived_(false),
+        		msgAcc_(boost::make_shared<sensor_msgs::Imu>()),
+        		msgAccBatch_(boost::make_shared<imu::ImuBatch>()),
+        		nbSamplesAcc_(0),
+        		syncDroppedAccel_(false),
+        		syncDroppedGyro_(false),
+        		eventDrops_(0),
+        		msgPos_(boost::make_shared<sensor_msgs::Imu>()),
+        		msgPosBatch_(boost::make_shared<imu::ImuBatch>()),
+        		ringLossesAccel_(0),
+        		ringLossesGyro_(0){
+
+        	node_.param("output", outputPos_, std::string("/imu/data_raw"));
+        	// Accelerometer samples at the accelerometer rate (e.g. for vibration analysis), not throttled by rate
+        	node_.param("publish_acc", publishAcc_, false);
+        	node_.param("output_acc", outputAcc_, std::string("/imu/acc_raw"));
+        	node_.param("device_acc", deviceAccel_, std::string("/dev/lsm303d_acc"));
+        	node_.param("device_gyro", deviceGyro_, std::string("/dev/l3gd20_gyr"));
+        	node_.param("use_ring", useRing_, false);
+        	node_.param("ring_acc", ringAccel_, std::string("/dev/lsm303d_acc_ring"));
+        	node_.param("ring_gyro", ringGyro_, std::string("/dev/l3gd20_gyr_ring"));
+        	node_.param("rate", rate_, 0.0);
+        	node_.param("frame_size", frameSize_, 1);
+        	node_.param("gyro_range", gyroRange_, 250);
+        	// NOTE: using standard axis orientation, see http://www.ros.org/reps/rep-0103.html
+        	// NOTE: inverted x and y axis intentional since lsm303d and l3dg20 were not using same axis reference on IMU board.
+        	node_.param("gyro_axes", axesGyro_, std::string("x,y,z"));
+        	node_.param("acc_axes", axesAccel_, std::string("y,-x,z"));
+
+        	// Conversions are selected once, the capture loop only runs the specialized kernels
+        	// NOTE: the accelerometer measures the inertial force, which is the negative of the acceleration force.
+        	//	     Because the imu madgwick filter expects inertial forces, we don't apply this negation.
+        	convertGyro_.reset(makeGyroConverter(gyroRange_, axesGyro_));
+        	if (!convertGyro_) {
+        		std::ostringstream error;
+        		error << "Unsupported gyroscope range " << gyroRange_ << " dps or axes \"" << axesGyro_ << "\"";
+        		throw std::runtime_error(error.str());
+        	}
+        	convertAccel_.reset(makeVectorConverter<AccScale>(axesAccel_));
+        	if (!convertAccel_) {
+        		throw std::runtime_error("Unsupported accelerometer axes \"" + axesAccel_ + "\"");
+        	}
+
+        	// Adapted from: http://stackoverflow.com/questions/28841139/how-to-get-coordinates-of-touchscreen-rawdata-using-linux
+
+			fdAccel_ = -1;
+			fdGyro_ = -1;
+			if (useRing_){
+				/* Open accelerometer and gyroscope sample rings */
+				if (!readerAccel_.open(ringAccel_)) {
+					throw std::runtime_error(ringAccel_ + " is not a valid device");
+				}
+				if (!readerGyro_.open(ringGyro_)) {
+					throw std::runtime_error(ringGyro_ + " is not a valid device");
+				}
+				printf("Reading from accelerometer and gyroscope:\n");
+				printf("ring files = %s, %s\n", ringAccel_.c_str(), ringGyro_.c_str());
+			}else{
+				/* Open accelerometer device */
+				// Both devices are drained without blocking after a poll()
+				fdAccel_ = open(deviceAccel_.c_str(), O_RDONLY | O_NONBLOCK);
+				if (fdAccel_ == -1) {
+					throw std::runtime_error(deviceAccel_ + " is not a valid device");
+				}
+
+				/* Print accelerometer device name */
+				char nameAccel[256] = "Unknown";
+				ioctl(fdAccel_, EVIOCGNAME(sizeof(nameAccel)), nameAccel);
+				printf("Reading from accelerometer:\n");
+				printf("device file = %s\n", deviceAccel_.c_str());
+				printf("device name = %s\n", nameAccel);
+
+				/* Open gyroscope device */
+				fdGyro_ = open(deviceGyro_.c_str(), O_RDONLY | O_NONBLOCK);
+				if (fdGyro_ == -1) {
+					// The destructor is not called when the constructor throws
+					close(fdAccel_);
+					throw std::runtime_error(deviceGyro_ + " is not a valid device");
+				}
+
+				/* Print gyroscope device name */
+				char nameGyro[256] = "Unknown";
+				ioctl(fdGyro_, EVIOCGNAME(sizeof(nameGyro)), nameGyro);
+				printf("Reading from gyroscope:\n");
+				printf("device file = %s\n", deviceGyro_.c_str());
+				printf("device name = %s\n", nameGyro);
+			}
+
+			/*gyro_.setGyroDataRate(DR_GYRO_800HZ);
+			gyro_.setGyroScale(SCALE_GYRO_245dps);
+			lms303_.setAccelDataRate(DR_ACCEL_100HZ);
+			lms303_.setAccelScale(SCALE_ACCEL_4g);*/
+
+			nbSamplesBatch_ = 0;
+			if (frameSize_ > 1){
+				samplesAccel_.resize(frameSize_);
+				samplesGyro_.resize(frameSize_);
+				msgPosBatch_->stamps.resize(frameSize_);
+				msgPosBatch_->angular_velocities.resize(frameSize_);
+				msgPosBatch_->linear_accelerations.resize(frameSize_);
+				msgPosBatch_->orientations.resize(frameSize_);
+
+				msgPosBatch_->header.frame_id = "imu_link";
+				for (unsigned int i=0; i<frameSize_; i++){
+					msgPosBatch_->orientations[i].x = 0;
+					msgPosBatch_->orientations[i].y = 0;
+					msgPosBatch_->orientations[i].z = 0;
+					msgPosBatch_->orientations[i].w = 0;
+				}
+
+				pubPos_ = node_.advertise<imu::ImuBatch>(outputPos_, 10);
+
+				if (publishAcc_){
+					// Accelerometer only: the angular velocities and orientations are left to zero
+					samplesAccelOnly_.resize(frameSize_);
+					msgAccBatch_->stamps.resize(frameSize_);
+					msgAccBatch_->angular_velocities.resize(frameSize_);
+					msgAccBatch_->linear_accelerations.resize(frameSize_);
+					msgAccBatch_->orientations.resize(frameSize_);
+					msgAccBatch_->header.frame_id = "imu_link";
+					pubAcc_ = node_.advertise<imu::ImuBatch>(outputAcc_, 10);
+				}
+			}else{
+				msgPos_->header.frame_id = "imu_link";
+                msgPos_->orientation.x = 0;
+                msgPos_->orientation.y = 0;
+                msgPos_->orientation.z = 0;
+                msgPos_->orientation.w = 0;
+
+				pubPos_ = node_.advertise<sensor_msgs::Imu>(outputPos_, 10);
+
+				if (publishAcc_){
+					// Accelerometer only: no orientation nor angular velocity estimate (covariance -1)
+					msgAcc_->header.frame_id = "imu_link";
+					msgAcc_->orientation_covariance[0] = -1;
+					msgAcc_->angular_velocity_covariance[0] = -1;
+					pubAcc_ = node_.advertise<sensor_msgs::Imu>(outputAcc_, 10);
+				}
+			}
+        }
+
+        virtual ~AccGyroCaptureNode() {
+        	if (fdAccel_ != -1){
+        		close(fdAccel_);
+        	}
+        	if (fdGyro_ != -1){
+        		close(fdGyro_);
+        	}
+        }
+
+        /* Drains both rings, every accelerometer sample is kept and not only the latest one.
+         * The gyroscope ring paces the loop.
+         */
+        void waitRing(){
+        	if (!readerGyro_.available()){
+        		readerGyro_.wait(100);
+        	}
+        	AxisData data;
+        	while (readerAccel_.next(data)){
+        		framesAccel_.push_back(data);
+        	}
+        	while (readerGyro_.next(data)){
+        		framesGyro_.push_back(data);
+        	}
+
+        	if (readerAccel_.dropped() + readerAccel_.overruns() != ringLossesAccel_){
+        		ringLossesAccel_ = readerAccel_.dropped() + readerAccel_.overruns();
+        		ROS_WARN_THROTTLE(1.0, "Accelerometer samples lost, %llu overwritten in the ring and %llu device fifo overruns (since the start)",
+        				(unsigned long long) readerAccel_.dropped(), (unsigned long long) readerAccel_.overruns());
+        	}
+        	if (readerGyro_.dropped() + readerGyro_.overruns() != ringLossesGyro_){
+        		ringLossesGyro_ = readerGyro_.dropped() + readerGyro_.overruns();
+        		ROS_WARN_THROTTLE(1.0, "Gyroscope samples lost, %llu overwritten in the ring and %llu device fifo overruns (since the start)",
+        				(unsigned long long) readerGyro_.dropped(), (unsigned long long) readerGyro_.overruns());
+        	}
+        }
+
+        /* Waits for input events on either device, then drains both.
+         */
+        void waitEvents(){
+        	struct pollfd fds[2];
+        	fds[0].fd = fdAccel_;
+        	fds[0].events = POLLIN;
+        	fds[0].revents = 0;
+        	fds[1].fd = fdGyro_;
+        	fds[1].events = POLLIN;
+        	fds[1].revents = 0;
+        	if (poll(fds, 2, 100) <= 0){
+        		return;
+        	}
+        	readEvents(fdAccel_, eventsAccel_, syncDroppedAccel_, framesAccel_);
+        	readEvents(fdGyro_, eventsGyro_, syncDroppedGyro_, framesGyro_);
+        }
+
+        /* Parses the pending input events of a device, each complete frame (SYN_REPORT) is appended
+         * to frames. Values are in ug for the accelerometer and udps for the gyroscope.
+         * After a SYN_DROPPED, the events up to the next SYN_REPORT are discarded, as documented for evdev.
+         */
+        void readEvents(const int fd, AxisData& data, bool& syncDropped, std::vector<AxisData>& frames){
+        	struct input_event events[64];
+        	while (true){
+        		const ssize_t size = read(fd, events, sizeof(events));
+        		if (size < 0){
+        			if (errno != EAGAIN){
+        				ROS_ERROR_THROTTLE(1.0, "Error when reading input events (%s)", strerror(errno));
+        			}
+        			return;
+        		}
+
+        		const size_t count = size / sizeof(struct input_event);
+        		for (size_t i = 0; i < count; i++){
+        			const struct input_event& ev = events[i];
+        			if (ev.type == EV_SYN && ev.code == SYN_DROPPED){
+        				syncDropped = true;
+        				eventDrops_++;
+        				ROS_WARN_THROTTLE(1.0, "Input events dropped by the kernel, the capture is too slow (%lu since the start)", eventDrops_);
+        				continue;
+        			}
+        			if (syncDropped){
+        				if (ev.type == EV_SYN && ev.code == SYN_REPORT){
+        					syncDropped = false;
+        				}
+        				continue;
+        			}
+
+        			if (ev.type == EV_ABS){
+        				switch(ev.code) {
+        					case ABS_X : data.x = ev.value;
+        						break;
+        					case ABS_Y : data.y = ev.value;
+        						break;
+        					case ABS_Z : data.z = ev.value;
+        						break;
+        				}
+        			}else if (ev.type == EV_MSC && ev.code == MSC_TIMESTAMP){
+        				// Acquisition time of samples drained from the FIFO (stream mode)
+        				data.timestamp = (uint32_t) ev.value;
+        				data.hasTimestamp = true;
+        			}else if (ev.type == EV_SYN && ev.code == SYN_REPORT){
+        				frames.push_back(data);
+        			}
+        		}
+        		if ((size_t) size < sizeof(events)){
+        			return;
+        		}
+        	}
+        }
+
+        // Without acquisition times, the samples of a wakeup are ordered by device
+        static bool acquiredBefore(const AxisData& a, const AxisData& b){
+        	if (!a.hasTimestamp || !b.hasTimestamp){
+        		return true;
+        	}
+        	return (int32_t) (a.timestamp - b.timestamp) <= 0;
+        }
+
+        /* Merges the frames of a wakeup by acquisition time: each gyroscope sample is paired with
+         * the latest accelerometer sample acquired before it, and all accelerometer samples are
+         * published on their own topic if enabled. With a positive rate, at most one gyroscope
+         * sample per period is published. Returns true if a positioning message was published.
+         */
+        bool publishFrames(){
+        	bool published = false;
+        	size_t a = 0;
+        	for (size_t g = 0; g < framesGyro_.size(); g++){
+        		while (a < framesAccel_.size() && acquiredBefore(framesAccel_[a], framesGyro_[g])){
+        			publishAccel(framesAccel_[a++]);
+        		}
+        		// No accelerometer sample yet
+        		if (!accelReceived_){
+        			continue;
+        		}
+        		dataGyro_ = framesGyro_[g];
+        		if (rate_ > 0.0){
+        			const ros::Time stamp = sampleStamp(dataGyro_);
+        			if (stamp < nextPos_){
+        				continue;
+        			}
+        			nextPos_ = stamp + ros::Duration(1.0 / rate_);
+        		}
+        		published |= publishPos();
+        	}
+        	while (a < framesAccel_.size()){
+        		publishAccel(framesAccel_[a++]);
+        	}
+        	return published;
+        }
+
+        void publishAccel(const AxisData& sample){
+        	dataAccel_ = sample;
+        	accelReceived_ = true;
+        	if (!publishAcc_){
+        		return;
+        	}
+
+        	if (frameSize_ > 1){
+        		if (nbSamplesAcc_ == 0 && !msgAccBatch_.unique()){
+        			msgAccBatch_ = boost::make_shared<imu::ImuBatch>(*msgAccBatch_);
+        		}
+        		msgAccBatch_->stamps[nbSamplesAcc_] = sampleStamp(sample);
+        		samplesAccelOnly_[nbSamplesAcc_] = sample;
+        		nbSamplesAcc_++;
+
+        		if (nbSamplesAcc_ == frameSize_){
+        			convertAccel_->convert(&samplesAccelOnly_[0], &msgAccBatch_->linear_accelerations[0], frameSize_);
+        			msgAccBatch_->header.stamp = ros::Time::now();
+        			pubAcc_.publish(msgAccBatch_);
+        			nbSamplesAcc_ = 0;
+        		}
+        	} else{
+        		if (!msgAcc_.unique()){
+        			msgAcc_ = boost::make_shared<sensor_msgs::Imu>(*msgAcc_);
+        		}
+        		msgAcc_->header.stamp = sampleStamp(sample);
+        		convertAccel_->convert(sample, msgAcc_->linear_acceleration);
+        		pubAcc_.publish(msgAcc_);
+        	}
+        }
+
+        bool publishPos(){
+        	if (frameSize_ > 1){
+
+        		if (nbSamplesBatch_ == 0 && !msgPosBatch_.unique()){
+        			// Previous batch is still referenced by intra-process subscribers
+        			msgPosBatch_ = boost::make_shared<imu::ImuBatch>(*msgPosBatch_);
+        		}
+        		msgPosBatch_->stamps[nbSamplesBatch_] = sampleStamp(dataGyro_);
+        		samplesGyro_[nbSamplesBatch_] = dataGyro_;
+        		samplesAccel_[nbSamplesBatch_] = dataAccel_;
+        		nbSamplesBatch_++;
+
+        		if (nbSamplesBatch_ == frameSize_){
+        			// Convert the whole batch: udps to rad/sec and ug to m/s^2
+        			convertGyro_->convert(&samplesGyro_[0], &msgPosBatch_->angular_velocities[0], frameSize_);
+        			convertAccel_->convert(&samplesAccel_[0], &msgPosBatch_->linear_accelerations[0], frameSize_);
+        			msgPosBatch_->header.stamp = ros::Time::now();
+        			pubPos_.publish(msgPosBatch_);
+        			nbSamplesBatch_ = 0;
+        			return true;
+        		}
+        		return false;
+        	}
+
+        	// Positioning message
+        	if (!msgPos_.unique()){
+        		// Previous message is still referenced by intra-process subscribers
+        		msgPos_ = boost::make_shared<sensor_msgs::Imu>(*msgPos_);
+        	}
+        	msgPos_->header.stamp = sampleStamp(dataGyro_);
+
+        	// Convert from udps to rad/sec and from ug to m/s^2
+        	convertGyro_->convert(dataGyro_, msgPos_->angular_velocity);
+        	convertAccel_->convert(dataAccel_, msgPos_->linear_acceleration);
+
+        	pubPos_.publish(msgPos_);
+        	return true;
+        }
+
+        bool spin() {
+
+        	ros::Rate rate(0.0);
+			if (rate_ > 0.0){
+				rate = ros::Rate(rate_);
+			}
+
+            while (node_.ok()) {
+
+            	framesAccel_.clear();
+            	framesGyro_.clear();
+            	if (useRing_){
+            		waitRing();
+            	}else{
+            		waitEvents();
+            	}
+
+            	// Sleeping would let the devices overrun while every accelerometer sample is published
+            	if (publishFrames() && rate_ > 0.0 && !publishAcc_){
+            		rate.sleep();
+            	}
+            }
+            return true;
+        }
+};
+
+} // namespace imu
+
+#endif // IMU_CAPTURE_ACC_GYRO_H
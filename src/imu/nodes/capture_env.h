@@ -0,0 +1,318 @@
+/******************************************************************************
+ * 
+ * Copyright (c) 2016, Simon Brodeur
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ * 
+ *  - Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ *  - Neither the name of the NECOTIS research group nor the names of its contributors 
+ *    may be used to endorse or promote products derived from this software 
+ *    without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND 
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED 
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. 
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, 
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT 
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, 
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef IMU_CAPTURE_ENV_H
+#define IMU_CAPTURE_ENV_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <stdexcept>
+#include <ros/ros.h>
+#include <ros/console.h>
+#include <boost/make_shared.hpp>
+#include <sensor_msgs/FluidPressure.h>
+#include <sensor_msgs/Temperature.h>
+#include <imu/FluidPressureBatch.h>
+#include <imu/TemperatureBatch.h>
+
+// Maximum conversion times of the BMP180 (in sec), see datasheet table 8.
+// Pressure times are indexed by the oversampling setting.
+#define BMP180_TEMP_CONVERSION_TIME	0.0045
+static const double BMP180_PRESSURE_CONVERSION_TIME[4] = {0.0045, 0.0075, 0.0135, 0.0255};
+
+namespace imu {
+
+/* Combined sampler for the barometer and thermometer of the BMP180.
+ * Every read of the sysfs attributes triggers a blocking I2C conversion in the bmp085 driver,
+ * so both are scheduled on a single timeline: the conversions never overlap, the thread sleeps
+ * between them, and the pressure rate is bounded by the conversion times of the chip.
+ * Reading the temperature at least twice per second also keeps the driver from inserting
+ * its own temperature conversions before pressure reads.
+ */
+class EnvCaptureNode {
+
+    public:
+        ros::NodeHandle node_;
+        ros::Publisher pubPres_;
+        ros::Publisher pubTemp_;
+        std::string outputPres_;
+        std::string outputTemp_;
+        std::string deviceDir_;
+        double presRate_;
+        double tempRate_;
+        int oversampling_;
+        int frameSize_;
+        int tempFrameSize_;
+
+        int fdPres_;
+        int fdTemp_;
+
+        sensor_msgs::FluidPressurePtr msgPres_;
+        imu::FluidPressureBatchPtr msgPresBatch_;
+        int nbPresBatch_;
+        sensor_msgs::TemperaturePtr msgTemp_;
+        imu::TemperatureBatchPtr msgTempBatch_;
+        int nbTempBatch_;
+
+        EnvCaptureNode(const ros::NodeHandle& node = ros::NodeHandle("~")) : node_(node),
+                fdPres_(-1), fdTemp_(-1), nbPresBatch_(0), nbTempBatch_(0) {
+
+            node_.param("device_dir", deviceDir_, std::string("/sys/bus/i2c/drivers/bmp085/2-0077"));
+            node_.param("output_pressure", outputPres_, std::string("/imu/pressure"));
+            node_.param("output_temp", outputTemp_, std::string("/imu/temp"));
+            node_.param("pressure_rate", presRate_, 20.0);
+            node_.param("temp_rate", tempRate_, 2.0);
+            node_.param("oversampling", oversampling_, -1);
+            node_.param("frame_size", frameSize_, 1);
+            node_.param("temp_frame_size", tempFrameSize_, 1);
+
+            if (oversampling_ >= 0){
+                writeOversampling(std::min(oversampling_, 3));
+            }
+            oversampling_ = readOversampling();
+
+            // Keep the total conversion time within the sampling period
+            const double tempBusy = tempRate_ * BMP180_TEMP_CONVERSION_TIME;
+            const double presTime = BMP180_PRESSURE_CONVERSION_TIME[oversampling_];
+            if (presRate_ > 0.0 && tempBusy + presRate_ * presTime > 1.0){
+                double maxRate = std::max(0.0, (1.0 - tempBusy) / presTime);
+                ROS_WARN("Pressure rate %.1f Hz exceeds the conversion time of the sensor (oversampling %d): limited to %.1f Hz",
+                         presRate_, oversampling_, maxRate);
+                presRate_ = maxRate;
+            }
+
+            if (presRate_ > 0.0){
+                fdPres_ = openAttribute("pressure0_input");
+                if (frameSize_ > 1){
+                    msgPresBatch_ = boost::make_shared<imu::FluidPressureBatch>();
+                    msgPresBatch_->header.frame_id = "imu_link";
+                    msgPresBatch_->stamps.resize(frameSize_);
+                    msgPresBatch_->fluid_pressures.resize(frameSize_);
+                    pubPres_ = node_.advertise<imu::FluidPressureBatch>(outputPres_, 20);
+                }else{
+                    msgPres_ = boost::make_shared<sensor_msgs::FluidPressure>();
+                    msgPres_->header.frame_id = "imu_link";
+                    pubPres_ = node_.advertise<sensor_msgs::FluidPressure>(outputPres_, 20);
+                }
+            }
+
+            if (tempRate_ > 0.0){
+                try {
+                    fdTemp_ = openAttribute("temp0_input");
+                } catch (...) {
+                    // The destructor is not called when the constructor throws
+                    if (fdPres_ >= 0){
+                        close(fdPres_);
+                    }
+                    throw;
+                }
+                if (tempFrameSize_ > 1){
+                    msgTempBatch_ = boost::make_shared<imu::TemperatureBatch>();
+                    msgTempBatch_->header.frame_id = "imu_link";
+                    msgTempBatch_->stamps.resize(tempFrameSize_);
+                    msgTempBatch_->temperatures.resize(tempFrameSize_);
+                    pubTemp_ = node_.advertise<imu::TemperatureBatch>(outputTemp_, 10);
+                }else{
+                    msgTemp_ = boost::make_shared<sensor_msgs::Temperature>();
+                    msgTemp_->header.frame_id = "imu_link";
+                    pubTemp_ = node_.advertise<sensor_msgs::Temperature>(outputTemp_, 10);
+                }
+            }
+
+            printf("Reading from barometer:\n");
+            printf("device directory = %s\n", deviceDir_.c_str());
+            printf("oversampling = %d\n", oversampling_);
+            printf("pressure rate = %.1f Hz, temperature rate = %.1f Hz\n", presRate_, tempRate_);
+        }
+
+        virtual ~EnvCaptureNode() {
+            if (fdPres_ >= 0){
+                close(fdPres_);
+            }
+            if (fdTemp_ >= 0){
+                close(fdTemp_);
+            }
+        }
+
+        int openAttribute(const std::string& name){
+            std::string path = deviceDir_ + "/" + name;
+            int fd = open(path.c_str(), O_RDONLY);
+            if (fd == -1) {
+                throw std::runtime_error(path + " is not a valid device");
+            }
+            return fd;
+        }
+
+        // Each pread at offset 0 makes sysfs call the show() handler again, i.e. one conversion
+        bool readAttribute(int fd, long& value){
+            char buf[32];
+            ssize_t size = pread(fd, buf, sizeof(buf) - 1, 0);
+            if (size <= 0){
+                ROS_WARN_THROTTLE(1, "Could not read barometer attribute: %s", strerror(size < 0 ? errno : EIO));
+                return false;
+            }
+            buf[size] = '\0';
+            char* end;
+            value = strtol(buf, &end, 10);
+            return end != buf;
+        }
+
+        int readOversampling(){
+            long value = 1;
+            int fd = openAttribute("oversampling");
+            readAttribute(fd, value);
+            close(fd);
+            return std::max(0L, std::min(value, 3L));
+        }
+
+        void writeOversampling(int oversampling){
+            std::string path = deviceDir_ + "/oversampling";
+            int fd = open(path.c_str(), O_WRONLY);
+            char buf[4];
+            int len = snprintf(buf, sizeof(buf), "%d", oversampling);
+            if (fd == -1 || write(fd, buf, len) != len){
+                ROS_WARN("Could not set the barometer oversampling (%s)", path.c_str());
+            }
+            if (fd != -1){
+                close(fd);
+            }
+        }
+
+        void samplePressure(){
+            long value;
+            ros::Time start = ros::Time::now();
+            if (!readAttribute(fdPres_, value)){
+                return;
+            }
+            // Stamp at the middle of the conversion
+            ros::Time stamp = start + (ros::Time::now() - start) * 0.5;
+
+            // NOTE: the driver reports the pressure in Pascals
+            if (frameSize_ > 1){
+                if (nbPresBatch_ == 0 && !msgPresBatch_.unique()){
+                    // Previous batch is still referenced by intra-process subscribers
+                    msgPresBatch_ = boost::make_shared<imu::FluidPressureBatch>(*msgPresBatch_);
+                }
+                msgPresBatch_->stamps[nbPresBatch_] = stamp;
+                msgPresBatch_->fluid_pressures[nbPresBatch_] = value;
+                nbPresBatch_++;
+
+                if (nbPresBatch_ == frameSize_){
+                    msgPresBatch_->header.stamp = ros::Time::now();
+                    pubPres_.publish(msgPresBatch_);
+                    nbPresBatch_ = 0;
+                }
+            }else{
+                if (!msgPres_.unique()){
+                    // Previous message is still referenced by intra-process subscribers
+                    msgPres_ = boost::make_shared<sensor_msgs::FluidPressure>(*msgPres_);
+                }
+                msgPres_->header.stamp = stamp;
+                msgPres_->fluid_pressure = value;
+                pubPres_.publish(msgPres_);
+            }
+        }
+
+        void sampleTemperature(){
+            long value;
+            ros::Time start = ros::Time::now();
+            if (!readAttribute(fdTemp_, value)){
+                return;
+            }
+            ros::Time stamp = start + (ros::Time::now() - start) * 0.5;
+
+            // NOTE: the driver reports the temperature in tenths of degree Celsius
+            if (tempFrameSize_ > 1){
+                if (nbTempBatch_ == 0 && !msgTempBatch_.unique()){
+                    msgTempBatch_ = boost::make_shared<imu::TemperatureBatch>(*msgTempBatch_);
+                }
+                msgTempBatch_->stamps[nbTempBatch_] = stamp;
+                msgTempBatch_->temperatures[nbTempBatch_] = value / 10.0;
+                nbTempBatch_++;
+
+                if (nbTempBatch_ == tempFrameSize_){
+                    msgTempBatch_->header.stamp = ros::Time::now();
+                    pubTemp_.publish(msgTempBatch_);
+                    nbTempBatch_ = 0;
+                }
+            }else{
+                if (!msgTemp_.unique()){
+                    msgTemp_ = boost::make_shared<sensor_msgs::Temperature>(*msgTemp_);
+                }
+                msgTemp_->header.stamp = stamp;
+                msgTemp_->temperature = value / 10.0;
+                pubTemp_.publish(msgTemp_);
+            }
+        }
+
+        bool spin() {
+
+            if (presRate_ <= 0.0 && tempRate_ <= 0.0){
+                ROS_WARN("Both pressure and temperature sampling are disabled");
+                return false;
+            }
+
+            // Temperature is sampled first, so that the first pressure is compensated with it
+            const ros::WallDuration presPeriod(presRate_ > 0.0 ? 1.0 / presRate_ : 0.0);
+            const ros::WallDuration tempPeriod(tempRate_ > 0.0 ? 1.0 / tempRate_ : 0.0);
+            ros::WallTime nextPres = ros::WallTime::now();
+            ros::WallTime nextTemp = nextPres;
+
+            while (node_.ok()) {
+
+                bool temp = tempRate_ > 0.0 && (presRate_ <= 0.0 || nextTemp <= nextPres);
+                ros::WallTime& deadline = temp ? nextTemp : nextPres;
+                ros::WallTime::sleepUntil(deadline);
+
+                if (temp){
+                    sampleTemperature();
+                }else{
+                    samplePressure();
+                }
+
+                // Skip missed slots instead of bursting to catch up
+                const ros::WallDuration& period = temp ? tempPeriod : presPeriod;
+                deadline += period;
+                ros::WallTime now = ros::WallTime::now();
+                if (deadline < now){
+                    deadline = now + period;
+                }
+            }
+            return true;
+        }
+};
+
+} // namespace imu
+
+#endif // IMU_CAPTURE_ENV_H
@@ -0,0 +1,436 @@
+/******************************************************************************
+ * 
+ * Copyright (c) 2014, Simon Brodeur
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ * 
+ *  - Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ *  - Neither the name of the NECOTIS research group nor the names of its contributors 
+ *    may be used to endorse or promote products derived from this software 
+ *    without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND 
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED 
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. 
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, 
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT 
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, 
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef IMU_CAPTURE_MAG_H
+#define IMU_CAPTURE_MAG_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <iostream>
+#include <stdexcept>
+#include <linux/input.h>
+#include <sys/ioctl.h>
+#include <ros/ros.h>
+#include <ros/console.h>
+#include <boost/make_shared.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <geometry_msgs/Quaternion.h>
+#include <geometry_msgs/Vector3.h>
+#include <sensor_msgs/MagneticField.h>
+#include <imu/MagneticFieldBatch.h>
+#include <imu/mag_calibrator.h>
+
+#include "axis_data.h"
+#include "ring_reader.h"
+#include "sensor_conversion.h"
+
+namespace imu {
+
+class MagCaptureNode {
+
+    public:
+        ros::NodeHandle node_;
+        ros::Publisher pubMag_;
+        std::string outputMag_;
+        std::string deviceMag_;
+        bool useRing_;
+        std::string ringMag_;
+        double rate_;
+        bool calibrate_;
+        int frameSize_;
+
+        // Online hard/soft-iron calibration
+        bool onlineCalibration_;
+        std::string calibrationFile_;
+        int calibrationFitInterval_;
+        double calibrationSavePeriod_;
+        MagCalibrator calibrator_;
+        bool calibrationValid_;
+        int nbSamplesSinceFit_;
+        ros::WallTime lastCalibrationSave_;
+
+        AxisData dataMag_;
+        std::vector<AxisData> samplesMag_;
+        std::string axesMag_;
+        boost::scoped_ptr<VectorConverter> convertMag_;
+
+        sensor_msgs::MagneticFieldPtr msgMag_;
+        imu::MagneticFieldBatchPtr msgMagBatch_;
+        int nbSamplesBatch_;
+
+        int fdMag_;
+        RingReader readerMag_;
+        uint64_t ringLossesMag_;
+
+        MagCaptureNode(const ros::NodeHandle& node = ros::NodeHandle("~")) : node_(node),
+        		msgMag_(boost::make_shared<sensor_msgs::MagneticField>()),
+        		msgMagBatch_(boost::make_shared<imu::MagneticFieldBatch>()),
+        		ringLossesMag_(0){
+
+        	node_.param("output", outputMag_, std::string("/imu/mag"));
+        	node_.param("device", deviceMag_, std::string("/dev/lsm303d_mag"));
+        	node_.param("use_ring", useRing_, false);
+        	node_.param("ring", ringMag_, std::string("/dev/lsm303d_mag_ring"));
+        	node_.param("rate", rate_, 0.0);
+        	node_.param("calibrate", calibrate_, false);
+        	node_.param("frame_size", frameSize_, 1);
+        	// NOTE: using standard axis orientation, see http://www.ros.org/reps/rep-0103.html
+        	// NOTE: inverted x and y axis intentional since lsm303d and l3dg20 were not using same axis reference on IMU board.
+        	node_.param("mag_axes", axesMag_, std::string("y,-x,z"));
+
+        	convertMag_.reset(makeVectorConverter<MagScale>(axesMag_));
+        	if (!convertMag_) {
+        		throw std::runtime_error("Unsupported magnetometer axes \"" + axesMag_ + "\"");
+        	}
+
+        	std::string calibrationModel;
+        	double forgetting, minSpacing, minSamples, maxAxisRatio;
+        	node_.param("online_calibration", onlineCalibration_, false);
+        	node_.param("calibration_file", calibrationFile_, defaultCalibrationFile());
+        	node_.param("calibration_model", calibrationModel, std::string("ellipsoid"));
+        	node_.param("calibration_forgetting", forgetting, 0.999);
+        	node_.param("calibration_min_spacing", minSpacing, 0.05);
+        	node_.param("calibration_min_samples", minSamples, 100.0);
+        	node_.param("calibration_max_axis_ratio", maxAxisRatio, 2.0);
+        	node_.param("calibration_fit_interval", calibrationFitInterval_, 50);
+        	node_.param("calibration_save_period", calibrationSavePeriod_, 60.0);
+
+        	// Adapted from: http://stackoverflow.com/questions/28841139/how-to-get-coordinates-of-touchscreen-rawdata-using-linux
+
+			fdMag_ = -1;
+			if (useRing_){
+				/* Open magnetometer sample ring */
+				if (!readerMag_.open(ringMag_)) {
+					throw std::runtime_error(ringMag_ + " is not a valid device");
+				}
+				printf("Reading from magnetometer:\n");
+				printf("ring file = %s\n", ringMag_.c_str());
+			}else{
+				/* Open magnetometer device */
+				fdMag_ = open(deviceMag_.c_str(), O_RDONLY);
+				if (fdMag_ == -1) {
+					throw std::runtime_error(deviceMag_ + " is not a valid device");
+				}
+
+				/* Print magnetometer device name */
+				char nameMag[256] = "Unknown";
+				ioctl(fdMag_, EVIOCGNAME(sizeof(nameMag)), nameMag);
+				printf("Reading from magnetometer:\n");
+				printf("device file = %s\n", deviceMag_.c_str());
+				printf("device name = %s\n", nameMag);
+			}
+
+			if (calibrate_){
+				printf("calibration = true\n");
+			}else{
+				printf("calibration = false\n");
+			}
+
+			calibrationValid_ = false;
+			nbSamplesSinceFit_ = 0;
+			if (onlineCalibration_){
+				if (calibrationModel == "planar"){
+					calibrator_.setModel(MAG_CALIBRATION_PLANAR);
+				}else if (calibrationModel != "ellipsoid"){
+					ROS_WARN("Unknown calibration model '%s', using ellipsoid", calibrationModel.c_str());
+				}
+				calibrator_.setForgetting(forgetting);
+				calibrator_.setMinSpacing(minSpacing);
+				calibrator_.setMinSamples(minSamples);
+				calibrator_.setMaxAxisRatio(maxAxisRatio);
+
+				// Start from the last persisted calibration, if any
+				if (!calibrationFile_.empty() && calibrator_.load(calibrationFile_)){
+					calibrationValid_ = true;
+					printf("online calibration = %s (loaded from %s)\n", calibrationModel.c_str(), calibrationFile_.c_str());
+				}else{
+					printf("online calibration = %s\n", calibrationModel.c_str());
+				}
+				lastCalibrationSave_ = ros::WallTime::now();
+			}
+
+			/*
+			    lms303_.setMagDataRate(DR_MAG_100HZ);
+                lms303_.setMagScale(SCALE_MAG_2gauss);
+			 */
+
+			nbSamplesBatch_ = 0;
+			if (frameSize_ > 1){
+				samplesMag_.resize(frameSize_);
+				msgMagBatch_->stamps.resize(frameSize_);
+				msgMagBatch_->magnetic_fields.resize(frameSize_);
+				msgMagBatch_->header.frame_id = "imu_link";
+
+				pubMag_ = node_.advertise<imu::MagneticFieldBatch>(outputMag_, 10);
+			}else{
+				msgMag_->header.frame_id = "imu_link";
+
+				pubMag_ = node_.advertise<sensor_msgs::MagneticField>(outputMag_, 10);
+			}
+        }
+
+        virtual ~MagCaptureNode() {
+        	saveCalibration();
+        	if (fdMag_ != -1){
+        		close(fdMag_);
+        	}
+        }
+
+        static std::string defaultCalibrationFile(){
+        	const char* rosHome = getenv("ROS_HOME");
+        	if (rosHome != NULL){
+        		return std::string(rosHome) + "/mag_calibration.yaml";
+        	}
+        	const char* home = getenv("HOME");
+        	if (home != NULL){
+        		return std::string(home) + "/.ros/mag_calibration.yaml";
+        	}
+        	return std::string();
+        }
+
+        void saveCalibration(){
+        	if (onlineCalibration_ && calibrator_.isFitted() && !calibrationFile_.empty()){
+        		if (!calibrator_.save(calibrationFile_)){
+        			ROS_WARN("Unable to save magnetometer calibration to %s", calibrationFile_.c_str());
+        		}
+        	}
+        	lastCalibrationSave_ = ros::WallTime::now();
+        }
+
+        void applyCalibration(geometry_msgs::Vector3& magnetic_field){
+        	if (!onlineCalibration_){
+        		if (calibrate_){
+        			applyMagneticCorrection(magnetic_field);
+        		}
+        		return;
+        	}
+
+        	// The raw sample feeds the fit, the published field uses the latest accepted calibration
+        	if (calibrator_.addSample(magnetic_field.x, magnetic_field.y, magnetic_field.z)){
+        		nbSamplesSinceFit_++;
+        		if (nbSamplesSinceFit_ >= calibrationFitInterval_){
+        			nbSamplesSinceFit_ = 0;
+        			if (calibrator_.fit()){
+        				calibrationValid_ = true;
+        			}
+        		}
+        	}
+        	if (calibrationValid_){
+        		calibrator_.apply(magnetic_field.x, magnetic_field.y, magnetic_field.z);
+        	}
+
+        	if (calibrationSavePeriod_ > 0.0 && (ros::WallTime::now() - lastCalibrationSave_).toSec() > calibrationSavePeriod_){
+        		saveCalibration();
+        	}
+        }
+
+        bool waitMag(){
+        	struct input_event ev;
+        	const size_t ev_size = sizeof(struct input_event);
+			ssize_t size;
+
+			bool dataReady = false;
+			size = read(fdMag_, &ev, ev_size);
+			if (size < ev_size) {
+				fprintf(stderr, "Error size when reading\n");
+			}else{
+				if (ev.type == EV_ABS && (ev.code == ABS_X || ev.code == ABS_Y || ev.code == ABS_Z)) {
+
+					// ev.value are in uG
+					switch(ev.code) {
+						case ABS_X : dataMag_.x = ev.value;
+							break;
+						case ABS_Y : dataMag_.y = ev.value;
+							break;
+						case ABS_Z : dataMag_.z = ev.value;
+							break;
+					}
+				}else if (ev.type == EV_SYN){
+					dataReady = true;
+				}
+			}
+			return dataReady;
+        }
+
+        bool waitRing(){
+        	if (!readerMag_.available()){
+        		readerMag_.wait(100);
+        	}
+        	const bool dataReady = readerMag_.next(dataMag_);
+
+        	if (readerMag_.dropped() + readerMag_.overruns() != ringLossesMag_){
+        		ringLossesMag_ = readerMag_.dropped() + readerMag_.overruns();
+        		ROS_WARN_THROTTLE(1.0, "Magnetometer samples lost, %llu overwritten in the ring and %llu device fifo overruns (since the start)",
+        				(unsigned long long) readerMag_.dropped(), (unsigned long long) readerMag_.overruns());
+        	}
+        	return dataReady;
+        }
+
+        void applyMagneticCorrection(geometry_msgs::Vector3& magnetic_field){
+
+			//Correction constants
+			const float magRotz[3][3] = { {        1.0,        0.0, -0.07321487  } ,
+										  {        0.0,        1.0, -0.00444791  } ,
+										  {0.07901695 , 0.00446781,        1.0  } };
+
+			const float magRotxy[3][3] = { { 0.76908318 ,-0.6391487 ,       0.0  } ,
+										   { 0.6391487  , 0.76908318,       0.0  } ,
+										   {        0.0,        0.0 ,       1.0  } };
+			const float magFacxy[2] = { 1.07176589 , 0.9372419};
+
+			const float xOffset = 0.000010176;
+			const float yOffset = 0.00004176;
+			const float zOffset = -0.000029264;
+
+            float temp_mag_field_x = 0.0;
+            float temp_mag_field_y = 0.0;
+            float temp_mag_field_z = 0.0;
+
+			
+            float temp_mag_field_soft_x = 0.0;
+            float temp_mag_field_soft_y = 0.0;
+            float temp_mag_field_soft_z = 0.0;
+            
+            //Apply centering offsets (hard-iron correction)
+			magnetic_field.x -= xOffset;
+			magnetic_field.y -= yOffset;
+			magnetic_field.z -= zOffset;
+
+			
+            
+            //Apply bank correction
+			temp_mag_field_x = magRotz[0][0]*magnetic_field.x +
+							   magRotz[0][1]*magnetic_field.y +
+							   magRotz[0][2]*magnetic_field.z  ;
+			temp_mag_field_y = magRotz[1][0]*magnetic_field.x +
+							   magRotz[1][1]*magnetic_field.y +
+							   magRotz[1][2]*magnetic_field.z  ;
+			temp_mag_field_z = magRotz[2][0]*magnetic_field.x +
+							   magRotz[2][1]*magnetic_field.y +
+							   magRotz[2][2]*magnetic_field.z  ;
+
+			//Apply soft-iron correction
+			temp_mag_field_soft_x = magRotxy[0][0]*temp_mag_field_x +
+								    magRotxy[0][1]*temp_mag_field_y +
+							        magRotxy[0][2]*temp_mag_field_z  ;
+			temp_mag_field_soft_y = magRotxy[1][0]*temp_mag_field_x +
+								    magRotxy[1][1]*temp_mag_field_y +
+								    magRotxy[1][2]*temp_mag_field_z  ;
+			temp_mag_field_soft_z = magRotxy[2][0]*temp_mag_field_x +
+								    magRotxy[2][1]*temp_mag_field_y +
+								    magRotxy[2][2]*temp_mag_field_z  ;
+
+			temp_mag_field_soft_x *= magFacxy[0];
+			temp_mag_field_soft_y *= magFacxy[1];
+
+			magnetic_field.x = magRotxy[0][0]*temp_mag_field_soft_x +
+							   magRotxy[1][0]*temp_mag_field_soft_y +
+							   magRotxy[2][0]*temp_mag_field_soft_z  ;
+			magnetic_field.y = magRotxy[0][1]*temp_mag_field_soft_x +
+							   magRotxy[1][1]*temp_mag_field_soft_y +
+							   magRotxy[2][1]*temp_mag_field_soft_z  ;
+			magnetic_field.z = magRotxy[0][2]*temp_mag_field_soft_x +
+							   magRotxy[1][2]*temp_mag_field_soft_y +
+							   magRotxy[2][2]*temp_mag_field_soft_z  ;
+		}
+
+        bool spin() {
+
+        	bool magDataReady;
+
+        	ros::Rate rate(0.0);
+        	if (rate_ > 0.0){
+        		rate = ros::Rate(rate_);
+        	}
+
+        	bool published = false;
+        	while (node_.ok()) {
+                
+            	magDataReady = false;
+            	if (useRing_){
+            		if (!waitRing()){
+            			continue;
+            		}
+            	}else{
+            		while (!magDataReady){
+            			magDataReady = waitMag();
+            		}
+            	}
+
+            	if (frameSize_ > 1){
+					if (nbSamplesBatch_ == 0 && !msgMagBatch_.unique()){
+						// Previous batch is still referenced by intra-process subscribers
+						msgMagBatch_ = boost::make_shared<imu::MagneticFieldBatch>(*msgMagBatch_);
+					}
+					msgMagBatch_->stamps[nbSamplesBatch_] = sampleStamp(dataMag_);
+
+					samplesMag_[nbSamplesBatch_] = dataMag_;
+					nbSamplesBatch_++;
+
+					if (nbSamplesBatch_ == frameSize_){
+						// Convert the whole batch from ugauss to Tesla
+						convertMag_->convert(&samplesMag_[0], &msgMagBatch_->magnetic_fields[0], frameSize_);
+						for (unsigned int i=0; i<frameSize_; i++){
+							applyCalibration(msgMagBatch_->magnetic_fields[i]);
+						}
+						msgMagBatch_->header.stamp = ros::Time::now();
+						pubMag_.publish(msgMagBatch_);
+						nbSamplesBatch_ = 0;
+						published = true;
+					}
+				} else{
+
+					if (!msgMag_.unique()){
+						// Previous message is still referenced by intra-process subscribers
+						msgMag_ = boost::make_shared<sensor_msgs::MagneticField>(*msgMag_);
+					}
+					msgMag_->header.stamp = sampleStamp(dataMag_);
+
+					// Convert from ugauss to Tesla
+					convertMag_->convert(dataMag_, msgMag_->magnetic_field);
+
+					applyCalibration(msgMag_->magnetic_field);
+					pubMag_.publish(msgMag_);
+					published = true;
+				}
+
+            	if (rate_ > 0.0 && published){
+            		rate.sleep();
+            		published = false;
+            	}
+            }
+            return true;
+        }
+};
+
+} // namespace imu
+
+#endif // IMU_CAPTURE_MAG_H
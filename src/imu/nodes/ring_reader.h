@@ -0,0 +1,219 @@
+/******************************************************************************
+ * 
+ * Copyright (c) 2016, Simon Brodeur
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ * 
+ *  - Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ *  - Neither the name of the NECOTIS research group nor the names of its contributors 
+ *    may be used to endorse or promote products derived from this software 
+ *    without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND 
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED 
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. 
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, 
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT 
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, 
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef IMU_RING_READER_H
+#define IMU_RING_READER_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <string>
+
+#include <imu/imu_ring.h>
+
+#include "axis_data.h"
+
+namespace imu {
+
+/* Reader of the sample ring exported by the IMU drivers (e.g. /dev/lsm303d_acc_ring).
+ * Records are copied directly from the shared mapping: a single read() acknowledges all
+ * the records written since the previous one, instead of four input events per sample.
+ */
+class RingReader {
+
+    public:
+        RingReader() : fd_(-1), map_(MAP_FAILED), mapSize_(0), header_(NULL), records_(NULL),
+        		mask_(0), tail_(0), dropped_(0), overruns_(0) {}
+
+        virtual ~RingReader() {
+        	close();
+        }
+
+        bool open(const std::string& device){
+        	close();
+        	fd_ = ::open(device.c_str(), O_RDONLY | O_NONBLOCK);
+        	if (fd_ == -1) {
+        		return false;
+        	}
+
+        	// Map the header first, to get the size of the ring
+        	const size_t pageSize = sysconf(_SC_PAGESIZE);
+        	void* map = mmap(NULL, pageSize, PROT_READ, MAP_SHARED, fd_, 0);
+        	if (map == MAP_FAILED) {
+        		close();
+        		return false;
+        	}
+        	const struct imu_ring_header header = *((const struct imu_ring_header*) map);
+        	munmap(map, pageSize);
+        	if (header.magic != IMU_RING_MAGIC || header.version != IMU_RING_VERSION ||
+        			header.record_size != sizeof(struct imu_ring_record) ||
+        			header.capacity == 0 || (header.capacity & (header.capacity - 1)) != 0) {
+        		fprintf(stderr, "%s is not a valid sample ring\n", device.c_str());
+        		close();
+        		return false;
+        	}
+
+        	mapSize_ = header.data_offset + header.capacity * header.record_size;
+        	map_ = mmap(NULL, mapSize_, PROT_READ, MAP_SHARED, fd_, 0);
+        	if (map_ == MAP_FAILED) {
+        		close();
+        		return false;
+        	}
+        	header_ = (const volatile struct imu_ring_header*) map_;
+        	records_ = (const volatile struct imu_ring_record*) ((const char*) map_ + header.data_offset);
+        	mask_ = header.capacity - 1;
+
+        	// Only the records written from now on are read
+        	tail_ = header_->head;
+        	return true;
+        }
+
+        void close(){
+        	if (map_ != MAP_FAILED) {
+        		munmap(map_, mapSize_);
+        		map_ = MAP_FAILED;
+        	}
+        	if (fd_ != -1) {
+        		::close(fd_);
+        		fd_ = -1;
+        	}
+        	header_ = NULL;
+        	records_ = NULL;
+        }
+
+        bool isOpen() const {
+        	return header_ != NULL;
+        }
+
+        /* Wait until records are available, or until the timeout (in ms) expires.
+         */
+        bool wait(const int timeoutMs){
+        	if (available()) {
+        		return true;
+        	}
+        	struct pollfd pfd;
+        	pfd.fd = fd_;
+        	pfd.events = POLLIN;
+        	pfd.revents = 0;
+        	if (poll(&pfd, 1, timeoutMs) <= 0) {
+        		return false;
+        	}
+        	// Acknowledge the wakeup, so that the next poll() blocks until new records are written
+        	uint32_t head;
+        	if (read(fd_, &head, sizeof(head)) < 0 && errno != EAGAIN) {
+        		return false;
+        	}
+        	return available();
+        }
+
+        bool available() const {
+        	return header_->head != tail_;
+        }
+
+        /* Copy the next record, if any. Samples overwritten before they could be read are
+         * counted in dropped().
+         */
+        bool next(AxisData& data, uint64_t* timestampNs = NULL){
+        	while (true) {
+        		const uint32_t head = header_->head;
+        		if (head == tail_) {
+        			return false;
+        		}
+        		if (head - tail_ > mask_) {
+        			// The writer lapped the reader: skip to the oldest record that is not being rewritten
+        			dropped_ += head - tail_ - mask_;
+        			tail_ = head - mask_;
+        		}
+        		// Read the record only after the head that published it
+        		__sync_synchronize();
+
+        		const volatile struct imu_ring_record& rec = records_[tail_ & mask_];
+        		const uint64_t timestamp = rec.timestamp;
+        		const int32_t x = rec.x;
+        		const int32_t y = rec.y;
+        		const int32_t z = rec.z;
+        		const uint32_t flags = rec.flags;
+
+        		// Check that the slot was not reused while being copied
+        		__sync_synchronize();
+        		if (header_->head - tail_ > mask_) {
+        			dropped_++;
+        			tail_++;
+        			continue;
+        		}
+        		tail_++;
+
+        		if (flags & IMU_RING_FLAG_OVERRUN) {
+        			overruns_++;
+        		}
+        		data.x = x;
+        		data.y = y;
+        		data.z = z;
+        		data.timestamp = (uint32_t) (timestamp / 1000);
+        		data.hasTimestamp = true;
+        		if (timestampNs != NULL) {
+        			*timestampNs = timestamp;
+        		}
+        		return true;
+        	}
+        }
+
+        /* Number of records overwritten in the ring before they could be read */
+        uint64_t dropped() const {
+        	return dropped_;
+        }
+
+        /* Number of device fifo overruns reported by the driver */
+        uint64_t overruns() const {
+        	return overruns_;
+        }
+
+    private:
+        int fd_;
+        void* map_;
+        size_t mapSize_;
+        const volatile struct imu_ring_header* header_;
+        const volatile struct imu_ring_record* records_;
+        uint32_t mask_;
+        uint32_t tail_;
+        uint64_t dropped_;
+        uint64_t overruns_;
+
+        // Non-copyable: owns the mapping
+        RingReader(const RingReader&);
+        RingReader& operator=(const RingReader&);
+};
+
+} // namespace imu
+
+#endif // IMU_RING_READER_H
@@ -0,0 +1,209 @@
+/******************************************************************************
+ * 
+ * Copyright (c) 2016, Simon Brodeur
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ * 
+ *  - Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ *  - Neither the name of the NECOTIS research group nor the names of its contributors 
+ *    may be used to endorse or promote products derived from this software 
+ *    without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND 
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED 
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. 
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, 
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT 
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, 
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef IMU_SENSOR_CONVERSION_H
+#define IMU_SENSOR_CONVERSION_H
+
+#include <cmath>
+#include <string>
+#include <vector>
+#include <boost/algorithm/string.hpp>
+#include <geometry_msgs/Vector3.h>
+
+#include "axis_data.h"
+
+#define G_ACC   9.81
+#define PI  M_PI
+
+#define SENSITIVITY_250		8750		/*	udps/LSB */
+#define SENSITIVITY_500		17500		/*	udps/LSB */
+#define SENSITIVITY_2000	70000		/*	udps/LSB */
+
+namespace imu {
+
+/* Scale from the device unit to the SI unit published by the capture nodes.
+ */
+template <int Sensitivity>
+struct GyroScale {
+	// LSB to rad/sec
+	static inline double value() { return Sensitivity / 1000000.0 * PI / 180.0; }
+};
+
+struct AccScale {
+	// ug to m/s^2
+	static inline double value() { return G_ACC / 1000000.0; }
+};
+
+struct MagScale {
+	// ugauss to Tesla
+	static inline double value() { return 1.0 / 1000000.0 / 10000.0; }
+};
+
+/* Device axis (0 = x, 1 = y, 2 = z) and sign of an output axis.
+ */
+template <int Source, int Sign>
+struct AxisSource {
+	enum { SOURCE = Source, SIGN = Sign };
+};
+
+/* Conversion of a batch of device samples to vectors in the ROS frame.
+ * Implementations are selected once when the node starts, so that the only dispatch per batch is
+ * the virtual call.
+ */
+class VectorConverter {
+	public:
+		virtual ~VectorConverter() {}
+
+		virtual void convert(const AxisData* in, geometry_msgs::Vector3* out, const size_t n) const = 0;
+
+		inline void convert(const AxisData& in, geometry_msgs::Vector3& out) const {
+			convert(&in, &out, 1);
+		}
+};
+
+/* Scale, axis mapping and signs are template parameters: the inner loop has no branch and
+ * the axis lookups are resolved by the compiler.
+ */
+template <class Scale, class MapX, class MapY, class MapZ>
+class StaticVectorConverter : public VectorConverter {
+	public:
+		virtual void convert(const AxisData* in, geometry_msgs::Vector3* out, const size_t n) const {
+			const double sx = MapX::SIGN * Scale::value();
+			const double sy = MapY::SIGN * Scale::value();
+			const double sz = MapZ::SIGN * Scale::value();
+			for (size_t i = 0; i < n; i++){
+				const int v[3] = {in[i].x, in[i].y, in[i].z};
+				out[i].x = sx * v[MapX::SOURCE];
+				out[i].y = sy * v[MapY::SOURCE];
+				out[i].z = sz * v[MapZ::SOURCE];
+			}
+		}
+};
+
+namespace detail {
+
+template <class Scale, class MapX, class MapY, int SourceZ>
+inline VectorConverter* selectZ(const int signZ){
+	if (signZ > 0){
+		return new StaticVectorConverter<Scale, MapX, MapY, AxisSource<SourceZ, 1> >();
+	}
+	return new StaticVectorConverter<Scale, MapX, MapY, AxisSource<SourceZ, -1> >();
+}
+
+template <class Scale, class MapX, int SourceY, int SourceZ>
+inline VectorConverter* selectY(const int signY, const int signZ){
+	if (signY > 0){
+		return selectZ<Scale, MapX, AxisSource<SourceY, 1>, SourceZ>(signZ);
+	}
+	return selectZ<Scale, MapX, AxisSource<SourceY, -1>, SourceZ>(signZ);
+}
+
+template <class Scale, int SourceX, int SourceY, int SourceZ>
+inline VectorConverter* selectX(const int signX, const int signY, const int signZ){
+	if (signX > 0){
+		return selectY<Scale, AxisSource<SourceX, 1>, SourceY, SourceZ>(signY, signZ);
+	}
+	return selectY<Scale, AxisSource<SourceX, -1>, SourceY, SourceZ>(signY, signZ);
+}
+
+} // namespace detail
+
+/* Parse an axis mapping such as "y,-x,z": each entry gives the device axis (and its sign)
+ * published on the x, y and z axes of the ROS frame.
+ */
+inline bool parseAxisMapping(const std::string& mapping, int source[3], int sign[3]){
+	std::vector<std::string> axes;
+	boost::split(axes, mapping, boost::is_any_of(","));
+	if (axes.size() != 3){
+		return false;
+	}
+	bool used[3] = {false, false, false};
+	for (unsigned int i=0; i<3; i++){
+		std::string axis = boost::trim_copy(axes[i]);
+		sign[i] = 1;
+		if (!axis.empty() && (axis[0] == '-' || axis[0] == '+')){
+			sign[i] = (axis[0] == '-') ? -1 : 1;
+			axis = axis.substr(1);
+		}
+		if (axis.size() != 1 || axis[0] < 'x' || axis[0] > 'z'){
+			return false;
+		}
+		source[i] = axis[0] - 'x';
+		if (used[source[i]]){
+			return false;
+		}
+		used[source[i]] = true;
+	}
+	return true;
+}
+
+/* Create the converter for an axis mapping, or NULL if the mapping is invalid.
+ * The board is mounted flat, so only mappings that keep the z-axis on the device z-axis are
+ * instantiated (x and y can be swapped, every axis can be inverted).
+ */
+template <class Scale>
+VectorConverter* makeVectorConverter(const std::string& mapping){
+	int source[3];
+	int sign[3];
+	if (!parseAxisMapping(mapping, source, sign) || source[2] != 2){
+		return NULL;
+	}
+	if (source[0] == 0){
+		return detail::selectX<Scale, 0, 1, 2>(sign[0], sign[1], sign[2]);
+	}
+	return detail::selectX<Scale, 1, 0, 2>(sign[0], sign[1], sign[2]);
+}
+
+/* Create the gyroscope converter for a full-scale range (in dps), or NULL if the range is not
+ * supported by the L3GD20.
+ */
+inline VectorConverter* makeGyroConverter(const int range, const std::string& mapping){
+	switch (range){
+		case 250: return makeVectorConverter<GyroScale<SENSITIVITY_250> >(mapping);
+		case 500: return makeVectorConverter<GyroScale<SENSITIVITY_500> >(mapping);
+		case 2000: return makeVectorConverter<GyroScale<SENSITIVITY_2000> >(mapping);
+	}
+	return NULL;
+}
+
+/* Scale (LSB to rad/sec) of the gyroscope for a full-scale range (in dps), or 0 if the range is
+ * not supported by the L3GD20.
+ */
+inline double gyroScale(const int range){
+	switch (range){
+		case 250: return GyroScale<SENSITIVITY_250>::value();
+		case 500: return GyroScale<SENSITIVITY_500>::value();
+		case 2000: return GyroScale<SENSITIVITY_2000>::value();
+	}
+	return 0.0;
+}
+
+} // namespace imu
+
+#endif // IMU_SENSOR_CONVERSION_H
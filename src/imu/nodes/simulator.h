@@ -0,0 +1,736 @@
+/******************************************************************************
+ * 
+ * Copyright (c) 2016, Simon Brodeur
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ * 
+ *  - Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ *  - Neither the name of the NECOTIS research group nor the names of its contributors 
+ *    may be used to endorse or promote products derived from this software 
+ *    without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND 
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED 
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. 
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, 
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT 
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, 
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef IMU_SIMULATOR_H
+#define IMU_SIMULATOR_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <linux/input.h>
+#include <linux/uinput.h>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <ros/ros.h>
+#include <ros/console.h>
+#include <rosbag/bag.h>
+#include <rosbag/view.h>
+#include <boost/foreach.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/normal_distribution.hpp>
+#include <boost/random/variate_generator.hpp>
+#include <sensor_msgs/Imu.h>
+#include <sensor_msgs/MagneticField.h>
+#include <imu/ImuBatch.h>
+#include <imu/MagneticFieldBatch.h>
+
+#include "axis_data.h"
+#include "sensor_conversion.h"
+#include "capture_acc_gyro.h"
+
+// Axis ranges reported by the kernel drivers (see drivers/lsm303d/lsm303d.c and drivers/l3gd20/l3gd20.c)
+#define SIM_ACC_G_MAX_POS	1495040		/* ug */
+#define SIM_ACC_G_MAX_NEG	1495770		/* ug */
+#define SIM_MAG_G_MAX_POS	983520		/* ugauss */
+#define SIM_MAG_G_MAX_NEG	983040		/* ugauss */
+#define SIM_GYRO_FS_MAX		32768		/* LSB */
+
+namespace imu {
+
+/* Userspace input device with the same name and axis ranges as one of the kernel drivers.
+ * A symbolic link to its event node is created so that the capture nodes can open it
+ * like /dev/lsm303d_acc, /dev/lsm303d_mag or /dev/l3gd20_gyr.
+ */
+class SimulatedDevice {
+
+    public:
+        int fd_;
+        std::string name_;
+        std::string eventPath_;
+        std::string link_;
+        AxisData last_;
+        bool hasLast_;
+        int dither_;
+
+        SimulatedDevice() : fd_(-1), hasLast_(false), dither_(1) {}
+
+        virtual ~SimulatedDevice() {
+        	destroy();
+        }
+
+        bool create(const std::string& name, const int absMin, const int absMax, const std::string& link){
+        	name_ = name;
+        	fd_ = open("/dev/uinput", O_WRONLY | O_NONBLOCK);
+        	if (fd_ == -1) {
+        		fprintf(stderr, "Unable to open /dev/uinput (%s), is the uinput module loaded and writable?\n", strerror(errno));
+        		return false;
+        	}
+
+        	ioctl(fd_, UI_SET_EVBIT, EV_SYN);
+        	ioctl(fd_, UI_SET_EVBIT, EV_ABS);
+        	ioctl(fd_, UI_SET_ABSBIT, ABS_X);
+        	ioctl(fd_, UI_SET_ABSBIT, ABS_Y);
+        	ioctl(fd_, UI_SET_ABSBIT, ABS_Z);
+
+        	// Legacy setup interface, to stay compatible with older kernels
+        	struct uinput_user_dev dev;
+        	memset(&dev, 0, sizeof(dev));
+        	strncpy(dev.name, name.c_str(), UINPUT_MAX_NAME_SIZE - 1);
+        	dev.id.bustype = BUS_VIRTUAL;
+        	const int axes[3] = {ABS_X, ABS_Y, ABS_Z};
+        	for (int i = 0; i < 3; i++){
+        		dev.absmin[axes[i]] = absMin;
+        		dev.absmax[axes[i]] = absMax;
+        	}
+        	if (write(fd_, &dev, sizeof(dev)) != sizeof(dev) || ioctl(fd_, UI_DEV_CREATE) < 0) {
+        		fprintf(stderr, "Unable to create input device %s (%s)\n", name.c_str(), strerror(errno));
+        		close(fd_);
+        		fd_ = -1;
+        		return false;
+        	}
+
+        	eventPath_ = findEventNode();
+        	if (eventPath_.empty()){
+        		fprintf(stderr, "Unable to find the event node of %s, no link created\n", name.c_str());
+        	}else if (!link.empty()){
+        		unlink(link.c_str());
+        		if (symlink(eventPath_.c_str(), link.c_str()) == 0){
+        			link_ = link;
+        		}else{
+        			fprintf(stderr, "Unable to create link %s (%s)\n", link.c_str(), strerror(errno));
+        		}
+        	}
+        	printf("device name = %s\n", name.c_str());
+        	printf("device file = %s -> %s\n", link_.c_str(), eventPath_.c_str());
+        	return true;
+        }
+
+        void destroy(){
+        	if (!link_.empty()){
+        		unlink(link_.c_str());
+        		link_.clear();
+        	}
+        	if (fd_ != -1){
+        		ioctl(fd_, UI_DEV_DESTROY);
+        		close(fd_);
+        		fd_ = -1;
+        	}
+        }
+
+        std::string findEventNode(){
+#ifdef UI_GET_SYSNAME
+        	char sysname[64];
+        	if (ioctl(fd_, UI_GET_SYSNAME(sizeof(sysname)), sysname) < 0){
+        		return std::string();
+        	}
+        	const std::string sysdir = std::string("/sys/devices/virtual/input/") + sysname;
+        	DIR* dir = opendir(sysdir.c_str());
+        	if (dir == NULL){
+        		return std::string();
+        	}
+        	std::string path;
+        	struct dirent* entry;
+        	while ((entry = readdir(dir)) != NULL){
+        		if (strncmp(entry->d_name, "event", 5) == 0){
+        			path = std::string("/dev/input/") + entry->d_name;
+        			break;
+        		}
+        	}
+        	closedir(dir);
+        	return path;
+#else
+        	return std::string();
+#endif
+        }
+
+        bool emit(AxisData data){
+        	// The input core drops reports where no axis changed, which would stall the capture nodes.
+        	// Real sensors always have some noise, so dither the least significant bit instead.
+        	if (hasLast_ && data.x == last_.x && data.y == last_.y && data.z == last_.z){
+        		data.x += dither_;
+        		dither_ = -dither_;
+        	}
+        	last_ = data;
+        	hasLast_ = true;
+
+        	// Axes and report in a single write, timestamps are filled by the kernel
+        	struct input_event ev[4];
+        	memset(ev, 0, sizeof(ev));
+        	ev[0].type = EV_ABS; ev[0].code = ABS_X; ev[0].value = data.x;
+        	ev[1].type = EV_ABS; ev[1].code = ABS_Y; ev[1].value = data.y;
+        	ev[2].type = EV_ABS; ev[2].code = ABS_Z; ev[2].value = data.z;
+        	ev[3].type = EV_SYN; ev[3].code = SYN_REPORT; ev[3].value = 0;
+        	return write(fd_, ev, sizeof(ev)) == sizeof(ev);
+        }
+};
+
+/* Time series of 3-axis samples (in ROS units), linearly interpolated at arbitrary times.
+ */
+class SampleTrace {
+
+    public:
+        std::vector<double> times_;
+        std::vector<geometry_msgs::Vector3> values_;
+        size_t cursor_;
+
+        SampleTrace() : cursor_(0) {}
+
+        void add(const double& t, const geometry_msgs::Vector3& v){
+        	if (!times_.empty() && t <= times_.back()){
+        		// Drop out-of-order samples
+        		return;
+        	}
+        	times_.push_back(t);
+        	values_.push_back(v);
+        }
+
+        bool empty() const { return times_.empty(); }
+        double duration() const { return times_.empty() ? 0.0 : times_.back() - times_.front(); }
+
+        // Queries are expected in increasing time order, except when looping back to the start
+        geometry_msgs::Vector3 at(double t){
+        	t += times_.front();
+        	if (t <= times_.front()){
+        		cursor_ = 0;
+        		return values_.front();
+        	}
+        	if (t >= times_.back()){
+        		return values_.back();
+        	}
+        	if (times_[cursor_] > t){
+        		cursor_ = 0;
+        	}
+        	while (times_[cursor_ + 1] < t){
+        		cursor_++;
+        	}
+        	const double alpha = (t - times_[cursor_]) / (times_[cursor_ + 1] - times_[cursor_]);
+        	const geometry_msgs::Vector3& a = values_[cursor_];
+        	const geometry_msgs::Vector3& b = values_[cursor_ + 1];
+        	geometry_msgs::Vector3 v;
+        	v.x = a.x + alpha * (b.x - a.x);
+        	v.y = a.y + alpha * (b.y - a.y);
+        	v.z = a.z + alpha * (b.z - a.z);
+        	return v;
+        }
+};
+
+/* Simulator of the LSM303D accelerometer/magnetometer and L3GD20 gyroscope input devices.
+ * Samples are replayed from a recorded bag or generated from a synthetic trajectory, and
+ * emitted at the configured output data rate of each sensor.
+ * In benchmark mode, a sequence number is encoded in the gyroscope x-axis so that the
+ * latency and losses of the capture node can be measured on its output topic.
+ */
+class ImuSimulatorNode {
+
+    public:
+        static const int SEQ_RANGE = SIM_GYRO_FS_MAX;
+
+        ros::NodeHandle node_;
+        std::string source_;
+        std::string linkDir_;
+        double accRate_;
+        double gyroRate_;
+        double magRate_;
+
+        // Bag replay
+        std::string bagFile_;
+        std::string inputImu_;
+        std::string inputMag_;
+        bool loop_;
+        SampleTrace traceAcc_;
+        SampleTrace traceGyro_;
+        SampleTrace traceMag_;
+
+        // Synthetic trajectory
+        std::string trajectory_;
+        double yawRate_;
+        double wobbleAmplitude_;
+        double wobbleFrequency_;
+        double magNorth_;
+        double magUp_;
+        double noiseAcc_;
+        double noiseGyro_;
+        double noiseMag_;
+        boost::mt19937 rng_;
+        boost::variate_generator<boost::mt19937&, boost::normal_distribution<double> > noise_;
+
+        // Benchmark
+        bool benchmark_;
+        double duration_;
+        std::string benchmarkTopic_;
+        int frameSize_;
+        ros::Subscriber subBenchmark_;
+        boost::mutex benchmarkMutex_;
+        std::vector<double> emitTimes_;
+        std::vector<double> captureLatencies_;
+        std::vector<double> deliveryLatencies_;
+        int nbEmitted_;
+        int nbReceived_;
+        int nbMissing_;
+        int lastSeq_;
+        int nbOverruns_;
+        // Sequence numbers never emitted because the simulator skipped ahead, not lost by the capture node
+        int nbSkipped_;
+
+        // Device configuration, read from the same parameters as the capture nodes
+        int gyroRange_;
+        double gyroScale_;
+        std::string axesAccel_;
+        std::string axesGyro_;
+        std::string axesMag_;
+        int sourceAccel_[3];
+        int signAccel_[3];
+        int sourceGyro_[3];
+        int signGyro_[3];
+        int sourceMag_[3];
+        int signMag_[3];
+
+        SimulatedDevice devAcc_;
+        SimulatedDevice devGyro_;
+        SimulatedDevice devMag_;
+
+        ImuSimulatorNode(const ros::NodeHandle& node = ros::NodeHandle("~")) : node_(node),
+        		noise_(rng_, boost::normal_distribution<double>(0.0, 1.0)){
+
+        	node_.param("source", source_, std::string("synthetic"));
+        	node_.param("link_dir", linkDir_, std::string("/tmp/imu_sim"));
+        	node_.param("acc_rate", accRate_, 100.0);
+        	node_.param("gyro_rate", gyroRate_, 100.0);
+        	node_.param("mag_rate", magRate_, 100.0);
+
+        	node_.param("bag", bagFile_, std::string("input.bag"));
+        	node_.param("input_imu", inputImu_, std::string("/imu/data_raw"));
+        	node_.param("input_mag", inputMag_, std::string("/imu/mag"));
+        	node_.param("loop", loop_, true);
+
+        	node_.param("trajectory", trajectory_, std::string("wobble"));
+        	node_.param("yaw_rate", yawRate_, 0.5);
+        	node_.param("wobble_amplitude", wobbleAmplitude_, 0.2);
+        	node_.param("wobble_frequency", wobbleFrequency_, 0.5);
+        	node_.param("mag_north", magNorth_, 0.000018);
+        	node_.param("mag_up", magUp_, -0.000050);
+        	node_.param("noise_acc", noiseAcc_, 0.02);
+        	node_.param("noise_gyro", noiseGyro_, 0.002);
+        	node_.param("noise_mag", noiseMag_, 0.0000002);
+
+        	node_.param("benchmark", benchmark_, false);
+        	node_.param("duration", duration_, 10.0);
+        	node_.param("benchmark_topic", benchmarkTopic_, std::string("/imu/data_raw"));
+        	node_.param("frame_size", frameSize_, 1);
+
+        	node_.param("gyro_range", gyroRange_, 250);
+        	node_.param("gyro_axes", axesGyro_, std::string("x,y,z"));
+        	node_.param("acc_axes", axesAccel_, std::string("y,-x,z"));
+        	node_.param("mag_axes", axesMag_, std::string("y,-x,z"));
+
+        	gyroScale_ = gyroScale(gyroRange_);
+        	if (gyroScale_ <= 0.0 || !parseAxisMapping(axesGyro_, sourceGyro_, signGyro_)){
+        		fprintf(stderr, "Unsupported gyroscope range %d dps or axes \"%s\"\n", gyroRange_, axesGyro_.c_str());
+        		exit (1);
+        	}
+        	if (!parseAxisMapping(axesAccel_, sourceAccel_, signAccel_)){
+        		fprintf(stderr, "Unsupported accelerometer axes \"%s\"\n", axesAccel_.c_str());
+        		exit (1);
+        	}
+        	if (!parseAxisMapping(axesMag_, sourceMag_, signMag_)){
+        		fprintf(stderr, "Unsupported magnetometer axes \"%s\"\n", axesMag_.c_str());
+        		exit (1);
+        	}
+
+        	if (source_ == "bag"){
+        		loadBag();
+        	}else if (source_ != "synthetic"){
+        		fprintf(stderr, "Unknown source '%s' (expected 'bag' or 'synthetic')\n", source_.c_str());
+        		exit (1);
+        	}
+
+        	mkdir(linkDir_.c_str(), 0755);
+        	bool ok = true;
+        	if (accRate_ > 0.0){
+        		ok &= devAcc_.create("lsm303d_acc", -SIM_ACC_G_MAX_NEG, SIM_ACC_G_MAX_POS, linkDir_ + "/lsm303d_acc");
+        	}
+        	if (gyroRate_ > 0.0){
+        		ok &= devGyro_.create("l3gd20_gyr", -SIM_GYRO_FS_MAX - 1, SIM_GYRO_FS_MAX, linkDir_ + "/l3gd20_gyr");
+        	}
+        	if (magRate_ > 0.0){
+        		ok &= devMag_.create("lsm303d_mag", -SIM_MAG_G_MAX_NEG, SIM_MAG_G_MAX_POS, linkDir_ + "/lsm303d_mag");
+        	}
+        	if (!ok){
+        		exit (1);
+        	}
+
+        	nbEmitted_ = 0;
+        	nbReceived_ = 0;
+        	nbMissing_ = 0;
+        	lastSeq_ = -1;
+        	nbOverruns_ = 0;
+        	nbSkipped_ = 0;
+        	if (benchmark_){
+        		emitTimes_.resize(SEQ_RANGE, 0.0);
+        		if (frameSize_ > 1){
+        			subBenchmark_ = node_.subscribe(benchmarkTopic_, 100, &ImuSimulatorNode::benchmarkBatchCallback, this);
+        		}else{
+        			subBenchmark_ = node_.subscribe(benchmarkTopic_, 100, &ImuSimulatorNode::benchmarkCallback, this);
+        		}
+        	}
+        }
+
+        virtual ~ImuSimulatorNode() {}
+
+        void loadBag(){
+        	rosbag::Bag bag(bagFile_, rosbag::bagmode::Read);
+        	rosbag::View view(bag);
+        	BOOST_FOREACH(rosbag::MessageInstance const m, view)
+        	{
+        		const bool isImu = (m.getTopic() == inputImu_ || ("/" + m.getTopic() == inputImu_));
+        		const bool isMag = (m.getTopic() == inputMag_ || ("/" + m.getTopic() == inputMag_));
+        		if (isImu){
+        			sensor_msgs::Imu::ConstPtr imu = m.instantiate<sensor_msgs::Imu>();
+        			if (imu != NULL){
+        				traceAcc_.add(imu->header.stamp.toSec(), imu->linear_acceleration);
+        				traceGyro_.add(imu->header.stamp.toSec(), imu->angular_velocity);
+        			}
+        			imu::ImuBatch::ConstPtr batch = m.instantiate<imu::ImuBatch>();
+        			if (batch != NULL){
+        				for (size_t i = 0; i < batch->stamps.size(); i++){
+        					traceAcc_.add(batch->stamps[i].toSec(), batch->linear_accelerations[i]);
+        					traceGyro_.add(batch->stamps[i].toSec(), batch->angular_velocities[i]);
+        				}
+        			}
+        		}
+        		if (isMag){
+        			sensor_msgs::MagneticField::ConstPtr mag = m.instantiate<sensor_msgs::MagneticField>();
+        			if (mag != NULL){
+        				traceMag_.add(mag->header.stamp.toSec(), mag->magnetic_field);
+        			}
+        			imu::MagneticFieldBatch::ConstPtr batch = m.instantiate<imu::MagneticFieldBatch>();
+        			if (batch != NULL){
+        				for (size_t i = 0; i < batch->stamps.size(); i++){
+        					traceMag_.add(batch->stamps[i].toSec(), batch->magnetic_fields[i]);
+        				}
+        			}
+        		}
+        	}
+        	bag.close();
+
+        	printf("Loaded %d imu and %d magnetometer samples from %s\n",
+        			(int) traceAcc_.times_.size(), (int) traceMag_.times_.size(), bagFile_.c_str());
+        	if (traceAcc_.empty() && accRate_ > 0.0){
+        		fprintf(stderr, "No imu samples found on topic %s\n", inputImu_.c_str());
+        		exit (1);
+        	}
+        	if (traceMag_.empty() && magRate_ > 0.0){
+        		fprintf(stderr, "No magnetometer samples found on topic %s, disabling magnetometer\n", inputMag_.c_str());
+        		magRate_ = 0.0;
+        	}
+        }
+
+        // Orientation (roll, pitch, yaw) of the synthetic trajectory and its time derivative
+        void trajectoryAngles(const double& t, double angles[3], double rates[3]) const {
+        	for (int i = 0; i < 3; i++){
+        		angles[i] = 0.0;
+        		rates[i] = 0.0;
+        	}
+        	if (trajectory_ == "rotate" || trajectory_ == "wobble"){
+        		angles[2] = yawRate_ * t;
+        		rates[2] = yawRate_;
+        	}
+        	if (trajectory_ == "wobble"){
+        		const double w = 2.0 * M_PI * wobbleFrequency_;
+        		angles[0] = wobbleAmplitude_ * sin(w * t);
+        		rates[0] = wobbleAmplitude_ * w * cos(w * t);
+        		angles[1] = wobbleAmplitude_ * sin(0.7 * w * t + 1.0);
+        		rates[1] = wobbleAmplitude_ * 0.7 * w * cos(0.7 * w * t + 1.0);
+        	}
+        }
+
+        // Express a world vector (NWU) in the body frame for the ZYX orientation of the trajectory
+        static geometry_msgs::Vector3 toBody(const double angles[3], const double w[3]){
+        	const double cr = cos(angles[0]), sr = sin(angles[0]);
+        	const double cp = cos(angles[1]), sp = sin(angles[1]);
+        	const double cy = cos(angles[2]), sy = sin(angles[2]);
+        	geometry_msgs::Vector3 b;
+        	b.x = cp * cy * w[0] + cp * sy * w[1] - sp * w[2];
+        	b.y = (sr * sp * cy - cr * sy) * w[0] + (sr * sp * sy + cr * cy) * w[1] + sr * cp * w[2];
+        	b.z = (cr * sp * cy + sr * sy) * w[0] + (cr * sp * sy - sr * cy) * w[1] + cr * cp * w[2];
+        	return b;
+        }
+
+        void addNoise(geometry_msgs::Vector3& v, const double& sigma){
+        	if (sigma > 0.0){
+        		v.x += sigma * noise_();
+        		v.y += sigma * noise_();
+        		v.z += sigma * noise_();
+        	}
+        }
+
+        geometry_msgs::Vector3 sampleAcc(const double& t){
+        	if (source_ == "bag"){
+        		return traceAcc_.at(replayTime(t, traceAcc_));
+        	}
+        	double angles[3], rates[3];
+        	trajectoryAngles(t, angles, rates);
+        	// Inertial force, as expected by the capture node (+g along z when level)
+        	const double g[3] = {0.0, 0.0, G_ACC};
+        	geometry_msgs::Vector3 a = toBody(angles, g);
+        	addNoise(a, noiseAcc_);
+        	return a;
+        }
+
+        geometry_msgs::Vector3 sampleGyro(const double& t){
+        	if (source_ == "bag"){
+        		return traceGyro_.at(replayTime(t, traceGyro_));
+        	}
+        	double angles[3], rates[3];
+        	trajectoryAngles(t, angles, rates);
+        	// Body rates from the ZYX Euler angle rates
+        	const double cr = cos(angles[0]), sr = sin(angles[0]);
+        	const double cp = cos(angles[1]), sp = sin(angles[1]);
+        	geometry_msgs::Vector3 w;
+        	w.x = rates[0] - rates[2] * sp;
+        	w.y = rates[1] * cr + rates[2] * sr * cp;
+        	w.z = -rates[1] * sr + rates[2] * cr * cp;
+        	addNoise(w, noiseGyro_);
+        	return w;
+        }
+
+        geometry_msgs::Vector3 sampleMag(const double& t){
+        	if (source_ == "bag"){
+        		return traceMag_.at(replayTime(t, traceMag_));
+        	}
+        	double angles[3], rates[3];
+        	trajectoryAngles(t, angles, rates);
+        	const double m[3] = {magNorth_, 0.0, magUp_};
+        	geometry_msgs::Vector3 b = toBody(angles, m);
+        	addNoise(b, noiseMag_);
+        	return b;
+        }
+
+        double replayTime(const double& t, const SampleTrace& trace) const {
+        	if (loop_ && trace.duration() > 0.0){
+        		return fmod(t, trace.duration());
+        	}
+        	return t;
+        }
+
+        // Inverse of the conversions done by the capture nodes: the output axis i of the capture
+        // node is sign[i] * scale * (device axis source[i])
+        static AxisData toDevice(const geometry_msgs::Vector3& v, const int source[3], const int sign[3],
+        		const double& scale, const int minValue, const int maxValue){
+        	const double in[3] = {v.x, v.y, v.z};
+        	int out[3];
+        	for (int i = 0; i < 3; i++){
+        		out[source[i]] = clamp(lround(sign[i] * in[i] / scale), minValue, maxValue);
+        	}
+        	AxisData d;
+        	d.x = out[0];
+        	d.y = out[1];
+        	d.z = out[2];
+        	return d;
+        }
+
+        AxisData accToDevice(const geometry_msgs::Vector3& a) const {
+        	return toDevice(a, sourceAccel_, signAccel_, AccScale::value(), -SIM_ACC_G_MAX_NEG, SIM_ACC_G_MAX_POS);
+        }
+
+        AxisData gyroToDevice(const geometry_msgs::Vector3& w) const {
+        	return toDevice(w, sourceGyro_, signGyro_, gyroScale_, -SIM_GYRO_FS_MAX - 1, SIM_GYRO_FS_MAX);
+        }
+
+        AxisData magToDevice(const geometry_msgs::Vector3& m) const {
+        	return toDevice(m, sourceMag_, signMag_, MagScale::value(), -SIM_MAG_G_MAX_NEG, SIM_MAG_G_MAX_POS);
+        }
+
+        static int clamp(const long value, const int minValue, const int maxValue){
+        	return (int) std::max((long) minValue, std::min((long) maxValue, value));
+        }
+
+        // The sequence number is emitted on the device x-axis, published on the output axis mapped to it
+        int decodeSequence(const geometry_msgs::Vector3& w) const {
+        	const double in[3] = {w.x, w.y, w.z};
+        	for (int i = 0; i < 3; i++){
+        		if (sourceGyro_[i] == 0){
+        			return (int) lround(signGyro_[i] * in[i] / gyroScale_);
+        		}
+        	}
+        	return -1;
+        }
+
+        void recordSample(const geometry_msgs::Vector3& w, const ros::Time& stamp, const double& received){
+        	const int seq = decodeSequence(w);
+        	if (seq < 0 || seq >= SEQ_RANGE){
+        		return;
+        	}
+        	boost::mutex::scoped_lock lock(benchmarkMutex_);
+        	if (lastSeq_ >= 0){
+        		const int gap = (seq - lastSeq_ + SEQ_RANGE) % SEQ_RANGE;
+        		if (gap == 0){
+        			// Same gyroscope sample paired with a new accelerometer sample
+        			return;
+        		}
+        		nbMissing_ += gap - 1;
+        	}
+        	lastSeq_ = seq;
+        	nbReceived_++;
+        	const double emitted = emitTimes_[seq];
+        	captureLatencies_.push_back(stamp.toSec() - emitted);
+        	deliveryLatencies_.push_back(received - emitted);
+        }
+
+        void benchmarkCallback(const sensor_msgs::Imu::ConstPtr& msg){
+        	const double received = ros::WallTime::now().toSec();
+        	recordSample(msg->angular_velocity, msg->header.stamp, received);
+        }
+
+        void benchmarkBatchCallback(const imu::ImuBatch::ConstPtr& msg){
+        	const double received = ros::WallTime::now().toSec();
+        	for (size_t i = 0; i < msg->stamps.size(); i++){
+        		recordSample(msg->angular_velocities[i], msg->stamps[i], received);
+        	}
+        }
+
+        static double percentile(std::vector<double>& values, const double& p){
+        	if (values.empty()){
+        		return 0.0;
+        	}
+        	const size_t k = std::min(values.size() - 1, (size_t) (p * values.size()));
+        	std::nth_element(values.begin(), values.begin() + k, values.end());
+        	return values[k];
+        }
+
+        void printBenchmark(const double& elapsed){
+        	boost::mutex::scoped_lock lock(benchmarkMutex_);
+        	// The gaps in the received sequence also count the sequence numbers skipped by the simulator
+        	const int missing = std::max(0, nbMissing_ - nbSkipped_);
+        	printf("RESULT rate=%.0f frame_size=%d emitted=%d received=%d missing=%d overruns=%d skipped=%d throughput=%.1f "
+        			"capture_p50_ms=%.3f capture_p99_ms=%.3f delivery_p50_ms=%.3f delivery_p99_ms=%.3f delivery_max_ms=%.3f\n",
+        			gyroRate_, frameSize_, nbEmitted_, nbReceived_, missing, nbOverruns_, nbSkipped_, nbReceived_ / elapsed,
+        			1000.0 * percentile(captureLatencies_, 0.5), 1000.0 * percentile(captureLatencies_, 0.99),
+        			1000.0 * percentile(deliveryLatencies_, 0.5), 1000.0 * percentile(deliveryLatencies_, 0.99),
+        			1000.0 * percentile(deliveryLatencies_, 1.0));
+        	fflush(stdout);
+        }
+
+        bool spin() {
+
+        	ros::AsyncSpinner spinner(1);
+        	if (benchmark_){
+        		// Wait for the capture node to connect, so that no sample is emitted before it reads
+        		spinner.start();
+        		printf("Waiting for a publisher on %s\n", benchmarkTopic_.c_str());
+        		while (node_.ok() && subBenchmark_.getNumPublishers() == 0){
+        			ros::WallDuration(0.1).sleep();
+        		}
+        		ros::WallDuration(0.5).sleep();
+        	}
+
+        	const ros::WallTime start = ros::WallTime::now();
+        	const double rates[3] = {accRate_, gyroRate_, magRate_};
+        	ros::WallTime deadlines[3] = {start, start, start};
+        	int nbSamples[3] = {0, 0, 0};
+
+        	while (node_.ok()) {
+
+        		// Next sensor due
+        		int next = -1;
+        		for (int i = 0; i < 3; i++){
+        			if (rates[i] > 0.0 && (next < 0 || deadlines[i] < deadlines[next])){
+        				next = i;
+        			}
+        		}
+        		if (next < 0){
+        			break;
+        		}
+        		ros::WallTime::sleepUntil(deadlines[next]);
+
+        		// Nominal sampling time, so that the output data rate is exact
+        		const double t = nbSamples[next] / rates[next];
+        		if (benchmark_ && t > duration_){
+        			break;
+        		}
+        		if (!loop_ && source_ == "bag" && t > traceAcc_.duration()){
+        			break;
+        		}
+
+        		switch (next){
+        			case 0 : devAcc_.emit(accToDevice(sampleAcc(t)));
+        				break;
+        			case 1 : {
+        				AxisData d = gyroToDevice(sampleGyro(t));
+        				if (benchmark_){
+        					const int seq = nbSamples[1] % SEQ_RANGE;
+        					d.x = seq;
+        					boost::mutex::scoped_lock lock(benchmarkMutex_);
+        					emitTimes_[seq] = ros::WallTime::now().toSec();
+        					nbEmitted_++;
+        				}
+        				devGyro_.emit(d);
+        				break;
+        			}
+        			case 2 : devMag_.emit(magToDevice(sampleMag(t)));
+        				break;
+        		}
+        		nbSamples[next]++;
+
+        		const ros::WallDuration period(1.0 / rates[next]);
+        		deadlines[next] = start + ros::WallDuration(nbSamples[next] / rates[next]);
+        		if (ros::WallTime::now() - deadlines[next] > period){
+        			// Fell behind by more than a period: skip ahead instead of bursting
+        			nbOverruns_++;
+        			const int skipFrom = nbSamples[next];
+        			nbSamples[next] = (int) ((ros::WallTime::now() - start).toSec() * rates[next]);
+        			if (benchmark_ && next == 1){
+        				boost::mutex::scoped_lock lock(benchmarkMutex_);
+        				nbSkipped_ += nbSamples[next] - skipFrom;
+        			}
+        			deadlines[next] = start + ros::WallDuration(nbSamples[next] / rates[next]);
+        		}
+        	}
+
+        	if (benchmark_){
+        		// Let the last batches arrive
+        		ros::WallDuration(0.5 + frameSize_ / std::max(gyroRate_, 1.0)).sleep();
+        		printBenchmark((ros::WallTime::now() - start).toSec());
+        		spinner.stop();
+        	}
+        	return true;
+        }
+};
+
+} // namespace imu
+
+#endif // IMU_SIMULATOR_H
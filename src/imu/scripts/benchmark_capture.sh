@@ -0,0 +1,53 @@
+#!/bin/bash
+
+# Throughput and latency benchmark of imu_capture_acc_gyro against the simulated input devices.
+# Requires a running roscore and write access to /dev/uinput (e.g. run as root).
+#
+# Usage: benchmark_capture.sh [duration] [rates] [frame sizes]
+#   e.g. benchmark_capture.sh 10 "100 200 400 800 1600" "1 10 50"
+
+DURATION=${1:-10}
+RATES=${2:-"100 200 400 800 1600"}
+FRAME_SIZES=${3:-"1 10 50"}
+LINK_DIR=/tmp/imu_sim_benchmark
+OUTPUT_TOPIC=/imu_benchmark/data_raw
+
+if ! rostopic list > /dev/null 2>&1; then
+	echo "No roscore running"
+	exit 1
+fi
+
+RESULTS=$(mktemp)
+for rate in ${RATES}
+do
+	for frame in ${FRAME_SIZES}
+	do
+		echo "Benchmarking capture at ${rate} Hz with frame size ${frame}"
+
+		rosrun imu imu_simulator __name:=imu_benchmark_simulator \
+			_benchmark:=true _duration:=${DURATION} _link_dir:=${LINK_DIR} \
+			_acc_rate:=${rate} _gyro_rate:=${rate} _mag_rate:=0 \
+			_frame_size:=${frame} _benchmark_topic:=${OUTPUT_TOPIC} > ${RESULTS}.log 2>&1 &
+		SIM_PID=$!
+		sleep 2
+
+		rosrun imu imu_capture_acc_gyro __name:=imu_benchmark_capture \
+			_device_acc:=${LINK_DIR}/lsm303d_acc _device_gyro:=${LINK_DIR}/l3gd20_gyr \
+			_frame_size:=${frame} _output:=${OUTPUT_TOPIC} > /dev/null 2>&1 &
+		CAPTURE_PID=$!
+
+		wait ${SIM_PID}
+		# The capture node does not exit by itself once the devices are removed
+		kill -INT ${CAPTURE_PID} > /dev/null 2>&1
+		sleep 1
+		kill -KILL ${CAPTURE_PID} > /dev/null 2>&1
+		wait ${CAPTURE_PID} 2> /dev/null
+
+		grep "^RESULT" ${RESULTS}.log | tee -a ${RESULTS}
+	done
+done
+
+echo ""
+echo "Summary:"
+sed -e 's/^RESULT //' ${RESULTS} | column -t
+rm -f ${RESULTS} ${RESULTS}.log
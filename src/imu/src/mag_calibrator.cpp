@@ -0,0 +1,375 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+#include "imu/mag_calibrator.h"
+
+namespace imu {
+
+  // Solve the symmetric positive-definite system A x = b in place (Cholesky decomposition).
+  // Only the upper triangle of A is read. Returns false if A is not positive definite.
+  template <int N>
+  static bool choleskySolve(const int n, double A[N][N], double b[N], double x[N]) {
+    double L[N][N];
+    for (int i = 0; i < n; i++) {
+      for (int j = 0; j <= i; j++) {
+        double sum = A[j][i];
+        for (int k = 0; k < j; k++)
+          sum -= L[i][k] * L[j][k];
+        if (i == j) {
+          if (sum <= 0.0) return false;
+          L[i][i] = std::sqrt(sum);
+        } else {
+          L[i][j] = sum / L[j][j];
+        }
+      }
+    }
+    for (int i = 0; i < n; i++) {
+      double sum = b[i];
+      for (int k = 0; k < i; k++)
+        sum -= L[i][k] * x[k];
+      x[i] = sum / L[i][i];
+    }
+    for (int i = n - 1; i >= 0; i--) {
+      double sum = x[i];
+      for (int k = i + 1; k < n; k++)
+        sum -= L[k][i] * x[k];
+      x[i] = sum / L[i][i];
+    }
+    return true;
+  }
+
+  // Eigen decomposition of a small symmetric matrix with cyclic Jacobi rotations.
+  // On return, the eigenvalues are on the diagonal of A and the eigenvectors are the columns of V.
+  static void jacobiEigen(const int n, double A[3][3], double V[3][3]) {
+    for (int i = 0; i < n; i++)
+      for (int j = 0; j < n; j++)
+        V[i][j] = (i == j) ? 1.0 : 0.0;
+
+    for (int sweep = 0; sweep < 50; sweep++) {
+      double off = 0.0;
+      for (int p = 0; p < n; p++)
+        for (int q = p + 1; q < n; q++)
+          off += A[p][q] * A[p][q];
+      if (off < 1e-30) break;
+
+      for (int p = 0; p < n; p++) {
+        for (int q = p + 1; q < n; q++) {
+          if (std::fabs(A[p][q]) < 1e-300) continue;
+          const double theta = (A[q][q] - A[p][p]) / (2.0 * A[p][q]);
+          const double t = (theta >= 0.0 ? 1.0 : -1.0) / (std::fabs(theta) + std::sqrt(theta * theta + 1.0));
+          const double c = 1.0 / std::sqrt(t * t + 1.0);
+          const double s = t * c;
+          for (int k = 0; k < n; k++) {
+            const double akp = A[k][p];
+            const double akq = A[k][q];
+            A[k][p] = c * akp - s * akq;
+            A[k][q] = s * akp + c * akq;
+          }
+          for (int k = 0; k < n; k++) {
+            const double apk = A[p][k];
+            const double aqk = A[q][k];
+            A[p][k] = c * apk - s * aqk;
+            A[q][k] = s * apk + c * aqk;
+          }
+          for (int k = 0; k < n; k++) {
+            const double vkp = V[k][p];
+            const double vkq = V[k][q];
+            V[k][p] = c * vkp - s * vkq;
+            V[k][q] = s * vkp + c * vkq;
+          }
+        }
+      }
+    }
+  }
+
+  // Parse the values of a YAML flow sequence such as "key: [1.0, 2.0, 3.0]"
+  static int parseSequence(const std::string& line, double* values, const int size) {
+    const size_t start = line.find('[');
+    if (start == std::string::npos) return 0;
+    const char* p = line.c_str() + start + 1;
+    int n = 0;
+    while (n < size) {
+      char* end;
+      const double v = std::strtod(p, &end);
+      if (end == p) break;
+      values[n++] = v;
+      p = end;
+      while (*p == ',' || *p == ' ') p++;
+    }
+    return n;
+  }
+
+  MagCalibrator::MagCalibrator(const MagCalibrationModel& model) :
+    forgetting(0.999),
+    minSpacing(0.05),
+    minSamples(100.0),
+    maxAxisRatio(2.0) {
+    setModel(model);
+    for (int i = 0; i < 3; i++) {
+      hardIron[i] = 0.0;
+      for (int j = 0; j < 3; j++)
+        softIron[i * 3 + j] = (i == j) ? 1.0 : 0.0;
+    }
+    fitted = false;
+  }
+
+  void MagCalibrator::setModel(const MagCalibrationModel& model) {
+    this->model = model;
+    nbParams = (model == MAG_CALIBRATION_PLANAR) ? 5 : 9;
+    reset();
+  }
+
+  void MagCalibrator::setForgetting(const double& lambda) {
+    forgetting = lambda;
+  }
+
+  void MagCalibrator::setMinSpacing(const double& spacing) {
+    minSpacing = spacing;
+  }
+
+  void MagCalibrator::setMinSamples(const double& count) {
+    minSamples = count;
+  }
+
+  void MagCalibrator::setMaxAxisRatio(const double& ratio) {
+    maxAxisRatio = ratio;
+  }
+
+  void MagCalibrator::reset() {
+    std::memset(AtA, 0, sizeof(AtA));
+    std::memset(Atb, 0, sizeof(Atb));
+    count = 0.0;
+    scale = 0.0;
+    hasLast = false;
+  }
+
+  int MagCalibrator::designRow(const double u[3], double d[MAX_PARAMS]) const {
+    if (model == MAG_CALIBRATION_PLANAR) {
+      d[0] = u[0] * u[0];
+      d[1] = u[1] * u[1];
+      d[2] = 2.0 * u[0] * u[1];
+      d[3] = 2.0 * u[0];
+      d[4] = 2.0 * u[1];
+      return 5;
+    }
+    d[0] = u[0] * u[0];
+    d[1] = u[1] * u[1];
+    d[2] = u[2] * u[2];
+    d[3] = 2.0 * u[1] * u[2];
+    d[4] = 2.0 * u[0] * u[2];
+    d[5] = 2.0 * u[0] * u[1];
+    d[6] = 2.0 * u[0];
+    d[7] = 2.0 * u[1];
+    d[8] = 2.0 * u[2];
+    return 9;
+  }
+
+  bool MagCalibrator::addSample(const double& x, const double& y, const double& z) {
+    const double norm = std::sqrt(x * x + y * y + z * z);
+    if (!(norm > 0.0) || !std::isfinite(norm)) {
+      return false;
+    }
+    if (scale == 0.0) {
+      // Work in units of the first sample so the normal equations stay well scaled
+      scale = 1.0 / norm;
+    }
+
+    const double u[3] = {x * scale, y * scale, (model == MAG_CALIBRATION_PLANAR) ? 0.0 : z * scale};
+    if (hasLast) {
+      const double dx = u[0] - last[0];
+      const double dy = u[1] - last[1];
+      const double dz = u[2] - last[2];
+      if (dx * dx + dy * dy + dz * dz < minSpacing * minSpacing) {
+        return false;
+      }
+    }
+    last[0] = u[0];
+    last[1] = u[1];
+    last[2] = u[2];
+    hasLast = true;
+
+    double d[MAX_PARAMS];
+    const int n = designRow(u, d);
+    for (int i = 0; i < n; i++) {
+      for (int j = i; j < n; j++)
+        AtA[i][j] = forgetting * AtA[i][j] + d[i] * d[j];
+      Atb[i] = forgetting * Atb[i] + d[i];
+    }
+    count = forgetting * count + 1.0;
+    return true;
+  }
+
+  bool MagCalibrator::fit() {
+    if (count < minSamples) {
+      return false;
+    }
+    const int n = nbParams;
+
+    // Small ridge term relative to the average diagonal, against nearly degenerate coverage
+    double A[MAX_PARAMS][MAX_PARAMS];
+    double b[MAX_PARAMS];
+    double v[MAX_PARAMS];
+    double trace = 0.0;
+    for (int i = 0; i < n; i++)
+      trace += AtA[i][i];
+    for (int i = 0; i < n; i++) {
+      for (int j = i; j < n; j++)
+        A[i][j] = AtA[i][j];
+      A[i][i] += 1e-9 * trace / n;
+      b[i] = Atb[i];
+    }
+    if (!choleskySolve<MAX_PARAMS>(n, A, b, v)) {
+      return false;
+    }
+
+    // Quadric x'Mx + 2w'x = 1
+    const int dim = (model == MAG_CALIBRATION_PLANAR) ? 2 : 3;
+    double M[3][3];
+    double w[3];
+    if (model == MAG_CALIBRATION_PLANAR) {
+      M[0][0] = v[0]; M[0][1] = v[2];
+      M[1][0] = v[2]; M[1][1] = v[1];
+      w[0] = v[3]; w[1] = v[4];
+    } else {
+      M[0][0] = v[0]; M[0][1] = v[5]; M[0][2] = v[4];
+      M[1][0] = v[5]; M[1][1] = v[1]; M[1][2] = v[3];
+      M[2][0] = v[4]; M[2][1] = v[3]; M[2][2] = v[2];
+      w[0] = v[6]; w[1] = v[7]; w[2] = v[8];
+    }
+
+    // Center c = -inv(M) w, then (x-c)'M(x-c) = 1 + c'Mc
+    double Mc[3][3];
+    double negW[3];
+    double c[3];
+    for (int i = 0; i < dim; i++) {
+      for (int j = 0; j < dim; j++)
+        Mc[i][j] = M[i][j];
+      negW[i] = -w[i];
+    }
+    if (!choleskySolve<3>(dim, Mc, negW, c)) {
+      // M is not positive definite: not an ellipsoid
+      return false;
+    }
+    double k = 1.0;
+    for (int i = 0; i < dim; i++)
+      for (int j = 0; j < dim; j++)
+        k += c[i] * M[i][j] * c[j];
+    if (!(k > 0.0)) {
+      return false;
+    }
+
+    double E[3][3];
+    double V[3][3];
+    for (int i = 0; i < dim; i++)
+      for (int j = 0; j < dim; j++)
+        E[i][j] = M[i][j] / k;
+    jacobiEigen(dim, E, V);
+
+    double minRadius = 0.0, maxRadius = 0.0, logRadius = 0.0;
+    for (int i = 0; i < dim; i++) {
+      if (!(E[i][i] > 0.0)) return false;
+      const double r = 1.0 / std::sqrt(E[i][i]);
+      minRadius = (i == 0 || r < minRadius) ? r : minRadius;
+      maxRadius = (i == 0 || r > maxRadius) ? r : maxRadius;
+      logRadius += std::log(r);
+    }
+    if (maxRadius > maxAxisRatio * minRadius) {
+      return false;
+    }
+    const double radius = std::exp(logRadius / dim);
+
+    // W = V diag(sqrt(e_i) * radius) V'
+    double W[3][3];
+    for (int i = 0; i < 3; i++)
+      for (int j = 0; j < 3; j++)
+        W[i][j] = (i == j) ? 1.0 : 0.0;
+    for (int i = 0; i < dim; i++) {
+      for (int j = 0; j < dim; j++) {
+        double sum = 0.0;
+        for (int l = 0; l < dim; l++)
+          sum += V[i][l] * std::sqrt(E[l][l]) * radius * V[j][l];
+        W[i][j] = sum;
+      }
+    }
+
+    for (int i = 0; i < 3; i++) {
+      hardIron[i] = (i < dim) ? c[i] / scale : 0.0;
+      for (int j = 0; j < 3; j++)
+        softIron[i * 3 + j] = W[i][j];
+    }
+    fitted = true;
+    return true;
+  }
+
+  void MagCalibrator::apply(double& x, double& y, double& z) const {
+    const double u[3] = {x - hardIron[0], y - hardIron[1], z - hardIron[2]};
+    x = softIron[0] * u[0] + softIron[1] * u[1] + softIron[2] * u[2];
+    y = softIron[3] * u[0] + softIron[4] * u[1] + softIron[5] * u[2];
+    z = softIron[6] * u[0] + softIron[7] * u[1] + softIron[8] * u[2];
+  }
+
+  void MagCalibrator::setCalibration(const double hardIron[3], const double softIron[9]) {
+    for (int i = 0; i < 3; i++)
+      this->hardIron[i] = hardIron[i];
+    for (int i = 0; i < 9; i++)
+      this->softIron[i] = softIron[i];
+  }
+
+  bool MagCalibrator::save(const std::string& path) const {
+    // Written aside and renamed, so that an interrupted save never leaves a truncated calibration
+    const std::string tmp = path + ".tmp";
+    FILE* f = std::fopen(tmp.c_str(), "w");
+    if (f == NULL) {
+      return false;
+    }
+    std::fprintf(f, "# Magnetometer calibration: field = soft_iron * (raw - hard_iron), in Tesla\n");
+    std::fprintf(f, "model: %s\n", (model == MAG_CALIBRATION_PLANAR) ? "planar" : "ellipsoid");
+    std::fprintf(f, "samples: %.1f\n", count);
+    std::fprintf(f, "hard_iron: [%.9g, %.9g, %.9g]\n", hardIron[0], hardIron[1], hardIron[2]);
+    std::fprintf(f, "soft_iron: [%.9g, %.9g, %.9g,\n", softIron[0], softIron[1], softIron[2]);
+    std::fprintf(f, "            %.9g, %.9g, %.9g,\n", softIron[3], softIron[4], softIron[5]);
+    std::fprintf(f, "            %.9g, %.9g, %.9g]\n", softIron[6], softIron[7], softIron[8]);
+    if (std::fclose(f) != 0) {
+      std::remove(tmp.c_str());
+      return false;
+    }
+    return std::rename(tmp.c_str(), path.c_str()) == 0;
+  }
+
+  bool MagCalibrator::load(const std::string& path) {
+    std::ifstream file(path.c_str());
+    if (!file.good()) {
+      return false;
+    }
+
+    double hard[3];
+    double soft[9];
+    int nbHard = 0, nbSoft = 0;
+    std::string line, sequence;
+    bool inSoft = false;
+    while (std::getline(file, line)) {
+      if (line.compare(0, 10, "hard_iron:") == 0) {
+        nbHard = parseSequence(line, hard, 3);
+      } else if (line.compare(0, 10, "soft_iron:") == 0) {
+        sequence = line;
+        inSoft = true;
+      } else if (inSoft) {
+        // The soft-iron matrix spans several lines
+        sequence += " " + line;
+      }
+      if (inSoft && sequence.find(']') != std::string::npos) {
+        nbSoft = parseSequence(sequence, soft, 9);
+        inSoft = false;
+      }
+    }
+    if (nbHard != 3 || nbSoft != 9) {
+      return false;
+    }
+    setCalibration(hard, soft);
+    return true;
+  }
+
+}  // namespace imu
@@ -0,0 +1,183 @@
+/******************************************************************************
+ * 
+ * Copyright (c) 2016, Simon Brodeur
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ * 
+ *  - Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ *  - Neither the name of the NECOTIS research group nor the names of its contributors 
+ *    may be used to endorse or promote products derived from this software 
+ *    without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND 
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED 
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. 
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, 
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT 
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, 
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <cmath>
+#include <gtest/gtest.h>
+#include <boost/scoped_ptr.hpp>
+
+#include "../nodes/sensor_conversion.h"
+
+using namespace imu;
+
+static AxisData sample(const int x, const int y, const int z){
+	AxisData data;
+	data.x = x;
+	data.y = y;
+	data.z = z;
+	return data;
+}
+
+TEST(SensorConversion, AccelerometerScale)
+{
+	boost::scoped_ptr<VectorConverter> convert(makeVectorConverter<AccScale>("x,y,z"));
+	ASSERT_TRUE(convert);
+
+	// 1 g in ug is 9.81 m/s^2
+	geometry_msgs::Vector3 out;
+	convert->convert(sample(1000000, -500000, 0), out);
+	EXPECT_NEAR(9.81, out.x, 1e-9);
+	EXPECT_NEAR(-4.905, out.y, 1e-9);
+	EXPECT_NEAR(0.0, out.z, 1e-9);
+}
+
+TEST(SensorConversion, GyroscopeScale)
+{
+	// 100 LSB at 250, 500 and 2000 dps (8.75, 17.5 and 70 mdps/LSB)
+	const int ranges[3] = {250, 500, 2000};
+	const double dps[3] = {0.875, 1.75, 7.0};
+	for (int i = 0; i < 3; i++){
+		boost::scoped_ptr<VectorConverter> convert(makeGyroConverter(ranges[i], "x,y,z"));
+		ASSERT_TRUE(convert);
+		geometry_msgs::Vector3 out;
+		convert->convert(sample(100, 0, -100), out);
+		EXPECT_NEAR(dps[i] * M_PI / 180.0, out.x, 1e-12);
+		EXPECT_NEAR(0.0, out.y, 1e-12);
+		EXPECT_NEAR(-dps[i] * M_PI / 180.0, out.z, 1e-12);
+	}
+	EXPECT_FALSE(makeGyroConverter(245, "x,y,z"));
+}
+
+TEST(SensorConversion, MagnetometerScale)
+{
+	boost::scoped_ptr<VectorConverter> convert(makeVectorConverter<MagScale>("x,y,z"));
+	ASSERT_TRUE(convert);
+
+	// 0.5 gauss is 50 uT
+	geometry_msgs::Vector3 out;
+	convert->convert(sample(500000, 0, 0), out);
+	EXPECT_NEAR(5e-5, out.x, 1e-15);
+}
+
+TEST(SensorConversion, AxisMapping)
+{
+	// Default mapping of the accelerometer on the IMU board
+	boost::scoped_ptr<VectorConverter> convert(makeVectorConverter<AccScale>("y,-x,z"));
+	ASSERT_TRUE(convert);
+
+	const double scale = AccScale::value();
+	geometry_msgs::Vector3 out;
+	convert->convert(sample(1000, 2000, 3000), out);
+	EXPECT_NEAR(2000 * scale, out.x, 1e-12);
+	EXPECT_NEAR(-1000 * scale, out.y, 1e-12);
+	EXPECT_NEAR(3000 * scale, out.z, 1e-12);
+
+	// Every sign combination, with x and y swapped or not
+	const char* mappings[4] = {"x,y,z", "-x,y,-z", "y,x,z", "-y,-x,-z"};
+	const int expected[4][3] = {{1000, 2000, 3000}, {-1000, 2000, -3000}, {2000, 1000, 3000}, {-2000, -1000, -3000}};
+	for (int i = 0; i < 4; i++){
+		convert.reset(makeVectorConverter<AccScale>(mappings[i]));
+		ASSERT_TRUE(convert) << mappings[i];
+		convert->convert(sample(1000, 2000, 3000), out);
+		EXPECT_NEAR(expected[i][0] * scale, out.x, 1e-12) << mappings[i];
+		EXPECT_NEAR(expected[i][1] * scale, out.y, 1e-12) << mappings[i];
+		EXPECT_NEAR(expected[i][2] * scale, out.z, 1e-12) << mappings[i];
+	}
+}
+
+TEST(SensorConversion, Batch)
+{
+	boost::scoped_ptr<VectorConverter> convert(makeGyroConverter(250, "y,-x,z"));
+	ASSERT_TRUE(convert);
+
+	AxisData in[3] = {sample(1, 2, 3), sample(4, 5, 6), sample(7, 8, 9)};
+	geometry_msgs::Vector3 out[3];
+	convert->convert(in, out, 3);
+	const double scale = GyroScale<SENSITIVITY_250>::value();
+	for (int i = 0; i < 3; i++){
+		EXPECT_NEAR(in[i].y * scale, out[i].x, 1e-12);
+		EXPECT_NEAR(-in[i].x * scale, out[i].y, 1e-12);
+		EXPECT_NEAR(in[i].z * scale, out[i].z, 1e-12);
+	}
+}
+
+TEST(SensorConversion, LegacyExpressions)
+{
+	// Default mappings of the capture nodes against the expressions they replaced,
+	// which used PI = 3.14159: the gyroscope tolerance covers the relative error of 1e-6
+	const AxisData raw = sample(123456, -654321, 98765);
+	const double legacyPi = 3.14159;
+	geometry_msgs::Vector3 out;
+
+	boost::scoped_ptr<VectorConverter> gyro(makeGyroConverter(250, "x,y,z"));
+	ASSERT_TRUE(gyro);
+	gyro->convert(raw, out);
+	const double gyroX = ((double) raw.x) * SENSITIVITY_250/1000000.0 * legacyPi/180.0;
+	const double gyroY = ((double) raw.y) * SENSITIVITY_250/1000000.0 * legacyPi/180.0;
+	const double gyroZ = ((double) raw.z) * SENSITIVITY_250/1000000.0 * legacyPi/180.0;
+	EXPECT_NEAR(gyroX, out.x, 1e-6 * std::fabs(gyroX));
+	EXPECT_NEAR(gyroY, out.y, 1e-6 * std::fabs(gyroY));
+	EXPECT_NEAR(gyroZ, out.z, 1e-6 * std::fabs(gyroZ));
+
+	boost::scoped_ptr<VectorConverter> acc(makeVectorConverter<AccScale>("y,-x,z"));
+	ASSERT_TRUE(acc);
+	acc->convert(raw, out);
+	EXPECT_NEAR(G_ACC*((double) raw.y) / 1000000, out.x, 1e-12);
+	EXPECT_NEAR(-G_ACC*((double) raw.x) / 1000000, out.y, 1e-12);
+	EXPECT_NEAR(G_ACC*((double) raw.z) / 1000000, out.z, 1e-12);
+
+	boost::scoped_ptr<VectorConverter> mag(makeVectorConverter<MagScale>("y,-x,z"));
+	ASSERT_TRUE(mag);
+	mag->convert(raw, out);
+	EXPECT_NEAR(((double) raw.y)/1000000 /10000.0, out.x, 1e-15);
+	EXPECT_NEAR(-((double) raw.x)/1000000 /10000.0, out.y, 1e-15);
+	EXPECT_NEAR(((double) raw.z)/1000000 /10000.0, out.z, 1e-15);
+}
+
+TEST(SensorConversion, InvalidMappings)
+{
+	int source[3];
+	int sign[3];
+	EXPECT_FALSE(parseAxisMapping("x,y", source, sign));
+	EXPECT_FALSE(parseAxisMapping("x,x,z", source, sign));
+	EXPECT_FALSE(parseAxisMapping("x,y,w", source, sign));
+	ASSERT_TRUE(parseAxisMapping(" -y , +x , z ", source, sign));
+	EXPECT_EQ(1, source[0]);
+	EXPECT_EQ(-1, sign[0]);
+	EXPECT_EQ(0, source[1]);
+	EXPECT_EQ(1, sign[1]);
+
+	// The board is mounted flat: z stays on the device z-axis
+	EXPECT_FALSE(makeVectorConverter<AccScale>("z,y,x"));
+}
+
+int main(int argc, char **argv)
+{
+	testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
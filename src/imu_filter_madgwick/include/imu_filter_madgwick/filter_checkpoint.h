@@ -0,0 +1,72 @@
+/*
+ *  Copyright (C) 2010, CCNY Robotics Lab
+ *  Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  http://robotics.ccny.cuny.edu
+ *
+ *  Based on implementation of Madgwick's IMU and AHRS algorithms.
+ *  http://www.x-io.co.uk/node/8#open_source_ahrs_and_imu_algorithms
+ *
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef IMU_FILTER_MADWICK_FILTER_CHECKPOINT_H
+#define IMU_FILTER_MADWICK_FILTER_CHECKPOINT_H
+
+#include <string>
+#include <imu_filter_madgwick/world_frame.h>
+
+/* Saved state of the filter (orientation and gyro drift bias), so that the estimation can
+ * resume without waiting for the filter to converge again, e.g. after a restart of the node
+ * or in the middle of a recorded session.
+ */
+class FilterCheckpoint
+{
+public:
+  WorldFrame::WorldFrame world_frame;
+  double stamp;      // time of the last filter update (sec)
+  double wall_time;  // wall-clock time of the save (sec)
+  double q0, q1, q2, q3;
+  double w_bx, w_by, w_bz;
+
+  FilterCheckpoint();
+
+  template <class Filter>
+  void capture(Filter& filter, WorldFrame::WorldFrame frame, double time)
+  {
+    world_frame = frame;
+    stamp = time;
+    filter.getOrientation(q0, q1, q2, q3);
+    filter.getDriftBias(w_bx, w_by, w_bz);
+  }
+
+  template <class Filter>
+  void restore(Filter& filter, bool restore_orientation = true) const
+  {
+    if (restore_orientation)
+    {
+      filter.setOrientation(q0, q1, q2, q3);
+    }
+    filter.setDriftBias(w_bx, w_by, w_bz);
+  }
+
+  // The file is replaced atomically, so that a reader never sees a partial checkpoint
+  bool save(const std::string& path);
+  bool load(const std::string& path);
+
+  static std::string worldFrameName(WorldFrame::WorldFrame frame);
+};
+
+#endif // IMU_FILTER_MADWICK_FILTER_CHECKPOINT_H
@@ -26,24 +26,31 @@
 #define IMU_FILTER_MADWICK_IMU_FILTER_H
 
 #include <imu_filter_madgwick/world_frame.h>
+#include <imu_filter_madgwick/precision.h>
 #include <iostream>
 
-class ImuFilter
+/* Madgwick filter, with the state and the update computed in the scalar type of the
+ * precision policy (see precision.h). Implemented for FloatPrecision, LegacyFloatPrecision
+ * and DoublePrecision.
+ */
+template <class Precision>
+class ImuFilterT
 {
   public:
+    typedef typename Precision::Scalar Scalar;
 
-    ImuFilter();
-    virtual ~ImuFilter();
+    ImuFilterT();
+    virtual ~ImuFilterT();
 
   private:
     // **** paramaters
-    double gain_;    // algorithm gain
-    double zeta_;    // gyro drift bias gain
+    Scalar gain_;    // algorithm gain
+    Scalar zeta_;    // gyro drift bias gain
     WorldFrame::WorldFrame world_frame_;    // NWU, ENU, NED
 
     // **** state variables
-    double q0, q1, q2, q3;  // quaternion
-    float w_bx_, w_by_, w_bz_; // 
+    Scalar q0, q1, q2, q3;  // quaternion
+    Scalar w_bx_, w_by_, w_bz_; // gyro drift bias
 
 public:
     void setAlgorithmGain(double gain)
@@ -81,14 +88,31 @@ public:
         w_bz_ = 0;
     }
 
-    void madgwickAHRSupdate(float gx, float gy, float gz,
-                            float ax, float ay, float az,
-                            float mx, float my, float mz,
-                            float dt);
+    void getDriftBias(double& w_bx, double& w_by, double& w_bz)
+    {
+        w_bx = w_bx_;
+        w_by = w_by_;
+        w_bz = w_bz_;
+    }
+
+    // Must be called after setOrientation, which resets the drift bias
+    void setDriftBias(double w_bx, double w_by, double w_bz)
+    {
+        w_bx_ = w_bx;
+        w_by_ = w_by;
+        w_bz_ = w_bz;
+    }
 
-    void madgwickAHRSupdateIMU(float gx, float gy, float gz,
-                               float ax, float ay, float az,
-                               float dt);
+    void madgwickAHRSupdate(Scalar gx, Scalar gy, Scalar gz,
+                            Scalar ax, Scalar ay, Scalar az,
+                            Scalar mx, Scalar my, Scalar mz,
+                            Scalar dt);
+
+    void madgwickAHRSupdateIMU(Scalar gx, Scalar gy, Scalar gz,
+                               Scalar ax, Scalar ay, Scalar az,
+                               Scalar dt);
 };
 
+typedef ImuFilterT<FloatPrecision> ImuFilter;
+
 #endif // IMU_FILTER_IMU_MADWICK_FILTER_H
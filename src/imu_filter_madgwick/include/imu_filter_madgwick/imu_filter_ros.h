@@ -36,6 +36,7 @@
 #include <dynamic_reconfigure/server.h>
 
 #include "imu_filter_madgwick/imu_filter.h"
+#include "imu_filter_madgwick/filter_checkpoint.h"
 #include "imu_filter_madgwick/ImuFilterMadgwickConfig.h"
 
 class ImuFilterRos
@@ -91,13 +92,20 @@ class ImuFilterRos
     std::string imu_frame_;
     double constant_dt_;
     bool publish_debug_topics_;
+    bool mag_calibrated_;
     geometry_msgs::Vector3 mag_bias_;
     double orientation_variance_;
+    std::string checkpoint_file_;
+    double checkpoint_period_;
+    double checkpoint_max_age_;
 
     // **** state variables
     boost::mutex mutex_;
     bool initialized_;
     ros::Time last_time_;
+    bool has_checkpoint_;
+    FilterCheckpoint checkpoint_;
+    ros::WallTime last_checkpoint_;
 
     // **** filter implementation
     ImuFilter filter_;
@@ -117,6 +125,9 @@ class ImuFilterRos
                        float roll, float pitch, float yaw);
 
     void reconfigCallback(FilterConfig& config, uint32_t level);
+
+    void restoreCheckpoint();
+    void saveCheckpoint(bool force = false);
 };
 
 #endif // IMU_FILTER_IMU_MADWICK_FILTER_ROS_H
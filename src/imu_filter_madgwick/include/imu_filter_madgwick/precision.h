@@ -0,0 +1,98 @@
+/*
+ *  Copyright (C) 2010, CCNY Robotics Lab
+ *  Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  http://robotics.ccny.cuny.edu
+ *
+ *  Based on implementation of Madgwick's IMU and AHRS algorithms.
+ *  http://www.x-io.co.uk/node/8#open_source_ahrs_and_imu_algorithms
+ *
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef IMU_FILTER_MADWICK_PRECISION_H
+#define IMU_FILTER_MADWICK_PRECISION_H
+
+#include <cmath>
+
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+/* Precision policies of the filter update.
+ * The policy gives the scalar type used for the state and every intermediate value of the update,
+ * and the reciprocal square root used for normalisation.
+ */
+
+// Single precision, with the hardware reciprocal square root estimate refined by Newton-Raphson
+// (relative error below 1e-6 on SSE and NEON, exact division on other targets)
+struct FloatPrecision
+{
+  typedef float Scalar;
+
+  static inline float invSqrt(float x)
+  {
+#if defined(__SSE__)
+    const float y = _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss(x)));
+    return y * (1.5f - 0.5f * x * y * y);
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    // The NEON estimate only has 8 bits, each step doubles them
+    const float32x2_t v = vdup_n_f32(x);
+    float32x2_t y = vrsqrte_f32(v);
+    y = vmul_f32(y, vrsqrts_f32(vmul_f32(v, y), y));
+    y = vmul_f32(y, vrsqrts_f32(vmul_f32(v, y), y));
+    return vget_lane_f32(y, 0);
+#else
+    return 1.0f / std::sqrt(x);
+#endif
+  }
+};
+
+// Single precision, with the integer bit-hack and one Newton-Raphson iteration used by
+// the original implementation (relative error up to 2e-3)
+// See: http://en.wikipedia.org/wiki/Methods_of_computing_square_roots#Reciprocal_of_the_square_root
+struct LegacyFloatPrecision
+{
+  typedef float Scalar;
+
+  static inline float invSqrt(float x)
+  {
+    float xhalf = 0.5f * x;
+    union
+    {
+      float x;
+      int i;
+    } u;
+    u.x = x;
+    u.i = 0x5f3759df - (u.i >> 1);
+    u.x = u.x * (1.5f - xhalf * u.x * u.x);
+    return u.x;
+  }
+};
+
+// Double precision
+struct DoublePrecision
+{
+  typedef double Scalar;
+
+  static inline double invSqrt(double x)
+  {
+    return 1.0 / std::sqrt(x);
+  }
+};
+
+#endif // IMU_FILTER_MADWICK_PRECISION_H
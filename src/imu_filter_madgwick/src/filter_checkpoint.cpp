@@ -0,0 +1,119 @@
+/*
+ *  Copyright (C) 2010, CCNY Robotics Lab
+ *  Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  http://robotics.ccny.cuny.edu
+ *
+ *  Based on implementation of Madgwick's IMU and AHRS algorithms.
+ *  http://www.x-io.co.uk/node/8#open_source_ahrs_and_imu_algorithms
+ *
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <sys/time.h>
+#include "imu_filter_madgwick/filter_checkpoint.h"
+
+FilterCheckpoint::FilterCheckpoint() :
+    world_frame(WorldFrame::ENU), stamp(0.0), wall_time(0.0),
+    q0(1.0), q1(0.0), q2(0.0), q3(0.0),
+    w_bx(0.0), w_by(0.0), w_bz(0.0)
+{
+}
+
+std::string FilterCheckpoint::worldFrameName(WorldFrame::WorldFrame frame)
+{
+  switch (frame)
+  {
+    case WorldFrame::NED: return "ned";
+    case WorldFrame::NWU: return "nwu";
+    default:
+    case WorldFrame::ENU: return "enu";
+  }
+}
+
+bool FilterCheckpoint::save(const std::string& path)
+{
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  wall_time = now.tv_sec + now.tv_usec * 1e-6;
+
+  const std::string tmp = path + ".tmp";
+  FILE* f = std::fopen(tmp.c_str(), "w");
+  if (f == NULL)
+    return false;
+
+  std::fprintf(f, "# Madgwick filter state\n");
+  std::fprintf(f, "world_frame: %s\n", worldFrameName(world_frame).c_str());
+  std::fprintf(f, "stamp: %.9f\n", stamp);
+  std::fprintf(f, "wall_time: %.6f\n", wall_time);
+  std::fprintf(f, "orientation: [%.12g, %.12g, %.12g, %.12g]\n", q0, q1, q2, q3);
+  std::fprintf(f, "drift_bias: [%.12g, %.12g, %.12g]\n", w_bx, w_by, w_bz);
+  if (std::fclose(f) != 0)
+  {
+    std::remove(tmp.c_str());
+    return false;
+  }
+  return std::rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+bool FilterCheckpoint::load(const std::string& path)
+{
+  std::ifstream file(path.c_str());
+  if (!file.good())
+    return false;
+
+  bool has_frame = false, has_stamp = false, has_orientation = false, has_bias = false;
+  std::string line;
+  char frame[16];
+  while (std::getline(file, line))
+  {
+    if (std::sscanf(line.c_str(), "world_frame: %15s", frame) == 1)
+    {
+      const std::string name(frame);
+      has_frame = true;
+      if (name == "ned")
+        world_frame = WorldFrame::NED;
+      else if (name == "nwu")
+        world_frame = WorldFrame::NWU;
+      else if (name == "enu")
+        world_frame = WorldFrame::ENU;
+      else
+        has_frame = false;
+    }
+    else if (std::sscanf(line.c_str(), "stamp: %lf", &stamp) == 1)
+      has_stamp = true;
+    else if (std::sscanf(line.c_str(), "wall_time: %lf", &wall_time) == 1)
+      ;
+    else if (std::sscanf(line.c_str(), "orientation: [%lf, %lf, %lf, %lf]", &q0, &q1, &q2, &q3) == 4)
+      has_orientation = true;
+    else if (std::sscanf(line.c_str(), "drift_bias: [%lf, %lf, %lf]", &w_bx, &w_by, &w_bz) == 3)
+      has_bias = true;
+  }
+  if (!has_frame || !has_stamp || !has_orientation || !has_bias)
+    return false;
+
+  // Reject a corrupted orientation rather than starting the filter from it
+  const double norm = std::sqrt(q0 * q0 + q1 * q1 + q2 * q2 + q3 * q3);
+  if (!std::isfinite(norm) || std::fabs(norm - 1.0) > 1e-3)
+    return false;
+  q0 /= norm;
+  q1 /= norm;
+  q2 /= norm;
+  q3 /= norm;
+  return std::isfinite(w_bx) && std::isfinite(w_by) && std::isfinite(w_bz);
+}
@@ -25,71 +25,62 @@
 #include <cmath>
 #include "imu_filter_madgwick/imu_filter.h"
 
-// Fast inverse square-root
-// See: http://en.wikipedia.org/wiki/Methods_of_computing_square_roots#Reciprocal_of_the_square_root
-static float invSqrt(float x)
-{
-  float xhalf = 0.5f * x;
-  union
-  {
-    float x;
-    int i;
-  } u;
-  u.x = x;
-  u.i = 0x5f3759df - (u.i >> 1);
-  /* The next line can be repeated any number of times to increase accuracy */
-  u.x = u.x * (1.5f - xhalf * u.x * u.x);
-  return u.x;
-}
-
-template<typename T>
+template<class P, typename T>
 static inline void normalizeVector(T& vx, T& vy, T& vz)
 {
-  T recipNorm = invSqrt (vx * vx + vy * vy + vz * vz);
+  T recipNorm = P::invSqrt (vx * vx + vy * vy + vz * vz);
   vx *= recipNorm;
   vy *= recipNorm;
   vz *= recipNorm;
 }
 
-template<typename T>
+template<class P, typename T>
 static inline void normalizeQuaternion(T& q0, T& q1, T& q2, T& q3)
 {
-  T recipNorm = invSqrt (q0 * q0 + q1 * q1 + q2 * q2 + q3 * q3);
+  T norm2 = q0 * q0 + q1 * q1 + q2 * q2 + q3 * q3;
+  if (norm2 == T(0))
+  {
+    // Null gradient step, a reciprocal estimate of zero would give NaN
+    return;
+  }
+  T recipNorm = P::invSqrt (norm2);
   q0 *= recipNorm;
   q1 *= recipNorm;
   q2 *= recipNorm;
   q3 *= recipNorm;
 }
 
+template<typename T>
 static inline void rotateAndScaleVector(
-    float q0, float q1, float q2, float q3,
-    float _2dx, float _2dy, float _2dz,
-    float& rx, float& ry, float& rz) {
+    T q0, T q1, T q2, T q3,
+    T _2dx, T _2dy, T _2dz,
+    T& rx, T& ry, T& rz) {
 
   // result is half as long as input
-  rx = _2dx * (0.5f - q2 * q2 - q3 * q3)
+  rx = _2dx * (T(0.5) - q2 * q2 - q3 * q3)
      + _2dy * (q0 * q3 + q1 * q2)
      + _2dz * (q1 * q3 - q0 * q2);
   ry = _2dx * (q1 * q2 - q0 * q3)
-     + _2dy * (0.5f - q1 * q1 - q3 * q3)
+     + _2dy * (T(0.5) - q1 * q1 - q3 * q3)
      + _2dz * (q0 * q1 + q2 * q3);
   rz = _2dx * (q0 * q2 + q1 * q3)
      + _2dy * (q2 * q3 - q0 * q1)
-     + _2dz * (0.5f - q1 * q1 - q2 * q2);
+     + _2dz * (T(0.5) - q1 * q1 - q2 * q2);
 }
 
 
+template<typename T>
 static inline void compensateGyroDrift(
-    float q0, float q1, float q2, float q3,
-    float s0, float s1, float s2, float s3,
-    float dt, float zeta,
-    float& w_bx, float& w_by, float& w_bz,
-    float& gx, float& gy, float& gz)
+    T q0, T q1, T q2, T q3,
+    T s0, T s1, T s2, T s3,
+    T dt, T zeta,
+    T& w_bx, T& w_by, T& w_bz,
+    T& gx, T& gy, T& gz)
 {
   // w_err = 2 q x s
-  float w_err_x = 2.0f * q0 * s1 - 2.0f * q1 * s0 - 2.0f * q2 * s3 + 2.0f * q3 * s2;
-  float w_err_y = 2.0f * q0 * s2 + 2.0f * q1 * s3 - 2.0f * q2 * s0 - 2.0f * q3 * s1;
-  float w_err_z = 2.0f * q0 * s3 - 2.0f * q1 * s2 + 2.0f * q2 * s1 - 2.0f * q3 * s0;
+  T w_err_x = T(2) * q0 * s1 - T(2) * q1 * s0 - T(2) * q2 * s3 + T(2) * q3 * s2;
+  T w_err_y = T(2) * q0 * s2 + T(2) * q1 * s3 - T(2) * q2 * s0 - T(2) * q3 * s1;
+  T w_err_z = T(2) * q0 * s3 - T(2) * q1 * s2 + T(2) * q2 * s1 - T(2) * q3 * s0;
 
   w_bx += w_err_x * dt * zeta;
   w_by += w_err_y * dt * zeta;
@@ -100,26 +91,28 @@ static inline void compensateGyroDrift(
   gz -= w_bz;
 }
 
+template<typename T>
 static inline void orientationChangeFromGyro(
-    float q0, float q1, float q2, float q3,
-    float gx, float gy, float gz,
-    float& qDot1, float& qDot2, float& qDot3, float& qDot4)
+    T q0, T q1, T q2, T q3,
+    T gx, T gy, T gz,
+    T& qDot1, T& qDot2, T& qDot3, T& qDot4)
 {
   // Rate of change of quaternion from gyroscope
   // See EQ 12
-  qDot1 = 0.5f * (-q1 * gx - q2 * gy - q3 * gz);
-  qDot2 = 0.5f * (q0 * gx + q2 * gz - q3 * gy);
-  qDot3 = 0.5f * (q0 * gy - q1 * gz + q3 * gx);
-  qDot4 = 0.5f * (q0 * gz + q1 * gy - q2 * gx);
+  qDot1 = T(0.5) * (-q1 * gx - q2 * gy - q3 * gz);
+  qDot2 = T(0.5) * (q0 * gx + q2 * gz - q3 * gy);
+  qDot3 = T(0.5) * (q0 * gy - q1 * gz + q3 * gx);
+  qDot4 = T(0.5) * (q0 * gz + q1 * gy - q2 * gx);
 }
 
+template<typename T>
 static inline void addGradientDescentStep(
-    float q0, float q1, float q2, float q3,
-    float _2dx, float _2dy, float _2dz,
-    float mx, float my, float mz,
-    float& s0, float& s1, float& s2, float& s3)
+    T q0, T q1, T q2, T q3,
+    T _2dx, T _2dy, T _2dz,
+    T mx, T my, T mz,
+    T& s0, T& s1, T& s2, T& s3)
 {
-  float f0, f1, f2;
+  T f0, f1, f2;
 
   // Gradient decent algorithm corrective step
   // EQ 15, 21
@@ -136,98 +129,104 @@ static inline void addGradientDescentStep(
       + (-_2dx * q3 + _2dz * q1) * f1
       + (_2dx * q2 - _2dy * q1) * f2;
   s1 += (_2dy * q2 + _2dz * q3) * f0
-      + (_2dx * q2 - 2.0f * _2dy * q1 + _2dz * q0) * f1
-      + (_2dx * q3 - _2dy * q0 - 2.0f * _2dz * q1) * f2;
-  s2 += (-2.0f * _2dx * q2 + _2dy * q1 - _2dz * q0) * f0
+      + (_2dx * q2 - T(2) * _2dy * q1 + _2dz * q0) * f1
+      + (_2dx * q3 - _2dy * q0 - T(2) * _2dz * q1) * f2;
+  s2 += (-T(2) * _2dx * q2 + _2dy * q1 - _2dz * q0) * f0
       + (_2dx * q1 + _2dz * q3) * f1
-      + (_2dx * q0 + _2dy * q3 - 2.0f * _2dz * q2) * f2;
-  s3 += (-2.0f * _2dx * q3 + _2dy * q0 + _2dz * q1) * f0
-      + (-_2dx * q0 - 2.0f * _2dy * q3 + _2dz * q2) * f1
+      + (_2dx * q0 + _2dy * q3 - T(2) * _2dz * q2) * f2;
+  s3 += (-T(2) * _2dx * q3 + _2dy * q0 + _2dz * q1) * f0
+      + (-_2dx * q0 - T(2) * _2dy * q3 + _2dz * q2) * f1
       + (_2dx * q1 + _2dy * q2) * f2;
 }
 
+template<typename T>
 static inline void compensateMagneticDistortion(
-    float q0, float q1, float q2, float q3,
-    float mx, float my, float mz,
-    float& _2bxy, float& _2bz)
+    T q0, T q1, T q2, T q3,
+    T mx, T my, T mz,
+    T& _2bxy, T& _2bz)
 {
-  float hx, hy, hz;
+  T hx, hy, hz;
   // Reference direction of Earth's magnetic field (See EQ 46)
   rotateAndScaleVector(q0, -q1, -q2, -q3, mx, my, mz, hx, hy, hz);
 
-  _2bxy = 4.0f * sqrt (hx * hx + hy * hy);
-  _2bz = 4.0f * hz;
+  _2bxy = T(4) * std::sqrt (hx * hx + hy * hy);
+  _2bz = T(4) * hz;
 
 }
 
 
-ImuFilter::ImuFilter() :
+template <class Precision>
+ImuFilterT<Precision>::ImuFilterT() :
+    gain_ (0.0), zeta_ (0.0), world_frame_(WorldFrame::ENU),
     q0(1.0), q1(0.0), q2(0.0), q3(0.0),
-    w_bx_(0.0), w_by_(0.0), w_bz_(0.0),
-    zeta_ (0.0), gain_ (0.0), world_frame_(WorldFrame::ENU)
+    w_bx_(0.0), w_by_(0.0), w_bz_(0.0)
 {
 }
 
-ImuFilter::~ImuFilter()
+template <class Precision>
+ImuFilterT<Precision>::~ImuFilterT()
 {
 }
 
-void ImuFilter::madgwickAHRSupdate(
-    float gx, float gy, float gz,
-    float ax, float ay, float az,
-    float mx, float my, float mz,
-    float dt)
+template <class Precision>
+void ImuFilterT<Precision>::madgwickAHRSupdate(
+    Scalar gx, Scalar gy, Scalar gz,
+    Scalar ax, Scalar ay, Scalar az,
+    Scalar mx, Scalar my, Scalar mz,
+    Scalar dt)
 {
-  float s0, s1, s2, s3;
-  float qDot1, qDot2, qDot3, qDot4;
-  float _2bz, _2bxy;
+  Scalar s0, s1, s2, s3;
+  Scalar qDot1, qDot2, qDot3, qDot4;
+  Scalar _2bz, _2bxy;
 
   // Use IMU algorithm if magnetometer measurement invalid (avoids NaN in magnetometer normalisation)
-  if (!std::isfinite(mx) || !std::isfinite(my) || !std::isfinite(mz))
+  // NOTE: an exact reciprocal square root of a null norm is infinite, so a null reading must be caught too
+  if (!std::isfinite(mx) || !std::isfinite(my) || !std::isfinite(mz) ||
+      ((mx == Scalar(0)) && (my == Scalar(0)) && (mz == Scalar(0))))
   {
     madgwickAHRSupdateIMU(gx, gy, gz, ax, ay, az, dt);
     return;
   }
 
   // Compute feedback only if accelerometer measurement valid (avoids NaN in accelerometer normalisation)
-  if (!((ax == 0.0f) && (ay == 0.0f) && (az == 0.0f)))
+  if (!((ax == Scalar(0)) && (ay == Scalar(0)) && (az == Scalar(0))))
   {
     // Normalise accelerometer measurement
-    normalizeVector(ax, ay, az);
+    normalizeVector<Precision>(ax, ay, az);
 
     // Normalise magnetometer measurement
-    normalizeVector(mx, my, mz);
+    normalizeVector<Precision>(mx, my, mz);
 
     // Compensate for magnetic distortion
     compensateMagneticDistortion(q0, q1, q2, q3, mx, my, mz, _2bxy, _2bz);
 
     // Gradient decent algorithm corrective step
-    s0 = 0.0;  s1 = 0.0;  s2 = 0.0;  s3 = 0.0;
+    s0 = 0;  s1 = 0;  s2 = 0;  s3 = 0;
     switch (world_frame_) {
       case WorldFrame::NED:
         // Gravity: [0, 0, -1]
-        addGradientDescentStep(q0, q1, q2, q3, 0.0, 0.0, -2.0, ax, ay, az, s0, s1, s2, s3);
+        addGradientDescentStep(q0, q1, q2, q3, Scalar(0), Scalar(0), Scalar(-2), ax, ay, az, s0, s1, s2, s3);
 
         // Earth magnetic field: = [bxy, 0, bz]
-        addGradientDescentStep(q0,q1,q2,q3, _2bxy, 0.0, _2bz, mx, my, mz, s0, s1, s2, s3);
+        addGradientDescentStep(q0,q1,q2,q3, _2bxy, Scalar(0), _2bz, mx, my, mz, s0, s1, s2, s3);
         break;
       case WorldFrame::NWU:
         // Gravity: [0, 0, 1]
-        addGradientDescentStep(q0, q1, q2, q3, 0.0, 0.0, 2.0, ax, ay, az, s0, s1, s2, s3);
+        addGradientDescentStep(q0, q1, q2, q3, Scalar(0), Scalar(0), Scalar(2), ax, ay, az, s0, s1, s2, s3);
 
         // Earth magnetic field: = [bxy, 0, bz]
-        addGradientDescentStep(q0,q1,q2,q3, _2bxy, 0.0, _2bz, mx, my, mz, s0, s1, s2, s3);
+        addGradientDescentStep(q0,q1,q2,q3, _2bxy, Scalar(0), _2bz, mx, my, mz, s0, s1, s2, s3);
         break;
       default:
       case WorldFrame::ENU:
         // Gravity: [0, 0, 1]
-        addGradientDescentStep(q0, q1, q2, q3, 0.0, 0.0, 2.0, ax, ay, az, s0, s1, s2, s3);
+        addGradientDescentStep(q0, q1, q2, q3, Scalar(0), Scalar(0), Scalar(2), ax, ay, az, s0, s1, s2, s3);
 
         // Earth magnetic field: = [0, bxy, bz]
-        addGradientDescentStep(q0, q1, q2, q3, 0.0, _2bxy, _2bz, mx, my, mz, s0, s1, s2, s3);
+        addGradientDescentStep(q0, q1, q2, q3, Scalar(0), _2bxy, _2bz, mx, my, mz, s0, s1, s2, s3);
         break;
     }
-    normalizeQuaternion(s0, s1, s2, s3);
+    normalizeQuaternion<Precision>(s0, s1, s2, s3);
 
     // compute gyro drift bias
     compensateGyroDrift(q0, q1, q2, q3, s0, s1, s2, s3, dt, zeta_, w_bx_, w_by_, w_bz_, gx, gy, gz);
@@ -252,46 +251,46 @@ void ImuFilter::madgwickAHRSupdate(
   q3 += qDot4 * dt;
 
   // Normalise quaternion
-  normalizeQuaternion(q0, q1, q2, q3);
+  normalizeQuaternion<Precision>(q0, q1, q2, q3);
 }
 
-void ImuFilter::madgwickAHRSupdateIMU(
-    float gx, float gy, float gz,
-    float ax, float ay, float az,
-    float dt)
+template <class Precision>
+void ImuFilterT<Precision>::madgwickAHRSupdateIMU(
+    Scalar gx, Scalar gy, Scalar gz,
+    Scalar ax, Scalar ay, Scalar az,
+    Scalar dt)
 {
-  float recipNorm;
-  float s0, s1, s2, s3;
-  float qDot1, qDot2, qDot3, qDot4;
+  Scalar s0, s1, s2, s3;
+  Scalar qDot1, qDot2, qDot3, qDot4;
 
   // Rate of change of quaternion from gyroscope
   orientationChangeFromGyro (q0, q1, q2, q3, gx, gy, gz, qDot1, qDot2, qDot3, qDot4);
 
   // Compute feedback only if accelerometer measurement valid (avoids NaN in accelerometer normalisation)
-  if (!((ax == 0.0f) && (ay == 0.0f) && (az == 0.0f)))
+  if (!((ax == Scalar(0)) && (ay == Scalar(0)) && (az == Scalar(0))))
   {
     // Normalise accelerometer measurement
-    normalizeVector(ax, ay, az);
+    normalizeVector<Precision>(ax, ay, az);
 
     // Gradient decent algorithm corrective step
-    s0 = 0.0;  s1 = 0.0;  s2 = 0.0;  s3 = 0.0;
+    s0 = 0;  s1 = 0;  s2 = 0;  s3 = 0;
     switch (world_frame_) {
       case WorldFrame::NED:
         // Gravity: [0, 0, -1]
-        addGradientDescentStep(q0, q1, q2, q3, 0.0, 0.0, -2.0, ax, ay, az, s0, s1, s2, s3);
+        addGradientDescentStep(q0, q1, q2, q3, Scalar(0), Scalar(0), Scalar(-2), ax, ay, az, s0, s1, s2, s3);
         break;
       case WorldFrame::NWU:
         // Gravity: [0, 0, 1]
-        addGradientDescentStep(q0, q1, q2, q3, 0.0, 0.0, 2.0, ax, ay, az, s0, s1, s2, s3);
+        addGradientDescentStep(q0, q1, q2, q3, Scalar(0), Scalar(0), Scalar(2), ax, ay, az, s0, s1, s2, s3);
         break;
       default:
       case WorldFrame::ENU:
         // Gravity: [0, 0, 1]
-        addGradientDescentStep(q0, q1, q2, q3, 0.0, 0.0, 2.0, ax, ay, az, s0, s1, s2, s3);
+        addGradientDescentStep(q0, q1, q2, q3, Scalar(0), Scalar(0), Scalar(2), ax, ay, az, s0, s1, s2, s3);
         break;
     }
 
-    normalizeQuaternion(s0, s1, s2, s3);
+    normalizeQuaternion<Precision>(s0, s1, s2, s3);
 
     // Apply feedback step
     qDot1 -= gain_ * s0;
@@ -307,5 +306,9 @@ void ImuFilter::madgwickAHRSupdateIMU(
   q3 += qDot4 * dt;
 
   // Normalise quaternion
-  normalizeQuaternion (q0, q1, q2, q3);
+  normalizeQuaternion<Precision> (q0, q1, q2, q3);
 }
+
+template class ImuFilterT<FloatPrecision>;
+template class ImuFilterT<LegacyFloatPrecision>;
+template class ImuFilterT<DoublePrecision>;
@@ -0,0 +1,247 @@
+#include <ros/ros.h>
+#include <rosbag/bag.h>
+#include <rosbag/view.h>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <algorithm>
+#include <iostream>
+#include <boost/foreach.hpp>
+#include <boost/program_options.hpp>
+#include <sensor_msgs/Imu.h>
+#include <sensor_msgs/MagneticField.h>
+
+#include "imu_filter_madgwick/imu_filter.h"
+#include "imu_filter_madgwick/stateless_orientation.h"
+
+using namespace std;
+
+// Compare the precision policies of the filter on a recorded IMU session:
+// update time of each variant, and orientation error against the double precision filter.
+
+struct Sample
+{
+  double gx, gy, gz;
+  double ax, ay, az;
+  double mx, my, mz;  // NaN until a magnetometer message has been received
+  double dt;
+};
+
+struct Orientation
+{
+  double q0, q1, q2, q3;
+};
+
+struct Result
+{
+  double ns_per_update;
+  double max_error;   // deg
+  double rms_error;   // deg
+  double final_error; // deg
+};
+
+// Angle of the rotation between two unit quaternions (in degrees)
+static double angleBetween(const Orientation& a, const Orientation& b)
+{
+  double dot = fabs(a.q0 * b.q0 + a.q1 * b.q1 + a.q2 * b.q2 + a.q3 * b.q3);
+  dot = std::min(dot, 1.0);
+  return 2.0 * acos(dot) * 180.0 / M_PI;
+}
+
+template <class Filter>
+static void runFilter(Filter& filter, const std::vector<Sample>& samples, const Orientation& init,
+                      bool use_mag, std::vector<Orientation>* trajectory)
+{
+  filter.setOrientation(init.q0, init.q1, init.q2, init.q3);
+  for (size_t i = 0; i < samples.size(); i++)
+  {
+    const Sample& s = samples[i];
+    if (use_mag)
+      filter.madgwickAHRSupdate(s.gx, s.gy, s.gz, s.ax, s.ay, s.az, s.mx, s.my, s.mz, s.dt);
+    else
+      filter.madgwickAHRSupdateIMU(s.gx, s.gy, s.gz, s.ax, s.ay, s.az, s.dt);
+
+    if (trajectory != NULL)
+    {
+      Orientation& q = (*trajectory)[i];
+      filter.getOrientation(q.q0, q.q1, q.q2, q.q3);
+    }
+  }
+}
+
+template <class Precision>
+static Result benchmark(const std::vector<Sample>& samples, const Orientation& init,
+                        const std::vector<Orientation>& reference,
+                        WorldFrame::WorldFrame world_frame, double gain, double zeta,
+                        bool use_mag, int repeat)
+{
+  ImuFilterT<Precision> filter;
+  filter.setWorldFrame(world_frame);
+  filter.setAlgorithmGain(gain);
+  filter.setDriftBiasGain(zeta);
+
+  // Accuracy on a first pass, that also warms up the caches
+  std::vector<Orientation> trajectory(samples.size());
+  runFilter(filter, samples, init, use_mag, &trajectory);
+
+  Result result;
+  result.max_error = 0.0;
+  double sum = 0.0;
+  for (size_t i = 0; i < samples.size(); i++)
+  {
+    const double error = angleBetween(trajectory[i], reference[i]);
+    result.max_error = std::max(result.max_error, error);
+    sum += error * error;
+  }
+  result.rms_error = sqrt(sum / samples.size());
+  result.final_error = angleBetween(trajectory.back(), reference.back());
+
+  // Timing without the orientation copies, best of the repetitions
+  result.ns_per_update = std::numeric_limits<double>::max();
+  for (int r = 0; r < repeat; r++)
+  {
+    ros::WallTime start = ros::WallTime::now();
+    runFilter(filter, samples, init, use_mag, NULL);
+    const double ns = (ros::WallTime::now() - start).toSec() * 1e9 / samples.size();
+    result.ns_per_update = std::min(result.ns_per_update, ns);
+  }
+  return result;
+}
+
+static void printResult(const std::string& name, const Result& result)
+{
+  printf("%-12s %10.1f %12.6f %12.6f %12.6f\n", name.c_str(), result.ns_per_update,
+         result.max_error, result.rms_error, result.final_error);
+}
+
+int main(int argc, char **argv){
+
+	ros::Time::init();
+
+	std::string input_rosbag = "input.bag";
+	std::string input_imu_topic = "/imu/data_raw";
+	std::string input_mag_topic = "/imu/mag";
+	std::string world_frame = "nwu";
+	double gain = 0.1;
+	double zeta = 0.0;
+	bool imu_only = false;
+	int repeat = 10;
+
+	namespace po = boost::program_options;
+	po::options_description desc("Allowed options");
+	desc.add_options()
+	("help,h", "describe arguments")
+	("input,i", po::value(&input_rosbag), "set input rosbag file")
+	("input-imu-topic,m", po::value(&input_imu_topic), "set topic of the input Imu messages")
+	("input-mag-topic,g", po::value(&input_mag_topic), "set topic of the input MagneticField messages")
+	("world-frame,w", po::value(&world_frame), "set the world frame")
+	("gain", po::value(&gain), "set the algorithm gain")
+	("zeta", po::value(&zeta), "set the gyro drift bias gain")
+	("imu-only,u", po::bool_switch(&imu_only), "set to ignore the magnetometer")
+	("repeat,n", po::value(&repeat), "set the number of timed passes over the session");
+
+	po::variables_map vm;
+	po::store(po::parse_command_line(argc, argv, desc), vm);
+	po::notify(vm);
+
+	if (vm.count("help")) {
+		cout << desc << "\n";
+		return 1;
+	}
+
+	WorldFrame::WorldFrame frame = WorldFrame::ENU;
+	if (world_frame == "ned") {
+		frame = WorldFrame::NED;
+	} else if (world_frame == "nwu"){
+		frame = WorldFrame::NWU;
+	} else if (world_frame != "enu"){
+		fprintf(stderr, "The parameter world_frame was set to invalid value '%s'.\n", world_frame.c_str());
+		return 1;
+	}
+
+	// Load the session in memory, each Imu message is paired with the latest MagneticField message
+	std::vector<Sample> samples;
+	geometry_msgs::Vector3 mag;
+	mag.x = mag.y = mag.z = std::numeric_limits<double>::quiet_NaN();
+	ros::Time last_time;
+	bool has_orientation = false;
+	Orientation init = {1.0, 0.0, 0.0, 0.0};
+
+	rosbag::Bag input(input_rosbag, rosbag::bagmode::Read);
+	rosbag::View view(input);
+	BOOST_FOREACH(rosbag::MessageInstance const m, view)
+	{
+		if (m.getTopic() == input_mag_topic || ("/" + m.getTopic() == input_mag_topic))
+		{
+			sensor_msgs::MagneticField::ConstPtr msg = m.instantiate<sensor_msgs::MagneticField>();
+			if (msg != NULL)
+				mag = msg->magnetic_field;
+		}
+
+		if (m.getTopic() == input_imu_topic || ("/" + m.getTopic() == input_imu_topic))
+		{
+			sensor_msgs::Imu::ConstPtr imu = m.instantiate<sensor_msgs::Imu>();
+			if (imu == NULL)
+				continue;
+
+			if (!has_orientation)
+			{
+				// Start from the orientation given by the first samples, as the filter nodes do
+				geometry_msgs::Quaternion q;
+				if (imu_only || !std::isfinite(mag.x))
+				{
+					if (!imu_only)
+						continue;
+					StatelessOrientation::computeOrientation(frame, imu->linear_acceleration, q);
+				}
+				else
+				{
+					StatelessOrientation::computeOrientation(frame, imu->linear_acceleration, mag, q);
+				}
+				init.q0 = q.w;
+				init.q1 = q.x;
+				init.q2 = q.y;
+				init.q3 = q.z;
+				last_time = imu->header.stamp;
+				has_orientation = true;
+			}
+
+			Sample s;
+			s.gx = imu->angular_velocity.x;
+			s.gy = imu->angular_velocity.y;
+			s.gz = imu->angular_velocity.z;
+			s.ax = imu->linear_acceleration.x;
+			s.ay = imu->linear_acceleration.y;
+			s.az = imu->linear_acceleration.z;
+			s.mx = mag.x;
+			s.my = mag.y;
+			s.mz = mag.z;
+			s.dt = (imu->header.stamp - last_time).toSec();
+			last_time = imu->header.stamp;
+			samples.push_back(s);
+		}
+	}
+	input.close();
+
+	if (samples.empty())
+	{
+		fprintf(stderr, "No Imu messages found on topic %s\n", input_imu_topic.c_str());
+		return 1;
+	}
+
+	// Reference trajectory in double precision
+	std::vector<Orientation> reference(samples.size());
+	ImuFilterT<DoublePrecision> filter;
+	filter.setWorldFrame(frame);
+	filter.setAlgorithmGain(gain);
+	filter.setDriftBiasGain(zeta);
+	runFilter(filter, samples, init, !imu_only, &reference);
+
+	printf("Number of updates: %d (%s)\n", (int) samples.size(), imu_only ? "imu" : "imu + mag");
+	printf("%-12s %10s %12s %12s %12s\n", "variant", "ns/update", "max [deg]", "rms [deg]", "final [deg]");
+	printResult("double", benchmark<DoublePrecision>(samples, init, reference, frame, gain, zeta, !imu_only, repeat));
+	printResult("float", benchmark<FloatPrecision>(samples, init, reference, frame, gain, zeta, !imu_only, repeat));
+	printResult("float-legacy", benchmark<LegacyFloatPrecision>(samples, init, reference, frame, gain, zeta, !imu_only, repeat));
+
+	return 0;
+}
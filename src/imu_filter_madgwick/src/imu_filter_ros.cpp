@@ -31,7 +31,8 @@
 ImuFilterRos::ImuFilterRos(ros::NodeHandle nh, ros::NodeHandle nh_private):
   nh_(nh),
   nh_private_(nh_private),
-  initialized_(false)
+  initialized_(false),
+  has_checkpoint_(false)
 {
   ROS_INFO ("Starting ImuFilter");
 
@@ -50,6 +51,15 @@ ImuFilterRos::ImuFilterRos(ros::NodeHandle nh, ros::NodeHandle nh_private):
     constant_dt_ = 0.0;
   if (!nh_private_.getParam ("publish_debug_topics", publish_debug_topics_))
     publish_debug_topics_= false;
+  // the magnetometer driver already removes the hard and soft iron (e.g. imu_capture_mag with calibrate)
+  if (!nh_private_.getParam ("mag_calibrated", mag_calibrated_))
+    mag_calibrated_ = false;
+  if (!nh_private_.getParam ("checkpoint_file", checkpoint_file_))
+    checkpoint_file_ = "";
+  if (!nh_private_.getParam ("checkpoint_period", checkpoint_period_))
+    checkpoint_period_ = 10.0;
+  if (!nh_private_.getParam ("checkpoint_max_age", checkpoint_max_age_))
+    checkpoint_max_age_ = 600.0;
 
   // For ROS Jade, make this default to true.
   if (!nh_private_.getParam ("use_magnetic_field_msg", use_magnetic_field_msg_))
@@ -83,6 +93,18 @@ ImuFilterRos::ImuFilterRos(ros::NodeHandle nh, ros::NodeHandle nh_private):
   }
   filter_.setWorldFrame(world_frame_);
 
+  // **** load the state saved by the previous run
+  if (!checkpoint_file_.empty() && !stateless_)
+  {
+    if (!checkpoint_.load(checkpoint_file_))
+      ROS_INFO("No filter checkpoint loaded from %s", checkpoint_file_.c_str());
+    else if (checkpoint_.world_frame != world_frame_)
+      ROS_WARN("Ignoring filter checkpoint %s: saved in another world frame", checkpoint_file_.c_str());
+    else
+      has_checkpoint_ = true;
+  }
+  last_checkpoint_ = ros::WallTime::now();
+
   // check for illegal constant_dt values
   if (constant_dt_ < 0.0)
   {
@@ -156,6 +178,39 @@ ImuFilterRos::ImuFilterRos(ros::NodeHandle nh, ros::NodeHandle nh_private):
 ImuFilterRos::~ImuFilterRos()
 {
   ROS_INFO ("Destroying ImuFilter");
+  saveCheckpoint(true);
+}
+
+void ImuFilterRos::restoreCheckpoint()
+{
+  if (!has_checkpoint_)
+    return;
+  has_checkpoint_ = false;
+
+  // The drift bias is a property of the sensor and is always kept. The orientation is only
+  // restored if the device had no time to be moved since the checkpoint.
+  const double age = ros::WallTime::now().toSec() - checkpoint_.wall_time;
+  const bool restore_orientation = age >= 0.0 && age <= checkpoint_max_age_;
+  checkpoint_.restore(filter_, restore_orientation);
+  ROS_INFO("Restored filter %s from %s (%.1f sec old)",
+           restore_orientation ? "orientation and drift bias" : "drift bias",
+           checkpoint_file_.c_str(), age);
+}
+
+void ImuFilterRos::saveCheckpoint(bool force)
+{
+  if (checkpoint_file_.empty() || stateless_ || !initialized_)
+    return;
+
+  ros::WallTime now = ros::WallTime::now();
+  if (!force && (now - last_checkpoint_).toSec() < checkpoint_period_)
+    return;
+  last_checkpoint_ = now;
+
+  FilterCheckpoint checkpoint;
+  checkpoint.capture(filter_, world_frame_, last_time_.toSec());
+  if (!checkpoint.save(checkpoint_file_))
+    ROS_WARN("Unable to save filter checkpoint to %s", checkpoint_file_.c_str());
 }
 
 void ImuFilterRos::imuCallback(const ImuMsg::ConstPtr& imu_msg_raw)
@@ -173,6 +228,7 @@ void ImuFilterRos::imuCallback(const ImuMsg::ConstPtr& imu_msg_raw)
     geometry_msgs::Quaternion init_q;
     StatelessOrientation::computeOrientation(world_frame_, lin_acc, init_q);
     filter_.setOrientation(init_q.w, init_q.x, init_q.y, init_q.z);
+    restoreCheckpoint();
 
     // initialize time
     last_time_ = time;
@@ -193,6 +249,7 @@ void ImuFilterRos::imuCallback(const ImuMsg::ConstPtr& imu_msg_raw)
       ang_vel.x, ang_vel.y, ang_vel.z,
       lin_acc.x, lin_acc.y, lin_acc.z,
       dt);
+  saveCheckpoint();
 
   publishFilteredMsg(imu_msg_raw);
   if (publish_tf_)
@@ -212,11 +269,14 @@ void ImuFilterRos::imuMagCallback(
   ros::Time time = imu_msg_raw->header.stamp;
   imu_frame_ = imu_msg_raw->header.frame_id;
 
-  /*** Compensate for hard iron ***/
-  geometry_msgs::Vector3 mag_compensated;
-  mag_compensated.x = mag_fld.x - mag_bias_.x;
-  mag_compensated.y = mag_fld.y - mag_bias_.y;
-  mag_compensated.z = mag_fld.z - mag_bias_.z;
+  /*** Compensate for hard iron, unless already done on the calibrated topic ***/
+  geometry_msgs::Vector3 mag_compensated = mag_fld;
+  if (!mag_calibrated_)
+  {
+    mag_compensated.x -= mag_bias_.x;
+    mag_compensated.y -= mag_bias_.y;
+    mag_compensated.z -= mag_bias_.z;
+  }
 
   double roll = 0.0;
   double pitch = 0.0;
@@ -233,6 +293,7 @@ void ImuFilterRos::imuMagCallback(
     geometry_msgs::Quaternion init_q;
     StatelessOrientation::computeOrientation(world_frame_, lin_acc, mag_compensated, init_q);
     filter_.setOrientation(init_q.w, init_q.x, init_q.y, init_q.z);
+    restoreCheckpoint();
 
     last_time_ = time;
     initialized_ = true;
@@ -253,6 +314,7 @@ void ImuFilterRos::imuMagCallback(
       lin_acc.x, lin_acc.y, lin_acc.z,
       mag_compensated.x, mag_compensated.y, mag_compensated.z,
       dt);
+  saveCheckpoint();
 
   publishFilteredMsg(imu_msg_raw);
   if (publish_tf_)
@@ -359,7 +421,10 @@ void ImuFilterRos::reconfigCallback(FilterConfig& config, uint32_t level)
   mag_bias_.y = config.mag_bias_y;
   mag_bias_.z = config.mag_bias_z;
   orientation_variance_ = config.orientation_stddev * config.orientation_stddev;
-  ROS_INFO("Magnetometer bias values: %f %f %f", mag_bias_.x, mag_bias_.y, mag_bias_.z);
+  if (mag_calibrated_)
+    ROS_INFO("Magnetometer bias values ignored: the magnetic field is already calibrated");
+  else
+    ROS_INFO("Magnetometer bias values: %f %f %f", mag_bias_.x, mag_bias_.y, mag_bias_.z);
 }
 
 void ImuFilterRos::imuMagVectorCallback(const MagVectorMsg::ConstPtr& mag_vector_msg)
@@ -4,6 +4,8 @@
 #include <iostream>
 #include <boost/foreach.hpp>
 #include <boost/program_options.hpp>
+#include <boost/thread.hpp>
+#include <boost/lexical_cast.hpp>
 #include <message_filters/subscriber.h>
 #include <message_filters/synchronizer.h>
 #include <message_filters/sync_policies/exact_time.h>
@@ -13,6 +15,7 @@
 #include <sensor_msgs/MagneticField.h>
 
 #include "imu_filter_madgwick/imu_filter.h"
+#include "imu_filter_madgwick/filter_checkpoint.h"
 #include "imu_filter_madgwick/stateless_orientation.h"
 #include "imu_filter_madgwick/ImuFilterMadgwickConfig.h"
 #include "geometry_msgs/TransformStamped.h"
@@ -56,6 +59,9 @@ class ImuFilterRosbag
 				  const std::string& imu_frame = "imu_link", const std::string& fixed_frame = "base_link"){
 
 	  	bag_ = bag;
+	  	initialized_ = false;
+	  	output_start_ = ros::TIME_MIN;
+	  	output_end_ = ros::TIME_MAX;
 	  	nb_msg_generated_ = 0;
 	  	nb_tf_msg_generated_ = 0;
 	  	stateless_ = stateless;
@@ -110,6 +116,33 @@ class ImuFilterRosbag
 		mag_sub_->newMessage(mag);
 	}
 
+	// Resume the filter from a saved state: Imu messages up to the checkpoint time are ignored
+	bool startFromCheckpoint(const FilterCheckpoint& checkpoint){
+		if (stateless_ || checkpoint.world_frame != world_frame_){
+			return false;
+		}
+		checkpoint.restore(filter_);
+		last_time_ = ros::Time(checkpoint.stamp);
+		start_time_ = last_time_;
+		initialized_ = true;
+		return true;
+	}
+
+	// Only messages stamped in [start, end) are written, the others only update the filter
+	void setOutputWindow(const ros::Time& start, const ros::Time& end){
+		output_start_ = start;
+		output_end_ = end;
+	}
+
+	bool saveCheckpoint(const std::string& path){
+		if (!initialized_ || stateless_){
+			return false;
+		}
+		FilterCheckpoint checkpoint;
+		checkpoint.capture(filter_, world_frame_, last_time_.toSec());
+		return checkpoint.save(path);
+	}
+
 
   private:
 
@@ -129,6 +162,9 @@ class ImuFilterRosbag
     // **** state variables
     bool initialized_;
     ros::Time last_time_;
+    ros::Time start_time_;
+    ros::Time output_start_;
+    ros::Time output_end_;
     int nb_msg_generated_;
     int nb_tf_msg_generated_;
     bool publish_tf_;
@@ -163,6 +199,10 @@ class ImuFilterRosbag
 	  const geometry_msgs::Vector3& mag_fld = mag_msg->magnetic_field;
 
 	  ros::Time time = imu_msg_raw->header.stamp;
+	  if (time <= start_time_){
+		  // Already processed before the checkpoint
+		  return;
+	  }
 
 	  /*** Compensate for hard iron ***/
 	  geometry_msgs::Vector3 mag_compensated;
@@ -201,6 +241,9 @@ class ImuFilterRosbag
 		  mag_compensated.x, mag_compensated.y, mag_compensated.z,
 		  dt);
 
+	  if (time < output_start_ || time >= output_end_)
+		  return;
+
 	  publishFilteredMsg(imu_msg_raw);
 	  if (publish_tf_)
 	      publishTransform(imu_msg_raw);
@@ -277,6 +320,209 @@ class ImuFilterRosbag
 
 };
 
+static bool isTopic(const std::string& bag_topic, const std::string& topic){
+	return bag_topic == topic || ("/" + bag_topic == topic);
+}
+
+// Selects the connections of the input rosbag that are copied to the output rosbag
+struct ExcludeTopic
+{
+	std::string topic;
+
+	bool operator()(const rosbag::ConnectionInfo* info) const {
+		return !isTopic(info->topic, topic);
+	}
+};
+
+struct SegmentOptions
+{
+	std::string input_rosbag;
+	std::string output_imu_topic;
+	std::string input_imu_topic;
+	std::string input_mag_topic;
+	std::string world_frame;
+	std::string imu_frame;
+	std::string fixed_frame;
+	bool stateless;
+	bool publish_tf;
+	bool reverse_tf;
+};
+
+/* Time range of the input rosbag filtered by one thread.
+ * The filter is fed from read_start, a warm-up window before start, so that it has converged
+ * when the first output message is written. Outputs are written to a temporary rosbag.
+ */
+struct Segment
+{
+	ros::Time start;
+	ros::Time end;
+	ros::Time read_start;
+	ros::Time read_end;
+	bool has_checkpoint;
+	FilterCheckpoint checkpoint;
+	std::string checkpoint_out;
+	std::string path;
+	int nb_imu_msg_processed;
+	bool ok;
+};
+
+static void filterSegment(const SegmentOptions* options, Segment* segment){
+
+	segment->ok = false;
+	segment->nb_imu_msg_processed = 0;
+	try {
+		rosbag::Bag input(options->input_rosbag, rosbag::bagmode::Read);
+		rosbag::Bag output(segment->path, rosbag::bagmode::Write);
+
+		ImuFilterRosbag filter(&output, options->output_imu_topic, options->world_frame, options->stateless,
+		                       options->publish_tf, options->reverse_tf, options->imu_frame, options->fixed_frame);
+		filter.setOutputWindow(segment->start, segment->end);
+		if (segment->has_checkpoint && !filter.startFromCheckpoint(segment->checkpoint)){
+			fprintf(stderr, "Filter checkpoint does not match the world frame or stateless mode\n");
+			return;
+		}
+
+		std::vector<std::string> topics;
+		topics.push_back(options->input_imu_topic);
+		topics.push_back(options->input_imu_topic.substr(options->input_imu_topic.find_first_not_of('/')));
+		topics.push_back(options->input_mag_topic);
+		topics.push_back(options->input_mag_topic.substr(options->input_mag_topic.find_first_not_of('/')));
+
+		rosbag::View view(input, rosbag::TopicQuery(topics), segment->read_start, segment->read_end);
+		BOOST_FOREACH(rosbag::MessageInstance const m, view)
+		{
+			if (isTopic(m.getTopic(), options->input_imu_topic))
+			{
+			  sensor_msgs::Imu::ConstPtr imu = m.instantiate<sensor_msgs::Imu>();
+			  if (imu != NULL){
+				  filter.addImuMessage(imu);
+				  segment->nb_imu_msg_processed++;
+			  }
+			}
+			if (isTopic(m.getTopic(), options->input_mag_topic))
+			{
+			  sensor_msgs::MagneticField::ConstPtr mag = m.instantiate<sensor_msgs::MagneticField>();
+			  if (mag != NULL){
+				  filter.addMagMessage(mag);
+			  }
+			}
+		}
+
+		if (!segment->checkpoint_out.empty() && !filter.saveCheckpoint(segment->checkpoint_out)){
+			fprintf(stderr, "Unable to save filter checkpoint %s\n", segment->checkpoint_out.c_str());
+		}
+
+		output.close();
+		input.close();
+		segment->ok = true;
+	} catch (rosbag::BagException& e) {
+		fprintf(stderr, "Error while filtering segment %s: %s\n", segment->path.c_str(), e.what());
+	}
+}
+
+/* Filter the time segments of the input rosbag in parallel, then merge the filtered messages
+ * with a copy of the input messages, in time order.
+ */
+static int filterParallel(const SegmentOptions& options, const std::string& output_rosbag,
+                          int nb_jobs, double warmup, const std::string& checkpoint_in,
+                          const std::string& checkpoint_out){
+
+	FilterCheckpoint checkpoint;
+	ros::Time begin, end;
+	{
+		rosbag::Bag input(options.input_rosbag, rosbag::bagmode::Read);
+		rosbag::View view(input);
+		begin = view.getBeginTime();
+		end = view.getEndTime();
+	}
+	if (!checkpoint_in.empty()){
+		if (!checkpoint.load(checkpoint_in)){
+			fprintf(stderr, "Unable to load filter checkpoint %s\n", checkpoint_in.c_str());
+			return 1;
+		}
+		begin = std::max(begin, ros::Time(checkpoint.stamp));
+	}
+	if (end <= begin){
+		fprintf(stderr, "Nothing to filter after time %f\n", begin.toSec());
+		return 1;
+	}
+
+	const ros::Duration length((end - begin).toSec() / nb_jobs);
+	const ros::Duration margin(1.0);
+	std::vector<Segment> segments(nb_jobs);
+	for (int i = 0; i < nb_jobs; i++){
+		Segment& segment = segments[i];
+		segment.start = begin + ros::Duration(length.toSec() * i);
+		segment.end = begin + ros::Duration(length.toSec() * (i + 1));
+		segment.has_checkpoint = false;
+		segment.path = output_rosbag + ".segment" + boost::lexical_cast<std::string>(i);
+
+		// Header stamps lag the recording times: read a margin past the end of the segment
+		segment.read_end = (i == nb_jobs - 1) ? ros::TIME_MAX : segment.end + margin;
+		if (i == nb_jobs - 1){
+			segment.end = ros::TIME_MAX;
+			segment.checkpoint_out = checkpoint_out;
+		}
+
+		if (i == 0){
+			segment.start = ros::TIME_MIN;
+			segment.read_start = ros::TIME_MIN;
+			if (!checkpoint_in.empty()){
+				segment.has_checkpoint = true;
+				segment.checkpoint = checkpoint;
+				if (begin.toSec() > margin.toSec()){
+					segment.read_start = begin - margin;
+				}
+			}
+		} else{
+			segment.read_start = ros::Time(std::max(segment.start.toSec() - warmup, ros::TIME_MIN.toSec()));
+		}
+	}
+
+	boost::thread_group threads;
+	for (int i = 0; i < nb_jobs; i++){
+		threads.create_thread(boost::bind(&filterSegment, &options, &segments[i]));
+	}
+	threads.join_all();
+
+	bool ok = true;
+	for (int i = 0; i < nb_jobs; i++){
+		printf("Segment %d: %d imu messages processed\n", i, segments[i].nb_imu_msg_processed);
+		ok = ok && segments[i].ok;
+	}
+
+	if (ok){
+		rosbag::Bag output(output_rosbag, rosbag::bagmode::Write);
+		rosbag::Bag input(options.input_rosbag, rosbag::bagmode::Read);
+		std::vector<boost::shared_ptr<rosbag::Bag> > parts;
+
+		ExcludeTopic exclude;
+		exclude.topic = options.output_imu_topic;
+		rosbag::View view;
+		view.addQuery(input, exclude, segments[0].has_checkpoint ? begin : ros::TIME_MIN, ros::TIME_MAX);
+		for (int i = 0; i < nb_jobs; i++){
+			parts.push_back(boost::make_shared<rosbag::Bag>(segments[i].path, rosbag::bagmode::Read));
+			view.addQuery(*parts.back());
+		}
+
+		int nb_total_msg_processed = 0;
+		BOOST_FOREACH(rosbag::MessageInstance const m, view)
+		{
+			output.write(m.getTopic(), m.getTime(), m, m.getConnectionHeader());
+			nb_total_msg_processed++;
+			if (nb_total_msg_processed % 10000 == 0){
+				printf("Number of messages merged: %d\n", nb_total_msg_processed);
+			}
+		}
+		output.close();
+	}
+
+	for (int i = 0; i < nb_jobs; i++){
+		std::remove(segments[i].path.c_str());
+	}
+	return ok ? 0 : 1;
+}
+
 int main(int argc, char **argv){
 
 	ros::Time::init();
@@ -289,9 +535,13 @@ int main(int argc, char **argv){
 	std::string world_frame = "nwu";
 	std::string imu_frame = "imu_link";
 	std::string fixed_frame = "base_link";
+	std::string checkpoint_in;
+	std::string checkpoint_out;
 	bool stateless = false;
 	bool publish_tf = false;
 	bool reverse_tf = false;
+	int nb_jobs = 1;
+	double warmup = 30.0;
 
 	namespace po = boost::program_options;
 	po::options_description desc("Allowed options");
@@ -307,7 +557,11 @@ int main(int argc, char **argv){
 	("publish-tf,t", po::bool_switch(&publish_tf), "set to publish tf messages")
 	("reverse-tf,r", po::bool_switch(&reverse_tf), "set to reverse tf messages")
 	("imu-frame,f", po::value(&imu_frame), "set the name of the imu frame")
-	("fixed-frame,x", po::value(&fixed_frame), "set the name of the fixed frame");
+	("fixed-frame,x", po::value(&fixed_frame), "set the name of the fixed frame")
+	("checkpoint-in,c", po::value(&checkpoint_in), "set the filter checkpoint to start from (in the middle of the input rosbag)")
+	("checkpoint-out,k", po::value(&checkpoint_out), "set the file where the final filter state is saved")
+	("jobs,j", po::value(&nb_jobs), "set the number of time segments filtered in parallel")
+	("warmup", po::value(&warmup), "set the time (in sec) the filter runs before each segment to converge");
 
 	po::variables_map vm;
 	po::store(po::parse_command_line(argc, argv, desc), vm);
@@ -318,15 +572,51 @@ int main(int argc, char **argv){
 		return 1;
 	}
 
+	if (nb_jobs > 1){
+		SegmentOptions options;
+		options.input_rosbag = input_rosbag;
+		options.output_imu_topic = output_imu_topic;
+		options.input_imu_topic = input_imu_topic;
+		options.input_mag_topic = input_mag_topic;
+		options.world_frame = world_frame;
+		options.imu_frame = imu_frame;
+		options.fixed_frame = fixed_frame;
+		options.stateless = stateless;
+		options.publish_tf = publish_tf;
+		options.reverse_tf = reverse_tf;
+		return filterParallel(options, output_rosbag, nb_jobs, warmup, checkpoint_in, checkpoint_out);
+	}
+
 	rosbag::Bag output(output_rosbag, rosbag::bagmode::Write);
 	rosbag::Bag input(input_rosbag, rosbag::bagmode::Read);
 
 	ImuFilterRosbag filter(&output, output_imu_topic, world_frame, stateless, publish_tf, reverse_tf, imu_frame, fixed_frame);
 
+	ros::Time start_time = ros::TIME_MIN;
+	ros::Time read_time = ros::TIME_MIN;
+	if (!checkpoint_in.empty()){
+		FilterCheckpoint checkpoint;
+		if (!checkpoint.load(checkpoint_in)){
+			fprintf(stderr, "Unable to load filter checkpoint %s\n", checkpoint_in.c_str());
+			return 1;
+		}
+		if (!filter.startFromCheckpoint(checkpoint)){
+			fprintf(stderr, "Filter checkpoint %s does not match the world frame or stateless mode\n", checkpoint_in.c_str());
+			return 1;
+		}
+
+		// Read slightly earlier so that the first Imu messages can be paired with a MagneticField message
+		start_time = ros::Time(checkpoint.stamp);
+		if (checkpoint.stamp > 1.0){
+			read_time = start_time - ros::Duration(1.0);
+		}
+		printf("Starting from filter checkpoint at time %f\n", checkpoint.stamp);
+	}
+
 	int nb_imu_msg_processed = 0;
 	int nb_mag_msg_processed = 0;
 	int nb_total_msg_processed = 0;
-	rosbag::View view(input);
+	rosbag::View view(input, read_time, ros::TIME_MAX);
 	BOOST_FOREACH(rosbag::MessageInstance const m, view)
 	{
 		// Detect Imu messages from the given topic
@@ -349,7 +639,7 @@ int main(int argc, char **argv){
 		  }
 		}
 
-		if (m.getTopic() != output_imu_topic){
+		if (m.getTopic() != output_imu_topic && m.getTime() >= start_time){
 			// Write every message to output bag
 			output.write(m.getTopic(), m.getTime(), m, m.getConnectionHeader());
 			nb_total_msg_processed++;
@@ -361,6 +651,10 @@ int main(int argc, char **argv){
 		}
 	}
 
+	if (!checkpoint_out.empty() && !filter.saveCheckpoint(checkpoint_out)){
+		fprintf(stderr, "Unable to save filter checkpoint %s\n", checkpoint_out.c_str());
+	}
+
 	output.close();
 	input.close();
 
@@ -0,0 +1,160 @@
+/*
+ *  Copyright (C) 2010, CCNY Robotics Lab
+ *  Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  http://robotics.ccny.cuny.edu
+ *
+ *  Based on implementation of Madgwick's IMU and AHRS algorithms.
+ *  http://www.x-io.co.uk/node/8#open_source_ahrs_and_imu_algorithms
+ *
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cmath>
+#include <vector>
+#include <gtest/gtest.h>
+#include "imu_filter_madgwick/imu_filter.h"
+
+// Accuracy of the single precision policies against the double precision filter, on a synthetic
+// session where the sensor rotates at a constant rate about a tilted axis.
+
+struct Orientation
+{
+  double q0, q1, q2, q3;
+};
+
+static const int NB_SAMPLES = 20000;
+static const double DT = 0.005;
+
+// Rotate v by the conjugate of q, i.e. express a vector of the world frame in the sensor frame
+static void toSensorFrame(const Orientation& q, const double v[3], double out[3])
+{
+  const double r[3][3] = {
+    {1 - 2 * (q.q2 * q.q2 + q.q3 * q.q3), 2 * (q.q1 * q.q2 - q.q0 * q.q3), 2 * (q.q1 * q.q3 + q.q0 * q.q2)},
+    {2 * (q.q1 * q.q2 + q.q0 * q.q3), 1 - 2 * (q.q1 * q.q1 + q.q3 * q.q3), 2 * (q.q2 * q.q3 - q.q0 * q.q1)},
+    {2 * (q.q1 * q.q3 - q.q0 * q.q2), 2 * (q.q2 * q.q3 + q.q0 * q.q1), 1 - 2 * (q.q1 * q.q1 + q.q2 * q.q2)}};
+  for (int i = 0; i < 3; i++)
+    out[i] = r[0][i] * v[0] + r[1][i] * v[1] + r[2][i] * v[2];
+}
+
+// Angle of the rotation between two unit quaternions (in degrees)
+static double angleBetween(const Orientation& a, const Orientation& b)
+{
+  double dot = std::fabs(a.q0 * b.q0 + a.q1 * b.q1 + a.q2 * b.q2 + a.q3 * b.q3);
+  dot = std::min(dot, 1.0);
+  return 2.0 * std::acos(dot) * 180.0 / M_PI;
+}
+
+// Orientation of the sensor at sample i, and the gyroscope, accelerometer and magnetometer readings (ENU)
+static Orientation truth(int i, double gyro[3], double acc[3], double mag[3])
+{
+  static const double axis[3] = {0.3, -0.2, 0.93};
+  static const double rate = 0.8;  // rad/s
+  const double n = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+  const double half = 0.5 * rate * i * DT;
+  Orientation q = {std::cos(half), std::sin(half) * axis[0] / n, std::sin(half) * axis[1] / n,
+                   std::sin(half) * axis[2] / n};
+
+  // Rotation about a fixed axis: the axis is the same in the world and sensor frames
+  for (int k = 0; k < 3; k++)
+    gyro[k] = rate * axis[k] / n;
+  const double gravity[3] = {0.0, 0.0, 9.81};
+  const double field[3] = {0.0, 0.18e-4, -0.5e-4};
+  toSensorFrame(q, gravity, acc);
+  toSensorFrame(q, field, mag);
+  return q;
+}
+
+template <class Precision>
+static std::vector<Orientation> run(bool use_mag, bool null_mag = false)
+{
+  ImuFilterT<Precision> filter;
+  filter.setWorldFrame(WorldFrame::ENU);
+  filter.setAlgorithmGain(0.1);
+  filter.setDriftBiasGain(0.0);
+  filter.setOrientation(1.0, 0.0, 0.0, 0.0);
+
+  std::vector<Orientation> trajectory(NB_SAMPLES);
+  for (int i = 0; i < NB_SAMPLES; i++)
+  {
+    double g[3], a[3], m[3];
+    truth(i + 1, g, a, m);
+    if (null_mag)
+      m[0] = m[1] = m[2] = 0.0;
+    if (use_mag)
+      filter.madgwickAHRSupdate(g[0], g[1], g[2], a[0], a[1], a[2], m[0], m[1], m[2], DT);
+    else
+      filter.madgwickAHRSupdateIMU(g[0], g[1], g[2], a[0], a[1], a[2], DT);
+    Orientation& q = trajectory[i];
+    filter.getOrientation(q.q0, q.q1, q.q2, q.q3);
+  }
+  return trajectory;
+}
+
+static double maxError(const std::vector<Orientation>& a, const std::vector<Orientation>& b)
+{
+  double error = 0.0;
+  for (size_t i = 0; i < a.size(); i++)
+    error = std::max(error, angleBetween(a[i], b[i]));
+  return error;
+}
+
+TEST(ImuFilterPrecision, DoubleFollowsTruth)
+{
+  std::vector<Orientation> reference = run<DoublePrecision>(true);
+  for (int i = 0; i < NB_SAMPLES; i++)
+  {
+    double g[3], a[3], m[3];
+    EXPECT_LT(angleBetween(reference[i], truth(i + 1, g, a, m)), 0.5) << "sample " << i;
+  }
+}
+
+// The remaining error comes from the single precision integration of the quaternion
+TEST(ImuFilterPrecision, FloatMatchesDouble)
+{
+  std::vector<Orientation> reference = run<DoublePrecision>(true);
+  EXPECT_LT(maxError(run<FloatPrecision>(true), reference), 0.2);
+
+  reference = run<DoublePrecision>(false);
+  EXPECT_LT(maxError(run<FloatPrecision>(false), reference), 0.2);
+}
+
+// The bit-hack reciprocal square root of the original implementation drifts by several degrees
+TEST(ImuFilterPrecision, FloatMoreAccurateThanLegacy)
+{
+  const std::vector<Orientation> reference = run<DoublePrecision>(true);
+  EXPECT_LT(maxError(run<FloatPrecision>(true), reference), maxError(run<LegacyFloatPrecision>(true), reference));
+}
+
+TEST(ImuFilterPrecision, NullMagnetometerFallsBackToImu)
+{
+  // A null magnetometer reading must not make the exact reciprocal square root infinite
+  const std::vector<Orientation> imu = run<DoublePrecision>(false);
+  const std::vector<Orientation> reference = run<DoublePrecision>(true, true);
+  const std::vector<Orientation> single = run<FloatPrecision>(true, true);
+  for (int i = 0; i < NB_SAMPLES; i++)
+  {
+    ASSERT_TRUE(std::isfinite(single[i].q0) && std::isfinite(single[i].q1) &&
+                std::isfinite(single[i].q2) && std::isfinite(single[i].q3)) << "sample " << i;
+  }
+  EXPECT_LT(maxError(reference, imu), 1e-4);
+  EXPECT_LT(maxError(single, imu), 0.2);
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -33,13 +33,14 @@ POSSIBILITY OF SUCH DAMAGE.
 #define CREATE_H
 
 #include <boost/shared_ptr.hpp>
-#include <boost/numeric/ublas/matrix.hpp>
+#include <boost/thread/mutex.hpp>
 #include <string>
 #include <unistd.h>
 
 #include "create/serial_stream.h"
 #include "create/serial_query.h"
 #include "create/data.h"
+#include "create/matrix.h"
 #include "create/types.h"
 #include "create/util.h"
 
@@ -53,8 +54,6 @@ namespace create {
 
   class Create {
     private:
-      typedef boost::numeric::ublas::matrix<float> Matrix;
-
       enum CreateLED {
         LED_DEBRIS = 1,
         LED_SPOT = 2,
@@ -87,9 +86,16 @@ namespace create {
       bool firstOnData;
       util::timestamp_t prevOnDataTime;
 
+      // Wheel slip coefficients (variance per meter of travel) of the right and left wheel
+      float kr;
+      float kl;
+
+      // Odometry state, updated from the serial callback thread
+      mutable boost::mutex odomMutex;
+      create::Pose pose;
+      create::Vel vel;
+
       void init(const SerialMode& serialMode = AUTO);
-      // Add two matrices and handle overflow case
-      Matrix addMatrices(const Matrix &A, const Matrix &B) const;
       void onData();
       bool updateLEDs();
 
@@ -125,6 +131,11 @@ namespace create {
        */
       void disconnect();
 
+      /* Set the slip coefficients (variance per meter of travel) of the right and left wheel
+       * used to propagate the odometry covariances.
+       */
+      void setWheelNoise(const float& right, const float& left);
+
       /* Change Create mode.
        * \param mode to put Create in.
        * \return true if successful, false otherwise
@@ -512,6 +523,17 @@ namespace create {
        */
       float getRightWheelDistance() const;
 
+      /* Get the estimated pose of Create based on wheel velocities.
+       * Pose covariance is propagated with the differential drive error model.
+       * \return pose (x-y position in meters and yaw angle in radians)
+       */
+      create::Pose getPose() const;
+
+      /* Get the estimated velocity of Create based on wheel velocities.
+       * \return velocity (x and y in m/s and angular velocity in rad/s)
+       */
+      create::Vel getVel() const;
+
       /* Get the requested velocity (in mm/sec) of the left wheel.
        * This value is bounded at the maximum velocity of the robot model.
        */
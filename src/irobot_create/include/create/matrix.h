@@ -0,0 +1,153 @@
+/**
+Software License Agreement (BSD)
+
+\file      matrix.h
+\authors   Jacob Perron <jperron@sfu.ca>
+\copyright Copyright (c) 2015, Autonomy Lab (Simon Fraser University), All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+ * Neither the name of Autonomy Lab nor the names of its contributors may
+   be used to endorse or promote products derived from this software without
+   specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef CREATE_MATRIX_H
+#define CREATE_MATRIX_H
+
+#include <cmath>
+#include <limits>
+
+namespace create {
+
+  /* Fixed-size, stack-allocated matrix used for odometry and covariance propagation.
+   * Dimensions are compile-time constants so that all loops can be fully unrolled
+   * and no heap allocation happens on the serial callback thread.
+   */
+  template <int R, int C>
+  struct FixedMatrix {
+    static const int ROWS = R;
+    static const int COLS = C;
+    static const int SIZE = R * C;
+
+    float data[R][C];
+
+    inline float& operator()(const int i, const int j) { return data[i][j]; }
+    inline const float& operator()(const int i, const int j) const { return data[i][j]; }
+
+    /* Set all elements to zero.
+     */
+    inline void setZero() {
+      for (int i = 0; i < R; i++)
+        for (int j = 0; j < C; j++)
+          data[i][j] = 0.0f;
+    }
+
+    static FixedMatrix zeros() {
+      FixedMatrix M;
+      M.setZero();
+      return M;
+    }
+
+    static FixedMatrix identity() {
+      FixedMatrix M;
+      M.setZero();
+      for (int i = 0; i < (R < C ? R : C); i++)
+        M.data[i][i] = 1.0f;
+      return M;
+    }
+
+    FixedMatrix<C, R> transpose() const {
+      FixedMatrix<C, R> T;
+      for (int i = 0; i < R; i++)
+        for (int j = 0; j < C; j++)
+          T.data[j][i] = data[i][j];
+      return T;
+    }
+
+    template <int K>
+    FixedMatrix<R, K> operator*(const FixedMatrix<C, K>& B) const {
+      FixedMatrix<R, K> P;
+      for (int i = 0; i < R; i++) {
+        for (int k = 0; k < K; k++) {
+          float sum = 0.0f;
+          for (int j = 0; j < C; j++)
+            sum += data[i][j] * B.data[j][k];
+          P.data[i][k] = sum;
+        }
+      }
+      return P;
+    }
+
+    /* Scale the matrix and saturate the result at the float limits.
+     */
+    FixedMatrix operator*(const float& k) const {
+      FixedMatrix S;
+      const float maxValue = std::numeric_limits<float>::max();
+      for (int i = 0; i < R; i++)
+        for (int j = 0; j < C; j++)
+          S.data[i][j] = data[i][j] * k;
+      for (int i = 0; i < R; i++) {
+        for (int j = 0; j < C; j++) {
+          if (std::fabs(S.data[i][j]) > maxValue) {
+            S.data[i][j] = (S.data[i][j] < 0.0f) ? -maxValue : maxValue;
+          }
+        }
+      }
+      return S;
+    }
+
+    /* Add two matrices and saturate the result at the float limits.
+     * Adding first and clamping non-finite results afterwards keeps the inner
+     * loop free of the per-element overflow branch.
+     */
+    FixedMatrix operator+(const FixedMatrix& B) const {
+      FixedMatrix S;
+      const float maxValue = std::numeric_limits<float>::max();
+      for (int i = 0; i < R; i++)
+        for (int j = 0; j < C; j++)
+          S.data[i][j] = data[i][j] + B.data[i][j];
+      for (int i = 0; i < R; i++) {
+        for (int j = 0; j < C; j++) {
+          if (std::fabs(S.data[i][j]) > maxValue) {
+            S.data[i][j] = (S.data[i][j] < 0.0f) ? -maxValue : maxValue;
+          }
+        }
+      }
+      return S;
+    }
+
+    /* Copy the matrix in row-major order to a flat array of at least SIZE elements.
+     */
+    template <typename T>
+    void toArray(T* out) const {
+      for (int i = 0; i < R; i++)
+        for (int j = 0; j < C; j++)
+          out[i * C + j] = data[i][j];
+    }
+  };
+
+  typedef FixedMatrix<2, 2> Matrix2;
+  typedef FixedMatrix<3, 2> Matrix32;
+  typedef FixedMatrix<3, 3> Matrix3;
+
+}  // namespace create
+
+#endif  // CREATE_MATRIX_H
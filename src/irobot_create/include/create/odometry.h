@@ -0,0 +1,170 @@
+/******************************************************************************
+ *
+ * Copyright (c) 2016, Simon Brodeur
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  - Neither the name of the NECOTIS research group nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef CREATE_ODOMETRY_H
+#define CREATE_ODOMETRY_H
+
+#include <string>
+
+#include "create/matrix.h"
+#include "create/types.h"
+
+namespace create {
+
+  enum OdometryIntegration {
+    INTEGRATION_EULER = 0,       // Straight-line step along the previous heading
+    INTEGRATION_RUNGE_KUTTA = 1, // Second-order step along the midpoint heading
+    INTEGRATION_EXACT = 2        // Exact circular arc (falls back to midpoint when driving straight)
+  };
+
+  // Variance reported for the pose dimensions not observed by planar odometry (z, roll, pitch)
+  const double UNOBSERVED_VARIANCE = 1e6;
+
+  /* Parse an integration method name ("euler", "runge_kutta" or "exact").
+   * \return false if the name is unknown, in which case integration is left unchanged.
+   */
+  bool parseIntegration(const std::string& name, OdometryIntegration& integration);
+
+  /* Express an angular velocity (in the IMU frame) around the world z-axis, so that the yaw rate
+   * is independent of how the IMU is mounted or of the tilt of the floor.
+   * The orientation quaternion (x, y, z, w) is ignored if it is not set (e.g. all zeros),
+   * in which case the z-axis of the IMU is used.
+   */
+  double worldYawRate(const double& wx, const double& wy, const double& wz,
+                      const double& qx, const double& qy, const double& qz, const double& qw);
+
+  /* Set a large uncorrelated variance on the dimensions not observed by planar odometry
+   * in a 6x6 (x, y, z, roll, pitch, yaw) row-major covariance.
+   */
+  template <typename Covariance6>
+  inline void fillUnobservedCovariance(Covariance6& out) {
+    for (int i = 2; i < 5; i++) {
+      out[i * 6 + i] = UNOBSERVED_VARIANCE;
+    }
+  }
+
+  /* Copy a 3x3 (x, y, yaw) covariance into a 6x6 (x, y, z, roll, pitch, yaw) row-major covariance.
+   */
+  template <typename Covariance6>
+  inline void fillPlanarCovariance(const Matrix3& cov, Covariance6& out) {
+    static const int index[3] = {0, 1, 5};
+    for (int i = 0; i < 3; i++) {
+      for (int j = 0; j < 3; j++) {
+        out[index[i] * 6 + index[j]] = cov(i, j);
+      }
+    }
+  }
+
+  /* Differential-drive odometry engine.
+   * Wheel travel is integrated on every joint state update, while the yaw increment is
+   * fused with the gyroscope yaw rate interpolated at the joint timestamps.
+   * All times are in seconds.
+   */
+  class Odometry {
+    public:
+      Odometry(const float& axleLength, const OdometryIntegration& integration = INTEGRATION_EXACT);
+
+      /* Set the method used to integrate the position increments.
+       */
+      void setIntegration(const OdometryIntegration& integration);
+
+      /* Set the wheel slip coefficient (variance per meter of travel).
+       */
+      void setWheelNoise(const float& k);
+
+      /* Set the gyroscope yaw rate noise density (in rad/s/sqrt(Hz)).
+       */
+      void setGyroNoise(const float& sigma);
+
+      /* Set the maximum age of gyroscope samples before falling back to wheel-only yaw.
+       */
+      void setGyroTimeout(const double& timeout);
+
+      /* Clear the pose, covariances and buffered gyroscope samples.
+       */
+      void reset();
+
+      /* Buffer a gyroscope sample (yaw rate around the world z-axis, in rad/s).
+       * Samples must be added in increasing time order.
+       */
+      void addGyro(const double& time, const float& yawRate);
+
+      /* Integrate a new wheel state.
+       * \param leftDist, rightDist total distance travelled by each wheel (in meters).
+       * \param leftVel, rightVel wheel velocities (in m/s).
+       * \return false on the first update, which only initializes the engine.
+       */
+      bool update(const double& time, const float& leftDist, const float& rightDist,
+                  const float& leftVel, const float& rightVel);
+
+      inline const create::Pose& getPose() const { return pose; };
+      inline const create::Vel& getVel() const { return vel; };
+
+      /* True if the gyroscope contributed to the last update.
+       */
+      inline bool isGyroFused() const { return gyroFused; };
+
+    private:
+      static const int GYRO_BUFFER_SIZE = 128;
+
+      float axleLength;
+      OdometryIntegration integration;
+      float wheelNoise;
+      float gyroNoise;
+      double gyroTimeout;
+
+      bool initialized;
+      bool gyroFused;
+      double lastTime;
+      float lastLeftDist;
+      float lastRightDist;
+
+      create::Pose pose;
+      create::Vel vel;
+
+      // Ring buffer of gyroscope samples
+      double gyroTimes[GYRO_BUFFER_SIZE];
+      float gyroRates[GYRO_BUFFER_SIZE];
+      int gyroHead;
+      int gyroCount;
+
+      inline int gyroIndex(const int i) const {
+        return (gyroHead - gyroCount + i + GYRO_BUFFER_SIZE) % GYRO_BUFFER_SIZE;
+      };
+
+      // Yaw rate at the given time, linearly interpolated between buffered samples
+      float interpolateGyro(const double& time) const;
+
+      // Integrate the interpolated yaw rate over [t0, t1] with the trapezoidal rule
+      bool integrateGyro(const double& t0, const double& t1, float& deltaYaw) const;
+  };
+
+}  // namespace create
+
+#endif  // CREATE_ODOMETRY_H
@@ -37,6 +37,8 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <string>
 #include <stdexcept>
 
+#include "create/matrix.h"
+
 namespace create {
   enum ProtocolVersion {
     V_1 = 1,
@@ -260,11 +262,14 @@ namespace create {
     IR_CHAR_VIRTUAL_WALL = 162
   };
 
+  /* Planar pose (or velocity) of the robot with its 3x3 covariance,
+   * ordered as (x, y, yaw).
+   */
   struct Pose {
     float x;
     float y;
     float yaw;
-    std::vector<float> covariance;
+    Matrix3 covariance;
   };
 
   typedef Pose Vel;
@@ -6,9 +6,9 @@
 #define SAFETY_RESTRICTION_TURNONLY 2
 #define SAFETY_RESTRICTION_BACKONLY 3
 
-CreateDriver::CreateDriver(ros::NodeHandle& nh)
+CreateDriver::CreateDriver(ros::NodeHandle& nh, const ros::NodeHandle& priv_nh)
   : nh_(nh),
-    priv_nh_("~"),
+    priv_nh_(priv_nh),
     diagnostics_(),
     model_(create::RobotModel::CREATE_1),
     is_running_slowly_(false)
@@ -18,6 +18,7 @@ CreateDriver::CreateDriver(ros::NodeHandle& nh)
   priv_nh_.param<std::string>("dev", dev_, "/dev/ttyUSB0");
   priv_nh_.param<double>("latch_cmd_duration", latch_duration_, 0.2);
   priv_nh_.param<bool>("safety", safety_, true);
+  priv_nh_.param<bool>("publish_odom", publish_odom_, true);
 
   create::SerialMode serialMode;
   std::string serial_mode_str;
@@ -29,8 +30,8 @@ CreateDriver::CreateDriver(ros::NodeHandle& nh)
   }else if (serial_mode_str == "query"){
 	  serialMode = create::QUERY;
   }else{
-	  ROS_FATAL("[CREATE] Unknown serial mode.");
-	  ros::shutdown();
+	  // Not ros::shutdown(), which would also stop the other nodelets of the manager
+	  throw std::runtime_error("Unknown serial mode '" + serial_mode_str + "'");
   }
 
   model_ = create::RobotModel::CREATE_1;
@@ -39,12 +40,19 @@ CreateDriver::CreateDriver(ros::NodeHandle& nh)
 
   priv_nh_.param<int>("baud", baud_, model_.getBaud());
 
+  // Slip coefficients (variance per meter of travel) of the odometry error model
+  double wheel_noise_right, wheel_noise_left;
+  priv_nh_.param<double>("wheel_noise_right", wheel_noise_right, 1.0);
+  priv_nh_.param<double>("wheel_noise_left", wheel_noise_left, 1.0);
+
   robot_ = new create::Create(model_, serialMode);
+  robot_->setWheelNoise(wheel_noise_right, wheel_noise_left);
 
   if (!robot_->connect(dev_, baud_))
   {
-    ROS_FATAL("[CREATE] Failed to establish serial connection with Create.");
-    ros::shutdown();
+    // The destructor is not called when the constructor throws
+    delete robot_;
+    throw std::runtime_error("Failed to establish serial connection with Create.");
   }
 
   ROS_INFO("[CREATE] Connection established.");
@@ -55,19 +63,41 @@ CreateDriver::CreateDriver(ros::NodeHandle& nh)
   // Show robot's battery level
   ROS_INFO("[CREATE] Battery level %.2f %%", (robot_->getBatteryCharge() / robot_->getBatteryCapacity()) * 100.0);
 
-  // Set frame_id's
+  // Set frame_id's and constant fields once on the prototype of each message pool
   const std::string str_base_baselink("base_link");
-  battery_msg_.header.frame_id = str_base_baselink;
-  contact_msg_.header.frame_id = str_base_baselink;
-  motors_msg_.header.frame_id = str_base_baselink;
-  ir_range_msg_.header.frame_id = str_base_baselink;
-
-  joint_state_msg_.name.resize(2);
-  joint_state_msg_.position.resize(2);
-  joint_state_msg_.velocity.resize(2);
-  joint_state_msg_.effort.resize(2);
-  joint_state_msg_.name[0] = "left_wheel_joint";
-  joint_state_msg_.name[1] = "right_wheel_joint";
+  sensor_msgs::BatteryState battery_msg;
+  create::Contact contact_msg;
+  create::MotorSpeed motors_msg;
+  create::IrRange ir_range_msg;
+  sensor_msgs::JointState joint_state_msg;
+  nav_msgs::Odometry odom_msg;
+
+  battery_msg.header.frame_id = str_base_baselink;
+  battery_msg.design_capacity = float(3.0);
+  battery_msg.present = true;
+  contact_msg.header.frame_id = str_base_baselink;
+  motors_msg.header.frame_id = str_base_baselink;
+  ir_range_msg.header.frame_id = str_base_baselink;
+  odom_msg.header.frame_id = "odom";
+  odom_msg.child_frame_id = str_base_baselink;
+
+  // Dimensions not estimated by the wheel odometry are left uncorrelated with a large variance
+  create::fillUnobservedCovariance(odom_msg.pose.covariance);
+  create::fillUnobservedCovariance(odom_msg.twist.covariance);
+
+  joint_state_msg.name.resize(2);
+  joint_state_msg.position.resize(2);
+  joint_state_msg.velocity.resize(2);
+  joint_state_msg.effort.resize(2);
+  joint_state_msg.name[0] = "left_wheel_joint";
+  joint_state_msg.name[1] = "right_wheel_joint";
+
+  battery_pool_.init(battery_msg);
+  contact_pool_.init(contact_msg);
+  motors_pool_.init(motors_msg);
+  ir_range_pool_.init(ir_range_msg);
+  joint_state_pool_.init(joint_state_msg);
+  odom_pool_.init(odom_msg);
 
   // Setup services
   beep_srv_ = nh.advertiseService("/irobot_create/beep", &CreateDriver::beepSrvCallback, this);
@@ -83,6 +113,10 @@ CreateDriver::CreateDriver(ros::NodeHandle& nh)
   motors_pub_ = nh.advertise<create::MotorSpeed>("/irobot_create/motors", 30);
   ir_range_pub_ = nh.advertise<create::IrRange>("/irobot_create/irRange", 30);
   wheel_joint_pub_ = nh.advertise<sensor_msgs::JointState>("/irobot_create/joints", 30);
+  if (publish_odom_)
+  {
+    odom_pub_ = nh.advertise<nav_msgs::Odometry>("/irobot_create/wheel_odom", 30);
+  }
 
   // Setup diagnostics
   diagnostics_.add("Battery Status", this, &CreateDriver::updateBatteryDiagnostics);
@@ -203,23 +237,27 @@ void CreateDriver::cmdVelCallback(const create::MotorSpeed& msg)
 {
   float leftWheel = ((float) msg.left) / 1000;
   float rightWheel = ((float) msg.right) / 1000;
+  boost::mutex::scoped_lock lock(robot_mutex_);
   driveWheels(leftWheel, rightWheel);
   last_cmd_vel_time_ = ros::Time::now();
 }
 
 bool CreateDriver::beepSrvCallback(create::Beep::Request& req, create::Beep::Response& res){
+	boost::mutex::scoped_lock lock(robot_mutex_);
 	beep();
 	res.success = true;
 	return true;
 }
 
 bool CreateDriver::brakeSrvCallback(create::Brake::Request& req, create::Brake::Response& res){
+	boost::mutex::scoped_lock lock(robot_mutex_);
 	robot_->driveWheels(0.0, 0.0);
 	res.success = true;
 	return true;
 }
 
 bool CreateDriver::ledsSrvCallback(create::Leds::Request& req, create::Leds::Response& res){
+	boost::mutex::scoped_lock lock(robot_mutex_);
 	robot_->setPowerLED(req.color, req.intensity);
 	res.success = true;
 	return true;
@@ -231,14 +269,33 @@ bool CreateDriver::update()
 	applySafety();
   }
 
-  publishJointInfo();
-  publishContactInfo();
-  publishBatteryInfo();
-  publishMotorsInfo();
-  publishIrRangeInfo();
+  ros::WallTime start = ros::WallTime::now();
+  readSnapshot();
+  ros::WallTime end = ros::WallTime::now();
+  read_timing_.add(end - start);
+
+  // All messages of a frame share the same timestamp
+  start = end;
+  const ros::Time stamp = ros::Time::now();
+  fillJointInfo(stamp);
+  if (publish_odom_)
+  {
+    fillOdomInfo(stamp);
+  }
+  fillContactInfo(stamp);
+  fillBatteryInfo(stamp);
+  fillMotorsInfo(stamp);
+  fillIrRangeInfo(stamp);
+  end = ros::WallTime::now();
+  fill_timing_.add(end - start);
+
+  start = end;
+  publishMessages();
+  end = ros::WallTime::now();
+  publish_timing_.add(end - start);
 
   // If last velocity command was sent longer than latch duration, stop robot
-  if (ros::Time::now() - last_cmd_vel_time_ >= ros::Duration(latch_duration_))
+  if (stamp - last_cmd_vel_time_ >= ros::Duration(latch_duration_))
   {
     robot_->drive(0, 0);
   }
@@ -377,89 +434,175 @@ void CreateDriver::updateDriverDiagnostics(diagnostic_updater::DiagnosticStatusW
   {
     stat.summary(diagnostic_msgs::DiagnosticStatus::OK, "Maintaining loop frequency");
   }
+
+  // Per-cycle timing breakdown (in ms)
+  stat.add("Read snapshot time (ms)", read_timing_.mean * 1000.0);
+  stat.add("Read snapshot max time (ms)", read_timing_.max * 1000.0);
+  stat.add("Fill time (ms)", fill_timing_.mean * 1000.0);
+  stat.add("Fill max time (ms)", fill_timing_.max * 1000.0);
+  stat.add("Publish time (ms)", publish_timing_.mean * 1000.0);
+  stat.add("Publish max time (ms)", publish_timing_.max * 1000.0);
+  stat.add("Diagnostics time (ms)", diagnostics_timing_.mean * 1000.0);
+  stat.add("Diagnostics max time (ms)", diagnostics_timing_.max * 1000.0);
 }
 
-void CreateDriver::publishJointInfo() {
+void CreateDriver::readSnapshot() {
+
+	snapshot_.left_wheel_dist =          robot_->getLeftWheelDistance();
+	snapshot_.right_wheel_dist =         robot_->getRightWheelDistance();
+	snapshot_.left_wheel_vel =           robot_->getRequestedLeftWheelVel();
+	snapshot_.right_wheel_vel =          robot_->getRequestedRightWheelVel();
+	if (publish_odom_)
+	{
+		snapshot_.pose =                 robot_->getPose();
+		snapshot_.vel =                  robot_->getVel();
+	}
+
+	snapshot_.voltage =                  robot_->getVoltage();
+	snapshot_.current =                  robot_->getCurrent();
+	snapshot_.charge =                   robot_->getBatteryCharge();
+	snapshot_.capacity =                 robot_->getBatteryCapacity();
+	snapshot_.charging_state =           robot_->getChargingState();
+
+	snapshot_.wheeldrop_caster =         robot_->isCasterWheeldrop();
+	snapshot_.wheeldrop_left =           robot_->isLeftWheeldrop();
+	snapshot_.wheeldrop_right =          robot_->isRightWheeldrop();
+	snapshot_.bump_left =                robot_->isLeftBumper();
+	snapshot_.bump_right =               robot_->isRightBumper();
+	snapshot_.wall =                     robot_->isWall();
+	snapshot_.cliff_left =               robot_->isLeftCliff();
+	snapshot_.cliff_front_left =         robot_->isFrontLeftCliff();
+	snapshot_.cliff_right =              robot_->isRightCliff();
+	snapshot_.cliff_front_right =        robot_->isFrontRightCliff();
+	snapshot_.virtual_wall =             robot_->isVirtualWall();
+
+	snapshot_.wall_signal =              robot_->getWallSignal();
+	snapshot_.cliff_left_signal =        robot_->getCliffLeftSignal();
+	snapshot_.cliff_front_left_signal =  robot_->getCliffFrontLeftSignal();
+	snapshot_.cliff_front_right_signal = robot_->getCliffFrontRightSignal();
+	snapshot_.cliff_right_signal =       robot_->getCliffRightSignal();
+}
+
+void CreateDriver::fillJointInfo(const ros::Time& stamp) {
     // Publish joint states
     float wheelRadius = model_.getWheelDiameter() / 2.0;
 
     // Positions of the joints are expressed in rad, and velocities in rad/sec
-    joint_state_msg_.header.stamp = ros::Time::now();
-    joint_state_msg_.position[0] = robot_->getLeftWheelDistance() / wheelRadius;
-    joint_state_msg_.position[1] = robot_->getRightWheelDistance() / wheelRadius;
-    joint_state_msg_.velocity[0] = ((float)robot_->getRequestedLeftWheelVel() / 1000.0) / wheelRadius;
-    joint_state_msg_.velocity[1] = ((float)robot_->getRequestedRightWheelVel() / 1000.0) / wheelRadius;
-    wheel_joint_pub_.publish(joint_state_msg_);
+    joint_state_msg_ = joint_state_pool_.next();
+    joint_state_msg_->header.stamp = stamp;
+    joint_state_msg_->position[0] = snapshot_.left_wheel_dist / wheelRadius;
+    joint_state_msg_->position[1] = snapshot_.right_wheel_dist / wheelRadius;
+    joint_state_msg_->velocity[0] = ((float)snapshot_.left_wheel_vel / 1000.0) / wheelRadius;
+    joint_state_msg_->velocity[1] = ((float)snapshot_.right_wheel_vel / 1000.0) / wheelRadius;
 }
 
-void CreateDriver::publishBatteryInfo() {
+void CreateDriver::fillOdomInfo(const ros::Time& stamp) {
 
-	battery_msg_.header.stamp =         ros::Time::now();
-	battery_msg_.voltage =              robot_->getVoltage();
-	battery_msg_.current =              robot_->getCurrent();
-	battery_msg_.charge  =              robot_->getBatteryCharge();
-	battery_msg_.capacity =             robot_->getBatteryCapacity();
-	battery_msg_.percentage =           float(robot_->getBatteryCharge())/float(robot_->getBatteryCapacity());
-	battery_msg_.design_capacity = 		float(3.0);
-	battery_msg_.power_supply_status =  convertChargingStatus(robot_->getChargingState());
-	battery_msg_.present =              true;
+	const create::Pose& pose = snapshot_.pose;
+	const create::Vel& vel = snapshot_.vel;
 
-	battery_pub_.publish(battery_msg_);
+	odom_msg_ = odom_pool_.next();
+	odom_msg_->header.stamp = stamp;
+	odom_msg_->pose.pose.position.x = pose.x;
+	odom_msg_->pose.pose.position.y = pose.y;
+	odom_msg_->pose.pose.orientation = tf::createQuaternionMsgFromYaw(pose.yaw);
+	create::fillPlanarCovariance(pose.covariance, odom_msg_->pose.covariance);
+
+	// Velocity is expressed in the frame of the robot
+	odom_msg_->twist.twist.linear.x = vel.x;
+	odom_msg_->twist.twist.linear.y = vel.y;
+	odom_msg_->twist.twist.angular.z = vel.yaw;
+	create::fillPlanarCovariance(vel.covariance, odom_msg_->twist.covariance);
 }
 
-void CreateDriver::publishContactInfo() {
-
-	contact_msg_.header.stamp = ros::Time::now();
-	contact_msg_.wheeldropCaster = robot_->isCasterWheeldrop();
-	contact_msg_.wheeldropLeft =   robot_->isLeftWheeldrop();
-	contact_msg_.wheeldropRight =  robot_->isRightWheeldrop();
-	contact_msg_.bumpLeft =        robot_->isLeftBumper();
-	contact_msg_.bumpRight =       robot_->isRightBumper();
-	contact_msg_.wall =            robot_->isWall();
-	contact_msg_.cliffLeft =       robot_->isLeftCliff();
-	contact_msg_.cliffFrontLeft =  robot_->isFrontLeftCliff();
-	contact_msg_.cliffRight =      robot_->isRightCliff();
-	contact_msg_.cliffFrontRight = robot_->isFrontRightCliff();
-	contact_msg_.virtualWall =     robot_->isVirtualWall();
+void CreateDriver::fillBatteryInfo(const ros::Time& stamp) {
 
-	contact_pub_.publish(contact_msg_);
+	battery_msg_ = battery_pool_.next();
+	battery_msg_->header.stamp =         stamp;
+	battery_msg_->voltage =              snapshot_.voltage;
+	battery_msg_->current =              snapshot_.current;
+	battery_msg_->charge  =              snapshot_.charge;
+	battery_msg_->capacity =             snapshot_.capacity;
+	battery_msg_->percentage =           snapshot_.charge / snapshot_.capacity;
+	battery_msg_->power_supply_status =  convertChargingStatus(snapshot_.charging_state);
 }
 
+void CreateDriver::fillContactInfo(const ros::Time& stamp) {
+
+	contact_msg_ = contact_pool_.next();
+	contact_msg_->header.stamp =    stamp;
+	contact_msg_->wheeldropCaster = snapshot_.wheeldrop_caster;
+	contact_msg_->wheeldropLeft =   snapshot_.wheeldrop_left;
+	contact_msg_->wheeldropRight =  snapshot_.wheeldrop_right;
+	contact_msg_->bumpLeft =        snapshot_.bump_left;
+	contact_msg_->bumpRight =       snapshot_.bump_right;
+	contact_msg_->wall =            snapshot_.wall;
+	contact_msg_->cliffLeft =       snapshot_.cliff_left;
+	contact_msg_->cliffFrontLeft =  snapshot_.cliff_front_left;
+	contact_msg_->cliffRight =      snapshot_.cliff_right;
+	contact_msg_->cliffFrontRight = snapshot_.cliff_front_right;
+	contact_msg_->virtualWall =     snapshot_.virtual_wall;
+}
 
-void CreateDriver::publishMotorsInfo(){
 
-	motors_msg_.header.stamp =      ros::Time::now();
-	motors_msg_.left =    			robot_->getRequestedLeftWheelVel();
-	motors_msg_.right =   			robot_->getRequestedRightWheelVel();
+void CreateDriver::fillMotorsInfo(const ros::Time& stamp){
 
-	motors_pub_.publish(motors_msg_);
+	motors_msg_ = motors_pool_.next();
+	motors_msg_->header.stamp =     stamp;
+	motors_msg_->left =    			snapshot_.left_wheel_vel;
+	motors_msg_->right =   			snapshot_.right_wheel_vel;
 }
 
-void CreateDriver::publishIrRangeInfo(){
+void CreateDriver::fillIrRangeInfo(const ros::Time& stamp){
+
+	ir_range_msg_ = ir_range_pool_.next();
+	ir_range_msg_->header.stamp =      	    stamp;
+	ir_range_msg_->wallSignal =             snapshot_.wall_signal;
+	ir_range_msg_->cliffLeftSignal =        snapshot_.cliff_left_signal;
+	ir_range_msg_->cliffFrontLeftSignal =   snapshot_.cliff_front_left_signal;
+	ir_range_msg_->cliffFrontRightSignal =  snapshot_.cliff_front_right_signal;
+	ir_range_msg_->cliffRightSignal =       snapshot_.cliff_right_signal;
+}
 
-	ir_range_msg_.header.stamp =      	   ros::Time::now();
-	ir_range_msg_.wallSignal =             robot_->getWallSignal();
-	ir_range_msg_.cliffLeftSignal =        robot_->getCliffLeftSignal();
-	ir_range_msg_.cliffFrontLeftSignal =   robot_->getCliffFrontLeftSignal();
-	ir_range_msg_.cliffFrontRightSignal =  robot_->getCliffFrontRightSignal();
-	ir_range_msg_.cliffRightSignal =       robot_->getCliffRightSignal();
+void CreateDriver::publishMessages(){
 
+	// NOTE: messages are published by shared pointer and must not be modified afterwards.
+	//       The pools only hand them out again once no subscriber holds a reference.
+	wheel_joint_pub_.publish(joint_state_msg_);
+	if (publish_odom_)
+	{
+		odom_pub_.publish(odom_msg_);
+	}
+	contact_pub_.publish(contact_msg_);
+	battery_pub_.publish(battery_msg_);
+	motors_pub_.publish(motors_msg_);
 	ir_range_pub_.publish(ir_range_msg_);
 }
 
-void CreateDriver::spinOnce()
+void CreateDriver::spinOnce(bool spin_callbacks)
 {
-  update();
-  diagnostics_.update();
-  ros::spinOnce();
+  {
+    // Released before the callbacks are spun, they take it too
+    boost::mutex::scoped_lock lock(robot_mutex_);
+    update();
+
+    ros::WallTime start = ros::WallTime::now();
+    diagnostics_.update();
+    diagnostics_timing_.add(ros::WallTime::now() - start);
+  }
+
+  if (spin_callbacks)
+  {
+    ros::spinOnce();
+  }
 }
 
-void CreateDriver::spin()
+void CreateDriver::spin(bool spin_callbacks)
 {
   ros::Rate rate(rate_);
-  while (ros::ok())
+  while (priv_nh_.ok())
   {
-    spinOnce();
+    spinOnce(spin_callbacks);
 
     is_running_slowly_ = !rate.sleep();
     if (is_running_slowly_)
@@ -468,22 +611,3 @@ void CreateDriver::spin()
     }
   }
 }
-
-int main(int argc, char** argv)
-{
-  ros::init(argc, argv, "irobot_create");
-  ros::NodeHandle nh;
-
-  CreateDriver create_driver(nh);
-
-  try
-  {
-    create_driver.spin();
-  }
-  catch (std::runtime_error& ex)
-  {
-    ROS_FATAL_STREAM("[CREATE] Runtime error: " << ex.what());
-    return 1;
-  }
-  return 0;
-}
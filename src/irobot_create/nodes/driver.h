@@ -1,6 +1,8 @@
 #ifndef DRIVER_H
 #define DRIVER_H
 
+#include <stdexcept>
+#include <boost/thread/mutex.hpp>
 #include <ros/ros.h>
 #include <ros/console.h>
 #include <geometry_msgs/Twist.h>
@@ -20,20 +22,95 @@
 #include <create/Leds.h>
 
 #include "create/create.h"
+#include "create/odometry.h"
+#include "message_pool.h"
+
+// Values read from the robot once per cycle, so that all messages of a frame are consistent
+struct RobotSnapshot
+{
+  float left_wheel_dist;
+  float right_wheel_dist;
+  int16_t left_wheel_vel;
+  int16_t right_wheel_vel;
+  create::Pose pose;
+  create::Vel vel;
+
+  float voltage;
+  float current;
+  float charge;
+  float capacity;
+  create::ChargingState charging_state;
+
+  bool wheeldrop_caster;
+  bool wheeldrop_left;
+  bool wheeldrop_right;
+  bool bump_left;
+  bool bump_right;
+  bool wall;
+  bool cliff_left;
+  bool cliff_front_left;
+  bool cliff_right;
+  bool cliff_front_right;
+  bool virtual_wall;
+
+  uint16_t wall_signal;
+  uint16_t cliff_left_signal;
+  uint16_t cliff_front_left_signal;
+  uint16_t cliff_front_right_signal;
+  uint16_t cliff_right_signal;
+};
+
+// Running statistics of the duration of one stage of the update cycle
+struct StageTiming
+{
+  double last;
+  double mean;
+  double max;
+
+  StageTiming() : last(0.0), mean(0.0), max(0.0) {}
+
+  void add(const ros::WallDuration& duration)
+  {
+    last = duration.toSec();
+    mean = (mean == 0.0) ? last : 0.99 * mean + 0.01 * last;
+    if (last > max)
+      max = last;
+  }
+};
 
 class CreateDriver
 {
 private:
   create::Create* robot_;
   create::RobotModel model_;
+  // Serializes the serial commands and the safety state between the update loop and the callbacks,
+  // which run on other threads in a nodelet manager
+  boost::mutex robot_mutex_;
   diagnostic_updater::Updater diagnostics_;
   ros::Time last_cmd_vel_time_;
 
-  sensor_msgs::BatteryState battery_msg_;
-  create::Contact contact_msg_;
-  create::MotorSpeed motors_msg_;
-  create::IrRange ir_range_msg_;
-  sensor_msgs::JointState joint_state_msg_;
+  // Pre-allocated messages, published by shared pointer
+  MessagePool<sensor_msgs::BatteryState> battery_pool_;
+  MessagePool<create::Contact> contact_pool_;
+  MessagePool<create::MotorSpeed> motors_pool_;
+  MessagePool<create::IrRange> ir_range_pool_;
+  MessagePool<sensor_msgs::JointState> joint_state_pool_;
+  MessagePool<nav_msgs::Odometry> odom_pool_;
+
+  sensor_msgs::BatteryState::Ptr battery_msg_;
+  create::Contact::Ptr contact_msg_;
+  create::MotorSpeed::Ptr motors_msg_;
+  create::IrRange::Ptr ir_range_msg_;
+  sensor_msgs::JointState::Ptr joint_state_msg_;
+  nav_msgs::Odometry::Ptr odom_msg_;
+
+  RobotSnapshot snapshot_;
+
+  // Per-cycle timing breakdown
+  StageTiming read_timing_;
+  StageTiming fill_timing_;
+  StageTiming publish_timing_;
+  StageTiming diagnostics_timing_;
 
   bool is_running_slowly_;
   int safety_restriction_;
@@ -45,6 +122,7 @@ private:
   int baud_;
   double latch_duration_;
   bool safety_;
+  bool publish_odom_;
 
   void cmdVelCallback(const create::MotorSpeed& msg);
 
@@ -59,11 +137,14 @@ private:
   void updateModeDiagnostics(diagnostic_updater::DiagnosticStatusWrapper& stat);
   void updateDriverDiagnostics(diagnostic_updater::DiagnosticStatusWrapper& stat);
 
-  void publishBatteryInfo();
-  void publishContactInfo();
-  void publishMotorsInfo();
-  void publishIrRangeInfo();
-  void publishJointInfo();
+  void readSnapshot();
+  void fillBatteryInfo(const ros::Time& stamp);
+  void fillContactInfo(const ros::Time& stamp);
+  void fillMotorsInfo(const ros::Time& stamp);
+  void fillIrRangeInfo(const ros::Time& stamp);
+  void fillJointInfo(const ros::Time& stamp);
+  void fillOdomInfo(const ros::Time& stamp);
+  void publishMessages();
 
   bool applySafety();
   void beep();
@@ -85,12 +166,16 @@ protected:
   ros::Publisher motors_pub_;
   ros::Publisher ir_range_pub_;
   ros::Publisher wheel_joint_pub_;
+  ros::Publisher odom_pub_;
 
 public:
-  CreateDriver(ros::NodeHandle& nh);
+  CreateDriver(ros::NodeHandle& nh, const ros::NodeHandle& priv_nh = ros::NodeHandle("~"));
   ~CreateDriver();
-  virtual void spin();
-  virtual void spinOnce();
+  // Callbacks are left to the nodelet manager when spin_callbacks is false
+  virtual void spin(bool spin_callbacks = true);
+  virtual void spinOnce(bool spin_callbacks = true);
+  // Stop spin() from another thread
+  void shutdown() { priv_nh_.shutdown(); }
 
 };  // class CreateDriver
 
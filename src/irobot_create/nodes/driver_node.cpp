@@ -0,0 +1,19 @@
+#include "driver.h"
+
+int main(int argc, char** argv)
+{
+  ros::init(argc, argv, "irobot_create");
+  ros::NodeHandle nh;
+
+  try
+  {
+    CreateDriver create_driver(nh);
+    create_driver.spin();
+  }
+  catch (std::runtime_error& ex)
+  {
+    ROS_FATAL_STREAM("[CREATE] Runtime error: " << ex.what());
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,56 @@
+#ifndef MESSAGE_POOL_H
+#define MESSAGE_POOL_H
+
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include <boost/make_shared.hpp>
+
+/* Small ring of pre-allocated messages published by shared pointer.
+ * A message is reused only once no subscriber holds a reference to it anymore, so that
+ * intra-process subscribers (e.g. nodelets) never see it modified after publication.
+ * Messages are copied from a prototype, so constant fields (frame_id, joint names, array sizes)
+ * are only filled once.
+ */
+template <class M>
+class MessagePool
+{
+public:
+  MessagePool() : index_(0) {}
+
+  void init(const M& prototype, const size_t size = 4)
+  {
+    prototype_ = prototype;
+    messages_.resize(size);
+    for (size_t i = 0; i < size; i++)
+    {
+      messages_[i] = boost::make_shared<M>(prototype_);
+    }
+    index_ = 0;
+  }
+
+  boost::shared_ptr<M> next()
+  {
+    for (size_t n = 0; n < messages_.size(); n++)
+    {
+      boost::shared_ptr<M>& msg = messages_[index_];
+      index_ = (index_ + 1) % messages_.size();
+      if (msg.unique())
+      {
+        return msg;
+      }
+    }
+
+    // All messages are still referenced: release the oldest one to its subscribers
+    boost::shared_ptr<M>& msg = messages_[index_];
+    index_ = (index_ + 1) % messages_.size();
+    msg = boost::make_shared<M>(prototype_);
+    return msg;
+  }
+
+private:
+  M prototype_;
+  std::vector<boost::shared_ptr<M> > messages_;
+  size_t index_;
+};
+
+#endif  // MESSAGE_POOL_H
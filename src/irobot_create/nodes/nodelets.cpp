@@ -0,0 +1,79 @@
+#include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread.hpp>
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+
+#include "driver.h"
+#include "odometry.h"
+
+namespace create
+{
+
+// Runs the serial polling loop of the driver in its own thread inside a nodelet manager
+class DriverNodelet : public nodelet::Nodelet
+{
+public:
+  virtual ~DriverNodelet()
+  {
+    if (driver_)
+    {
+      driver_->shutdown();
+      thread_.join();
+    }
+  }
+
+private:
+  boost::scoped_ptr<CreateDriver> driver_;
+  boost::thread thread_;
+
+  virtual void onInit()
+  {
+    try
+    {
+      driver_.reset(new CreateDriver(getNodeHandle(), getPrivateNodeHandle()));
+    }
+    catch (std::runtime_error& ex)
+    {
+      NODELET_FATAL_STREAM("[CREATE] Runtime error: " << ex.what());
+      return;
+    }
+    thread_ = boost::thread(boost::bind(&DriverNodelet::spin, this));
+  }
+
+  void spin()
+  {
+    try
+    {
+      driver_->spin(false);
+    }
+    catch (std::runtime_error& ex)
+    {
+      NODELET_FATAL_STREAM("[CREATE] Runtime error: " << ex.what());
+    }
+  }
+};
+
+// Odometry is purely callback driven, so the subscriptions are served by the manager threads
+class OdometryNodelet : public nodelet::Nodelet
+{
+private:
+  boost::scoped_ptr<OdometryNode> node_;
+
+  virtual void onInit()
+  {
+    try
+    {
+      node_.reset(new OdometryNode(getPrivateNodeHandle()));
+    }
+    catch (std::runtime_error& ex)
+    {
+      NODELET_FATAL_STREAM(ex.what());
+    }
+  }
+};
+
+}  // namespace create
+
+PLUGINLIB_EXPORT_CLASS(create::DriverNodelet, nodelet::Nodelet)
+PLUGINLIB_EXPORT_CLASS(create::OdometryNodelet, nodelet::Nodelet)
@@ -0,0 +1,191 @@
+/******************************************************************************
+ *
+ * Copyright (c) 2016, Simon Brodeur
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  - Neither the name of the NECOTIS research group nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef ODOMETRY_NODE_H
+#define ODOMETRY_NODE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <iostream>
+#include <stdexcept>
+#include <ros/ros.h>
+#include <ros/console.h>
+#include <sensor_msgs/Imu.h>
+#include <sensor_msgs/JointState.h>
+#include <nav_msgs/Odometry.h>
+#include <tf/transform_broadcaster.h>
+#include <tf/transform_datatypes.h>
+#include "tf2_ros/transform_broadcaster.h"
+
+#include "create/create.h"
+#include "create/odometry.h"
+#include "message_pool.h"
+
+#define AXLE_LEN		0.258
+#define WHEEL_DIAMETER	0.078
+
+class OdometryNode {
+
+    public:
+        ros::NodeHandle node_;
+
+        ros::Publisher odom_pub_;
+        tf2_ros::TransformBroadcaster tf_broadcaster_;
+		MessagePool<nav_msgs::Odometry> odom_pool_;
+		geometry_msgs::TransformStamped tf_odom_;
+
+		ros::Subscriber imu_subscriber_;
+		ros::Subscriber joint_subscriber_;
+
+		create::Odometry odometry_;
+
+	    bool publish_tf_;
+	    bool use_imu_;
+
+        std::string inputJoints_;
+        std::string inputImu_;
+
+        OdometryNode(const ros::NodeHandle& node = ros::NodeHandle("~")) : node_(node), odometry_(AXLE_LEN){
+
+        	int queue_size;
+        	double wheel_noise, gyro_noise, gyro_timeout;
+        	std::string integration;
+        	node_.param("input_joints", inputJoints_, std::string("/irobot_create/joints"));
+        	node_.param("input_imu", inputImu_, std::string("/imu/data"));
+        	node_.param("queue_size", queue_size, 10);
+        	node_.param("publish_tf", publish_tf_, false);
+        	node_.param("use_imu", use_imu_, true);
+        	node_.param("integration", integration, std::string("exact"));
+        	node_.param("wheel_noise", wheel_noise, 0.01);
+        	node_.param("gyro_noise", gyro_noise, 0.005);
+        	node_.param("gyro_timeout", gyro_timeout, 0.1);
+
+        	create::OdometryIntegration method;
+        	if (!create::parseIntegration(integration, method)){
+        		throw std::runtime_error("Unknown integration method '" + integration + "' (expected euler, runge_kutta or exact)");
+        	}
+        	odometry_.setIntegration(method);
+        	odometry_.setWheelNoise(wheel_noise);
+        	odometry_.setGyroNoise(gyro_noise);
+        	odometry_.setGyroTimeout(gyro_timeout);
+
+			// Set frame_id's
+			const std::string str_base_baselink("base_link");
+			tf_odom_.header.frame_id = "odom";
+			tf_odom_.child_frame_id = str_base_baselink;
+			nav_msgs::Odometry odom_msg;
+			odom_msg.header.frame_id = "odom";
+			odom_msg.child_frame_id = str_base_baselink;
+
+			// Dimensions not estimated by the planar odometry are left uncorrelated with a large variance
+			create::fillUnobservedCovariance(odom_msg.pose.covariance);
+			create::fillUnobservedCovariance(odom_msg.twist.covariance);
+			odom_pool_.init(odom_msg);
+
+			// NOTE: the streams are handled independently so that odometry is produced for every joint
+			//       state message, even when the IMU is late or missing.
+			if (use_imu_){
+				imu_subscriber_ = node_.subscribe(inputImu_, queue_size, &OdometryNode::imuCallback, this, ros::TransportHints().tcpNoDelay());
+			}
+			joint_subscriber_ = node_.subscribe(inputJoints_, queue_size, &OdometryNode::jointCallback, this, ros::TransportHints().tcpNoDelay());
+
+			odom_pub_ = node_.advertise<nav_msgs::Odometry>("/irobot_create/odom", 30);
+        }
+
+        virtual ~OdometryNode() {
+        	// empty
+        }
+
+        void imuCallback(const sensor_msgs::Imu::ConstPtr& imu_msg){
+
+			const geometry_msgs::Vector3& w = imu_msg->angular_velocity;
+			const geometry_msgs::Quaternion& q = imu_msg->orientation;
+			double yawRate = create::worldYawRate(w.x, w.y, w.z, q.x, q.y, q.z, q.w);
+
+			odometry_.addGyro(imu_msg->header.stamp.toSec(), yawRate);
+        }
+
+        void jointCallback(const sensor_msgs::JointState::ConstPtr& joint_state_msg){
+
+			ros::Time time = joint_state_msg->header.stamp;
+
+			double wheelRadius = WHEEL_DIAMETER / 2.0;
+			double leftWheelDist = joint_state_msg->position[0] * wheelRadius;
+			double rightWheelDist = joint_state_msg->position[1] * wheelRadius;
+			double leftWheelVel = joint_state_msg->velocity[0] * wheelRadius;
+			double rightWheelVel = joint_state_msg->velocity[1] * wheelRadius;
+
+			if (!odometry_.update(time.toSec(), leftWheelDist, rightWheelDist, leftWheelVel, rightWheelVel)){
+				return;
+			}
+
+			const create::Pose& pose = odometry_.getPose();
+			const create::Vel& vel = odometry_.getVel();
+			geometry_msgs::Quaternion orientation = tf::createQuaternionMsgFromYaw(pose.yaw);
+			nav_msgs::OdometryPtr odom_msg = odom_pool_.next();
+
+			// Populate position info
+			// NOTE: propagate timestamp from the message
+			odom_msg->header.stamp = time;
+			odom_msg->pose.pose.position.x = pose.x;
+			odom_msg->pose.pose.position.y = pose.y;
+			odom_msg->pose.pose.orientation = orientation;
+			create::fillPlanarCovariance(pose.covariance, odom_msg->pose.covariance);
+
+			// Populate velocity info (in the frame of the robot)
+			odom_msg->twist.twist.linear.x = vel.x;
+			odom_msg->twist.twist.linear.y = vel.y;
+			odom_msg->twist.twist.angular.z = vel.yaw;
+			create::fillPlanarCovariance(vel.covariance, odom_msg->twist.covariance);
+
+			if (publish_tf_){
+				// NOTE: propagate timestamp from the message
+				tf_odom_.header.stamp = time;
+				tf_odom_.transform.translation.x = pose.x;
+				tf_odom_.transform.translation.y = pose.y;
+				tf_odom_.transform.rotation = orientation;
+				tf_broadcaster_.sendTransform(tf_odom_);
+			}
+
+			if (use_imu_ && !odometry_.isGyroFused()){
+				ROS_WARN_THROTTLE(10, "No recent IMU data: using wheel-only odometry");
+			}
+
+			odom_pub_.publish(odom_msg);
+        }
+
+        bool spin() {
+        	ros::spin();
+            return true;
+        }
+};
+
+#endif  // ODOMETRY_NODE_H
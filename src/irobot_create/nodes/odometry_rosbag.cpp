@@ -33,11 +33,6 @@
 #include <iostream>
 #include <boost/foreach.hpp>
 #include <boost/program_options.hpp>
-#include <message_filters/subscriber.h>
-#include <message_filters/synchronizer.h>
-#include <message_filters/sync_policies/exact_time.h>
-#include <message_filters/sync_policies/approximate_time.h>
-#include <message_filters/time_synchronizer.h>
 #include <sensor_msgs/Imu.h>
 #include <sensor_msgs/JointState.h>
 #include <nav_msgs/Odometry.h>
@@ -45,41 +40,23 @@
 #include <tf/transform_datatypes.h>
 #include <tf2_msgs/TFMessage.h>
 
+#include "create/odometry.h"
+
 using namespace std;
 
 
 #define AXLE_LEN		0.258
 #define WHEEL_DIAMETER	0.078
 
-// NOTE: adapted from http://wiki.ros.org/rosbag/Cookbook
-
-/**
- * Inherits from message_filters::SimpleFilter<M>
- * to use protected signalMessage function
- */
-template <class M>
-class BagSubscriber : public message_filters::SimpleFilter<M>
-{
-public:
-  void newMessage(const boost::shared_ptr<M const> &msg)
-  {
-	  message_filters::SimpleFilter<M>::signalMessage(msg);
-  }
-};
-
-
 class OdometryRosbag
 {
   typedef sensor_msgs::Imu              ImuMsg;
   typedef sensor_msgs::JointState    	JointMsg;
-  typedef BagSubscriber<ImuMsg> 		ImuSubscriber;
-  typedef BagSubscriber<JointMsg> 		JointSubscriber;
-  typedef message_filters::sync_policies::ApproximateTime<ImuMsg, JointMsg> SyncPolicy;
-  typedef message_filters::Synchronizer<SyncPolicy> Synchronizer;
 
   public:
 
-  OdometryRosbag(rosbag::Bag* bag, const std::string& output_odom_topic, const bool& publish_tf): initialized_(false){
+  OdometryRosbag(rosbag::Bag* bag, const std::string& output_odom_topic, const bool& publish_tf,
+		  	  	 const create::OdometryIntegration& integration): odometry_(AXLE_LEN, integration){
 
 	  	bag_ = bag;
 	  	nb_msg_generated_ = 0;
@@ -94,35 +71,27 @@ class OdometryRosbag
 		odom_msg_.header.frame_id = "odom";
 		odom_msg_.child_frame_id = str_base_baselink;
 
-		// Set up fake subscribers to capture Imu and MagneticField messages
-	  	imu_sub_.reset(new ImuSubscriber());
-	  	joint_sub_.reset(new JointSubscriber());
-
-	  	sync_.reset(new Synchronizer(
-		  SyncPolicy(50), *imu_sub_, *joint_sub_));
-		sync_->registerCallback(boost::bind(&OdometryRosbag::imuJointCallback, this, _1, _2));
-
+		// Dimensions not estimated by the planar odometry are left uncorrelated with a large variance
+		create::fillUnobservedCovariance(odom_msg_.pose.covariance);
+		create::fillUnobservedCovariance(odom_msg_.twist.covariance);
     }
 
     virtual ~OdometryRosbag(){
-    	// TODO: fix the following error at termination:
-    	// terminate called after throwing an instance of 'boost::exception_detail::clone_impl<boost::exception_detail::error_info_injector<boost::lock_error> >'
-    	//  what():  boost: mutex lock failed in pthread_mutex_lock: Invalid argument
-    	// Aborted
-    	//
-    	// see: https://github.com/ros/ros_comm/issues/318
-    	//      http://answers.ros.org/question/143756/rostimer-leads-to-boostlock_error-at-process-cleanup/
-    	imu_sub_.reset();
-    	joint_sub_.reset();
-    	sync_.reset();
+    	// empty
     }
 
-    void addImuMessage(sensor_msgs::Imu::ConstPtr imu){
-		imu_sub_->newMessage(imu);
+    void addImuMessage(sensor_msgs::Imu::ConstPtr imu_msg){
+
+		// Express the angular velocity around the world z-axis
+		const geometry_msgs::Vector3& w = imu_msg->angular_velocity;
+		const geometry_msgs::Quaternion& q = imu_msg->orientation;
+		double yawRate = create::worldYawRate(w.x, w.y, w.z, q.x, q.y, q.z, q.w);
+
+		odometry_.addGyro(imu_msg->header.stamp.toSec(), yawRate);
 	}
 
 	void addJointMessage(sensor_msgs::JointState::ConstPtr joint){
-		joint_sub_->newMessage(joint);
+		jointCallback(joint);
 	}
 
 
@@ -134,73 +103,51 @@ class OdometryRosbag
     nav_msgs::Odometry odom_msg_;
     geometry_msgs::TransformStamped tf_odom_;
 
-    bool initialized_;
-    ros::Time last_time_;
     bool publish_tf_;
     int nb_msg_generated_;
     int nb_tf_msg_generated_;
 
-	double x_;
-	double y_;
-	double lastLeftWheelDist_;
-	double lastRightWheelDist_;
-
-	boost::shared_ptr<Synchronizer> sync_;
-	boost::shared_ptr<ImuSubscriber> imu_sub_;
-	boost::shared_ptr<JointSubscriber> joint_sub_;
+    create::Odometry odometry_;
 
     // **** member functions
-    void imuJointCallback(const ImuMsg::ConstPtr& imu_msg,
-                          const JointMsg::ConstPtr& joint_state_msg){
+    void jointCallback(const JointMsg::ConstPtr& joint_state_msg){
 
-		ros::Time time = imu_msg->header.stamp;
+		ros::Time time = joint_state_msg->header.stamp;
 
 		double wheelRadius = WHEEL_DIAMETER / 2.0;
 		double leftWheelDist = joint_state_msg->position[0] * wheelRadius;
 		double rightWheelDist = joint_state_msg->position[1] * wheelRadius;
+		double leftWheelVel = joint_state_msg->velocity[0] * wheelRadius;
+		double rightWheelVel = joint_state_msg->velocity[1] * wheelRadius;
 
-		if (!initialized_){
-			x_ = 0.0;
-			y_ = 0.0;
-			lastLeftWheelDist_ = leftWheelDist;
-			lastRightWheelDist_ = rightWheelDist;
-			last_time_ = time;
-			initialized_ = true;
+		if (!odometry_.update(time.toSec(), leftWheelDist, rightWheelDist, leftWheelVel, rightWheelVel)){
+			return;
 		}
 
-		double deltaLeftWheelDist = leftWheelDist - lastLeftWheelDist_;
-		double deltaRightWheelDist = rightWheelDist - lastRightWheelDist_;
-
-		// NOTE: assume we are moving straight (true if dt is small enough)
-		double roll, pitch, yaw;
-		tf::Quaternion q;
-		quaternionMsgToTF(imu_msg->orientation, q);
-		tf::Matrix3x3 m(q);
-		m.getRPY(roll, pitch, yaw);
-
-		double deltaDist = (deltaLeftWheelDist + deltaRightWheelDist) / 2.0;
-		x_ += deltaDist * cos(yaw);
-		y_ += deltaDist * sin(yaw);
+		const create::Pose& pose = odometry_.getPose();
+		const create::Vel& vel = odometry_.getVel();
+		geometry_msgs::Quaternion orientation = tf::createQuaternionMsgFromYaw(pose.yaw);
 
 		// Populate position info
 		// NOTE: propagate timestamp from the message
 		odom_msg_.header.stamp = time;
-		odom_msg_.pose.pose.position.x = x_;
-		odom_msg_.pose.pose.position.y = y_;
-		odom_msg_.pose.pose.orientation = imu_msg->orientation;
+		odom_msg_.pose.pose.position.x = pose.x;
+		odom_msg_.pose.pose.position.y = pose.y;
+		odom_msg_.pose.pose.orientation = orientation;
+		create::fillPlanarCovariance(pose.covariance, odom_msg_.pose.covariance);
 
 		// Populate velocity info (in the frame of the robot)
-		double velocitiyForward = (joint_state_msg->velocity[0] + joint_state_msg->velocity[1]) * wheelRadius / 2.0;
-		odom_msg_.twist.twist.linear.x = velocitiyForward;
-		odom_msg_.twist.twist.linear.y = 0.0;
-		odom_msg_.twist.twist.angular = imu_msg->angular_velocity;
+		odom_msg_.twist.twist.linear.x = vel.x;
+		odom_msg_.twist.twist.linear.y = vel.y;
+		odom_msg_.twist.twist.angular.z = vel.yaw;
+		create::fillPlanarCovariance(vel.covariance, odom_msg_.twist.covariance);
 
 		if (publish_tf_){
 			// NOTE: propagate timestamp from the message
 			tf_odom_.header.stamp = time;
-			tf_odom_.transform.translation.x = x_;
-			tf_odom_.transform.translation.y = y_;
-			tf_odom_.transform.rotation = imu_msg->orientation;
+			tf_odom_.transform.translation.x = pose.x;
+			tf_odom_.transform.translation.y = pose.y;
+			tf_odom_.transform.rotation = orientation;
 
 			// Write tf message to rosbag
 			//tf::tfMessage tf_msg;
@@ -222,10 +169,6 @@ class OdometryRosbag
 		if (nb_msg_generated_ % 1000 == 0){
 		  printf("Number of odometry messages generated: %d \n", nb_msg_generated_);
 		}
-
-		last_time_ = time;
-		lastLeftWheelDist_ = leftWheelDist;
-		lastRightWheelDist_ = rightWheelDist;
 	}
 };
 
@@ -239,6 +182,7 @@ int main(int argc, char **argv){
 	std::string input_imu_topic = "/imu/data";
 	std::string input_joint_topic = "/irobot_create/joints";
 	bool publish_tf = false;
+	std::string integration = "exact";
 
 	namespace po = boost::program_options;
 	po::options_description desc("Allowed options");
@@ -249,7 +193,8 @@ int main(int argc, char **argv){
 	("output-odom-topic,d", po::value(&output_odom_topic), "set topic of the output Odometry messages")
 	("input-imu-topic,m", po::value(&input_imu_topic), "set topic of the input Imu messages")
 	("input-joint-topic,j", po::value(&input_joint_topic), "set topic of the input JointState messages")
-	("publish-tf,t", po::bool_switch(&publish_tf), "set to publish tf messages");
+	("publish-tf,t", po::bool_switch(&publish_tf), "set to publish tf messages")
+	("integration,g", po::value(&integration), "set integration method (euler, runge_kutta or exact)");
 
 	po::variables_map vm;
 	po::store(po::parse_command_line(argc, argv, desc), vm);
@@ -260,10 +205,16 @@ int main(int argc, char **argv){
 		return 1;
 	}
 
+	create::OdometryIntegration method;
+	if (!create::parseIntegration(integration, method)){
+		cerr << "Unknown integration method '" << integration << "' (expected euler, runge_kutta or exact)" << endl;
+		return 1;
+	}
+
 	rosbag::Bag output(output_rosbag, rosbag::bagmode::Write);
 	rosbag::Bag input(input_rosbag, rosbag::bagmode::Read);
 
-	OdometryRosbag odometry(&output, output_odom_topic, publish_tf);
+	OdometryRosbag odometry(&output, output_odom_topic, publish_tf, method);
 
 	int nb_imu_msg_processed = 0;
 	int nb_joint_msg_processed = 0;
@@ -13,8 +13,6 @@
 
 namespace create {
 
-  namespace ublas = boost::numeric::ublas;
-
   // TODO: Handle SIGINT to do clean disconnect
 
   void Create::init(const SerialMode& serialMode) {
@@ -30,6 +28,16 @@ namespace create {
     totalLeftDist = 0.0;
     totalRightDist = 0.0;
     firstOnData = true;
+    kr = 1.0;
+    kl = 1.0;
+    pose.x = 0;
+    pose.y = 0;
+    pose.yaw = 0;
+    pose.covariance = Matrix3::zeros();
+    vel.x = 0;
+    vel.y = 0;
+    vel.yaw = 0;
+    vel.covariance = Matrix3::zeros();
     mode = MODE_OFF;
     data = boost::shared_ptr<Data>(new Data(model.getVersion()));
 
@@ -59,30 +67,6 @@ namespace create {
     disconnect();
   }
 
-  Create::Matrix Create::addMatrices(const Matrix &A, const Matrix &B) const {
-    int rows = A.size1();
-    int cols = A.size2();
-
-    assert(rows == B.size1());
-    assert(cols == B.size2());
-
-    Matrix C(rows, cols);
-    for (int i = 0; i < rows; i++) {
-      for (int j = 0; j < cols; j++) {
-        const float a = A(i, j);
-        const float b = B(i, j);
-        if (util::willFloatOverflow(a, b)) {
-          // If overflow, set to float min or max depending on direction of overflow
-          C(i, j) = (a < 0.0) ? std::numeric_limits<float>::min() : std::numeric_limits<float>::max();
-        }
-        else {
-          C(i, j) = a + b;
-        }
-      }
-    }
-    return C;
-  }
-
   void Create::onData() {
     if (firstOnData) {
       prevOnDataTime = util::getTimestamp();
@@ -92,7 +76,7 @@ namespace create {
     // Get current time
     util::timestamp_t curTime = util::getTimestamp();
     float dt = (curTime - prevOnDataTime) / 1000000.0;
-    float leftWheelDist, rightWheelDist;
+    float deltaDist, deltaX, deltaY, deltaYaw, leftWheelDist, rightWheelDist, wheelDistDiff;
 
     // Read raw velocities (mm/sec)
     int16_t leftWheelVelRaw = getRequestedLeftWheelVel();
@@ -102,12 +86,88 @@ namespace create {
 	leftWheelDist = ((float)leftWheelVelRaw) / 1000.0 * dt;
 	rightWheelDist = ((float)rightWheelVelRaw) / 1000.0 * dt;
 
+    const float axleLength = model.getAxleLength();
+    deltaDist = (rightWheelDist + leftWheelDist) / 2.0;
+    wheelDistDiff = rightWheelDist - leftWheelDist;
+    deltaYaw = wheelDistDiff / axleLength;
+
+    boost::mutex::scoped_lock lock(odomMutex);
+
+    // Moving straight
+    if (fabs(wheelDistDiff) < util::EPS) {
+      deltaX = deltaDist * cos(pose.yaw);
+      deltaY = deltaDist * sin(pose.yaw);
+    } else {
+      float turnRadius = (axleLength / 2.0) * (leftWheelDist + rightWheelDist) / wheelDistDiff;
+      deltaX = turnRadius * (sin(pose.yaw + deltaYaw) - sin(pose.yaw));
+      deltaY = -turnRadius * (cos(pose.yaw + deltaYaw) - cos(pose.yaw));
+    }
+
     totalLeftDist += leftWheelDist;
     totalRightDist += rightWheelDist;
 
+    if (fabs(dt) > util::EPS) {
+      vel.x = deltaDist / dt;
+      vel.y = 0.0;
+      vel.yaw = deltaYaw / dt;
+    } else {
+      vel.x = 0.0;
+      vel.y = 0.0;
+      vel.yaw = 0.0;
+    }
+
+    // Update covariances
+    // Ref: "Introduction to Autonomous Mobile Robots" (Siegwart 2004, page 189)
+    const float cosYawAndHalfDelta = cos(pose.yaw + (deltaYaw / 2.0));
+    const float sinYawAndHalfDelta = sin(pose.yaw + (deltaYaw / 2.0));
+    const float distOverTwoWB = deltaDist / (axleLength * 2.0);
+
+    Matrix2 invCovar = Matrix2::zeros();
+    invCovar(0, 0) = kr * fabs(rightWheelDist);
+    invCovar(1, 1) = kl * fabs(leftWheelDist);
+
+    Matrix32 Finc;
+    Finc(0, 0) = (cosYawAndHalfDelta / 2.0) - (distOverTwoWB * sinYawAndHalfDelta);
+    Finc(0, 1) = (cosYawAndHalfDelta / 2.0) + (distOverTwoWB * sinYawAndHalfDelta);
+    Finc(1, 0) = (sinYawAndHalfDelta / 2.0) + (distOverTwoWB * cosYawAndHalfDelta);
+    Finc(1, 1) = (sinYawAndHalfDelta / 2.0) - (distOverTwoWB * cosYawAndHalfDelta);
+    Finc(2, 0) = (1.0 / axleLength);
+    Finc(2, 1) = (-1.0 / axleLength);
+
+    Matrix3 Fp = Matrix3::identity();
+    Fp(0, 2) = (-deltaDist) * sinYawAndHalfDelta;
+    Fp(1, 2) = deltaDist * cosYawAndHalfDelta;
+
+    const Matrix3 incCovar = Finc * (invCovar * Finc.transpose());
+    pose.covariance = Fp * (pose.covariance * Fp.transpose()) + incCovar;
+
+    // The velocity is expressed in the frame of the robot: rotate the increment
+    // covariance out of the world frame and scale it from meters to meters per second
+    if (fabs(dt) > util::EPS) {
+      Matrix3 Rinc = Matrix3::identity();
+      Rinc(0, 0) = cosYawAndHalfDelta;
+      Rinc(0, 1) = sinYawAndHalfDelta;
+      Rinc(1, 0) = -sinYawAndHalfDelta;
+      Rinc(1, 1) = cosYawAndHalfDelta;
+      vel.covariance = Rinc * (incCovar * Rinc.transpose()) * (1.0 / (dt * dt));
+    } else {
+      vel.covariance = Matrix3::zeros();
+    }
+
+    // Update pose
+    pose.x += deltaX;
+    pose.y += deltaY;
+    pose.yaw = util::normalizeAngle(pose.yaw + deltaYaw);
+
     prevOnDataTime = curTime;
   }
 
+  void Create::setWheelNoise(const float& right, const float& left) {
+    boost::mutex::scoped_lock lock(odomMutex);
+    kr = right;
+    kl = left;
+  }
+
   bool Create::connect(const std::string& port, const int& baud) {
     bool timeout = false;
     time_t start, now;
@@ -914,6 +974,16 @@ namespace create {
     return totalRightDist;
   }
 
+  Pose Create::getPose() const {
+    boost::mutex::scoped_lock lock(odomMutex);
+    return pose;
+  }
+
+  Vel Create::getVel() const {
+    boost::mutex::scoped_lock lock(odomMutex);
+    return vel;
+  }
+
   int16_t Create::getRequestedLeftWheelVel() const {
 	if (data->isValidPacketID(ID_LEFT_VEL)) {
 	  // This is a standards compliant way of doing unsigned to signed conversion
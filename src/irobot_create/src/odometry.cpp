@@ -0,0 +1,234 @@
+#include <cmath>
+#include <limits>
+
+#include "create/odometry.h"
+#include "create/util.h"
+
+namespace create {
+
+  bool parseIntegration(const std::string& name, OdometryIntegration& integration) {
+    if (name == "euler") {
+      integration = INTEGRATION_EULER;
+    } else if (name == "runge_kutta") {
+      integration = INTEGRATION_RUNGE_KUTTA;
+    } else if (name == "exact") {
+      integration = INTEGRATION_EXACT;
+    } else {
+      return false;
+    }
+    return true;
+  }
+
+  double worldYawRate(const double& wx, const double& wy, const double& wz,
+                      const double& qx, const double& qy, const double& qz, const double& qw) {
+    const double n = qx * qx + qy * qy + qz * qz + qw * qw;
+    if (n <= 0.5) {
+      return wz;
+    }
+
+    // Last row of the rotation matrix of the (normalized) quaternion
+    const double s = 2.0 / n;
+    return s * (qx * qz - qw * qy) * wx +
+           s * (qy * qz + qw * qx) * wy +
+           (1.0 - s * (qx * qx + qy * qy)) * wz;
+  }
+
+  Odometry::Odometry(const float& axleLength, const OdometryIntegration& integration) :
+    axleLength(axleLength),
+    integration(integration),
+    wheelNoise(0.01),
+    gyroNoise(0.005),
+    gyroTimeout(0.1) {
+    reset();
+  }
+
+  void Odometry::setIntegration(const OdometryIntegration& integration) {
+    this->integration = integration;
+  }
+
+  void Odometry::setWheelNoise(const float& k) {
+    wheelNoise = k;
+  }
+
+  void Odometry::setGyroNoise(const float& sigma) {
+    gyroNoise = sigma;
+  }
+
+  void Odometry::setGyroTimeout(const double& timeout) {
+    gyroTimeout = timeout;
+  }
+
+  void Odometry::reset() {
+    initialized = false;
+    gyroFused = false;
+    lastTime = 0.0;
+    lastLeftDist = 0.0;
+    lastRightDist = 0.0;
+    gyroHead = 0;
+    gyroCount = 0;
+
+    pose.x = 0.0;
+    pose.y = 0.0;
+    pose.yaw = 0.0;
+    pose.covariance = Matrix3::zeros();
+    vel.x = 0.0;
+    vel.y = 0.0;
+    vel.yaw = 0.0;
+    vel.covariance = Matrix3::zeros();
+  }
+
+  void Odometry::addGyro(const double& time, const float& yawRate) {
+    if (gyroCount > 0 && time <= gyroTimes[gyroIndex(gyroCount - 1)]) {
+      // Drop out-of-order samples
+      return;
+    }
+    gyroTimes[gyroHead] = time;
+    gyroRates[gyroHead] = yawRate;
+    gyroHead = (gyroHead + 1) % GYRO_BUFFER_SIZE;
+    if (gyroCount < GYRO_BUFFER_SIZE) {
+      gyroCount++;
+    }
+  }
+
+  float Odometry::interpolateGyro(const double& time) const {
+    // Hold the oldest or newest sample outside of the buffered range
+    if (time <= gyroTimes[gyroIndex(0)]) {
+      return gyroRates[gyroIndex(0)];
+    }
+    if (time >= gyroTimes[gyroIndex(gyroCount - 1)]) {
+      return gyroRates[gyroIndex(gyroCount - 1)];
+    }
+
+    // Newest samples are the most likely to bracket the requested time
+    for (int i = gyroCount - 1; i > 0; i--) {
+      const int a = gyroIndex(i - 1);
+      const int b = gyroIndex(i);
+      if (gyroTimes[a] <= time) {
+        const double alpha = (time - gyroTimes[a]) / (gyroTimes[b] - gyroTimes[a]);
+        return gyroRates[a] + alpha * (gyroRates[b] - gyroRates[a]);
+      }
+    }
+    return gyroRates[gyroIndex(0)];
+  }
+
+  bool Odometry::integrateGyro(const double& t0, const double& t1, float& deltaYaw) const {
+    if (gyroCount == 0 || t1 - gyroTimes[gyroIndex(gyroCount - 1)] > gyroTimeout
+        || gyroTimes[gyroIndex(0)] - t0 > gyroTimeout) {
+      return false;
+    }
+
+    // Piecewise-linear integration through every sample inside the interval
+    double t = t0;
+    float rate = interpolateGyro(t0);
+    double sum = 0.0;
+    for (int i = 0; i < gyroCount; i++) {
+      const int k = gyroIndex(i);
+      if (gyroTimes[k] <= t0) continue;
+      if (gyroTimes[k] >= t1) break;
+      sum += 0.5 * (rate + gyroRates[k]) * (gyroTimes[k] - t);
+      t = gyroTimes[k];
+      rate = gyroRates[k];
+    }
+    sum += 0.5 * (rate + interpolateGyro(t1)) * (t1 - t);
+
+    deltaYaw = sum;
+    return true;
+  }
+
+  bool Odometry::update(const double& time, const float& leftDist, const float& rightDist,
+                        const float& leftVel, const float& rightVel) {
+    if (!initialized) {
+      lastTime = time;
+      lastLeftDist = leftDist;
+      lastRightDist = rightDist;
+      initialized = true;
+      return false;
+    }
+
+    const double dt = time - lastTime;
+    const float deltaLeft = leftDist - lastLeftDist;
+    const float deltaRight = rightDist - lastRightDist;
+    const float deltaDist = (deltaRight + deltaLeft) / 2.0;
+
+    // Yaw increment and its variance from the wheels
+    // Ref: "Introduction to Autonomous Mobile Robots" (Siegwart 2004, page 189)
+    const float wheelDeltaYaw = (deltaRight - deltaLeft) / axleLength;
+    const float wheelYawVar = wheelNoise * (std::fabs(deltaRight) + std::fabs(deltaLeft))
+                              / (axleLength * axleLength);
+
+    // Fuse with the gyroscope using inverse-variance weighting
+    float deltaYaw = wheelDeltaYaw;
+    float deltaYawVar = wheelYawVar;
+    float gyroDeltaYaw;
+    gyroFused = (dt > 0.0) && integrateGyro(lastTime, time, gyroDeltaYaw);
+    if (gyroFused) {
+      const float gyroYawVar = gyroNoise * gyroNoise * dt;
+      if (wheelYawVar + gyroYawVar > util::EPS * util::EPS) {
+        deltaYaw = (wheelDeltaYaw * gyroYawVar + gyroDeltaYaw * wheelYawVar) / (wheelYawVar + gyroYawVar);
+        deltaYawVar = (wheelYawVar * gyroYawVar) / (wheelYawVar + gyroYawVar);
+      } else {
+        deltaYaw = gyroDeltaYaw;
+        deltaYawVar = gyroYawVar;
+      }
+    }
+
+    // Position increment
+    float deltaX, deltaY;
+    const float yaw = pose.yaw;
+    const float midYaw = yaw + deltaYaw / 2.0;
+    if (integration == INTEGRATION_EXACT && std::fabs(deltaYaw) > util::EPS) {
+      const float radius = deltaDist / deltaYaw;
+      deltaX = radius * (std::sin(yaw + deltaYaw) - std::sin(yaw));
+      deltaY = -radius * (std::cos(yaw + deltaYaw) - std::cos(yaw));
+    } else if (integration == INTEGRATION_EULER) {
+      deltaX = deltaDist * std::cos(yaw);
+      deltaY = deltaDist * std::sin(yaw);
+    } else {
+      deltaX = deltaDist * std::cos(midYaw);
+      deltaY = deltaDist * std::sin(midYaw);
+    }
+
+    // Covariance propagation: P = Fp P Fp' + Q, with Q built from the
+    // translational wheel noise and the fused yaw variance
+    const float cosMid = std::cos(midYaw);
+    const float sinMid = std::sin(midYaw);
+    const float distVar = wheelNoise * (std::fabs(deltaRight) + std::fabs(deltaLeft)) / 4.0;
+
+    Matrix3 Fp = Matrix3::identity();
+    Fp(0, 2) = -deltaDist * sinMid;
+    Fp(1, 2) = deltaDist * cosMid;
+
+    Matrix32 G = Matrix32::zeros();
+    G(0, 0) = cosMid;
+    G(1, 0) = sinMid;
+    G(2, 1) = 1.0;
+    Matrix2 N = Matrix2::zeros();
+    N(0, 0) = distVar;
+    N(1, 1) = deltaYawVar;
+
+    const Matrix3 Q = G * (N * G.transpose());
+    pose.covariance = Fp * (pose.covariance * Fp.transpose()) + Q;
+
+    pose.x += deltaX;
+    pose.y += deltaY;
+    pose.yaw = util::normalizeAngle(yaw + deltaYaw);
+
+    // Velocity in the frame of the robot
+    vel.x = (leftVel + rightVel) / 2.0;
+    vel.y = 0.0;
+    vel.covariance = Matrix3::zeros();
+    vel.covariance(0, 0) = wheelNoise * (std::fabs(leftVel) + std::fabs(rightVel)) / 4.0;
+    if (dt > util::EPS) {
+      vel.yaw = deltaYaw / dt;
+      vel.covariance(2, 2) = deltaYawVar / (dt * dt);
+    } else {
+      vel.yaw = 0.0;
+    }
+
+    lastTime = time;
+    lastLeftDist = leftDist;
+    lastRightDist = rightDist;
+    return true;
+  }
+
+}  // namespace create
@@ -0,0 +1,92 @@
+/*********************************************************************
+ *
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2014, Robert Bosch LLC.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Robert Bosch nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ *********************************************************************/
+#ifndef USB_CAM_FRAME_DECODER_H
+#define USB_CAM_FRAME_DECODER_H
+
+#include <string>
+#include <boost/scoped_ptr.hpp>
+#include <sensor_msgs/Image.h>
+
+#include <usb_cam/mjpeg_decoder.h>
+
+namespace usb_cam {
+
+// Converts the frames of the camera into rgb8 images (mono8 for the monochrome formats).
+// The MJPEG codec state is not shared, so each thread decoding frames needs its own decoder.
+// Frames can be decoded at 1/2, 1/4 or 1/8 of their size: MJPEG frames are scaled by the MjpegDecoder,
+// the raw formats are decimated (one pixel of each block is converted).
+class FrameDecoder {
+ public:
+  FrameDecoder();
+  ~FrameDecoder();
+
+  // pixelformat is the V4L2 fourcc of the frames, mjpeg_decoder the MjpegDecoder backend.
+  // With lazy, the MJPEG codec is only opened by the first decode(), and retried by the next ones if it fails.
+  bool init(unsigned int pixelformat, bool monochrome, int image_width, int image_height,
+            const std::string& mjpeg_decoder = "libav", int scale_denom = 1, bool lazy = false);
+  void release();
+
+  // size of a decoded image
+  int width() const { return width_; }
+  int height() const { return height_; }
+  int image_size() const;
+
+  // decodes a frame into dest, which holds image_size() bytes
+  bool decode(const void * src, int len, char *dest);
+  // decodes a frame into the image message, reusing its data buffer
+  bool decode(const void * src, int len, sensor_msgs::Image *image);
+
+ private:
+  // not copyable, the codec state is owned
+  FrameDecoder(const FrameDecoder&);
+  FrameDecoder& operator=(const FrameDecoder&);
+
+  // converts every scale_-th pixel of every scale_-th row of a raw frame
+  void decimate(const char *src, char *dest) const;
+  // opens the MJPEG codec, serialized between all the decoders
+  bool init_mjpeg();
+
+  unsigned int pixelformat_;
+  bool monochrome_;
+  int frame_width_, frame_height_, scale_;
+  int width_, height_;
+  boost::scoped_ptr<MjpegDecoder> mjpeg_;
+  bool mjpeg_initialized_;
+};
+
+}
+
+#endif
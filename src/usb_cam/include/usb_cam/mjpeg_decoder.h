@@ -0,0 +1,82 @@
+/*********************************************************************
+ *
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2014, Robert Bosch LLC.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Robert Bosch nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ *********************************************************************/
+#ifndef USB_CAM_MJPEG_DECODER_H
+#define USB_CAM_MJPEG_DECODER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+namespace usb_cam {
+
+// DHT segment with the default Huffman tables of the JPEG standard, which MJPEG frames usually omit
+extern const uint8_t mjpeg_huffman_table[];
+extern const size_t mjpeg_huffman_table_size;
+
+// Decodes MJPEG frames into packed 8-bit RGB or BGR images.
+// The image can be reduced while decoding (1/2, 1/4 or 1/8 of the frame size), which the libjpeg
+// backend does in the DCT domain, e.g. for previews.
+class MjpegDecoder {
+ public:
+  typedef enum
+  {
+    OUTPUT_RGB8, OUTPUT_BGR8,
+  } output_format;
+
+  virtual ~MjpegDecoder() {}
+
+  // scale_denom is 1, 2, 4 or 8, the decoded image size is rounded up
+  virtual bool init(int image_width, int image_height, int scale_denom, output_format output) = 0;
+  // decodes a frame into dest, which holds image_size() bytes
+  virtual bool decode(const uint8_t* data, int len, uint8_t* dest) = 0;
+
+  int width() const { return width_; }
+  int height() const { return height_; }
+  int image_size() const { return width_ * height_ * 3; }
+
+  // backend is "libav" or "libjpeg", returns NULL if the backend is unknown or was not built
+  static MjpegDecoder* create(const std::string& backend);
+
+ protected:
+  MjpegDecoder() : width_(0), height_(0) {}
+  bool set_size(int image_width, int image_height, int scale_denom);
+
+  int width_, height_;
+};
+
+}
+
+#endif
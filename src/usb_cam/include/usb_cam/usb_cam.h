@@ -41,23 +41,17 @@
 extern "C"
 {
 #include <linux/videodev2.h>
-#include <libavcodec/avcodec.h>
-#include <libswscale/swscale.h>
-#include <libavutil/mem.h>
 }
 
-// legacy reasons
-#include <libavcodec/version.h>
-#if LIBAVCODEC_VERSION_MAJOR < 55
-#define AV_CODEC_ID_MJPEG CODEC_ID_MJPEG
-#endif
-
 #include <string>
 #include <sstream>
 
 #include <sensor_msgs/Image.h>
 #include <sensor_msgs/CompressedImage.h>
 
+#include <usb_cam/frame_decoder.h>
+#include <usb_cam/v4l2_controls.h>
+
 namespace usb_cam {
 
 class UsbCam {
@@ -75,28 +69,49 @@ class UsbCam {
   UsbCam();
   ~UsbCam();
 
-  // start camera
-  void start(const std::string& dev, io_method io, pixel_format pf,
+  // start camera, returns false with the device released on failure
+  bool start(const std::string& dev, io_method io, pixel_format pf,
 		    int image_width, int image_height, int framerate);
   // shutdown camera
   void shutdown(void);
 
-  // grabs a new image from the camera
-  void grab_image(sensor_msgs::Image* image);
-  void grab_image(sensor_msgs::CompressedImage* image);
+  // grabs a new image from the camera, false if no frame arrived within the timeout or on a driver error
+  bool grab_image(sensor_msgs::Image* image);
+  bool grab_image(sensor_msgs::CompressedImage* image);
+
+  // configures another decoder for the frames of this camera, e.g. to decode on other threads
+  // or at a reduced size (scale_denom is 1, 2, 4 or 8)
+  bool init_decoder(FrameDecoder* decoder, int scale_denom = 1) const;
+
+  // MjpegDecoder backend of the mjpeg frames ("libav" or "libjpeg"), to set before start()
+  void set_mjpeg_decoder(const std::string& name);
+
+  // reuse the format and frame rate already set in the driver (e.g. by a previous run) instead of negotiating
+  // them again, to set before start()
+  void set_lazy_init(bool lazy_init);
+
+  // maximum wait for a frame in grab_image (in seconds)
+  void set_timeout(double timeout);
+
+  // recover a stalled camera: restart the stream (STREAMOFF/STREAMON), or reopen the device with the same settings
+  bool restart_capturing(void);
+  bool reopen_device(void);
 
   // enables/disable auto focus
   void set_auto_focus(int value);
 
-  // Set video device parameters
+  // Set video device parameters (v4l2-ctl control names), written immediately
   void set_v4l_parameter(const std::string& param, int value);
   void set_v4l_parameter(const std::string& param, const std::string& value);
 
+  // controls of the open device, to write several parameters together
+  V4l2Controls& controls() { return controls_; }
+
   static io_method io_method_from_string(const std::string& str);
   static pixel_format pixel_format_from_string(const std::string& str);
 
-  void stop_capturing(void);
-  void start_capturing(void);
+  bool stop_capturing(void);
+  bool start_capturing(void);
   bool is_capturing();
 
  private:
@@ -117,19 +132,21 @@ class UsbCam {
   };
 
 
-  int init_mjpeg_decoder(int image_width, int image_height);
-  void mjpeg2rgb(char *MJPEG, int len, char *RGB, int NumPixels);
-  void process_image_raw_bytes(const void * src, int len, camera_image_t *dest);
+  void process_image_compressed(const void * src, int len, sensor_msgs::CompressedImage *msg);
   void process_image(const void * src, int len, camera_image_t *dest);
-  int read_frame(bool raw_bytes = false);
+  // the frame is copied to the compressed message if given, else decoded into image_.
+  // Returns 1 for a frame, 0 if no frame is ready yet (EAGAIN) and -1 on a driver error
+  int read_frame(sensor_msgs::CompressedImage* compressed = NULL);
   void uninit_device(void);
-  void init_read(unsigned int buffer_size);
-  void init_mmap(void);
-  void init_userp(unsigned int buffer_size);
-  void init_device(int image_width, int image_height, int framerate);
+  bool init_read(unsigned int buffer_size);
+  bool init_mmap(void);
+  bool init_userp(unsigned int buffer_size);
+  bool init_device(int image_width, int image_height, int framerate);
+  // resets the cropping and negotiates the format with VIDIOC_S_FMT
+  bool set_format(int image_width, int image_height, struct v4l2_format* fmt);
   void close_device(void);
-  void open_device(void);
-  void grab_image(bool raw_bytes = false);
+  bool open_device(void);
+  bool grab_frame(sensor_msgs::CompressedImage* compressed = NULL);
   bool is_capturing_;
 
 
@@ -140,16 +157,16 @@ class UsbCam {
   int fd_;
   buffer * buffers_;
   unsigned int n_buffers_;
-  AVFrame *avframe_camera_;
-  AVFrame *avframe_rgb_;
-  AVCodec *avcodec_;
-  AVDictionary *avoptions_;
-  AVCodecContext *avcodec_context_;
-  int avframe_camera_size_;
-  int avframe_rgb_size_;
-  struct SwsContext *video_sws_;
+  FrameDecoder decoder_;
+  std::string mjpeg_decoder_;
+  bool lazy_init_;
+  V4l2Controls controls_;
   camera_image_t *image_;
 
+  // settings kept to reopen the device
+  int image_width_, image_height_, framerate_;
+  double timeout_;
+
 };
 
 }
@@ -0,0 +1,92 @@
+/*********************************************************************
+ *
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2014, Robert Bosch LLC.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Robert Bosch nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ *********************************************************************/
+#ifndef USB_CAM_V4L2_CONTROLS_H
+#define USB_CAM_V4L2_CONTROLS_H
+
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace usb_cam {
+
+// Controls of a V4L2 device, enumerated once when the device is opened.
+// Controls are named as by v4l2-ctl (e.g. "exposure_absolute"). set() stages a value, and apply() writes the
+// staged values with one VIDIOC_S_EXT_CTRLS per control class. The values written are cached, so setting the
+// same value again costs no ioctl (e.g. when a whole dynamic_reconfigure configuration is applied).
+class V4l2Controls {
+ public:
+  struct Control
+  {
+    uint32_t id;
+    std::string name;
+    uint32_t type;
+    int32_t minimum, maximum, step, default_value;
+    int32_t value;
+    // the value was written by apply(), rather than read when the controls were queried
+    bool written;
+    bool read_only;
+  };
+
+  V4l2Controls();
+
+  // enumerates the controls of the device and reads their values, fd must stay open while the controls are used
+  bool query(int fd);
+  void clear();
+
+  // NULL if the device has no control of this name
+  const Control* find(const std::string& name) const;
+  const std::vector<Control>& controls() const { return controls_; }
+
+  // stages a value, clamped to the range of the control; false if the device has no such writable control
+  bool set(const std::string& name, int32_t value);
+  // writes the staged values in the order they were set, false if one was rejected by the driver
+  bool apply();
+
+ private:
+  bool write(const std::vector<size_t>& indices);
+
+  int fd_;
+  std::vector<Control> controls_;
+  std::map<std::string, size_t> by_name_;
+  // staged controls, with the values in pending_values_
+  std::vector<size_t> pending_;
+  std::vector<int32_t> pending_values_;
+};
+
+}
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef USB_CAM_FRAME_QUEUE_H
+#define USB_CAM_FRAME_QUEUE_H
+
+#include <boost/atomic.hpp>
+#include <boost/lockfree/queue.hpp>
+#include <boost/interprocess/sync/interprocess_semaphore.hpp>
+
+namespace usb_cam {
+
+/* Bounded queue of frame pointers from a single producer to several consumers.
+ * Items go through a lock-free queue, and consumers sleep on a semaphore counting the queued items.
+ * When the queue is full, push() removes the oldest item and returns it, so that the producer can
+ * recycle its buffer: consumers always get the most recent frames.
+ */
+template <class T>
+class FrameQueue
+{
+public:
+  explicit FrameQueue(const size_t capacity) :
+      queue_(capacity), capacity_(capacity), size_(0), available_(0), stopped_(false) {}
+
+  // Returns the dropped item, or NULL if the queue was not full
+  T* push(T* item)
+  {
+    T* dropped = NULL;
+    // a consumer may claim the oldest item first, then there is room anyway
+    if (size_ >= (int)capacity_ && available_.try_wait())
+    {
+      queue_.pop(dropped);
+      size_--;
+    }
+    queue_.push(item);
+    size_++;
+    available_.post();
+    return dropped;
+  }
+
+  // Blocks until an item is available, returns NULL once the queue is stopped
+  T* pop()
+  {
+    available_.wait();
+    T* item = NULL;
+    if (stopped_ || !queue_.pop(item))
+    {
+      return NULL;
+    }
+    size_--;
+    return item;
+  }
+
+  // Wakes up the consumers, the items still queued are left to their owner
+  void stop(const int consumers)
+  {
+    stopped_ = true;
+    for (int i = 0; i < consumers; i++)
+    {
+      available_.post();
+    }
+  }
+
+private:
+  boost::lockfree::queue<T*> queue_;
+  const size_t capacity_;
+  boost::atomic<int> size_;
+  boost::interprocess::interprocess_semaphore available_;
+  boost::atomic<bool> stopped_;
+};
+
+}
+
+#endif // USB_CAM_FRAME_QUEUE_H
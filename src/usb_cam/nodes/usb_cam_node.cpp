@@ -34,308 +34,8 @@
 *
 *********************************************************************/
 
-#include <unistd.h>
 #include <ros/ros.h>
-#include <usb_cam/usb_cam.h>
-#include <image_transport/image_transport.h>
-#include <camera_info_manager/camera_info_manager.h>
-#include <sstream>
-#include <std_srvs/Empty.h>
-
-namespace usb_cam {
-
-static uint8_t huffman_table[] = {0xFF,0xC4,0x01,0xA2,0x00,0x00,0x01,0x05,0x01,0x01,0x01,0x01,0x01,0x01,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x01,0x02,0x03,0x04,0x05,0x06,0x07,0x08,0x09,0x0A,0x0B,0x01,0x00,0x03,0x01,0x01,0x01,0x01,0x01,0x01,0x01,0x01,0x01,0x00,0x00,0x00,0x00,0x00,0x00,0x01,0x02,0x03,0x04,0x05,0x06,0x07,0x08,0x09,0x0A,0x0B,0x10,0x00,0x02,0x01,0x03,0x03,0x02,0x04,0x03,0x05,0x05,0x04,0x04,0x00,0x00,0x01,0x7D,0x01,0x02,0x03,0x00,0x04,0x11,0x05,0x12,0x21,0x31,0x41,0x06,0x13,0x51,0x61,0x07,0x22,0x71,0x14,0x32,0x81,0x91,0xA1,0x08,0x23,0x42,0xB1,0xC1,0x15,0x52,0xD1,0xF0,0x24,0x33,0x62,0x72,0x82,0x09,0x0A,0x16,0x17,0x18,0x19,0x1A,0x25,0x26,0x27,0x28,0x29,0x2A,0x34,0x35,0x36,0x37,0x38,0x39,0x3A,0x43,0x44,0x45,0x46,0x47,0x48,0x49,0x4A,0x53,0x54,0x55,0x56,0x57,0x58,0x59,0x5A,0x63,0x64,0x65,0x66,0x67,0x68,0x69,0x6A,0x73,0x74,0x75,0x76,0x77,0x78,0x79,0x7A,0x83,0x84,0x85,0x86,0x87,0x88,0x89,0x8A,0x92,0x93,0x94,0x95,0x96,0x97,0x98,0x99,0x9A,0xA2,0xA3,0xA4,0xA5,0xA6,0xA7,0xA8,0xA9,0xAA,0xB2,0xB3,0xB4,0xB5,0xB6,0xB7,0xB8,0xB9,0xBA,0xC2,0xC3,0xC4,0xC5,0xC6,0xC7,0xC8,0xC9,0xCA,0xD2,0xD3,0xD4,0xD5,0xD6,0xD7,0xD8,0xD9,0xDA,0xE1,0xE2,0xE3,0xE4,0xE5,0xE6,0xE7,0xE8,0xE9,0xEA,0xF1,0xF2,0xF3,0xF4,0xF5,0xF6,0xF7,0xF8,0xF9,0xFA,0x11,0x00,0x02,0x01,0x02,0x04,0x04,0x03,0x04,0x07,0x05,0x04,0x04,0x00,0x01,0x02,0x77,0x00,0x01,0x02,0x03,0x11,0x04,0x05,0x21,0x31,0x06,0x12,0x41,0x51,0x07,0x61,0x71,0x13,0x22,0x32,0x81,0x08,0x14,0x42,0x91,0xA1,0xB1,0xC1,0x09,0x23,0x33,0x52,0xF0,0x15,0x62,0x72,0xD1,0x0A,0x16,0x24,0x34,0xE1,0x25,0xF1,0x17,0x18,0x19,0x1A,0x26,0x27,0x28,0x29,0x2A,0x35,0x36,0x37,0x38,0x39,0x3A,0x43,0x44,0x45,0x46,0x47,0x48,0x49,0x4A,0x53,0x54,0x55,0x56,0x57,0x58,0x59,0x5A,0x63,0x64,0x65,0x66,0x67,0x68,0x69,0x6A,0x73,0x74,0x75,0x76,0x77,0x78,0x79,0x7A,0x82,0x83,0x84,0x85,0x86,0x87,0x88,0x89,0x8A,0x92,0x93,0x94,0x95,0x96,0x97,0x98,0x99,0x9A,0xA2,0xA3,0xA4,0xA5,0xA6,0xA7,0xA8,0xA9,0xAA,0xB2,0xB3,0xB4,0xB5,0xB6,0xB7,0xB8,0xB9,0xBA,0xC2,0xC3,0xC4,0xC5,0xC6,0xC7,0xC8,0xC9,0xCA,0xD2,0xD3,0xD4,0xD5,0xD6,0xD7,0xD8,0xD9,0xDA,0xE2,0xE3,0xE4,0xE5,0xE6,0xE7,0xE8,0xE9,0xEA,0xF2,0xF3,0xF4,0xF5,0xF6,0xF7,0xF8,0xF9,0xFA};
-
-class UsbCamNode
-{
-public:
-  // private ROS node handle
-  ros::NodeHandle node_;
-
-  // shared image message
-  sensor_msgs::Image img_;
-  sensor_msgs::CompressedImage img_compressed_;
-  image_transport::CameraPublisher image_pub_;
-  ros::Publisher image_compressed_pub_;
-  ros::Publisher cam_info_pub_;
-
-  // parameters
-  std::string video_device_name_, io_method_name_, pixel_format_name_, camera_name_, camera_info_url_;
-  //std::string start_service_name_, start_service_name_;
-  bool streaming_status_;
-  bool passthrough_;
-  int image_width_, image_height_, framerate_, exposure_, brightness_, contrast_, saturation_, sharpness_, focus_,
-      white_balance_, gain_;
-  bool autofocus_, autoexposure_, auto_white_balance_;
-  boost::shared_ptr<camera_info_manager::CameraInfoManager> cinfo_;
-
-  UsbCam cam_;
-
-  ros::ServiceServer service_start_, service_stop_;
-
-
-
-  bool service_start_cap(std_srvs::Empty::Request  &req, std_srvs::Empty::Response &res )
-  {
-    cam_.start_capturing();
-    return true;
-  }
-
-
-  bool service_stop_cap( std_srvs::Empty::Request  &req, std_srvs::Empty::Response &res )
-  {
-    cam_.stop_capturing();
-    return true;
-  }
-
-  UsbCamNode() :
-      node_("~")
-  {
-
-    // grab the parameters
-    node_.param("video_device", video_device_name_, std::string("/dev/video0"));
-    node_.param("brightness", brightness_, -1); //0-255, -1 "leave alone"
-    node_.param("contrast", contrast_, -1); //0-255, -1 "leave alone"
-    node_.param("saturation", saturation_, -1); //0-255, -1 "leave alone"
-    node_.param("sharpness", sharpness_, -1); //0-255, -1 "leave alone"
-    // possible values: mmap, read, userptr
-    node_.param("io_method", io_method_name_, std::string("mmap"));
-    node_.param("image_width", image_width_, 640);
-    node_.param("image_height", image_height_, 480);
-    node_.param("framerate", framerate_, 30);
-    // possible values: yuyv, uyvy, mjpeg, yuvmono10, rgb24
-    node_.param("pixel_format", pixel_format_name_, std::string("mjpeg"));
-    node_.param("passthrough", passthrough_, false);
-    // enable/disable autofocus
-    node_.param("autofocus", autofocus_, false);
-    node_.param("focus", focus_, -1); //0-255, -1 "leave alone"
-    // enable/disable autoexposure
-    node_.param("autoexposure", autoexposure_, true);
-    node_.param("exposure", exposure_, 100);
-    node_.param("gain", gain_, -1); //0-100?, -1 "leave alone"
-    // enable/disable auto white balance temperature
-    node_.param("auto_white_balance", auto_white_balance_, true);
-    node_.param("white_balance", white_balance_, 4000);
-
-    // load the camera info
-    node_.param("camera_frame_id", img_.header.frame_id, std::string("head_camera"));
-    node_.param("camera_name", camera_name_, std::string("head_camera"));
-    node_.param("camera_info_url", camera_info_url_, std::string(""));
-    cinfo_.reset(new camera_info_manager::CameraInfoManager(node_, camera_name_, camera_info_url_));
-
-    // create Publishers
-    if (passthrough_){
-		image_compressed_pub_ = node_.advertise<sensor_msgs::CompressedImage>("/video/" + camera_name_ + "/compressed", 1);
-		cam_info_pub_ = node_.advertise<sensor_msgs::CameraInfo>("/video/" + camera_name_ + "/camera_info",1);
-	}else{
-		// advertise the main image topic
-		image_transport::ImageTransport it(node_);
-		image_pub_ = it.advertiseCamera("/video/" + camera_name_, 1);
-	}
-
-    // create Services
-    service_start_ = node_.advertiseService("/video/" + camera_name_ + "start_capture", &UsbCamNode::service_start_cap, this);
-    service_stop_ = node_.advertiseService("/video/" + camera_name_ + "stop_capture", &UsbCamNode::service_stop_cap, this);
-
-    // check for default camera info
-    if (!cinfo_->isCalibrated())
-    {
-      cinfo_->setCameraName(video_device_name_);
-      sensor_msgs::CameraInfo camera_info;
-      camera_info.header.frame_id = img_.header.frame_id;
-      camera_info.width = image_width_;
-      camera_info.height = image_height_;
-      cinfo_->setCameraInfo(camera_info);
-    }
-
-
-    ROS_INFO("Starting '%s' (%s) at %dx%d via %s (%s) at %i FPS", camera_name_.c_str(), video_device_name_.c_str(),
-        image_width_, image_height_, io_method_name_.c_str(), pixel_format_name_.c_str(), framerate_);
-
-    // set the IO method
-    UsbCam::io_method io_method = UsbCam::io_method_from_string(io_method_name_);
-    if(io_method == UsbCam::IO_METHOD_UNKNOWN)
-    {
-      ROS_FATAL("Unknown IO method '%s'", io_method_name_.c_str());
-      node_.shutdown();
-      return;
-    }
-
-    // set the pixel format
-    UsbCam::pixel_format pixel_format = UsbCam::pixel_format_from_string(pixel_format_name_);
-    if (pixel_format == UsbCam::PIXEL_FORMAT_UNKNOWN)
-    {
-      ROS_FATAL("Unknown pixel format '%s'", pixel_format_name_.c_str());
-      node_.shutdown();
-      return;
-    }
-
-    // start the camera
-    cam_.start(video_device_name_.c_str(), io_method, pixel_format, image_width_,
-		     image_height_, framerate_);
-
-    usleep(500000);
-
-    // set camera parameters
-    if (brightness_ >= 0)
-    {
-      cam_.set_v4l_parameter("brightness", brightness_);
-    }
-
-    if (contrast_ >= 0)
-    {
-      cam_.set_v4l_parameter("contrast", contrast_);
-    }
-
-    if (saturation_ >= 0)
-    {
-      cam_.set_v4l_parameter("saturation", saturation_);
-    }
-
-    if (sharpness_ >= 0)
-    {
-      cam_.set_v4l_parameter("sharpness", sharpness_);
-    }
-
-    usleep(500000);
-
-    // check auto white balance
-    if (auto_white_balance_)
-    {
-      cam_.set_v4l_parameter("white_balance_temperature_auto", 1);
-    }
-    else
-    {
-      cam_.set_v4l_parameter("white_balance_temperature_auto", 0);
-      cam_.set_v4l_parameter("white_balance_temperature", white_balance_);
-    }
-
-    usleep(500000);
-
-    // check auto exposure
-    if (!autoexposure_)
-    {
-      // turn down exposure control (from max of 3)
-      cam_.set_v4l_parameter("exposure_auto", 1);
-      // change the exposure level
-      cam_.set_v4l_parameter("exposure_absolute", exposure_);
-    }
-
-    if (gain_ >= 0)
-    {
-      cam_.set_v4l_parameter("gain", gain_);
-    }
-
-    // check auto focus
-    if (autofocus_)
-    {
-      cam_.set_auto_focus(1);
-      cam_.set_v4l_parameter("focus_auto", 1);
-    }
-    else
-    {
-      cam_.set_v4l_parameter("focus_auto", 0);
-      if (focus_ >= 0)
-      {
-        cam_.set_v4l_parameter("focus", focus_);
-      }
-    }
-  }
-
-  virtual ~UsbCamNode()
-  {
-    cam_.shutdown();
-  }
-
-  void mjpeg2jpeg(sensor_msgs::CompressedImage* msg){
-
-  	if (msg->format != "mjpeg"){
-  		ROS_FATAL("CompressedImage message format must be 'mjpeg', not '%s'", msg->format.c_str());
-  		node_.shutdown();
-  		return;
-  	}
-
-  	std::vector < uint8_t> frame = msg->data;
-
-  	uint8_t wHdr[2];
-  	wHdr[0] = frame[0];
-  	wHdr[1] = frame[1];
-  	frame.erase(frame.begin(), frame.begin()+2);
-  	std::vector<uint8_t> new_frame(huffman_table, huffman_table+sizeof(huffman_table)/sizeof(uint8_t));
-
-  	if(wHdr[0] == 0xFF && wHdr[1] == 0xD8){
-  		//Header at start
-  		new_frame.insert(new_frame.begin(), wHdr, wHdr+2);
-  		//Original after Huffman table
-  		new_frame.insert(new_frame.end(), frame.begin(), frame.end());
-  	} else{
-  		ROS_FATAL("Incorrect header for mjpeg data");
-		node_.shutdown();
-		return;
-  	}
-
-  	msg->format = "jpeg";
-  	msg->data.resize(new_frame.size());
-  	memcpy(&(msg->data[0]), &(new_frame[0]), new_frame.size());
-  }
-
-  bool take_and_send_image()
-  {
-	if (passthrough_){
-		// grab the image
-		cam_.grab_image(&img_compressed_);
-
-		if (pixel_format_name_ == "mjpeg"){
-			// convert to jpeg
-			mjpeg2jpeg(&img_compressed_);
-		}
-
-		// grab the camera info
-		sensor_msgs::CameraInfoPtr ci(new sensor_msgs::CameraInfo(cinfo_->getCameraInfo()));
-		ci->header.frame_id = img_compressed_.header.frame_id;
-		ci->header.stamp = img_compressed_.header.stamp;
-
-		// publish the image
-		image_compressed_pub_.publish(img_compressed_);
-		cam_info_pub_.publish(*ci);
-
-	}else{
-		// grab the image
-		cam_.grab_image(&img_);
-
-		// grab the camera info
-		sensor_msgs::CameraInfoPtr ci(new sensor_msgs::CameraInfo(cinfo_->getCameraInfo()));
-		ci->header.frame_id = img_.header.frame_id;
-		ci->header.stamp = img_.header.stamp;
-
-		// publish the image
-		image_pub_.publish(img_, *ci);
-	}
-    return true;
-  }
-
-  bool spin()
-  {
-    ros::Rate loop_rate(this->framerate_);
-    while (node_.ok())
-    {
-      if (cam_.is_capturing()) {
-        if (!take_and_send_image()) ROS_WARN("USB camera did not respond in time.");
-      }
-      ros::spinOnce();
-      loop_rate.sleep();
-    }
-    return true;
-  }
-
-
-
-
-
-
-};
-
-}
+#include "usb_cam_node.h"
 
 int main(int argc, char **argv)
 {
@@ -0,0 +1,838 @@
+/*********************************************************************
+*
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2014, Robert Bosch LLC.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Robert Bosch nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*
+*********************************************************************/
+
+#ifndef USB_CAM_NODE_H
+#define USB_CAM_NODE_H
+
+#include <unistd.h>
+#include <ros/ros.h>
+#include <usb_cam/usb_cam.h>
+#include <image_transport/image_transport.h>
+#include <camera_info_manager/camera_info_manager.h>
+#include <diagnostic_updater/diagnostic_updater.h>
+#include <dynamic_reconfigure/server.h>
+#include <usb_cam/UsbCamConfig.h>
+#include <sstream>
+#include <cmath>
+#include <std_srvs/Empty.h>
+#include <boost/make_shared.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/bind.hpp>
+#include <boost/lockfree/queue.hpp>
+
+#include "frame_queue.h"
+
+namespace usb_cam {
+
+// Frame handed by the capture thread to the decoding workers
+struct RawFrame
+{
+  sensor_msgs::CompressedImage image;
+  uint64_t seq;
+  ros::WallTime captured;
+  // also published on the preview topic
+  bool preview;
+};
+
+class UsbCamNode
+{
+public:
+  // private ROS node handle
+  ros::NodeHandle node_;
+
+  // shared image messages, only reallocated while a subscriber still holds the previous one
+  sensor_msgs::ImagePtr img_;
+  sensor_msgs::CompressedImagePtr img_compressed_;
+  image_transport::CameraPublisher image_pub_;
+  ros::Publisher image_compressed_pub_;
+  image_transport::Publisher preview_pub_;
+  ros::Publisher cam_info_pub_;
+
+  // parameters
+  std::string video_device_name_, io_method_name_, pixel_format_name_, camera_name_, camera_info_url_;
+  std::string mjpeg_decoder_;
+  //std::string start_service_name_, start_service_name_;
+  bool streaming_status_;
+  bool passthrough_;
+  bool driver_paced_;
+  bool lazy_init_;
+  double timeout_;
+  int image_width_, image_height_, framerate_, exposure_, brightness_, contrast_, saturation_, sharpness_, focus_,
+      white_balance_, gain_;
+  bool autofocus_, autoexposure_, auto_white_balance_;
+  boost::shared_ptr<camera_info_manager::CameraInfoManager> cinfo_;
+
+  UsbCam cam_;
+  // serializes the capture loop with the service callbacks, which may run on another thread
+  boost::mutex cam_mutex_;
+
+  ros::ServiceServer service_start_, service_stop_;
+
+  // the camera controls can be changed while streaming
+  typedef dynamic_reconfigure::Server<UsbCamConfig> ConfigServer;
+  boost::scoped_ptr<ConfigServer> config_server_;
+
+  // capture statistics, reset at each diagnostics update
+  diagnostic_updater::Updater diagnostics_;
+  ros::Time window_start_, last_stamp_;
+  int window_frames_, window_intervals_;
+  double interval_sum_, interval_sq_sum_, interval_max_;
+  // consecutive failed grabs, and recovery attempts since startup
+  int failures_, recoveries_total_;
+  // delay between the construction of the node and the first frame (in seconds, negative until then)
+  ros::WallTime startup_;
+  double first_frame_delay_;
+
+  // downscaled preview, published at a limited rate while it has subscribers
+  bool preview_;
+  int preview_scale_;
+  double preview_rate_;
+  ros::Time last_preview_;
+  sensor_msgs::ImagePtr preview_img_;
+  FrameDecoder preview_decoder_;
+  // raw frame and full size decoder, used instead of grab_image(Image*) for the frames also previewed
+  sensor_msgs::CompressedImage raw_frame_;
+  FrameDecoder decoder_;
+
+  // decoding pipeline: the capture thread only copies the frames out of the driver buffers, and
+  // a pool of workers decodes and publishes them
+  int decode_threads_, queue_size_;
+  std::vector<boost::shared_ptr<RawFrame> > frames_;
+  boost::scoped_ptr<boost::lockfree::queue<RawFrame*> > free_frames_;
+  boost::scoped_ptr<FrameQueue<RawFrame> > frame_queue_;
+  boost::thread_group workers_;
+  uint64_t capture_seq_;
+  // serializes the publication by the workers, and their statistics (reset at each diagnostics update)
+  boost::mutex publish_mutex_;
+  uint64_t next_publish_seq_;
+  int pipeline_frames_, dropped_frames_, late_frames_;
+  double queue_latency_sum_, decode_latency_sum_, publish_latency_sum_;
+  double queue_latency_max_, decode_latency_max_, publish_latency_max_;
+
+
+  bool service_start_cap(std_srvs::Empty::Request  &req, std_srvs::Empty::Response &res )
+  {
+    boost::mutex::scoped_lock lock(cam_mutex_);
+    cam_.start_capturing();
+    return true;
+  }
+
+
+  bool service_stop_cap( std_srvs::Empty::Request  &req, std_srvs::Empty::Response &res )
+  {
+    boost::mutex::scoped_lock lock(cam_mutex_);
+    cam_.stop_capturing();
+    // a stopped camera is not recovered
+    failures_ = 0;
+    return true;
+  }
+
+  UsbCamNode(const ros::NodeHandle& node = ros::NodeHandle("~")) :
+      node_(node), img_(boost::make_shared<sensor_msgs::Image>()),
+      img_compressed_(boost::make_shared<sensor_msgs::CompressedImage>()),
+      diagnostics_(ros::NodeHandle(), node_), window_frames_(0), window_intervals_(0),
+      interval_sum_(0.0), interval_sq_sum_(0.0), interval_max_(0.0),
+      failures_(0), recoveries_total_(0), startup_(ros::WallTime::now()), first_frame_delay_(-1.0),
+      preview_(false), preview_scale_(4), preview_rate_(5.0),
+      decode_threads_(0), queue_size_(2), capture_seq_(0), next_publish_seq_(0)
+  {
+
+    // grab the parameters
+    node_.param("video_device", video_device_name_, std::string("/dev/video0"));
+    node_.param("brightness", brightness_, -1); //0-255, -1 "leave alone"
+    node_.param("contrast", contrast_, -1); //0-255, -1 "leave alone"
+    node_.param("saturation", saturation_, -1); //0-255, -1 "leave alone"
+    node_.param("sharpness", sharpness_, -1); //0-255, -1 "leave alone"
+    // possible values: mmap, read, userptr
+    node_.param("io_method", io_method_name_, std::string("mmap"));
+    node_.param("image_width", image_width_, 640);
+    node_.param("image_height", image_height_, 480);
+    node_.param("framerate", framerate_, 30);
+    // possible values: yuyv, uyvy, mjpeg, yuvmono10, rgb24
+    node_.param("pixel_format", pixel_format_name_, std::string("mjpeg"));
+    node_.param("passthrough", passthrough_, false);
+    // possible values: libav, libjpeg (if usb_cam was built with libjpeg-turbo)
+    node_.param("mjpeg_decoder", mjpeg_decoder_, std::string("libav"));
+    // publish every frame as soon as the driver delivers it, instead of pacing the loop with ros::Rate
+    node_.param("driver_paced", driver_paced_, false);
+    // reuse the format already negotiated with the camera, e.g. when the node restarts
+    node_.param("lazy_init", lazy_init_, false);
+    // wait for a frame before restarting the stream (in seconds)
+    node_.param("timeout", timeout_, 5.0);
+    // decode on worker threads, the capture thread then only copies frames (0 decodes in the capture thread)
+    node_.param("decode_threads", decode_threads_, 0);
+    // frames waiting for a worker, the oldest one is dropped when the queue is full
+    node_.param("queue_size", queue_size_, 2);
+    // downscaled preview (1/2, 1/4 or 1/8 of the size) at a limited rate (in Hz, 0 for every frame), e.g. for
+    // remote viewers, published on preview/image_raw next to the full frames
+    node_.param("preview", preview_, false);
+    node_.param("preview_scale", preview_scale_, 4);
+    node_.param("preview_rate", preview_rate_, 5.0);
+    // enable/disable autofocus
+    node_.param("autofocus", autofocus_, false);
+    node_.param("focus", focus_, -1); //0-255, -1 "leave alone"
+    // enable/disable autoexposure
+    node_.param("autoexposure", autoexposure_, true);
+    node_.param("exposure", exposure_, 100);
+    node_.param("gain", gain_, -1); //0-100?, -1 "leave alone"
+    // enable/disable auto white balance temperature
+    node_.param("auto_white_balance", auto_white_balance_, true);
+    node_.param("white_balance", white_balance_, 4000);
+
+    // load the camera info
+    node_.param("camera_frame_id", img_->header.frame_id, std::string("head_camera"));
+    node_.param("camera_name", camera_name_, std::string("head_camera"));
+    node_.param("camera_info_url", camera_info_url_, std::string(""));
+    cinfo_.reset(new camera_info_manager::CameraInfoManager(node_, camera_name_, camera_info_url_));
+
+    // create Publishers
+    if (passthrough_){
+		image_compressed_pub_ = node_.advertise<sensor_msgs::CompressedImage>("/video/" + camera_name_ + "/compressed", 1);
+		cam_info_pub_ = node_.advertise<sensor_msgs::CameraInfo>("/video/" + camera_name_ + "/camera_info",1);
+	}else{
+		// advertise the main image topic
+		image_transport::ImageTransport it(node_);
+		image_pub_ = it.advertiseCamera("/video/" + camera_name_, 1);
+	}
+    if (preview_){
+		image_transport::ImageTransport it(node_);
+		preview_pub_ = it.advertise("/video/" + camera_name_ + "/preview/image_raw", 1);
+	}
+
+    // create Services
+    service_start_ = node_.advertiseService("/video/" + camera_name_ + "start_capture", &UsbCamNode::service_start_cap, this);
+    service_stop_ = node_.advertiseService("/video/" + camera_name_ + "stop_capture", &UsbCamNode::service_stop_cap, this);
+
+    // check for default camera info
+    if (!cinfo_->isCalibrated())
+    {
+      cinfo_->setCameraName(video_device_name_);
+      sensor_msgs::CameraInfo camera_info;
+      camera_info.header.frame_id = img_->header.frame_id;
+      camera_info.width = image_width_;
+      camera_info.height = image_height_;
+      cinfo_->setCameraInfo(camera_info);
+    }
+
+
+    ROS_INFO("Starting '%s' (%s) at %dx%d via %s (%s) at %i FPS", camera_name_.c_str(), video_device_name_.c_str(),
+        image_width_, image_height_, io_method_name_.c_str(), pixel_format_name_.c_str(), framerate_);
+
+    // set the IO method
+    UsbCam::io_method io_method = UsbCam::io_method_from_string(io_method_name_);
+    if(io_method == UsbCam::IO_METHOD_UNKNOWN)
+    {
+      ROS_FATAL("Unknown IO method '%s'", io_method_name_.c_str());
+      node_.shutdown();
+      return;
+    }
+
+    // set the pixel format
+    UsbCam::pixel_format pixel_format = UsbCam::pixel_format_from_string(pixel_format_name_);
+    if (pixel_format == UsbCam::PIXEL_FORMAT_UNKNOWN)
+    {
+      ROS_FATAL("Unknown pixel format '%s'", pixel_format_name_.c_str());
+      node_.shutdown();
+      return;
+    }
+
+    // start the camera
+    cam_.set_mjpeg_decoder(mjpeg_decoder_);
+    cam_.set_lazy_init(lazy_init_);
+    if (!cam_.start(video_device_name_.c_str(), io_method, pixel_format, image_width_,
+		     image_height_, framerate_))
+    {
+      ROS_FATAL("Could not start '%s' (%s)", camera_name_.c_str(), video_device_name_.c_str());
+      node_.shutdown();
+      return;
+    }
+    cam_.set_timeout(timeout_);
+
+    set_camera_parameters();
+
+    // the configuration is loaded from the same parameters, so the first callback writes nothing new
+    config_server_.reset(new ConfigServer(node_));
+    config_server_->setCallback(boost::bind(&UsbCamNode::reconfigure, this, _1, _2));
+
+    if (preview_ && (!cam_.init_decoder(&preview_decoder_, preview_scale_) || !cam_.init_decoder(&decoder_)))
+    {
+      ROS_ERROR("Preview disabled");
+      preview_ = false;
+    }
+
+    // diagnostics of the achieved frame rate
+    diagnostics_.setHardwareID(video_device_name_);
+    diagnostics_.add("Capture", this, &UsbCamNode::update_capture_diagnostics);
+    window_start_ = ros::Time::now();
+
+    if (!passthrough_ && decode_threads_ > 0)
+    {
+      start_pipeline();
+    }
+  }
+
+  void start_pipeline()
+  {
+    reset_pipeline_statistics();
+
+    // enough frames for a full queue, one per worker and the one being captured
+    const int pool_size = std::max(queue_size_, 1) + decode_threads_ + 1;
+    free_frames_.reset(new boost::lockfree::queue<RawFrame*>(pool_size));
+    for (int i = 0; i < pool_size; i++)
+    {
+      frames_.push_back(boost::make_shared<RawFrame>());
+      free_frames_->push(frames_.back().get());
+    }
+    frame_queue_.reset(new FrameQueue<RawFrame>(std::max(queue_size_, 1)));
+
+    for (int i = 0; i < decode_threads_; i++)
+    {
+      workers_.create_thread(boost::bind(&UsbCamNode::decode_worker, this));
+    }
+    diagnostics_.add("Pipeline", this, &UsbCamNode::update_pipeline_diagnostics);
+    ROS_INFO("Decoding frames on %d threads", decode_threads_);
+  }
+
+  void stop_pipeline()
+  {
+    if (frame_queue_)
+    {
+      frame_queue_->stop(decode_threads_);
+      workers_.join_all();
+    }
+  }
+
+  void decode_worker()
+  {
+    FrameDecoder decoder, preview_decoder;
+    {
+      boost::mutex::scoped_lock lock(cam_mutex_);
+      // a decoder that could not be opened retries with each frame
+      if (!cam_.init_decoder(&decoder) || (preview_ && !cam_.init_decoder(&preview_decoder, preview_scale_)))
+        ROS_ERROR("Could not initialize the decoder of a decode thread");
+    }
+    sensor_msgs::ImagePtr img = boost::make_shared<sensor_msgs::Image>();
+    img->header.frame_id = img_->header.frame_id;
+    sensor_msgs::ImagePtr preview_img;
+
+    while (RawFrame* frame = frame_queue_->pop())
+    {
+      const ros::WallTime dequeued = ros::WallTime::now();
+      if (!img.unique())
+      {
+        sensor_msgs::ImagePtr msg = boost::make_shared<sensor_msgs::Image>();
+        msg->header = img->header;
+        img = msg;
+      }
+      const std::vector<uint8_t>& data = frame->image.data;
+      const bool decoded = !data.empty() && decoder.decode(&data[0], data.size(), img.get());
+      img->header.stamp = frame->image.header.stamp;
+      const uint64_t seq = frame->seq;
+      const ros::WallTime captured = frame->captured;
+      if (frame->preview)
+      {
+        publish_preview(&preview_decoder, frame->image, preview_img);
+      }
+      free_frames_->push(frame);
+      if (!decoded)
+      {
+        continue;
+      }
+      const ros::WallTime decoded_time = ros::WallTime::now();
+
+      boost::mutex::scoped_lock lock(publish_mutex_);
+      if (seq < next_publish_seq_)
+      {
+        // another worker already published a more recent frame
+        late_frames_++;
+        continue;
+      }
+      next_publish_seq_ = seq + 1;
+
+      sensor_msgs::CameraInfoPtr ci(new sensor_msgs::CameraInfo(cinfo_->getCameraInfo()));
+      ci->header.frame_id = img->header.frame_id;
+      ci->header.stamp = img->header.stamp;
+      image_pub_.publish(img, ci);
+
+      const double queue_latency = (dequeued - captured).toSec();
+      const double decode_latency = (decoded_time - dequeued).toSec();
+      const double publish_latency = (ros::WallTime::now() - decoded_time).toSec();
+      pipeline_frames_++;
+      queue_latency_sum_ += queue_latency;
+      decode_latency_sum_ += decode_latency;
+      publish_latency_sum_ += publish_latency;
+      queue_latency_max_ = std::max(queue_latency_max_, queue_latency);
+      decode_latency_max_ = std::max(decode_latency_max_, decode_latency);
+      publish_latency_max_ = std::max(publish_latency_max_, publish_latency);
+    }
+  }
+
+  // copies the next frame out of the driver buffer and queues it for the workers
+  bool capture_raw_frame()
+  {
+    RawFrame* frame = NULL;
+    if (!free_frames_->pop(frame))
+    {
+      ROS_WARN_THROTTLE(1.0, "No free frame buffer for the decoding pipeline");
+      return true;
+    }
+    if (!cam_.grab_image(&frame->image))
+    {
+      free_frames_->push(frame);
+      return false;
+    }
+    frame->seq = capture_seq_++;
+    frame->captured = ros::WallTime::now();
+    frame->preview = preview_due();
+    record_frame(frame->image.header.stamp);
+
+    RawFrame* dropped = frame_queue_->push(frame);
+    if (dropped)
+    {
+      free_frames_->push(dropped);
+      boost::mutex::scoped_lock lock(publish_mutex_);
+      dropped_frames_++;
+    }
+    return true;
+  }
+
+  // true if the next frame should also be published on the preview topic
+  bool preview_due()
+  {
+    if (!preview_ || preview_pub_.getNumSubscribers() == 0)
+    {
+      return false;
+    }
+    const ros::Time now = ros::Time::now();
+    if (preview_rate_ > 0.0 && !last_preview_.isZero() && (now - last_preview_).toSec() < 1.0 / preview_rate_)
+    {
+      return false;
+    }
+    last_preview_ = now;
+    return true;
+  }
+
+  // decodes the raw frame at the preview size and publishes it, img is reused once subscribers released it
+  void publish_preview(FrameDecoder* decoder, const sensor_msgs::CompressedImage& frame, sensor_msgs::ImagePtr& img)
+  {
+    if (!img.unique())
+    {
+      img = boost::make_shared<sensor_msgs::Image>();
+      img->header.frame_id = img_->header.frame_id;
+    }
+    if (frame.data.empty() || !decoder->decode(&frame.data[0], frame.data.size(), img.get()))
+    {
+      return;
+    }
+    img->header.stamp = frame.header.stamp;
+    preview_pub_.publish(img);
+  }
+
+  void reset_pipeline_statistics()
+  {
+    pipeline_frames_ = 0;
+    dropped_frames_ = 0;
+    late_frames_ = 0;
+    queue_latency_sum_ = decode_latency_sum_ = publish_latency_sum_ = 0.0;
+    queue_latency_max_ = decode_latency_max_ = publish_latency_max_ = 0.0;
+  }
+
+  void update_pipeline_diagnostics(diagnostic_updater::DiagnosticStatusWrapper& stat)
+  {
+    boost::mutex::scoped_lock lock(publish_mutex_);
+    const int frames = std::max(pipeline_frames_, 1);
+
+    if (dropped_frames_ > 0)
+    {
+      stat.summary(diagnostic_msgs::DiagnosticStatus::WARN, "Decoding slower than capture, frames dropped");
+    }
+    else
+    {
+      stat.summary(diagnostic_msgs::DiagnosticStatus::OK, "Decoding keeps up with capture");
+    }
+
+    stat.add("Decode threads", decode_threads_);
+    stat.add("Published frames", pipeline_frames_);
+    stat.add("Dropped frames (queue full)", dropped_frames_);
+    stat.add("Late frames (out of order)", late_frames_);
+    stat.add("Mean queue latency (ms)", queue_latency_sum_ / frames * 1e3);
+    stat.add("Max queue latency (ms)", queue_latency_max_ * 1e3);
+    stat.add("Mean decode latency (ms)", decode_latency_sum_ / frames * 1e3);
+    stat.add("Max decode latency (ms)", decode_latency_max_ * 1e3);
+    stat.add("Mean publish latency (ms)", publish_latency_sum_ / frames * 1e3);
+    stat.add("Max publish latency (ms)", publish_latency_max_ * 1e3);
+
+    reset_pipeline_statistics();
+  }
+
+  void set_control(const std::string& name, int value)
+  {
+    if (!cam_.controls().set(name, value))
+    {
+      ROS_WARN("The camera has no writable control '%s'", name.c_str());
+    }
+  }
+
+  // applies the controls given as parameters, again after the device has been reopened or reconfigured.
+  // They are written together, and the values already set are skipped.
+  void set_camera_parameters()
+  {
+    if (brightness_ >= 0)
+    {
+      set_control("brightness", brightness_);
+    }
+
+    if (contrast_ >= 0)
+    {
+      set_control("contrast", contrast_);
+    }
+
+    if (saturation_ >= 0)
+    {
+      set_control("saturation", saturation_);
+    }
+
+    if (sharpness_ >= 0)
+    {
+      set_control("sharpness", sharpness_);
+    }
+
+    // check auto white balance
+    if (auto_white_balance_)
+    {
+      set_control("white_balance_temperature_auto", 1);
+    }
+    else
+    {
+      set_control("white_balance_temperature_auto", 0);
+      set_control("white_balance_temperature", white_balance_);
+    }
+
+    // check auto exposure
+    const V4l2Controls::Control* exposure_auto = cam_.controls().find("exposure_auto");
+    if (!autoexposure_)
+    {
+      // turn down exposure control (from max of 3)
+      set_control("exposure_auto", 1);
+      // change the exposure level
+      set_control("exposure_absolute", exposure_);
+    }
+    else if (exposure_auto && exposure_auto->default_value != 1)
+    {
+      // back to the automatic mode of the driver (usually aperture priority)
+      set_control("exposure_auto", exposure_auto->default_value);
+    }
+
+    if (gain_ >= 0)
+    {
+      set_control("gain", gain_);
+    }
+
+    // check auto focus
+    if (autofocus_)
+    {
+      set_control("focus_auto", 1);
+    }
+    else
+    {
+      set_control("focus_auto", 0);
+      if (focus_ >= 0)
+      {
+        // named focus_absolute by uvcvideo
+        set_control(cam_.controls().find("focus_absolute") ? "focus_absolute" : "focus", focus_);
+      }
+    }
+
+    cam_.controls().apply();
+  }
+
+  void reconfigure(UsbCamConfig& config, uint32_t level)
+  {
+    boost::mutex::scoped_lock lock(cam_mutex_);
+    brightness_ = config.brightness;
+    contrast_ = config.contrast;
+    saturation_ = config.saturation;
+    sharpness_ = config.sharpness;
+    gain_ = config.gain;
+    autoexposure_ = config.autoexposure;
+    exposure_ = config.exposure;
+    auto_white_balance_ = config.auto_white_balance;
+    white_balance_ = config.white_balance;
+    autofocus_ = config.autofocus;
+    focus_ = config.focus;
+    set_camera_parameters();
+  }
+
+  void record_frame(const ros::Time& stamp)
+  {
+    if (first_frame_delay_ < 0.0)
+    {
+      first_frame_delay_ = (ros::WallTime::now() - startup_).toSec();
+      ROS_INFO("First frame %.3f s after startup", first_frame_delay_);
+    }
+    if (!last_stamp_.isZero())
+    {
+      const double interval = (stamp - last_stamp_).toSec();
+      interval_sum_ += interval;
+      interval_sq_sum_ += interval * interval;
+      interval_max_ = std::max(interval_max_, interval);
+      window_intervals_++;
+    }
+    last_stamp_ = stamp;
+    window_frames_++;
+  }
+
+  void update_capture_diagnostics(diagnostic_updater::DiagnosticStatusWrapper& stat)
+  {
+    boost::mutex::scoped_lock lock(cam_mutex_);
+    const ros::Time now = ros::Time::now();
+    const double window = (now - window_start_).toSec();
+    const double fps = window > 0.0 ? window_frames_ / window : 0.0;
+    double mean = 0.0, jitter = 0.0;
+    if (window_intervals_ > 0)
+    {
+      mean = interval_sum_ / window_intervals_;
+      jitter = std::sqrt(std::max(0.0, interval_sq_sum_ / window_intervals_ - mean * mean));
+    }
+
+    if (failures_ > 0)
+    {
+      stat.summary(diagnostic_msgs::DiagnosticStatus::ERROR, "Camera not responding, recovering");
+    }
+    else if (!cam_.is_capturing())
+    {
+      stat.summary(diagnostic_msgs::DiagnosticStatus::OK, "Capture stopped");
+    }
+    else if (window_frames_ == 0)
+    {
+      stat.summary(diagnostic_msgs::DiagnosticStatus::ERROR, "No frames received");
+    }
+    else if (fps < 0.9 * framerate_)
+    {
+      stat.summary(diagnostic_msgs::DiagnosticStatus::WARN, "Frame rate below the requested rate");
+    }
+    else
+    {
+      stat.summary(diagnostic_msgs::DiagnosticStatus::OK, "Capturing");
+    }
+
+    stat.add("Requested frame rate (Hz)", framerate_);
+    stat.add("Achieved frame rate (Hz)", fps);
+    stat.add("Mean frame interval (ms)", mean * 1e3);
+    stat.add("Frame interval jitter (ms)", jitter * 1e3);
+    stat.add("Max frame interval (ms)", interval_max_ * 1e3);
+    stat.add("Recovery attempts", recoveries_total_);
+    if (first_frame_delay_ >= 0.0)
+    {
+      stat.add("Time to first frame (s)", first_frame_delay_);
+    }
+
+    window_start_ = now;
+    window_frames_ = 0;
+    window_intervals_ = 0;
+    interval_sum_ = 0.0;
+    interval_sq_sum_ = 0.0;
+    interval_max_ = 0.0;
+  }
+
+  // After a failed grab, the stream is restarted first, then the device is reopened until it responds again.
+  // Returns false when the device could not be restarted.
+  bool recover()
+  {
+    recoveries_total_++;
+    if (failures_++ == 0)
+    {
+      return cam_.restart_capturing();
+    }
+    if (!cam_.reopen_device())
+    {
+      return false;
+    }
+    set_camera_parameters();
+    return true;
+  }
+
+  virtual ~UsbCamNode()
+  {
+    stop_pipeline();
+    cam_.shutdown();
+  }
+
+  bool take_and_send_image()
+  {
+	if (frame_queue_){
+		// decoded and published by the workers
+		return capture_raw_frame();
+	}
+
+	if (passthrough_){
+		if (!img_compressed_.unique()){
+			sensor_msgs::CompressedImagePtr msg = boost::make_shared<sensor_msgs::CompressedImage>();
+			msg->header = img_compressed_->header;
+			img_compressed_ = msg;
+		}
+
+		// grab the image, MJPEG frames are completed into JPEG images while they are copied
+		if (!cam_.grab_image(img_compressed_.get()))
+			return false;
+		record_frame(img_compressed_->header.stamp);
+
+		// grab the camera info
+		sensor_msgs::CameraInfoPtr ci(new sensor_msgs::CameraInfo(cinfo_->getCameraInfo()));
+		ci->header.frame_id = img_compressed_->header.frame_id;
+		ci->header.stamp = img_compressed_->header.stamp;
+
+		// publish the image
+		image_compressed_pub_.publish(img_compressed_);
+		cam_info_pub_.publish(ci);
+
+		if (preview_due())
+			publish_preview(&preview_decoder_, *img_compressed_, preview_img_);
+
+	}else{
+		if (!img_.unique()){
+			sensor_msgs::ImagePtr msg = boost::make_shared<sensor_msgs::Image>();
+			msg->header = img_->header;
+			img_ = msg;
+		}
+
+		// grab the image, the raw frame is kept when it is also previewed
+		const bool preview = preview_due();
+		if (preview){
+			if (!cam_.grab_image(&raw_frame_))
+				return false;
+			if (raw_frame_.data.empty() || !decoder_.decode(&raw_frame_.data[0], raw_frame_.data.size(), img_.get()))
+				return true;
+			img_->header.stamp = raw_frame_.header.stamp;
+		}else if (!cam_.grab_image(img_.get())){
+			return false;
+		}
+		record_frame(img_->header.stamp);
+
+		// grab the camera info
+		sensor_msgs::CameraInfoPtr ci(new sensor_msgs::CameraInfo(cinfo_->getCameraInfo()));
+		ci->header.frame_id = img_->header.frame_id;
+		ci->header.stamp = img_->header.stamp;
+
+		// publish the image
+		image_pub_.publish(img_, ci);
+
+		if (preview)
+			publish_preview(&preview_decoder_, raw_frame_, preview_img_);
+	}
+    return true;
+  }
+
+  // grabs and publishes one frame, and recovers the camera on failure.
+  // Returns false if the camera is stopped, so that the loop waits before the next call.
+  bool capture()
+  {
+    bool recovered;
+    {
+      boost::mutex::scoped_lock lock(cam_mutex_);
+      if (failures_ == 0)
+      {
+        if (!cam_.is_capturing())
+        {
+          return false;
+        }
+        if (take_and_send_image())
+        {
+          return true;
+        }
+        ROS_WARN("USB camera did not respond in time.");
+      }
+      else if (cam_.is_capturing() && take_and_send_image())
+      {
+        ROS_INFO("USB camera recovered.");
+        failures_ = 0;
+        return true;
+      }
+      recovered = recover();
+    }
+
+    if (!recovered)
+    {
+      // the device is likely gone, retry later without holding the camera
+      ros::WallDuration(1.0).sleep();
+    }
+    return true;
+  }
+
+  // callbacks are left to the nodelet manager when running as a nodelet
+  bool spin(bool spin_callbacks = true)
+  {
+    if (driver_paced_)
+    {
+      // the loop blocks in the driver until the next frame, so callbacks are served by another thread
+      boost::scoped_ptr<ros::AsyncSpinner> spinner;
+      if (spin_callbacks)
+      {
+        spinner.reset(new ros::AsyncSpinner(1));
+        spinner->start();
+      }
+      while (node_.ok())
+      {
+        if (!capture())
+        {
+          ros::WallDuration(0.1).sleep();
+        }
+        diagnostics_.update();
+      }
+      return true;
+    }
+
+    ros::Rate loop_rate(this->framerate_);
+    while (node_.ok())
+    {
+      capture();
+      diagnostics_.update();
+      if (spin_callbacks)
+      {
+        ros::spinOnce();
+      }
+      loop_rate.sleep();
+    }
+    return true;
+  }
+
+};
+
+}
+
+#endif // USB_CAM_NODE_H
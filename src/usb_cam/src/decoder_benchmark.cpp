@@ -0,0 +1,196 @@
+/*********************************************************************
+ *
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2014, Robert Bosch LLC.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Robert Bosch nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ *********************************************************************/
+#include <ros/ros.h>
+#include <rosbag/bag.h>
+#include <rosbag/view.h>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <vector>
+#include <algorithm>
+#include <iostream>
+#include <boost/foreach.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/program_options.hpp>
+#include <sensor_msgs/CompressedImage.h>
+
+#include <usb_cam/mjpeg_decoder.h>
+
+using namespace std;
+using usb_cam::MjpegDecoder;
+
+// Compare the MJPEG decoders on frames recorded in passthrough mode:
+// decode time of each backend and scale, and difference with the libav images at full size.
+
+struct Result
+{
+  double ms_per_frame;
+  int failures;
+  double mean_error; // mean absolute difference per channel, NaN if not compared
+};
+
+static Result benchmark(MjpegDecoder* decoder, const std::vector<sensor_msgs::CompressedImage>& frames,
+                        const std::vector<std::vector<uint8_t> >* reference, int repeat)
+{
+  Result result;
+  result.failures = 0;
+  result.mean_error = std::numeric_limits<double>::quiet_NaN();
+  std::vector<uint8_t> image(decoder->image_size());
+
+  // Accuracy on a first pass, that also warms up the caches
+  double sum = 0.0;
+  for (size_t i = 0; i < frames.size(); i++)
+  {
+    if (!decoder->decode(&frames[i].data[0], frames[i].data.size(), &image[0]))
+    {
+      result.failures++;
+      continue;
+    }
+    if (reference != NULL && !(*reference)[i].empty())
+    {
+      const std::vector<uint8_t>& ref = (*reference)[i];
+      long diff = 0;
+      for (size_t j = 0; j < image.size(); j++)
+        diff += abs((int)image[j] - (int)ref[j]);
+      sum += (double)diff / image.size();
+    }
+  }
+  if (reference != NULL && result.failures < (int)frames.size())
+    result.mean_error = sum / (frames.size() - result.failures);
+
+  // Timing, best of the repetitions
+  result.ms_per_frame = std::numeric_limits<double>::max();
+  for (int r = 0; r < repeat; r++)
+  {
+    ros::WallTime start = ros::WallTime::now();
+    for (size_t i = 0; i < frames.size(); i++)
+      decoder->decode(&frames[i].data[0], frames[i].data.size(), &image[0]);
+    const double ms = (ros::WallTime::now() - start).toSec() * 1e3 / frames.size();
+    result.ms_per_frame = std::min(result.ms_per_frame, ms);
+  }
+  return result;
+}
+
+int main(int argc, char **argv){
+
+	ros::Time::init();
+
+	std::string input_rosbag = "input.bag";
+	std::string input_topic = "/video/head_camera/compressed";
+	int width = 640;
+	int height = 480;
+	int repeat = 5;
+
+	namespace po = boost::program_options;
+	po::options_description desc("Allowed options");
+	desc.add_options()
+	("help,h", "describe arguments")
+	("input,i", po::value(&input_rosbag), "set input rosbag file")
+	("input-topic,t", po::value(&input_topic), "set topic of the input CompressedImage messages")
+	("width", po::value(&width), "set the width of the frames")
+	("height", po::value(&height), "set the height of the frames")
+	("repeat,n", po::value(&repeat), "set the number of timed passes over the frames");
+
+	po::variables_map vm;
+	po::store(po::parse_command_line(argc, argv, desc), vm);
+	po::notify(vm);
+
+	if (vm.count("help")) {
+		cout << desc << "\n";
+		return 1;
+	}
+
+	// Load the frames in memory
+	std::vector<sensor_msgs::CompressedImage> frames;
+	rosbag::Bag input(input_rosbag, rosbag::bagmode::Read);
+	rosbag::View view(input);
+	BOOST_FOREACH(rosbag::MessageInstance const m, view)
+	{
+		if (m.getTopic() == input_topic || ("/" + m.getTopic() == input_topic))
+		{
+			sensor_msgs::CompressedImage::ConstPtr msg = m.instantiate<sensor_msgs::CompressedImage>();
+			if (msg != NULL && !msg->data.empty())
+				frames.push_back(*msg);
+		}
+	}
+	input.close();
+
+	if (frames.empty())
+	{
+		fprintf(stderr, "No CompressedImage messages found on topic %s\n", input_topic.c_str());
+		return 1;
+	}
+
+	// Reference images from libav at full size
+	std::vector<std::vector<uint8_t> > reference(frames.size());
+	boost::scoped_ptr<MjpegDecoder> decoder(MjpegDecoder::create("libav"));
+	if (!decoder->init(width, height, 1, MjpegDecoder::OUTPUT_RGB8))
+		return 1;
+	for (size_t i = 0; i < frames.size(); i++)
+	{
+		reference[i].resize(decoder->image_size());
+		if (!decoder->decode(&frames[i].data[0], frames[i].data.size(), &reference[i][0]))
+			reference[i].clear();
+	}
+
+	const char* backends[] = {"libav", "libjpeg"};
+	const int scales[] = {1, 2, 4};
+
+	printf("Number of frames: %d (%dx%d)\n", (int) frames.size(), width, height);
+	printf("%-8s %6s %10s %10s %9s %10s\n", "backend", "scale", "size", "ms/frame", "failures", "mean diff");
+	for (int b = 0; b < 2; b++)
+	{
+		for (int s = 0; s < 3; s++)
+		{
+			decoder.reset(MjpegDecoder::create(backends[b]));
+			if (!decoder)
+			{
+				printf("%-8s not built\n", backends[b]);
+				break;
+			}
+			if (!decoder->init(width, height, scales[s], MjpegDecoder::OUTPUT_RGB8))
+				continue;
+
+			const Result result = benchmark(decoder.get(), frames, scales[s] == 1 ? &reference : NULL, repeat);
+			char size[32];
+			snprintf(size, sizeof(size), "%dx%d", decoder->width(), decoder->height());
+			printf("%-8s %4s/%d %10s %10.3f %9d %10.3f\n", backends[b], "1", scales[s], size,
+			       result.ms_per_frame, result.failures, result.mean_error);
+		}
+	}
+
+	return 0;
+}
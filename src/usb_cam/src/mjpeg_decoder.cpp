@@ -0,0 +1,383 @@
+/*********************************************************************
+ *
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2014, Robert Bosch LLC.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Robert Bosch nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ *********************************************************************/
+#define __STDC_CONSTANT_MACROS
+#include <stdio.h>
+#include <string.h>
+#include <setjmp.h>
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libswscale/swscale.h>
+#include <libavutil/mem.h>
+#ifdef USB_CAM_WITH_LIBJPEG
+#include <jpeglib.h>
+#endif
+}
+
+// legacy reasons
+#include <libavcodec/version.h>
+#if LIBAVCODEC_VERSION_MAJOR < 55
+#define AV_CODEC_ID_MJPEG CODEC_ID_MJPEG
+#endif
+
+#include <ros/ros.h>
+
+#include <usb_cam/mjpeg_decoder.h>
+
+namespace usb_cam {
+
+const uint8_t mjpeg_huffman_table[] = {
+  0xFF,0xC4,0x01,0xA2,0x00,0x00,0x01,0x05,0x01,0x01,0x01,0x01,0x01,0x01,0x00,0x00,
+  0x00,0x00,0x00,0x00,0x00,0x00,0x01,0x02,0x03,0x04,0x05,0x06,0x07,0x08,0x09,0x0A,
+  0x0B,0x01,0x00,0x03,0x01,0x01,0x01,0x01,0x01,0x01,0x01,0x01,0x01,0x00,0x00,0x00,
+  0x00,0x00,0x00,0x01,0x02,0x03,0x04,0x05,0x06,0x07,0x08,0x09,0x0A,0x0B,0x10,0x00,
+  0x02,0x01,0x03,0x03,0x02,0x04,0x03,0x05,0x05,0x04,0x04,0x00,0x00,0x01,0x7D,0x01,
+  0x02,0x03,0x00,0x04,0x11,0x05,0x12,0x21,0x31,0x41,0x06,0x13,0x51,0x61,0x07,0x22,
+  0x71,0x14,0x32,0x81,0x91,0xA1,0x08,0x23,0x42,0xB1,0xC1,0x15,0x52,0xD1,0xF0,0x24,
+  0x33,0x62,0x72,0x82,0x09,0x0A,0x16,0x17,0x18,0x19,0x1A,0x25,0x26,0x27,0x28,0x29,
+  0x2A,0x34,0x35,0x36,0x37,0x38,0x39,0x3A,0x43,0x44,0x45,0x46,0x47,0x48,0x49,0x4A,
+  0x53,0x54,0x55,0x56,0x57,0x58,0x59,0x5A,0x63,0x64,0x65,0x66,0x67,0x68,0x69,0x6A,
+  0x73,0x74,0x75,0x76,0x77,0x78,0x79,0x7A,0x83,0x84,0x85,0x86,0x87,0x88,0x89,0x8A,
+  0x92,0x93,0x94,0x95,0x96,0x97,0x98,0x99,0x9A,0xA2,0xA3,0xA4,0xA5,0xA6,0xA7,0xA8,
+  0xA9,0xAA,0xB2,0xB3,0xB4,0xB5,0xB6,0xB7,0xB8,0xB9,0xBA,0xC2,0xC3,0xC4,0xC5,0xC6,
+  0xC7,0xC8,0xC9,0xCA,0xD2,0xD3,0xD4,0xD5,0xD6,0xD7,0xD8,0xD9,0xDA,0xE1,0xE2,0xE3,
+  0xE4,0xE5,0xE6,0xE7,0xE8,0xE9,0xEA,0xF1,0xF2,0xF3,0xF4,0xF5,0xF6,0xF7,0xF8,0xF9,
+  0xFA,0x11,0x00,0x02,0x01,0x02,0x04,0x04,0x03,0x04,0x07,0x05,0x04,0x04,0x00,0x01,
+  0x02,0x77,0x00,0x01,0x02,0x03,0x11,0x04,0x05,0x21,0x31,0x06,0x12,0x41,0x51,0x07,
+  0x61,0x71,0x13,0x22,0x32,0x81,0x08,0x14,0x42,0x91,0xA1,0xB1,0xC1,0x09,0x23,0x33,
+  0x52,0xF0,0x15,0x62,0x72,0xD1,0x0A,0x16,0x24,0x34,0xE1,0x25,0xF1,0x17,0x18,0x19,
+  0x1A,0x26,0x27,0x28,0x29,0x2A,0x35,0x36,0x37,0x38,0x39,0x3A,0x43,0x44,0x45,0x46,
+  0x47,0x48,0x49,0x4A,0x53,0x54,0x55,0x56,0x57,0x58,0x59,0x5A,0x63,0x64,0x65,0x66,
+  0x67,0x68,0x69,0x6A,0x73,0x74,0x75,0x76,0x77,0x78,0x79,0x7A,0x82,0x83,0x84,0x85,
+  0x86,0x87,0x88,0x89,0x8A,0x92,0x93,0x94,0x95,0x96,0x97,0x98,0x99,0x9A,0xA2,0xA3,
+  0xA4,0xA5,0xA6,0xA7,0xA8,0xA9,0xAA,0xB2,0xB3,0xB4,0xB5,0xB6,0xB7,0xB8,0xB9,0xBA,
+  0xC2,0xC3,0xC4,0xC5,0xC6,0xC7,0xC8,0xC9,0xCA,0xD2,0xD3,0xD4,0xD5,0xD6,0xD7,0xD8,
+  0xD9,0xDA,0xE2,0xE3,0xE4,0xE5,0xE6,0xE7,0xE8,0xE9,0xEA,0xF2,0xF3,0xF4,0xF5,0xF6,
+  0xF7,0xF8,0xF9,0xFA
+};
+const size_t mjpeg_huffman_table_size = sizeof(mjpeg_huffman_table);
+
+bool MjpegDecoder::set_size(int image_width, int image_height, int scale_denom)
+{
+  if (scale_denom != 1 && scale_denom != 2 && scale_denom != 4 && scale_denom != 8)
+  {
+    ROS_ERROR("Unsupported MJPEG decoding scale 1/%d", scale_denom);
+    return false;
+  }
+  width_ = (image_width + scale_denom - 1) / scale_denom;
+  height_ = (image_height + scale_denom - 1) / scale_denom;
+  return true;
+}
+
+// Decodes to YUV with libavcodec, then converts (and scales) the picture with libswscale
+class LibavMjpegDecoder : public MjpegDecoder {
+ public:
+  LibavMjpegDecoder()
+    : avframe_camera_(NULL), avcodec_(NULL), avoptions_(NULL), avcodec_context_(NULL), video_sws_(NULL),
+      output_pix_fmt_(PIX_FMT_RGB24) {
+  }
+
+  virtual ~LibavMjpegDecoder()
+  {
+    release();
+  }
+
+  virtual bool init(int image_width, int image_height, int scale_denom, output_format output)
+  {
+    release();
+    if (!set_size(image_width, image_height, scale_denom))
+      return false;
+    output_pix_fmt_ = output == OUTPUT_BGR8 ? PIX_FMT_BGR24 : PIX_FMT_RGB24;
+
+    avcodec_register_all();
+
+    avcodec_ = avcodec_find_decoder(AV_CODEC_ID_MJPEG);
+    if (!avcodec_)
+    {
+      ROS_ERROR("Could not find MJPEG decoder");
+      return false;
+    }
+
+    avcodec_context_ = avcodec_alloc_context3(avcodec_);
+    avframe_camera_ = avcodec_alloc_frame();
+
+    avcodec_context_->codec_id = AV_CODEC_ID_MJPEG;
+    avcodec_context_->width = image_width;
+    avcodec_context_->height = image_height;
+
+#if LIBAVCODEC_VERSION_MAJOR > 52
+    avcodec_context_->pix_fmt = PIX_FMT_YUV422P;
+    avcodec_context_->codec_type = AVMEDIA_TYPE_VIDEO;
+#endif
+
+    /* open it */
+    if (avcodec_open2(avcodec_context_, avcodec_, &avoptions_) < 0)
+    {
+      ROS_ERROR("Could not open MJPEG Decoder");
+      return false;
+    }
+    return true;
+  }
+
+  virtual bool decode(const uint8_t* data, int len, uint8_t* dest)
+  {
+    int got_picture;
+
+#if LIBAVCODEC_VERSION_MAJOR > 52
+    int decoded_len;
+    AVPacket avpkt;
+    av_init_packet(&avpkt);
+
+    avpkt.size = len;
+    avpkt.data = (unsigned char*)data;
+    decoded_len = avcodec_decode_video2(avcodec_context_, avframe_camera_, &got_picture, &avpkt);
+
+    if (decoded_len < 0)
+    {
+      ROS_ERROR("Error while decoding frame.");
+      memset(dest, 0, image_size());
+      return false;
+    }
+#else
+    avcodec_decode_video(avcodec_context_, avframe_camera_, &got_picture, (uint8_t *) data, len);
+#endif
+
+    if (!got_picture)
+    {
+      ROS_ERROR("Webcam: expected picture but didn't get it...");
+      memset(dest, 0, image_size());
+      return false;
+    }
+
+    // the context is only rebuilt if the decoded picture changes (e.g. 4:2:0 instead of 4:2:2 frames)
+    video_sws_ = sws_getCachedContext(video_sws_, avcodec_context_->width, avcodec_context_->height,
+                                      avcodec_context_->pix_fmt, width_, height_, output_pix_fmt_, SWS_BILINEAR,
+                                      NULL, NULL, NULL);
+    if (!video_sws_)
+    {
+      ROS_ERROR("Could not convert the decoded picture");
+      memset(dest, 0, image_size());
+      return false;
+    }
+
+    // converted straight into the destination
+    uint8_t* planes[4] = {dest, NULL, NULL, NULL};
+    int strides[4] = {width_ * 3, 0, 0, 0};
+    sws_scale(video_sws_, avframe_camera_->data, avframe_camera_->linesize, 0, avcodec_context_->height, planes,
+              strides);
+    return true;
+  }
+
+ private:
+  void release()
+  {
+    if (avcodec_context_)
+    {
+      avcodec_close(avcodec_context_);
+      av_free(avcodec_context_);
+      avcodec_context_ = NULL;
+    }
+    if (avframe_camera_)
+      av_free(avframe_camera_);
+    avframe_camera_ = NULL;
+    if (video_sws_)
+      sws_freeContext(video_sws_);
+    video_sws_ = NULL;
+  }
+
+  AVFrame *avframe_camera_;
+  AVCodec *avcodec_;
+  AVDictionary *avoptions_;
+  AVCodecContext *avcodec_context_;
+  struct SwsContext *video_sws_;
+  enum AVPixelFormat output_pix_fmt_;
+};
+
+#ifdef USB_CAM_WITH_LIBJPEG
+
+struct LibjpegError
+{
+  struct jpeg_error_mgr pub;
+  jmp_buf setjmp_buffer;
+};
+
+static void libjpeg_error_exit(j_common_ptr cinfo)
+{
+  char message[JMSG_LENGTH_MAX];
+  (*cinfo->err->format_message)(cinfo, message);
+  ROS_ERROR("Error while decoding frame: %s", message);
+  longjmp(((LibjpegError*)cinfo->err)->setjmp_buffer, 1);
+}
+
+static void libjpeg_output_message(j_common_ptr cinfo)
+{
+  // warnings about corrupt data are frequent with MJPEG cameras
+  char message[JMSG_LENGTH_MAX];
+  (*cinfo->err->format_message)(cinfo, message);
+  ROS_DEBUG("libjpeg: %s", message);
+}
+
+// Loads the tables of mjpeg_huffman_table, for the frames that do not define them
+static void load_default_huffman_tables(j_decompress_ptr cinfo)
+{
+  // after the marker and the length, each table is its class and index, 16 code counts and the values
+  const uint8_t* table = mjpeg_huffman_table + 4;
+  const uint8_t* end = mjpeg_huffman_table + mjpeg_huffman_table_size;
+  while (table + 17 <= end)
+  {
+    JHUFF_TBL** slot = (table[0] >> 4) == 0 ? &cinfo->dc_huff_tbl_ptrs[table[0] & 0x0F]
+                                            : &cinfo->ac_huff_tbl_ptrs[table[0] & 0x0F];
+    if (*slot == NULL)
+      *slot = jpeg_alloc_huff_table((j_common_ptr)cinfo);
+
+    int count = 0;
+    (*slot)->bits[0] = 0;
+    for (int i = 1; i <= 16; i++)
+    {
+      (*slot)->bits[i] = table[i];
+      count += table[i];
+    }
+    memcpy((*slot)->huffval, table + 17, count);
+    (*slot)->sent_table = FALSE;
+    table += 17 + count;
+  }
+}
+
+// Decodes straight to RGB or BGR with libjpeg(-turbo), reduced sizes are decoded from fewer DCT coefficients
+class LibjpegMjpegDecoder : public MjpegDecoder {
+ public:
+  LibjpegMjpegDecoder() : initialized_(false), scale_denom_(1), output_(OUTPUT_RGB8) {}
+
+  virtual ~LibjpegMjpegDecoder()
+  {
+    if (initialized_)
+      jpeg_destroy_decompress(&cinfo_);
+  }
+
+  virtual bool init(int image_width, int image_height, int scale_denom, output_format output)
+  {
+    if (!set_size(image_width, image_height, scale_denom))
+      return false;
+    scale_denom_ = scale_denom;
+    output_ = output;
+
+    if (!initialized_)
+    {
+      cinfo_.err = jpeg_std_error(&error_.pub);
+      error_.pub.error_exit = libjpeg_error_exit;
+      error_.pub.output_message = libjpeg_output_message;
+      jpeg_create_decompress(&cinfo_);
+      initialized_ = true;
+    }
+    return true;
+  }
+
+  virtual bool decode(const uint8_t* data, int len, uint8_t* dest)
+  {
+    if (setjmp(error_.setjmp_buffer))
+    {
+      jpeg_abort_decompress(&cinfo_);
+      memset(dest, 0, image_size());
+      return false;
+    }
+
+    jpeg_mem_src(&cinfo_, (unsigned char*)data, len);
+    jpeg_read_header(&cinfo_, TRUE);
+    if (cinfo_.dc_huff_tbl_ptrs[0] == NULL)
+      load_default_huffman_tables(&cinfo_);
+
+#ifdef JCS_EXTENSIONS
+    cinfo_.out_color_space = output_ == OUTPUT_BGR8 ? JCS_EXT_BGR : JCS_EXT_RGB;
+#else
+    cinfo_.out_color_space = JCS_RGB;
+#endif
+    cinfo_.scale_num = 1;
+    cinfo_.scale_denom = scale_denom_;
+    jpeg_start_decompress(&cinfo_);
+
+    if ((int)cinfo_.output_width != width_ || (int)cinfo_.output_height != height_)
+    {
+      ROS_ERROR("Frame of %dx%d, expected %dx%d", cinfo_.output_width, cinfo_.output_height, width_, height_);
+      jpeg_abort_decompress(&cinfo_);
+      memset(dest, 0, image_size());
+      return false;
+    }
+
+    const int stride = width_ * 3;
+    while (cinfo_.output_scanline < cinfo_.output_height)
+    {
+      JSAMPROW row = dest + cinfo_.output_scanline * stride;
+      jpeg_read_scanlines(&cinfo_, &row, 1);
+    }
+    jpeg_finish_decompress(&cinfo_);
+
+#ifndef JCS_EXTENSIONS
+    if (output_ == OUTPUT_BGR8)
+    {
+      for (int i = 0; i < image_size(); i += 3)
+      {
+        const uint8_t r = dest[i];
+        dest[i] = dest[i + 2];
+        dest[i + 2] = r;
+      }
+    }
+#endif
+    return true;
+  }
+
+ private:
+  struct jpeg_decompress_struct cinfo_;
+  LibjpegError error_;
+  bool initialized_;
+  int scale_denom_;
+  output_format output_;
+};
+
+#endif // USB_CAM_WITH_LIBJPEG
+
+MjpegDecoder* MjpegDecoder::create(const std::string& backend)
+{
+  if (backend == "libav")
+    return new LibavMjpegDecoder();
+#ifdef USB_CAM_WITH_LIBJPEG
+  if (backend == "libjpeg")
+    return new LibjpegMjpegDecoder();
+#endif
+  return NULL;
+}
+
+}
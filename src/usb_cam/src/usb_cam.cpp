@@ -58,10 +58,11 @@
 
 namespace usb_cam {
 
-static void errno_exit(const char * s)
+// Reports a failed call, so that the caller can recover the device
+static bool errno_error(const char * s)
 {
   ROS_ERROR("%s error %d, %s", s, errno, strerror(errno));
-  exit(EXIT_FAILURE);
+  return false;
 }
 
 static int xioctl(int fd, int request, void * arg)
@@ -75,414 +76,65 @@ static int xioctl(int fd, int request, void * arg)
   return r;
 }
 
-const unsigned char uchar_clipping_table[] = {
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0, // -128 - -121
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0, // -120 - -113
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0, // -112 - -105
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0, // -104 -  -97
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0, //  -96 -  -89
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0, //  -88 -  -81
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0, //  -80 -  -73
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0, //  -72 -  -65
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0, //  -64 -  -57
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0, //  -56 -  -49
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0, //  -48 -  -41
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0, //  -40 -  -33
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0, //  -32 -  -25
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0, //  -24 -  -17
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0, //  -16 -   -9
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0, //   -8 -   -1
-    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30,
-    31, 32, 33, 34, 35, 36, 37, 38, 39, 40, 41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, 52, 53, 54, 55, 56, 57, 58, 59,
-    60, 61, 62, 63, 64, 65, 66, 67, 68, 69, 70, 71, 72, 73, 74, 75, 76, 77, 78, 79, 80, 81, 82, 83, 84, 85, 86, 87, 88,
-    89, 90, 91, 92, 93, 94, 95, 96, 97, 98, 99, 100, 101, 102, 103, 104, 105, 106, 107, 108, 109, 110, 111, 112, 113,
-    114, 115, 116, 117, 118, 119, 120, 121, 122, 123, 124, 125, 126, 127, 128, 129, 130, 131, 132, 133, 134, 135, 136,
-    137, 138, 139, 140, 141, 142, 143, 144, 145, 146, 147, 148, 149, 150, 151, 152, 153, 154, 155, 156, 157, 158, 159,
-    160, 161, 162, 163, 164, 165, 166, 167, 168, 169, 170, 171, 172, 173, 174, 175, 176, 177, 178, 179, 180, 181, 182,
-    183, 184, 185, 186, 187, 188, 189, 190, 191, 192, 193, 194, 195, 196, 197, 198, 199, 200, 201, 202, 203, 204, 205,
-    206, 207, 208, 209, 210, 211, 212, 213, 214, 215, 216, 217, 218, 219, 220, 221, 222, 223, 224, 225, 226, 227, 228,
-    229, 230, 231, 232, 233, 234, 235, 236, 237, 238, 239, 240, 241, 242, 243, 244, 245, 246, 247, 248, 249, 250, 251,
-    252, 253, 254, 255, 255, 255, 255, 255, 255, 255, 255, 255, // 256-263
-    255, 255, 255, 255, 255, 255, 255, 255, // 264-271
-    255, 255, 255, 255, 255, 255, 255, 255, // 272-279
-    255, 255, 255, 255, 255, 255, 255, 255, // 280-287
-    255, 255, 255, 255, 255, 255, 255, 255, // 288-295
-    255, 255, 255, 255, 255, 255, 255, 255, // 296-303
-    255, 255, 255, 255, 255, 255, 255, 255, // 304-311
-    255, 255, 255, 255, 255, 255, 255, 255, // 312-319
-    255, 255, 255, 255, 255, 255, 255, 255, // 320-327
-    255, 255, 255, 255, 255, 255, 255, 255, // 328-335
-    255, 255, 255, 255, 255, 255, 255, 255, // 336-343
-    255, 255, 255, 255, 255, 255, 255, 255, // 344-351
-    255, 255, 255, 255, 255, 255, 255, 255, // 352-359
-    255, 255, 255, 255, 255, 255, 255, 255, // 360-367
-    255, 255, 255, 255, 255, 255, 255, 255, // 368-375
-    255, 255, 255, 255, 255, 255, 255, 255, // 376-383
-    };
-const int clipping_table_offset = 128;
-
-/** Clip a value to the range 0<val<255. For speed this is done using an
- * array, so can only cope with numbers in the range -128<val<383.
- */
-static unsigned char CLIPVALUE(int val)
-{
-  // Old method (if)
-  /*   val = val < 0 ? 0 : val; */
-  /*   return val > 255 ? 255 : val; */
-
-  // New method (array)
-  return uchar_clipping_table[val + clipping_table_offset];
-}
-
-/**
- * Conversion from YUV to RGB.
- * The normal conversion matrix is due to Julien (surname unknown):
- *
- * [ R ]   [  1.0   0.0     1.403 ] [ Y ]
- * [ G ] = [  1.0  -0.344  -0.714 ] [ U ]
- * [ B ]   [  1.0   1.770   0.0   ] [ V ]
- *
- * and the firewire one is similar:
- *
- * [ R ]   [  1.0   0.0     0.700 ] [ Y ]
- * [ G ] = [  1.0  -0.198  -0.291 ] [ U ]
- * [ B ]   [  1.0   1.015   0.0   ] [ V ]
- *
- * Corrected by BJT (coriander's transforms RGB->YUV and YUV->RGB
- *                   do not get you back to the same RGB!)
- * [ R ]   [  1.0   0.0     1.136 ] [ Y ]
- * [ G ] = [  1.0  -0.396  -0.578 ] [ U ]
- * [ B ]   [  1.0   2.041   0.002 ] [ V ]
- *
- */
-static void YUV2RGB(const unsigned char y, const unsigned char u, const unsigned char v, unsigned char* r,
-                    unsigned char* g, unsigned char* b)
-{
-  const int y2 = (int)y;
-  const int u2 = (int)u - 128;
-  const int v2 = (int)v - 128;
-  //std::cerr << "YUV=("<<y2<<","<<u2<<","<<v2<<")"<<std::endl;
-
-  // This is the normal YUV conversion, but
-  // appears to be incorrect for the firewire cameras
-  //   int r2 = y2 + ( (v2*91947) >> 16);
-  //   int g2 = y2 - ( ((u2*22544) + (v2*46793)) >> 16 );
-  //   int b2 = y2 + ( (u2*115999) >> 16);
-  // This is an adjusted version (UV spread out a bit)
-  int r2 = y2 + ((v2 * 37221) >> 15);
-  int g2 = y2 - (((u2 * 12975) + (v2 * 18949)) >> 15);
-  int b2 = y2 + ((u2 * 66883) >> 15);
-  //std::cerr << "   RGB=("<<r2<<","<<g2<<","<<b2<<")"<<std::endl;
-
-  // Cap the values.
-  *r = CLIPVALUE(r2);
-  *g = CLIPVALUE(g2);
-  *b = CLIPVALUE(b2);
-}
-
-void uyvy2rgb(char *YUV, char *RGB, int NumPixels)
-{
-  int i, j;
-  unsigned char y0, y1, u, v;
-  unsigned char r, g, b;
-  for (i = 0, j = 0; i < (NumPixels << 1); i += 4, j += 6)
-  {
-    u = (unsigned char)YUV[i + 0];
-    y0 = (unsigned char)YUV[i + 1];
-    v = (unsigned char)YUV[i + 2];
-    y1 = (unsigned char)YUV[i + 3];
-    YUV2RGB(y0, u, v, &r, &g, &b);
-    RGB[j + 0] = r;
-    RGB[j + 1] = g;
-    RGB[j + 2] = b;
-    YUV2RGB(y1, u, v, &r, &g, &b);
-    RGB[j + 3] = r;
-    RGB[j + 4] = g;
-    RGB[j + 5] = b;
-  }
-}
-
-static void mono102mono8(char *RAW, char *MONO, int NumPixels)
-{
-  int i, j;
-  for (i = 0, j = 0; i < (NumPixels << 1); i += 2, j += 1)
-  {
-    //first byte is low byte, second byte is high byte; smash together and convert to 8-bit
-    MONO[j] = (unsigned char)(((RAW[i + 0] >> 2) & 0x3F) | ((RAW[i + 1] << 6) & 0xC0));
-  }
-}
-
-static void yuyv2rgb(char *YUV, char *RGB, int NumPixels)
-{
-  int i, j;
-  unsigned char y0, y1, u, v;
-  unsigned char r, g, b;
-
-  for (i = 0, j = 0; i < (NumPixels << 1); i += 4, j += 6)
-  {
-    y0 = (unsigned char)YUV[i + 0];
-    u = (unsigned char)YUV[i + 1];
-    y1 = (unsigned char)YUV[i + 2];
-    v = (unsigned char)YUV[i + 3];
-    YUV2RGB(y0, u, v, &r, &g, &b);
-    RGB[j + 0] = r;
-    RGB[j + 1] = g;
-    RGB[j + 2] = b;
-    YUV2RGB(y1, u, v, &r, &g, &b);
-    RGB[j + 3] = r;
-    RGB[j + 4] = g;
-    RGB[j + 5] = b;
-  }
-}
-
-void rgb242rgb(char *YUV, char *RGB, int NumPixels)
-{
-  memcpy(RGB, YUV, NumPixels * 3);
-}
-
-
 UsbCam::UsbCam()
-  : io_(IO_METHOD_MMAP), fd_(-1), buffers_(NULL), n_buffers_(0), avframe_camera_(NULL),
-    avframe_rgb_(NULL), avcodec_(NULL), avoptions_(NULL), avcodec_context_(NULL),
-    avframe_camera_size_(0), avframe_rgb_size_(0), video_sws_(NULL), image_(NULL), is_capturing_(false) {
+  : io_(IO_METHOD_MMAP), fd_(-1), buffers_(NULL), n_buffers_(0), mjpeg_decoder_("libav"), lazy_init_(false), image_(NULL), is_capturing_(false),
+    image_width_(0), image_height_(0), framerate_(0), timeout_(5.0) {
 }
 UsbCam::~UsbCam()
 {
   shutdown();
 }
 
-int UsbCam::init_mjpeg_decoder(int image_width, int image_height)
+// True if the JPEG headers (up to the start of scan) define Huffman tables
+static bool jpeg_has_huffman_table(const uint8_t* data, int len)
 {
-  avcodec_register_all();
-
-  avcodec_ = avcodec_find_decoder(AV_CODEC_ID_MJPEG);
-  if (!avcodec_)
+  int pos = 2;
+  while (pos + 4 <= len && data[pos] == 0xFF)
   {
-    ROS_ERROR("Could not find MJPEG decoder");
-    return 0;
-  }
-
-  avcodec_context_ = avcodec_alloc_context3(avcodec_);
-  avframe_camera_ = avcodec_alloc_frame();
-  avframe_rgb_ = avcodec_alloc_frame();
-
-  avpicture_alloc((AVPicture *)avframe_rgb_, PIX_FMT_RGB24, image_width, image_height);
-
-  avcodec_context_->codec_id = AV_CODEC_ID_MJPEG;
-  avcodec_context_->width = image_width;
-  avcodec_context_->height = image_height;
-
-#if LIBAVCODEC_VERSION_MAJOR > 52
-  avcodec_context_->pix_fmt = PIX_FMT_YUV422P;
-  avcodec_context_->codec_type = AVMEDIA_TYPE_VIDEO;
-#endif
-
-  avframe_camera_size_ = avpicture_get_size(PIX_FMT_YUV422P, image_width, image_height);
-  avframe_rgb_size_ = avpicture_get_size(PIX_FMT_RGB24, image_width, image_height);
-
-  /* open it */
-  if (avcodec_open2(avcodec_context_, avcodec_, &avoptions_) < 0)
-  {
-    ROS_ERROR("Could not open MJPEG Decoder");
-    return 0;
+    const uint8_t marker = data[pos + 1];
+    if (marker == 0xC4)
+      return true;
+    if (marker == 0xDA)
+      break;
+    pos += 2 + ((data[pos + 2] << 8) | data[pos + 3]);
   }
-  return 1;
+  return false;
 }
 
-void UsbCam::mjpeg2rgb(char *MJPEG, int len, char *RGB, int NumPixels)
+void UsbCam::process_image_compressed(const void * src, int len, sensor_msgs::CompressedImage *msg)
 {
-  int got_picture;
-
-  memset(RGB, 0, avframe_rgb_size_);
+  const uint8_t* data = (const uint8_t*)src;
 
-#if LIBAVCODEC_VERSION_MAJOR > 52
-  int decoded_len;
-  AVPacket avpkt;
-  av_init_packet(&avpkt);
-
-  avpkt.size = len;
-  avpkt.data = (unsigned char*)MJPEG;
-  decoded_len = avcodec_decode_video2(avcodec_context_, avframe_camera_, &got_picture, &avpkt);
-
-  if (decoded_len < 0)
-  {
-    ROS_ERROR("Error while decoding frame.");
-    return;
-  }
-#else
-  avcodec_decode_video(avcodec_context_, avframe_camera_, &got_picture, (uint8_t *) MJPEG, len);
-#endif
-
-  if (!got_picture)
+  if (pixelformat_ == V4L2_PIX_FMT_MJPEG && len >= 2 && data[0] == 0xFF && data[1] == 0xD8)
   {
-    ROS_ERROR("Webcam: expected picture but didn't get it...");
-    return;
-  }
-
-  int xsize = avcodec_context_->width;
-  int ysize = avcodec_context_->height;
-  int pic_size = avpicture_get_size(avcodec_context_->pix_fmt, xsize, ysize);
-  if (pic_size != avframe_camera_size_)
-  {
-    ROS_ERROR("outbuf size mismatch.  pic_size: %d bufsize: %d", pic_size, avframe_camera_size_);
-    return;
+    msg->format = "jpeg";
+    if (!jpeg_has_huffman_table(data, len))
+    {
+      // Copy the frame once from the V4L2 buffer, with the Huffman tables inserted after the SOI marker
+      msg->data.resize(len + mjpeg_huffman_table_size);
+      uint8_t* dest = &msg->data[0];
+      memcpy(dest, data, 2);
+      memcpy(dest + 2, mjpeg_huffman_table, mjpeg_huffman_table_size);
+      memcpy(dest + 2 + mjpeg_huffman_table_size, data + 2, len - 2);
+      return;
+    }
   }
-
-  video_sws_ = sws_getContext(xsize, ysize, avcodec_context_->pix_fmt, xsize, ysize, PIX_FMT_RGB24, SWS_BILINEAR, NULL,
-			      NULL,  NULL);
-  sws_scale(video_sws_, avframe_camera_->data, avframe_camera_->linesize, 0, ysize, avframe_rgb_->data,
-            avframe_rgb_->linesize);
-  sws_freeContext(video_sws_);
-
-  int size = avpicture_layout((AVPicture *)avframe_rgb_, PIX_FMT_RGB24, xsize, ysize, (uint8_t *)RGB, avframe_rgb_size_);
-  if (size != avframe_rgb_size_)
+  else if (pixelformat_ == V4L2_PIX_FMT_MJPEG)
   {
-    ROS_ERROR("webcam: avpicture_layout error: %d", size);
-    return;
+    ROS_WARN_THROTTLE(1.0, "Incorrect header for mjpeg data");
   }
-}
 
-void UsbCam::process_image_raw_bytes(const void * src, int len, camera_image_t *dest){
-	dest->image_size = len;
-	memcpy(dest->image, (char*)src, len);
+  msg->data.resize(len);
+  if (len > 0)
+    memcpy(&msg->data[0], data, len);
 }
 
 void UsbCam::process_image(const void * src, int len, camera_image_t *dest)
 {
-  if (pixelformat_ == V4L2_PIX_FMT_YUYV)
-  {
-    if (monochrome_)
-    { //actually format V4L2_PIX_FMT_Y16, but xioctl gets unhappy if you don't use the advertised type (yuyv)
-      mono102mono8((char*)src, dest->image, dest->width * dest->height);
-    }
-    else
-    {
-      yuyv2rgb((char*)src, dest->image, dest->width * dest->height);
-    }
-  }
-  else if (pixelformat_ == V4L2_PIX_FMT_UYVY)
-    uyvy2rgb((char*)src, dest->image, dest->width * dest->height);
-  else if (pixelformat_ == V4L2_PIX_FMT_MJPEG)
-    mjpeg2rgb((char*)src, len, dest->image, dest->width * dest->height);
-  else if (pixelformat_ == V4L2_PIX_FMT_RGB24)
-    rgb242rgb((char*)src, dest->image, dest->width * dest->height);
-  else if (pixelformat_ == V4L2_PIX_FMT_GREY)
-    memcpy(dest->image, (char*)src, dest->width * dest->height);
+  decoder_.decode(src, len, dest->image);
 }
 
-int UsbCam::read_frame(bool raw_bytes)
+int UsbCam::read_frame(sensor_msgs::CompressedImage* compressed)
 {
   struct v4l2_buffer buf;
   unsigned int i;
@@ -505,12 +157,13 @@ int UsbCam::read_frame(bool raw_bytes)
             /* fall through */
 
           default:
-            errno_exit("read");
+            errno_error("read");
+            return -1;
         }
       }
 
-      if (raw_bytes){
-    	  process_image_raw_bytes(buffers_[0].start, len, image_);
+      if (compressed){
+    	  process_image_compressed(buffers_[0].start, len, compressed);
       }else{
     	  process_image(buffers_[0].start, len, image_);
       }
@@ -536,7 +189,8 @@ int UsbCam::read_frame(bool raw_bytes)
             /* fall through */
 
           default:
-            errno_exit("VIDIOC_DQBUF");
+            errno_error("VIDIOC_DQBUF");
+            return -1;
         }
       }
 
@@ -547,14 +201,17 @@ int UsbCam::read_frame(bool raw_bytes)
       assert(buf.index < n_buffers_);
       len = buf.bytesused;
 
-      if (raw_bytes){
-    	  process_image_raw_bytes(buffers_[buf.index].start, len, image_);
+      if (compressed){
+    	  process_image_compressed(buffers_[buf.index].start, len, compressed);
 		}else{
 		  process_image(buffers_[buf.index].start, len, image_);
       }
 
       if (-1 == xioctl(fd_, VIDIOC_QBUF, &buf))
-        errno_exit("VIDIOC_QBUF");
+      {
+        errno_error("VIDIOC_QBUF");
+        return -1;
+      }
 
       break;
 
@@ -577,7 +234,8 @@ int UsbCam::read_frame(bool raw_bytes)
             /* fall through */
 
           default:
-            errno_exit("VIDIOC_DQBUF");
+            errno_error("VIDIOC_DQBUF");
+            return -1;
         }
       }
 
@@ -588,14 +246,17 @@ int UsbCam::read_frame(bool raw_bytes)
       assert(i < n_buffers_);
       len = buf.bytesused;
 
-      if (raw_bytes){
-    	  process_image_raw_bytes((void *)buf.m.userptr, len, image_);
+      if (compressed){
+    	  process_image_compressed((void *)buf.m.userptr, len, compressed);
 		}else{
 			process_image((void *)buf.m.userptr, len, image_);
 	  }
 
       if (-1 == xioctl(fd_, VIDIOC_QBUF, &buf))
-        errno_exit("VIDIOC_QBUF");
+      {
+        errno_error("VIDIOC_QBUF");
+        return -1;
+      }
 
       break;
   }
@@ -607,9 +268,9 @@ bool UsbCam::is_capturing() {
   return is_capturing_;
 }
 
-void UsbCam::stop_capturing(void)
+bool UsbCam::stop_capturing(void)
 {
-  if(!is_capturing_) return;
+  if(!is_capturing_) return true;
 
   is_capturing_ = false;
   enum v4l2_buf_type type;
@@ -625,16 +286,17 @@ void UsbCam::stop_capturing(void)
       type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
 
       if (-1 == xioctl(fd_, VIDIOC_STREAMOFF, &type))
-        errno_exit("VIDIOC_STREAMOFF");
+        return errno_error("VIDIOC_STREAMOFF");
 
       break;
   }
+  return true;
 }
 
-void UsbCam::start_capturing(void)
+bool UsbCam::start_capturing(void)
 {
 
-  if(is_capturing_) return;
+  if(is_capturing_) return true;
 
   unsigned int i;
   enum v4l2_buf_type type;
@@ -657,13 +319,13 @@ void UsbCam::start_capturing(void)
         buf.index = i;
 
         if (-1 == xioctl(fd_, VIDIOC_QBUF, &buf))
-          errno_exit("VIDIOC_QBUF");
+          return errno_error("VIDIOC_QBUF");
       }
 
       type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
 
       if (-1 == xioctl(fd_, VIDIOC_STREAMON, &type))
-        errno_exit("VIDIOC_STREAMON");
+        return errno_error("VIDIOC_STREAMON");
 
       break;
 
@@ -681,23 +343,28 @@ void UsbCam::start_capturing(void)
         buf.length = buffers_[i].length;
 
         if (-1 == xioctl(fd_, VIDIOC_QBUF, &buf))
-          errno_exit("VIDIOC_QBUF");
+          return errno_error("VIDIOC_QBUF");
       }
 
       type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
 
       if (-1 == xioctl(fd_, VIDIOC_STREAMON, &type))
-        errno_exit("VIDIOC_STREAMON");
+        return errno_error("VIDIOC_STREAMON");
 
       break;
   }
   is_capturing_ = true;
+  return true;
 }
 
 void UsbCam::uninit_device(void)
 {
   unsigned int i;
 
+  // nothing allocated, e.g. the device could not be reopened
+  if (!buffers_)
+    return;
+
   switch (io_)
   {
     case IO_METHOD_READ:
@@ -707,7 +374,7 @@ void UsbCam::uninit_device(void)
     case IO_METHOD_MMAP:
       for (i = 0; i < n_buffers_; ++i)
         if (-1 == munmap(buffers_[i].start, buffers_[i].length))
-          errno_exit("munmap");
+          errno_error("munmap");
       break;
 
     case IO_METHOD_USERPTR:
@@ -717,16 +384,18 @@ void UsbCam::uninit_device(void)
   }
 
   free(buffers_);
+  buffers_ = NULL;
+  n_buffers_ = 0;
 }
 
-void UsbCam::init_read(unsigned int buffer_size)
+bool UsbCam::init_read(unsigned int buffer_size)
 {
   buffers_ = (buffer*)calloc(1, sizeof(*buffers_));
 
   if (!buffers_)
   {
     ROS_ERROR("Out of memory");
-    exit(EXIT_FAILURE);
+    return false;
   }
 
   buffers_[0].length = buffer_size;
@@ -735,11 +404,12 @@ void UsbCam::init_read(unsigned int buffer_size)
   if (!buffers_[0].start)
   {
     ROS_ERROR("Out of memory");
-    exit(EXIT_FAILURE);
+    return false;
   }
+  return true;
 }
 
-void UsbCam::init_mmap(void)
+bool UsbCam::init_mmap(void)
 {
   struct v4l2_requestbuffers req;
 
@@ -754,18 +424,18 @@ void UsbCam::init_mmap(void)
     if (EINVAL == errno)
     {
       ROS_ERROR_STREAM(camera_dev_ << " does not support memory mapping");
-      exit(EXIT_FAILURE);
+      return false;
     }
     else
     {
-      errno_exit("VIDIOC_REQBUFS");
+      return errno_error("VIDIOC_REQBUFS");
     }
   }
 
   if (req.count < 2)
   {
     ROS_ERROR_STREAM("Insufficient buffer memory on " << camera_dev_);
-    exit(EXIT_FAILURE);
+    return false;
   }
 
   buffers_ = (buffer*)calloc(req.count, sizeof(*buffers_));
@@ -773,7 +443,7 @@ void UsbCam::init_mmap(void)
   if (!buffers_)
   {
     ROS_ERROR("Out of memory");
-    exit(EXIT_FAILURE);
+    return false;
   }
 
   for (n_buffers_ = 0; n_buffers_ < req.count; ++n_buffers_)
@@ -787,7 +457,7 @@ void UsbCam::init_mmap(void)
     buf.index = n_buffers_;
 
     if (-1 == xioctl(fd_, VIDIOC_QUERYBUF, &buf))
-      errno_exit("VIDIOC_QUERYBUF");
+      return errno_error("VIDIOC_QUERYBUF");
 
     buffers_[n_buffers_].length = buf.length;
     buffers_[n_buffers_].start = mmap(NULL /* start anywhere */, buf.length, PROT_READ | PROT_WRITE /* required */,
@@ -795,11 +465,12 @@ void UsbCam::init_mmap(void)
 				      fd_, buf.m.offset);
 
     if (MAP_FAILED == buffers_[n_buffers_].start)
-      errno_exit("mmap");
+      return errno_error("mmap");
   }
+  return true;
 }
 
-void UsbCam::init_userp(unsigned int buffer_size)
+bool UsbCam::init_userp(unsigned int buffer_size)
 {
   struct v4l2_requestbuffers req;
   unsigned int page_size;
@@ -819,11 +490,11 @@ void UsbCam::init_userp(unsigned int buffer_size)
     {
       ROS_ERROR_STREAM(camera_dev_ << " does not support "
                 "user pointer i/o");
-      exit(EXIT_FAILURE);
+      return false;
     }
     else
     {
-      errno_exit("VIDIOC_REQBUFS");
+      return errno_error("VIDIOC_REQBUFS");
     }
   }
 
@@ -832,7 +503,7 @@ void UsbCam::init_userp(unsigned int buffer_size)
   if (!buffers_)
   {
     ROS_ERROR("Out of memory");
-    exit(EXIT_FAILURE);
+    return false;
   }
 
   for (n_buffers_ = 0; n_buffers_ < 4; ++n_buffers_)
@@ -843,16 +514,15 @@ void UsbCam::init_userp(unsigned int buffer_size)
     if (!buffers_[n_buffers_].start)
     {
       ROS_ERROR("Out of memory");
-      exit(EXIT_FAILURE);
+      return false;
     }
   }
+  return true;
 }
 
-void UsbCam::init_device(int image_width, int image_height, int framerate)
+bool UsbCam::init_device(int image_width, int image_height, int framerate)
 {
   struct v4l2_capability cap;
-  struct v4l2_cropcap cropcap;
-  struct v4l2_crop crop;
   struct v4l2_format fmt;
   unsigned int min;
 
@@ -861,18 +531,18 @@ void UsbCam::init_device(int image_width, int image_height, int framerate)
     if (EINVAL == errno)
     {
       ROS_ERROR_STREAM(camera_dev_ << " is no V4L2 device");
-      exit(EXIT_FAILURE);
+      return false;
     }
     else
     {
-      errno_exit("VIDIOC_QUERYCAP");
+      return errno_error("VIDIOC_QUERYCAP");
     }
   }
 
   if (!(cap.capabilities & V4L2_CAP_VIDEO_CAPTURE))
   {
     ROS_ERROR_STREAM(camera_dev_ << " is no video capture device");
-    exit(EXIT_FAILURE);
+    return false;
   }
 
   switch (io_)
@@ -881,7 +551,7 @@ void UsbCam::init_device(int image_width, int image_height, int framerate)
       if (!(cap.capabilities & V4L2_CAP_READWRITE))
       {
         ROS_ERROR_STREAM(camera_dev_ << " does not support read i/o");
-        exit(EXIT_FAILURE);
+        return false;
       }
 
       break;
@@ -891,12 +561,83 @@ void UsbCam::init_device(int image_width, int image_height, int framerate)
       if (!(cap.capabilities & V4L2_CAP_STREAMING))
       {
         ROS_ERROR_STREAM(camera_dev_ << " does not support streaming i/o");
-        exit(EXIT_FAILURE);
+        return false;
       }
 
       break;
   }
 
+  CLEAR(fmt);
+  fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+
+  // the driver keeps the negotiated format while the device stays connected, the renegotiation (and its
+  // round trips to the camera) can be skipped if it is the requested one
+  bool negotiate = true;
+  if (lazy_init_ && 0 == xioctl(fd_, VIDIOC_G_FMT, &fmt))
+  {
+    negotiate = fmt.fmt.pix.width != (unsigned int)image_width || fmt.fmt.pix.height != (unsigned int)image_height ||
+                fmt.fmt.pix.pixelformat != pixelformat_;
+    if (!negotiate)
+      ROS_DEBUG_STREAM("Reusing the format of " << camera_dev_);
+  }
+
+  if (negotiate)
+  {
+    if (!set_format(image_width, image_height, &fmt))
+      return false;
+  }
+
+  /* Note VIDIOC_S_FMT may change width and height. */
+
+  /* Buggy driver paranoia. */
+  min = fmt.fmt.pix.width * 2;
+  if (fmt.fmt.pix.bytesperline < min)
+    fmt.fmt.pix.bytesperline = min;
+  min = fmt.fmt.pix.bytesperline * fmt.fmt.pix.height;
+  if (fmt.fmt.pix.sizeimage < min)
+    fmt.fmt.pix.sizeimage = min;
+
+  image_width = fmt.fmt.pix.width;
+  image_height = fmt.fmt.pix.height;
+
+  struct v4l2_streamparm stream_params;
+  memset(&stream_params, 0, sizeof(stream_params));
+  stream_params.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  if (xioctl(fd_, VIDIOC_G_PARM, &stream_params) < 0)
+    return errno_error("Couldn't query v4l fps!");
+
+  ROS_DEBUG("Capability flag: 0x%x", stream_params.parm.capture.capability);
+
+  if (negotiate || stream_params.parm.capture.timeperframe.numerator != 1 ||
+      stream_params.parm.capture.timeperframe.denominator != (unsigned int)framerate)
+  {
+    stream_params.parm.capture.timeperframe.numerator = 1;
+    stream_params.parm.capture.timeperframe.denominator = framerate;
+    if (xioctl(fd_, VIDIOC_S_PARM, &stream_params) < 0)
+      ROS_WARN("Couldn't set camera framerate");
+    else
+      ROS_DEBUG("Set framerate to be %i", framerate);
+  }
+
+  switch (io_)
+  {
+    case IO_METHOD_READ:
+      return init_read(fmt.fmt.pix.sizeimage);
+
+    case IO_METHOD_MMAP:
+      return init_mmap();
+
+    case IO_METHOD_USERPTR:
+      return init_userp(fmt.fmt.pix.sizeimage);
+  }
+  return true;
+}
+
+bool UsbCam::set_format(int image_width, int image_height, struct v4l2_format* fmt)
+{
+  struct v4l2_cropcap cropcap;
+  struct v4l2_crop crop;
+
   /* Select video input, video standard and tune here. */
 
   CLEAR(cropcap);
@@ -926,7 +667,7 @@ void UsbCam::init_device(int image_width, int image_height, int framerate)
     /* Errors ignored. */
   }
 
-  CLEAR(fmt);
+  CLEAR(*fmt);
 
 //  fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
 //  fmt.fmt.pix.width = 640;
@@ -934,81 +675,40 @@ void UsbCam::init_device(int image_width, int image_height, int framerate)
 //  fmt.fmt.pix.pixelformat = V4L2_PIX_FMT_YUYV;
 //  fmt.fmt.pix.field = V4L2_FIELD_INTERLACED;
 
-  fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-  fmt.fmt.pix.width = image_width;
-  fmt.fmt.pix.height = image_height;
-  fmt.fmt.pix.pixelformat = pixelformat_;
-  fmt.fmt.pix.field = V4L2_FIELD_INTERLACED;
-
-  if (-1 == xioctl(fd_, VIDIOC_S_FMT, &fmt))
-    errno_exit("VIDIOC_S_FMT");
-
-  /* Note VIDIOC_S_FMT may change width and height. */
-
-  /* Buggy driver paranoia. */
-  min = fmt.fmt.pix.width * 2;
-  if (fmt.fmt.pix.bytesperline < min)
-    fmt.fmt.pix.bytesperline = min;
-  min = fmt.fmt.pix.bytesperline * fmt.fmt.pix.height;
-  if (fmt.fmt.pix.sizeimage < min)
-    fmt.fmt.pix.sizeimage = min;
-
-  image_width = fmt.fmt.pix.width;
-  image_height = fmt.fmt.pix.height;
-
-  struct v4l2_streamparm stream_params;
-  memset(&stream_params, 0, sizeof(stream_params));
-  stream_params.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-  if (xioctl(fd_, VIDIOC_G_PARM, &stream_params) < 0)
-    errno_exit("Couldn't query v4l fps!");
-
-  ROS_DEBUG("Capability flag: 0x%x", stream_params.parm.capture.capability);
-
-  stream_params.parm.capture.timeperframe.numerator = 1;
-  stream_params.parm.capture.timeperframe.denominator = framerate;
-  if (xioctl(fd_, VIDIOC_S_PARM, &stream_params) < 0)
-    ROS_WARN("Couldn't set camera framerate");
-  else
-    ROS_DEBUG("Set framerate to be %i", framerate);
-
-  switch (io_)
-  {
-    case IO_METHOD_READ:
-      init_read(fmt.fmt.pix.sizeimage);
-      break;
+  fmt->type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  fmt->fmt.pix.width = image_width;
+  fmt->fmt.pix.height = image_height;
+  fmt->fmt.pix.pixelformat = pixelformat_;
+  fmt->fmt.pix.field = V4L2_FIELD_INTERLACED;
 
-    case IO_METHOD_MMAP:
-      init_mmap();
-      break;
-
-    case IO_METHOD_USERPTR:
-      init_userp(fmt.fmt.pix.sizeimage);
-      break;
-  }
+  if (-1 == xioctl(fd_, VIDIOC_S_FMT, fmt))
+    return errno_error("VIDIOC_S_FMT");
+  return true;
 }
 
 void UsbCam::close_device(void)
 {
   if (-1 == close(fd_))
-    errno_exit("close");
+    errno_error("close");
 
   fd_ = -1;
+  controls_.clear();
 }
 
-void UsbCam::open_device(void)
+bool UsbCam::open_device(void)
 {
   struct stat st;
 
   if (-1 == stat(camera_dev_.c_str(), &st))
   {
     ROS_ERROR_STREAM("Cannot identify '" << camera_dev_ << "': " << errno << ", " << strerror(errno));
-    exit(EXIT_FAILURE);
+    return false;
   }
 
   if (!S_ISCHR(st.st_mode))
   {
     ROS_ERROR_STREAM(camera_dev_ << " is no device");
-    exit(EXIT_FAILURE);
+    return false;
   }
 
   fd_ = open(camera_dev_.c_str(), O_RDWR /* required */| O_NONBLOCK, 0);
@@ -1016,15 +716,21 @@ void UsbCam::open_device(void)
   if (-1 == fd_)
   {
     ROS_ERROR_STREAM("Cannot open '" << camera_dev_ << "': " << errno << ", " << strerror(errno));
-    exit(EXIT_FAILURE);
+    return false;
   }
+  // the ranges and values of the controls are read once per device
+  controls_.query(fd_);
+  return true;
 }
 
-void UsbCam::start(const std::string& dev, io_method io_method,
+bool UsbCam::start(const std::string& dev, io_method io_method,
 		   pixel_format pixel_format, int image_width, int image_height,
 		   int framerate)
 {
   camera_dev_ = dev;
+  image_width_ = image_width;
+  image_height_ = image_height;
+  framerate_ = framerate;
 
   io_ = io_method;
   monochrome_ = false;
@@ -1033,10 +739,7 @@ void UsbCam::start(const std::string& dev, io_method io_method,
   else if (pixel_format == PIXEL_FORMAT_UYVY)
     pixelformat_ = V4L2_PIX_FMT_UYVY;
   else if (pixel_format == PIXEL_FORMAT_MJPEG)
-  {
     pixelformat_ = V4L2_PIX_FMT_MJPEG;
-    init_mjpeg_decoder(image_width, image_height);
-  }
   else if (pixel_format == PIXEL_FORMAT_YUVMONO10)
   {
     //actually format V4L2_PIX_FMT_Y16 (10-bit mono expresed as 16-bit pixels), but we need to use the advertised type (yuyv)
@@ -1055,12 +758,18 @@ void UsbCam::start(const std::string& dev, io_method io_method,
   else
   {
     ROS_ERROR("Unknown pixel format.");
-    exit(EXIT_FAILURE);
+    return false;
   }
 
-  open_device();
-  init_device(image_width, image_height, framerate);
-  start_capturing();
+  // no exit() on errors, it would also stop the other nodelets of the manager
+  if (!init_decoder(&decoder_))
+    return false;
+
+  if (!open_device() || !init_device(image_width, image_height, framerate) || !start_capturing())
+  {
+    shutdown();
+    return false;
+  }
 
   image_ = (camera_image_t *)calloc(1, sizeof(camera_image_t));
 
@@ -1072,35 +781,27 @@ void UsbCam::start(const std::string& dev, io_method io_method,
   image_->is_new = 0;
   image_->image = (char *)calloc(image_->image_size, sizeof(char));
   memset(image_->image, 0, image_->image_size * sizeof(char));
+  return true;
 }
 
 void UsbCam::shutdown(void)
 {
   stop_capturing();
   uninit_device();
-  close_device();
+  if (fd_ != -1)
+    close_device();
 
-  if (avcodec_context_)
-  {
-    avcodec_close(avcodec_context_);
-    av_free(avcodec_context_);
-    avcodec_context_ = NULL;
-  }
-  if (avframe_camera_)
-    av_free(avframe_camera_);
-  avframe_camera_ = NULL;
-  if (avframe_rgb_)
-    av_free(avframe_rgb_);
-  avframe_rgb_ = NULL;
+  decoder_.release();
   if(image_)
     free(image_);
   image_ = NULL;
 }
 
-void UsbCam::grab_image(sensor_msgs::Image* msg)
+bool UsbCam::grab_image(sensor_msgs::Image* msg)
 {
   // grab the image
-  grab_image(false);
+  if (!grab_frame())
+    return false;
   // stamp the image
   msg->header.stamp = ros::Time::now();
   // fill the info
@@ -1114,17 +815,12 @@ void UsbCam::grab_image(sensor_msgs::Image* msg)
     fillImage(*msg, "rgb8", image_->height, image_->width, 3 * image_->width,
         image_->image);
   }
+  return true;
 }
 
-void UsbCam::grab_image(sensor_msgs::CompressedImage* msg)
+bool UsbCam::grab_image(sensor_msgs::CompressedImage* msg)
 {
-  // grab the image
-  grab_image(true);
-
-  // stamp the image
-  msg->header.stamp = ros::Time::now();
-
-  // fill the info
+  // fill the info, MJPEG frames are completed into JPEG images by the copy
   if (pixelformat_ == V4L2_PIX_FMT_YUYV)
     {
       if (monochrome_)
@@ -1145,124 +841,159 @@ void UsbCam::grab_image(sensor_msgs::CompressedImage* msg)
     else if (pixelformat_ == V4L2_PIX_FMT_GREY)
     	msg->format = "grey";
 
-  msg->data.resize(image_->image_size);
-  memcpy(&(msg->data[0]), image_->image, image_->image_size);
+  // grab the image straight from the driver buffer into the message
+  if (!grab_frame(msg))
+    return false;
+
+  // stamp the image
+  msg->header.stamp = ros::Time::now();
+  return true;
 }
 
-void UsbCam::grab_image(bool raw_bytes)
+bool UsbCam::grab_frame(sensor_msgs::CompressedImage* compressed)
 {
   fd_set fds;
   struct timeval tv;
   int r;
 
-  FD_ZERO(&fds);
-  FD_SET(fd_, &fds);
+  if (fd_ == -1)
+    return false;
 
-  /* Timeout. */
-  tv.tv_sec = 5;
-  tv.tv_usec = 0;
+  // an interrupted wait or a buffer not dequeued yet is no failure of the camera:
+  // wait again for the rest of the timeout, and only report a stall or a driver error
+  const ros::WallTime deadline = ros::WallTime::now() + ros::WallDuration(timeout_);
+  while (true)
+  {
+    const double remaining = (deadline - ros::WallTime::now()).toSec();
+    if (remaining <= 0.0)
+    {
+      ROS_ERROR("select timeout");
+      return false;
+    }
 
-  r = select(fd_ + 1, &fds, NULL, NULL, &tv);
+    FD_ZERO(&fds);
+    FD_SET(fd_, &fds);
 
-  if (-1 == r)
-  {
-    if (EINTR == errno)
-      return;
+    /* Timeout. */
+    tv.tv_sec = (long)remaining;
+    tv.tv_usec = (long)((remaining - tv.tv_sec) * 1e6);
 
-    errno_exit("select");
-  }
+    r = select(fd_ + 1, &fds, NULL, NULL, &tv);
 
-  if (0 == r)
-  {
-    ROS_ERROR("select timeout");
-    exit(EXIT_FAILURE);
-  }
+    if (-1 == r)
+    {
+      if (EINTR == errno)
+        continue;
+
+      return errno_error("select");
+    }
 
-  read_frame(raw_bytes);
+    if (0 == r)
+    {
+      ROS_ERROR("select timeout");
+      return false;
+    }
+
+    r = read_frame(compressed);
+    if (r < 0)
+      return false;
+    if (r > 0)
+      break;
+    // no frame yet (EAGAIN)
+  }
   image_->is_new = 1;
+  return true;
 }
 
-// enables/disables auto focus
-void UsbCam::set_auto_focus(int value)
+bool UsbCam::init_decoder(FrameDecoder* decoder, int scale_denom) const
+{
+  return decoder->init(pixelformat_, monochrome_, image_width_, image_height_, mjpeg_decoder_, scale_denom, lazy_init_);
+}
+
+void UsbCam::set_mjpeg_decoder(const std::string& name)
+{
+  mjpeg_decoder_ = name;
+}
+
+void UsbCam::set_lazy_init(bool lazy_init)
+{
+  lazy_init_ = lazy_init;
+}
+
+void UsbCam::set_timeout(double timeout)
+{
+  timeout_ = timeout;
+}
+
+bool UsbCam::restart_capturing(void)
 {
-  struct v4l2_queryctrl queryctrl;
-  struct v4l2_ext_control control;
+  ROS_WARN_STREAM("Restarting the stream of " << camera_dev_);
+  // the stream is marked as stopped even if STREAMOFF fails
+  stop_capturing();
+  return start_capturing();
+}
 
-  memset(&queryctrl, 0, sizeof(queryctrl));
-  queryctrl.id = V4L2_CID_FOCUS_AUTO;
+bool UsbCam::reopen_device(void)
+{
+  ROS_WARN_STREAM("Reopening " << camera_dev_);
+  stop_capturing();
+  uninit_device();
+  if (fd_ != -1)
+    close_device();
 
-  if (-1 == xioctl(fd_, VIDIOC_QUERYCTRL, &queryctrl))
+  if (!open_device())
+    return false;
+  if (!init_device(image_width_, image_height_, framerate_) || !start_capturing())
   {
-    if (errno != EINVAL)
-    {
-      perror("VIDIOC_QUERYCTRL");
-      return;
-    }
-    else
-    {
-      ROS_INFO("V4L2_CID_FOCUS_AUTO is not supported");
-      return;
-    }
+    uninit_device();
+    close_device();
+    return false;
   }
-  else if (queryctrl.flags & V4L2_CTRL_FLAG_DISABLED)
+  return true;
+}
+
+// enables/disables auto focus
+void UsbCam::set_auto_focus(int value)
+{
+  if (!controls_.set("focus_auto", value))
   {
     ROS_INFO("V4L2_CID_FOCUS_AUTO is not supported");
     return;
   }
-  else
-  {
-    memset(&control, 0, sizeof(control));
-    control.id = V4L2_CID_FOCUS_AUTO;
-    control.value = value;
-
-    if (-1 == xioctl(fd_, VIDIOC_S_CTRL, &control))
-    {
-      perror("VIDIOC_S_CTRL");
-      return;
-    }
-  }
+  controls_.apply();
 }
 
 /**
-* Set video device parameter via call to v4l-utils.
+* Set video device parameter, named as by v4l-utils.
 *
 * @param param The name of the parameter to set
 * @param param The value to assign
 */
 void UsbCam::set_v4l_parameter(const std::string& param, int value)
 {
-  set_v4l_parameter(param, boost::lexical_cast<std::string>(value));
+  if (!controls_.set(param, value))
+  {
+    ROS_WARN("%s has no writable control '%s'", camera_dev_.c_str(), param.c_str());
+    return;
+  }
+  controls_.apply();
 }
 /**
-* Set video device parameter via call to v4l-utils.
+* Set video device parameter, named as by v4l-utils.
 *
 * @param param The name of the parameter to set
 * @param param The value to assign
 */
 void UsbCam::set_v4l_parameter(const std::string& param, const std::string& value)
 {
-  // build the command
-  std::stringstream ss;
-  ss << "v4l2-ctl --device=" << camera_dev_ << " -c " << param << "=" << value << " 2>&1";
-  std::string cmd = ss.str();
-
-  // capture the output
-  std::string output;
-  int buffer_size = 256;
-  char buffer[buffer_size];
-  FILE *stream = popen(cmd.c_str(), "r");
-  if (stream)
+  try
   {
-    while (!feof(stream))
-      if (fgets(buffer, buffer_size, stream) != NULL)
-        output.append(buffer);
-    pclose(stream);
-    // any output should be an error
-    if (output.length() > 0)
-      ROS_WARN("%s", output.c_str());
+    set_v4l_parameter(param, boost::lexical_cast<int>(value));
+  }
+  catch (const boost::bad_lexical_cast&)
+  {
+    ROS_WARN("Invalid value '%s' for %s", value.c_str(), param.c_str());
   }
-  else
-    ROS_WARN("usb_cam_node could not run '%s'", cmd.c_str());
 }
 
 UsbCam::io_method UsbCam::io_method_from_string(const std::string& str)
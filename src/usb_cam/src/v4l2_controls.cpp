@@ -0,0 +1,259 @@
+/*********************************************************************
+ *
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2014, Robert Bosch LLC.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Robert Bosch nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ *********************************************************************/
+#include <errno.h>
+#include <ctype.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <algorithm>
+#include <asm/types.h>          /* for videodev2.h */
+#include <linux/videodev2.h>
+
+#include <ros/ros.h>
+
+#include <usb_cam/v4l2_controls.h>
+
+namespace usb_cam {
+
+static int xioctl(int fd, int request, void * arg)
+{
+  int r;
+
+  do
+    r = ioctl(fd, request, arg);
+  while (-1 == r && EINTR == errno);
+
+  return r;
+}
+
+// same naming as v4l2-ctl: "White Balance Temperature, Auto" becomes "white_balance_temperature_auto"
+static std::string control_name(const char* description)
+{
+  std::string name;
+  for (const char* c = description; *c; c++)
+  {
+    if (isalnum(*c))
+      name += tolower(*c);
+    else if (!name.empty() && name[name.size() - 1] != '_')
+      name += '_';
+  }
+  if (!name.empty() && name[name.size() - 1] == '_')
+    name.erase(name.size() - 1);
+  return name;
+}
+
+V4l2Controls::V4l2Controls()
+  : fd_(-1) {
+}
+
+bool V4l2Controls::query(int fd)
+{
+  clear();
+  fd_ = fd;
+
+  struct v4l2_queryctrl queryctrl;
+  memset(&queryctrl, 0, sizeof(queryctrl));
+  queryctrl.id = V4L2_CTRL_FLAG_NEXT_CTRL;
+  std::vector<struct v4l2_queryctrl> found;
+  while (0 == xioctl(fd_, VIDIOC_QUERYCTRL, &queryctrl))
+  {
+    found.push_back(queryctrl);
+    queryctrl.id |= V4L2_CTRL_FLAG_NEXT_CTRL;
+  }
+  if (found.empty())
+  {
+    // drivers without V4L2_CTRL_FLAG_NEXT_CTRL: probe the user and private ranges
+    for (uint32_t id = V4L2_CID_BASE; id < V4L2_CID_LASTP1; id++)
+    {
+      queryctrl.id = id;
+      if (0 == xioctl(fd_, VIDIOC_QUERYCTRL, &queryctrl))
+        found.push_back(queryctrl);
+    }
+    for (queryctrl.id = V4L2_CID_PRIVATE_BASE; 0 == xioctl(fd_, VIDIOC_QUERYCTRL, &queryctrl); queryctrl.id++)
+      found.push_back(queryctrl);
+  }
+
+  for (size_t i = 0; i < found.size(); i++)
+  {
+    const struct v4l2_queryctrl& q = found[i];
+    // only the controls with a 32-bit value are handled (no classes, buttons, 64-bit or string controls)
+    if ((q.flags & V4L2_CTRL_FLAG_DISABLED) ||
+        (q.type != V4L2_CTRL_TYPE_INTEGER && q.type != V4L2_CTRL_TYPE_BOOLEAN && q.type != V4L2_CTRL_TYPE_MENU))
+      continue;
+
+    Control control;
+    control.id = q.id;
+    control.name = control_name((const char*)q.name);
+    control.type = q.type;
+    control.minimum = q.minimum;
+    control.maximum = q.maximum;
+    control.step = q.step;
+    control.default_value = q.default_value;
+    control.value = q.default_value;
+    control.written = false;
+    control.read_only = q.flags & V4L2_CTRL_FLAG_READ_ONLY;
+
+    struct v4l2_control current;
+    current.id = q.id;
+    if (0 == xioctl(fd_, VIDIOC_G_CTRL, &current))
+      control.value = current.value;
+
+    by_name_[control.name] = controls_.size();
+    controls_.push_back(control);
+  }
+
+  ROS_DEBUG("%d controls found", (int)controls_.size());
+  return !controls_.empty();
+}
+
+void V4l2Controls::clear()
+{
+  fd_ = -1;
+  controls_.clear();
+  by_name_.clear();
+  pending_.clear();
+  pending_values_.clear();
+}
+
+const V4l2Controls::Control* V4l2Controls::find(const std::string& name) const
+{
+  std::map<std::string, size_t>::const_iterator it = by_name_.find(name);
+  if (it == by_name_.end())
+    return NULL;
+  return &controls_[it->second];
+}
+
+bool V4l2Controls::set(const std::string& name, int32_t value)
+{
+  std::map<std::string, size_t>::const_iterator it = by_name_.find(name);
+  if (it == by_name_.end() || controls_[it->second].read_only)
+    return false;
+  const Control& control = controls_[it->second];
+
+  if (value < control.minimum || value > control.maximum)
+  {
+    ROS_WARN("Value %d of %s out of range [%d, %d]", value, name.c_str(), control.minimum, control.maximum);
+    value = std::max(control.minimum, std::min(control.maximum, value));
+  }
+
+  // a value staged twice is written once, with the last value but at its first position
+  for (size_t i = 0; i < pending_.size(); i++)
+  {
+    if (pending_[i] == it->second)
+    {
+      pending_values_[i] = value;
+      return true;
+    }
+  }
+  pending_.push_back(it->second);
+  pending_values_.push_back(value);
+  return true;
+}
+
+bool V4l2Controls::apply()
+{
+  // unchanged values are skipped
+  std::vector<size_t> changed;
+  for (size_t i = 0; i < pending_.size(); i++)
+  {
+    Control& control = controls_[pending_[i]];
+    if (control.written && control.value == pending_values_[i])
+      continue;
+    control.value = pending_values_[i];
+    changed.push_back(pending_[i]);
+  }
+  pending_.clear();
+  pending_values_.clear();
+
+  // consecutive controls of the same class are written together, e.g. exposure_auto before exposure_absolute
+  bool ok = true;
+  size_t begin = 0;
+  while (begin < changed.size())
+  {
+    size_t end = begin + 1;
+    while (end < changed.size() &&
+           V4L2_CTRL_ID2CLASS(controls_[changed[end]].id) == V4L2_CTRL_ID2CLASS(controls_[changed[begin]].id))
+      end++;
+    ok = write(std::vector<size_t>(changed.begin() + begin, changed.begin() + end)) && ok;
+    begin = end;
+  }
+  return ok;
+}
+
+bool V4l2Controls::write(const std::vector<size_t>& indices)
+{
+  std::vector<struct v4l2_ext_control> ext(indices.size());
+  for (size_t i = 0; i < indices.size(); i++)
+  {
+    memset(&ext[i], 0, sizeof(ext[i]));
+    ext[i].id = controls_[indices[i]].id;
+    ext[i].value = controls_[indices[i]].value;
+  }
+
+  struct v4l2_ext_controls ctrls;
+  memset(&ctrls, 0, sizeof(ctrls));
+  ctrls.ctrl_class = V4L2_CTRL_ID2CLASS(ext[0].id);
+  ctrls.count = ext.size();
+  ctrls.controls = &ext[0];
+  if (0 == xioctl(fd_, VIDIOC_S_EXT_CTRLS, &ctrls))
+  {
+    for (size_t i = 0; i < indices.size(); i++)
+      controls_[indices[i]].written = true;
+    return true;
+  }
+
+  // the batch is rejected as a whole: write the controls one by one to apply the others and find the culprit
+  bool ok = true;
+  for (size_t i = 0; i < indices.size(); i++)
+  {
+    Control& control = controls_[indices[i]];
+    struct v4l2_control single;
+    single.id = control.id;
+    single.value = control.value;
+    if (0 == xioctl(fd_, VIDIOC_S_CTRL, &single))
+    {
+      control.written = true;
+    }
+    else
+    {
+      ROS_WARN("Could not set %s to %d: %s", control.name.c_str(), control.value, strerror(errno));
+      control.written = false;
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+}